@@ -232,5 +232,10 @@ void setup() {
 }
 
 void loop() {
-    
+#ifndef WIO_LITE_AI
+    // erase the sectors freed by deleteFile()/removeDir() once the card has been idle;
+    // an application that records would call DEV.pauseTrim(true) while writing
+    DEV.trimStep();
+#endif
+    delay(100);
 }
\ No newline at end of file
@@ -107,5 +107,31 @@ namespace fs
         return size;
     }
 
+    bool SDFS::waitStats(sdcard_wait_stats_t *stats, bool reset)
+    {
+        if (_pdrv == 0xFF)
+        {
+            return false;
+        }
+        return sdcard_wait_stats(_pdrv, stats, reset);
+    }
+
+    uint32_t SDFS::trimStep(uint32_t maxSectors, uint32_t minIdleMs)
+    {
+        if (_pdrv == 0xFF)
+        {
+            return 0;
+        }
+        return sdcard_trim_step(_pdrv, maxSectors, minIdleMs);
+    }
+
+    void SDFS::pauseTrim(bool paused)
+    {
+        if (_pdrv != 0xFF)
+        {
+            sdcard_trim_pause(_pdrv, paused);
+        }
+    }
+
     SDFS SD;
 };
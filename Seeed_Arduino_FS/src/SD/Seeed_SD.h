@@ -42,6 +42,14 @@ namespace fs {
         uint64_t cardSize();
         uint64_t totalBytes();
         uint64_t usedBytes();
+
+        // busy-wait accounting, see sdcard_wait_stats_t
+        bool waitStats(sdcard_wait_stats_t* stats, bool reset = false);
+
+        // erase sectors freed by remove() once the card has been idle;
+        // call from loop(), and pause while recording
+        uint32_t trimStep(uint32_t maxSectors = 8192, uint32_t minIdleMs = 3000);
+        void pauseTrim(bool paused);
     };
 
     extern SDFS SD;
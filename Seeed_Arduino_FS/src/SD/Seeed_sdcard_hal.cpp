@@ -22,6 +22,9 @@ typedef enum
     SET_WR_BLK_ERASE_COUNT = 23,
     WRITE_BLOCK_SINGLE = 24,
     WRITE_BLOCK_MULTIPLE = 25,
+    ERASE_WR_BLK_START = 32,
+    ERASE_WR_BLK_END = 33,
+    ERASE = 38,
     APP_OP_COND = 41,
     APP_CLR_CARD_DETECT = 42,
     APP_CMD = 55,
@@ -63,16 +66,65 @@ namespace
     SD SPI
  * */
 
-bool sdWait(uint8_t pdrv, int timeout)
+/*
+    Adaptive polling. Waits that usually end quickly (data token) are spun,
+    long ones (write busy, erase) back off with delay() so the camera and
+    audio tasks on the same core are not starved. The spin budget follows
+    a running average of recent wait lengths.
+ * */
+#define SD_SPIN_MIN_US 50
+#define SD_SPIN_MAX_US 1000
+#define SD_BACKOFF_MAX_MS 4
+
+static char sdPollWhile(uint8_t pdrv, char busy, int timeout)
 {
+    ardu_sdcard_t *card = s_cards[pdrv];
+    sdcard_wait_stats_t *stats = &card->wait_stats;
+    uint32_t start = micros();
+    uint32_t slept = 0;
+    uint32_t elapsed;
+    uint32_t backoff = 1;
     char resp;
-    uint32_t start = millis();
 
-    do
+    while (true)
     {
-        resp = s_cards[pdrv]->spi->transfer(0xFF);
-    } while (resp == 0x00 && (millis() - start) < (unsigned int)timeout);
+        resp = card->spi->transfer(0xFF);
+        elapsed = micros() - start;
+        if (resp != busy || elapsed >= (uint32_t)timeout * 1000)
+        {
+            break;
+        }
+        if (elapsed < card->spin_us)
+        {
+            continue;
+        }
+        uint32_t t0 = micros();
+        delay(backoff);
+        slept += micros() - t0;
+        stats->yields++;
+        if (backoff < SD_BACKOFF_MAX_MS)
+        {
+            backoff <<= 1;
+        }
+    }
+
+    stats->waits++;
+    stats->wait_us += elapsed;
+    stats->spin_us += elapsed - slept;
+    if (elapsed > stats->max_wait_us)
+    {
+        stats->max_wait_us = elapsed;
+    }
+
+    // spin for about twice the typical wait
+    card->avg_wait_us = card->avg_wait_us - card->avg_wait_us / 8 + elapsed / 8;
+    card->spin_us = constrain(card->avg_wait_us * 2, SD_SPIN_MIN_US, SD_SPIN_MAX_US);
+    return resp;
+}
 
+bool sdWait(uint8_t pdrv, int timeout)
+{
+    char resp = sdPollWhile(pdrv, 0x00, timeout);
     return (resp > 0x00);
 }
 
@@ -102,12 +154,7 @@ bool sdReadBytes(uint8_t pdrv, char *buffer, int length)
     ardu_sdcard_t *card = s_cards[pdrv];
     char *p = buffer;
 
-    uint32_t start = millis();
-    do
-    {
-        token = card->spi->transfer(0xFF);
-    } while (token == 0xFF && (millis() - start) < 500);
-
+    token = sdPollWhile(pdrv, 0xFF, 500);
     if (token != 0xFE)
     {
         return false;
@@ -445,6 +492,124 @@ bool sdWriteSectors(uint8_t pdrv, const char *buffer, unsigned long long sector,
     return false;
 }
 
+/*
+    Erase one run of sectors (CMD32/33/38). Freed clusters are erased so the
+    card does not have to copy stale data around when they are rewritten.
+ * */
+#define SD_ERASE_CHUNK_SECTORS 8192
+
+bool sdEraseSectors(uint8_t pdrv, unsigned long start, unsigned long end)
+{
+    ardu_sdcard_t *card = s_cards[pdrv];
+    unsigned int mult = (card->type == CARD_SDHC) ? 1 : 512;
+
+    if (card->type == CARD_MMC)
+    {
+        return false;
+    }
+    if (sdTransaction(pdrv, ERASE_WR_BLK_START, start * mult, NULL))
+    {
+        return false;
+    }
+    if (sdTransaction(pdrv, ERASE_WR_BLK_END, end * mult, NULL))
+    {
+        return false;
+    }
+    if (!sdSelectCard(pdrv))
+    {
+        return false;
+    }
+    if (sdCommand(pdrv, ERASE, 0, NULL))
+    {
+        sdDeselectCard(pdrv);
+        return false;
+    }
+    // card holds MISO low while erasing, up to 250ms per allocation unit
+    bool done = sdWait(pdrv, 2000);
+    sdDeselectCard(pdrv);
+    return done;
+}
+
+/*
+    Freed sector queue. f_unlink only records the runs here; erasing them
+    inline would hold the bus for seconds while a recording is writing.
+    The queue is only touched with the SPI transaction held.
+ * */
+static void sdTrimRemoveAt(ardu_sdcard_t *card, uint8_t i)
+{
+    card->trim[i] = card->trim[--card->trim_count];
+}
+
+static void sdTrimEnqueue(ardu_sdcard_t *card, uint32_t start, uint32_t end)
+{
+    uint8_t i = 0;
+    while (i < card->trim_count)
+    {
+        sdcard_trim_range_t *r = &card->trim[i];
+        if (start <= r->end + 1 && r->start <= end + 1)
+        {
+            start = min(start, r->start);
+            end = max(end, r->end);
+            sdTrimRemoveAt(card, i);
+            continue;
+        }
+        i++;
+    }
+    if (card->trim_count == SD_TRIM_QUEUE_LEN)
+    {
+        // not erasing only costs write speed later
+        card->trim_dropped += end - start + 1;
+        return;
+    }
+    card->trim[card->trim_count].start = start;
+    card->trim[card->trim_count].end = end;
+    card->trim_count++;
+}
+
+// a freed cluster may be reallocated before it is erased
+static void sdTrimCancel(ardu_sdcard_t *card, uint32_t start, uint32_t end)
+{
+    uint8_t i = 0;
+    while (i < card->trim_count)
+    {
+        sdcard_trim_range_t *r = &card->trim[i];
+        if (end < r->start || start > r->end)
+        {
+            i++;
+        }
+        else if (start <= r->start && end >= r->end)
+        {
+            sdTrimRemoveAt(card, i);
+        }
+        else if (start <= r->start)
+        {
+            r->start = end + 1;
+            i++;
+        }
+        else if (end >= r->end)
+        {
+            r->end = start - 1;
+            i++;
+        }
+        else
+        {
+            uint32_t tail_end = r->end;
+            r->end = start - 1;
+            if (card->trim_count < SD_TRIM_QUEUE_LEN)
+            {
+                card->trim[card->trim_count].start = end + 1;
+                card->trim[card->trim_count].end = tail_end;
+                card->trim_count++;
+            }
+            else
+            {
+                card->trim_dropped += tail_end - end;
+            }
+            i++;
+        }
+    }
+}
+
 unsigned long sdGetSectorsCount(uint8_t pdrv)
 {
     for (int f = 0; f < 3; f++)
@@ -644,6 +809,7 @@ DRESULT sd_disk_read(uint8_t pdrv, uint8_t *buffer, DWORD sector, UINT count)
     DRESULT res = RES_OK;
 
     AcquireSPI lock(card);
+    card->last_io_ms = millis();
 
     if (count > 1)
     {
@@ -671,6 +837,8 @@ DRESULT sd_disk_write(uint8_t pdrv, const uint8_t *buffer, DWORD sector, UINT co
     DRESULT res = RES_OK;
 
     AcquireSPI lock(card);
+    card->last_io_ms = millis();
+    sdTrimCancel(card, sector, sector + count - 1);
 
     if (count > 1)
     {
@@ -706,6 +874,22 @@ DRESULT sd_disk_ioctl(uint8_t pdrv, uint8_t cmd, void *buff)
     case GET_BLOCK_SIZE:
         *((uint32_t *)buff) = 1;
         return RES_OK;
+#if _USE_TRIM
+    case CTRL_TRIM:
+    {
+        // only queued here, sdcard_trim_step erases when the card is idle
+        DWORD start = ((DWORD *)buff)[0];
+        DWORD end = ((DWORD *)buff)[1];
+        ardu_sdcard_t *card = s_cards[pdrv];
+        if (end < start || end >= card->sectors)
+        {
+            return RES_PARERR;
+        }
+        AcquireSPI lock(card);
+        sdTrimEnqueue(card, start, end);
+    }
+        return RES_OK;
+#endif
     }
     return RES_PARERR;
 }
@@ -750,6 +934,13 @@ uint8_t sdcard_init(uint8_t cs, SPIClass *spi, int hz)
     card->supports_crc = true;
     card->type = CARD_NONE;
     card->status = STA_NOINIT;
+    card->avg_wait_us = 0;
+    card->spin_us = SD_SPIN_MAX_US / 4;
+    memset(&card->wait_stats, 0, sizeof(card->wait_stats));
+    card->trim_count = 0;
+    card->trim_paused = false;
+    card->last_io_ms = 0;
+    card->trim_dropped = 0;
 
     pinMode(card->ssPin, OUTPUT);
     digitalWrite(card->ssPin, HIGH);
@@ -830,4 +1021,93 @@ sdcard_type_t sdcard_type(uint8_t pdrv)
         return CARD_NONE;
     }
     return card->type;
-}
\ No newline at end of file
+}
+
+bool sdcard_wait_stats(uint8_t pdrv, sdcard_wait_stats_t *stats, bool reset)
+{
+    if (pdrv >= _VOLUMES)
+    {
+        return false;
+    }
+    ardu_sdcard_t *card = s_cards[pdrv];
+    if (card == NULL)
+    {
+        return false;
+    }
+    if (stats)
+    {
+        *stats = card->wait_stats;
+    }
+    if (reset)
+    {
+        memset(&card->wait_stats, 0, sizeof(card->wait_stats));
+    }
+    return true;
+}
+
+uint32_t sdcard_trim_step(uint8_t pdrv, uint32_t max_sectors, uint32_t min_idle_ms)
+{
+    if (pdrv >= _VOLUMES)
+    {
+        return 0;
+    }
+    ardu_sdcard_t *card = s_cards[pdrv];
+    if (card == NULL || (card->status & STA_NOINIT))
+    {
+        return 0;
+    }
+
+    uint32_t erased = 0;
+    while (erased < max_sectors)
+    {
+        // one chunk per transaction, the bus is released between chunks
+        AcquireSPI lock(card);
+        if (card->trim_paused || card->trim_count == 0 || millis() - card->last_io_ms < min_idle_ms)
+        {
+            break;
+        }
+        sdcard_trim_range_t *r = &card->trim[0];
+        uint32_t n = r->end - r->start + 1;
+        n = min(n, min(max_sectors - erased, (uint32_t)SD_ERASE_CHUNK_SECTORS));
+        uint32_t start = r->start;
+        if (start + n - 1 == r->end)
+        {
+            sdTrimRemoveAt(card, 0);
+        }
+        else
+        {
+            r->start += n;
+        }
+        if (!sdEraseSectors(pdrv, start, start + n - 1))
+        {
+            card->trim_dropped += n;
+            break;
+        }
+        erased += n;
+    }
+    return erased;
+}
+
+void sdcard_trim_pause(uint8_t pdrv, bool paused)
+{
+    if (pdrv < _VOLUMES && s_cards[pdrv] != NULL)
+    {
+        s_cards[pdrv]->trim_paused = paused;
+    }
+}
+
+uint32_t sdcard_trim_pending(uint8_t pdrv)
+{
+    if (pdrv >= _VOLUMES || s_cards[pdrv] == NULL)
+    {
+        return 0;
+    }
+    ardu_sdcard_t *card = s_cards[pdrv];
+    AcquireSPI lock(card);
+    uint32_t pending = 0;
+    for (uint8_t i = 0; i < card->trim_count; i++)
+    {
+        pending += card->trim[i].end - card->trim[i].start + 1;
+    }
+    return pending;
+}
@@ -14,6 +14,25 @@ typedef enum {
     CARD_UNKNOWN
 } sdcard_type_t;
 
+// Accounting for busy/data-token waits. spin_us is CPU time spent polling
+// the bus; wait_us - spin_us is time given back to other tasks.
+typedef struct {
+    uint32_t waits;
+    uint32_t yields;
+    uint32_t max_wait_us;
+    uint64_t wait_us;
+    uint64_t spin_us;
+} sdcard_wait_stats_t;
+
+// Freed sector runs reported by FatFs (CTRL_TRIM) wait here until the card
+// has been idle for a while; see sdcard_trim_step.
+#define SD_TRIM_QUEUE_LEN 16
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;       // inclusive
+} sdcard_trim_range_t;
+
 typedef struct {
     uint8_t ssPin;
     SPIClass* spi;
@@ -22,6 +41,14 @@ typedef struct {
     unsigned long sectors;
     bool supports_crc;
     int status;
+    uint32_t avg_wait_us;
+    uint32_t spin_us;
+    sdcard_wait_stats_t wait_stats;
+    sdcard_trim_range_t trim[SD_TRIM_QUEUE_LEN];
+    uint8_t trim_count;
+    bool trim_paused;
+    unsigned long last_io_ms;
+    uint32_t trim_dropped;
 } ardu_sdcard_t;
 
 uint8_t sdcard_init(uint8_t cs, SPIClass* spi, int hz);
@@ -33,5 +60,14 @@ uint8_t sdcard_unmount(uint8_t pdrv);
 sdcard_type_t sdcard_type(uint8_t pdrv);
 uint32_t sdcard_num_sectors(uint8_t pdrv);
 uint32_t sdcard_sector_size(uint8_t pdrv);
+bool sdcard_wait_stats(uint8_t pdrv, sdcard_wait_stats_t* stats, bool reset);
+
+// Erase up to max_sectors of queued freed sectors if the card has been idle
+// for at least min_idle_ms and erasing is not paused. Call it periodically,
+// e.g. from loop(). Returns the number of sectors erased.
+uint32_t sdcard_trim_step(uint8_t pdrv, uint32_t max_sectors, uint32_t min_idle_ms);
+// Pause erasing while recording so erases never compete with writes.
+void sdcard_trim_pause(uint8_t pdrv, bool paused);
+uint32_t sdcard_trim_pending(uint8_t pdrv);
 
 #endif
\ No newline at end of file
@@ -25,6 +25,8 @@ namespace fs
             sprintf((char *)_name, "%s", n);
         }
         _fno = NULL;
+        _ra = NULL;
+        _fastSeekChecked = false;
     }
 
     File::File(DIR d, const char *n)
@@ -37,6 +39,8 @@ namespace fs
             sprintf((char *)_name, "%s", n);
         }
         _fno = NULL;
+        _ra = NULL;
+        _fastSeekChecked = false;
     }
 
     File::File(void)
@@ -46,6 +50,8 @@ namespace fs
         _name[0] = 0;
         // Serial.print("Created empty file object");
         _fno = NULL;
+        _ra = NULL;
+        _fastSeekChecked = false;
     }
 
     File::~File()
@@ -100,6 +106,7 @@ namespace fs
         {
             return false;
         }
+        dropReadAhead();
         ret = f_write(_file, buf, size, &t);
 
         if (FR_OK == ret)
@@ -109,6 +116,90 @@ namespace fs
         return false;
     }
 
+    // lazily allocated on the first buffered read of a readable file
+    FileReadAhead *File::readAhead()
+    {
+        if (!_file || !(_file->flag & FA_READ))
+        {
+            return NULL;
+        }
+        if (!_ra && !setReadAhead(SEEED_FS_READAHEAD_DEFAULT))
+        {
+            return NULL;
+        }
+        return _ra->size ? _ra : NULL;
+    }
+
+    bool File::fillReadAhead()
+    {
+        UINT t;
+        _ra->pos = 0;
+        _ra->len = 0;
+        if (f_read(_file, _ra->buf, _ra->window, &t) != FR_OK || t == 0)
+        {
+            return false;
+        }
+        _ra->len = t;
+        // only reached when the previous window was consumed, i.e. sequential
+        if (_ra->window < _ra->size)
+        {
+            _ra->window = min(_ra->window * 2, _ra->size);
+        }
+        return true;
+    }
+
+    // give unread bytes back to FatFs so that its file pointer is the logical one
+    void File::dropReadAhead()
+    {
+        if (!_ra)
+        {
+            return;
+        }
+        if (_ra->pos < _ra->len)
+        {
+            f_lseek(_file, f_tell(_file) - (_ra->len - _ra->pos));
+        }
+        _ra->pos = 0;
+        _ra->len = 0;
+        _ra->window = min((uint32_t)SEEED_FS_READAHEAD_MIN, _ra->size);
+    }
+
+    bool File::setReadAhead(uint32_t size)
+    {
+        if (!_file)
+        {
+            return false;
+        }
+        if (_ra)
+        {
+            dropReadAhead();
+            free(_ra->buf);
+        }
+        else
+        {
+            _ra = new FileReadAhead();
+            if (!_ra)
+            {
+                return false;
+            }
+        }
+        _ra->buf = NULL;
+        _ra->size = 0;
+        if (size)
+        {
+            _ra->buf = (uint8_t *)malloc(size);
+            if (!_ra->buf)
+            {
+                return false;
+            }
+            _ra->size = size;
+        }
+        _ra->pos = 0;
+        _ra->len = 0;
+        _ra->window = min((uint32_t)SEEED_FS_READAHEAD_MIN, size);
+        return true;
+    }
+
     // return the peek value
     int File::peek()
     {
@@ -117,6 +208,16 @@ namespace fs
             return 0;
         }
 
+        FileReadAhead *ra = readAhead();
+        if (ra)
+        {
+            if (ra->pos == ra->len && !fillReadAhead())
+            {
+                return -1;
+            }
+            return ra->buf[ra->pos];
+        }
+
         int c = read();
         if (c != -1)
         {
@@ -131,6 +232,15 @@ namespace fs
         uint8_t val;
         if (_file)
         {
+            FileReadAhead *ra = readAhead();
+            if (ra)
+            {
+                if (ra->pos == ra->len && !fillReadAhead())
+                {
+                    return -1;
+                }
+                return ra->buf[ra->pos++];
+            }
             return read(&val, 1) == 1 ? val : -1;
         }
         return -1;
@@ -142,24 +252,55 @@ namespace fs
         {
             return NULL;
         }
+        dropReadAhead();
         return f_gets(str, nbyte, _file);
     }
 
     size_t File::read(void *buf, uint32_t nbyte)
     {
         UINT t;
+        size_t done = 0;
         if (!_file)
         {
             return 0;
         }
-        if (f_read(_file, buf, nbyte, &t) == FR_OK)
+
+        // serve what is already buffered, then refill for small reads only;
+        // large reads go straight to FatFs which reads whole sectors in place
+        if (_ra && _ra->pos < _ra->len)
+        {
+            done = min(nbyte, _ra->len - _ra->pos);
+            memcpy(buf, _ra->buf + _ra->pos, done);
+            _ra->pos += done;
+            if (done == nbyte)
+            {
+                return done;
+            }
+        }
+        uint8_t *dst = (uint8_t *)buf + done;
+        uint32_t left = nbyte - done;
+
+        FileReadAhead *ra = readAhead();
+        if (ra && left < ra->size)
+        {
+            if (!fillReadAhead())
+            {
+                return done;
+            }
+            uint32_t n = min(left, ra->len);
+            memcpy(dst, ra->buf, n);
+            ra->pos = n;
+            return done + n;
+        }
+
+        if (f_read(_file, dst, left, &t) == FR_OK)
         {
 
-            return (size_t)t;
+            return done + (size_t)t;
         }
         else
         {
-            return 0;
+            return done;
         }
     }
 
@@ -170,7 +311,8 @@ namespace fs
             return 0;
         }
 
-        return !f_eof(_file);
+        uint32_t left = f_size(_file) - position();
+        return left > INT32_MAX ? INT32_MAX : (int)left;
     }
 
     void File::flush()
@@ -181,14 +323,60 @@ namespace fs
         }
     }
 
-    boolean File::seek(uint32_t pos)
+    // on ESP32 boards with PSRAM the table goes there
+    static void *clmtAlloc(size_t size)
     {
-        if (!_file)
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+        void *p = ps_malloc(size);
+        if (p)
         {
-            return false;
+            return p;
         }
+#endif
+        return malloc(size);
+    }
 
-        return f_lseek(_file, pos);
+    void File::enableFastSeek()
+    {
+#if _USE_FASTSEEK
+        if (_fastSeekChecked)
+        {
+            return;
+        }
+        _fastSeekChecked = true;
+        if (_file->cltbl || (_file->flag & FA_WRITE) || f_size(_file) < SEEED_FS_FASTSEEK_MIN_SIZE)
+        {
+            return;
+        }
+
+        // probe with a tiny table; FatFs reports the required length in tbl[0]
+        DWORD probe[4] = {4};
+        _file->cltbl = probe;
+        FRESULT res = f_lseek(_file, CREATE_LINKMAP);
+        _file->cltbl = NULL;
+        if ((res != FR_OK && res != FR_NOT_ENOUGH_CORE) || probe[0] * sizeof(DWORD) > SEEED_FS_FASTSEEK_MAX_TABLE)
+        {
+            return;
+        }
+
+        DWORD *clmt = (DWORD *)clmtAlloc(probe[0] * sizeof(DWORD));
+        if (!clmt)
+        {
+            return;
+        }
+        clmt[0] = probe[0];
+        _file->cltbl = clmt;
+        if (f_lseek(_file, CREATE_LINKMAP) != FR_OK)
+        {
+            _file->cltbl = NULL;
+            free(clmt);
+        }
+#endif
+    }
+
+    boolean File::seek(uint32_t pos)
+    {
+        return seek(pos, SeekSet);
     }
 
     bool File::seek(uint32_t pos, SeekMode mode)
@@ -197,22 +385,19 @@ namespace fs
         {
             return false;
         }
+        dropReadAhead();
+        enableFastSeek();
         switch (mode)
         {
         case SeekSet:
-            return f_lseek(_file, pos);
-            break;
+            return f_lseek(_file, pos) == FR_OK;
         case SeekCur:
-            f_lseek(_file, f_tell(_file) + pos);
-            break;
+            return f_lseek(_file, f_tell(_file) + pos) == FR_OK;
         case SeekEnd:
-            return f_lseek(_file, f_size(_file) - pos);
-            break;
+            return f_lseek(_file, f_size(_file) - pos) == FR_OK;
         default:
             return false;
-            break;
         }
-        return false;
     }
 
     uint32_t File::position()
@@ -221,16 +406,13 @@ namespace fs
         {
             return -1;
         }
-        return f_tell(_file);
+        // FatFs is ahead of the caller by whatever is still buffered
+        return f_tell(_file) - (_ra ? _ra->len - _ra->pos : 0);
     }
 
     uint32_t File::tell()
     {
-        if (!_file)
-        {
-            return -1;
-        }
-        return f_tell(_file);
+        return position();
     }
 
     uint32_t File::size()
@@ -249,9 +431,18 @@ namespace fs
         if (_file)
         {
             f_close(_file);
+#if _USE_FASTSEEK
+            free(_file->cltbl);
+#endif
             delete _file;
             _file = NULL;
         }
+        if (_ra)
+        {
+            free(_ra->buf);
+            delete _ra;
+            _ra = NULL;
+        }
         if (_fno)
         {
             delete _fno;
@@ -345,6 +536,8 @@ namespace fs
             this->_file = f._file;
             this->_dir = f._dir;
             this->_fno = f._fno;
+            this->_ra = f._ra;
+            this->_fastSeekChecked = f._fastSeekChecked;
             strcpy(this->_name, f._name);
         }
         return *this;
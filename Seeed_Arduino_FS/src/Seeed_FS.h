@@ -34,6 +34,19 @@
 #define FILE_WRITE (FA_CREATE_ALWAYS | FA_WRITE | FA_READ)
 #define FILE_APPEND (FA_OPEN_APPEND | FA_WRITE)
 
+// Read-ahead for byte-wise reads. The window starts small and doubles on
+// every sequential refill up to the buffer size; a seek shrinks it again.
+#define SEEED_FS_READAHEAD_MIN 64
+#ifndef SEEED_FS_READAHEAD_DEFAULT
+#define SEEED_FS_READAHEAD_DEFAULT 512
+#endif
+
+// Fast seek: read-only files at least this large get a cluster link map
+// table on their first seek, so later seeks do not walk the FAT chain.
+#define SEEED_FS_FASTSEEK_MIN_SIZE (1024UL * 1024)
+// largest table built for one file, 8 bytes per contiguous fragment
+#define SEEED_FS_FASTSEEK_MAX_TABLE (16 * 1024)
+
 extern "C"
 {
 #include "./fatfs/diskio.h"
@@ -53,6 +66,15 @@ namespace fs
         SeekEnd = 2
     };
 
+    struct FileReadAhead
+    {
+        uint8_t *buf;
+        uint32_t size;   // buffer size
+        uint32_t window; // bytes fetched by the next refill
+        uint32_t pos;    // next byte to return
+        uint32_t len;    // valid bytes in buf
+    };
+
     class File : public Stream
     {
     private:
@@ -60,6 +82,13 @@ namespace fs
         FIL *_file;               // underlying file pointer
         DIR *_dir;                // if open a dir
         FILINFO *_fno;            // for traverse directory
+        FileReadAhead *_ra;       // read-ahead buffer, shared by copies like _file
+        bool _fastSeekChecked;    // CLMT already built or found not worth it
+
+        FileReadAhead *readAhead();
+        bool fillReadAhead();
+        void dropReadAhead();
+        void enableFastSeek();
 
     public:
         File(FIL f, const char *name); // wraps an underlying SdFile
@@ -73,6 +102,8 @@ namespace fs
         virtual int available();
         virtual void flush();
         size_t read(void *buf, uint32_t nbyte);
+        // size of the read-ahead buffer used by read()/peek(), 0 disables it
+        bool setReadAhead(uint32_t size);
         char *gets(char *str, uint32_t nbyte);
         bool seek(uint32_t pos);
         bool seek(uint32_t pos, SeekMode mode);
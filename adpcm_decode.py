@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+import argparse
+import struct
+import wave
+
+# 把录制的 .adp（IMA-ADPCM，见 main/adpcm.h）解码成 16 位单声道 WAV。
+# 每块 256 字节、505 个样本，块头为第一个样本(int16)、步长索引(uint8)和一个保留字节，
+# 之后每字节两个样本，低 4 位在前。末尾不完整的块丢弃。
+# 输入也可以是原始 PCM（.pcm）。给出 .sil 时按其中的记录在跳过静音的位置补回静音，还原时间轴；
+# 给出 .ats 时按同步点拟合 I2S 的实际采样率和第一个样本的时间，把音频重采样到与视频相同的时间基准上
+
+BLOCK_SIZE = 256
+HEADER_SIZE = 4
+SAMPLES_PER_BLOCK = (BLOCK_SIZE - HEADER_SIZE) * 2 + 1
+
+STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767,
+]
+INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+
+def decode_block(block):
+    predictor, index = struct.unpack_from('<hB', block, 0)
+    if index > 88:
+        raise ValueError(f"bad step index {index}")
+    out = [predictor]
+    for byte in block[HEADER_SIZE:]:
+        for nibble in (byte & 0x0F, byte >> 4):
+            step = STEP_TABLE[index]
+            delta = step >> 3
+            if nibble & 4:
+                delta += step
+            if nibble & 2:
+                delta += step >> 1
+            if nibble & 1:
+                delta += step >> 2
+            predictor = predictor - delta if nibble & 8 else predictor + delta
+            predictor = max(-32768, min(32767, predictor))
+            index = max(0, min(88, index + INDEX_TABLE[nibble & 7]))
+            out.append(predictor)
+    return out
+
+
+def decode(data):
+    """返回 (样本列表, 损坏的块数)"""
+    samples = []
+    bad = 0
+    for pos in range(0, len(data) - BLOCK_SIZE + 1, BLOCK_SIZE):
+        try:
+            samples += decode_block(data[pos:pos + BLOCK_SIZE])
+        except ValueError:
+            # 块可以单独解码，损坏的块用静音代替，后面的块不受影响
+            samples += [0] * SAMPLES_PER_BLOCK
+            bad += 1
+    return samples, bad
+
+
+def read_silence(path):
+    """读取 .sil（main/recorder.h 的 recorder_silence_entry_t），返回 [(音频文件偏移, 样本数)]"""
+    with open(path, 'rb') as f:
+        data = f.read()
+    return [struct.unpack_from('<QI', data, pos) for pos in range(0, len(data) - 15, 16)]
+
+
+def insert_silence(samples, gaps, samples_at):
+    """在每个偏移处插入静音，samples_at 把文件偏移换算成样本位置"""
+    out = []
+    pos = 0
+    for offset, count in sorted(gaps):
+        at = min(samples_at(offset), len(samples))
+        out += samples[pos:at]
+        out += [0] * count
+        pos = at
+    return out + samples[pos:]
+
+
+def read_sync(path):
+    """读取 .ats（main/recorder.h 的 recorder_sync_entry_t），返回 [(已采集样本数, 相对录制开始的微秒数)]"""
+    with open(path, 'rb') as f:
+        data = f.read()
+    return [struct.unpack_from('<Qq', data, pos) for pos in range(0, len(data) - 15, 16)]
+
+
+# 录制开始时先读出的是DMA中积压的数据，这段时间的同步点不参与斜率拟合
+SYNC_WARMUP_US = 2000000
+
+
+def fit_clock(points):
+    """拟合 时间 = a + b * 样本数，返回 (a 微秒, b 微秒每样本)，同步点不足时返回 None。
+    斜率用最小二乘；读取只会比采集晚，截距取所有点的下包络，去掉调度延迟"""
+    fit = [p for p in points if p[1] >= SYNC_WARMUP_US]
+    if len(fit) < 2:
+        fit = points
+    if len(fit) < 2:
+        return None
+    mean_n = sum(n for n, _ in fit) / len(fit)
+    mean_t = sum(t for _, t in fit) / len(fit)
+    var = sum((n - mean_n) ** 2 for n, _ in fit)
+    if var == 0:
+        return None
+    b = sum((n - mean_n) * (t - mean_t) for n, t in fit) / var
+    a = min(t - b * n for n, t in points)
+    return a, b
+
+
+def retime(samples, a, b, rate, start_us):
+    """按标称采样率在 start_us 之后重新取样：第 i 个采集的样本在 a + b * (i + 1) 时采集完。
+    实际采样率与标称值只差百万分之几十到几百，取最近的样本即可，相当于每隔几千个样本重复或跳过一个"""
+    step = 1000000.0 / rate / b
+    first = (start_us - a) / b - 1
+    count = int((len(samples) - first) / step) if len(samples) > first else 0
+    return [samples[i] if i >= 0 else 0 for i in (int(first + k * step + 0.5) for k in range(count))
+            if i < len(samples)]
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Decode a recorded .adp/.pcm to WAV, restoring skipped audio and the shared timebase",
+        epilog="Example: python3 adpcm_decode.py 00000123-1432.adp 00000123-1432.wav 16000 00000123-1432.sil "
+               "--sync 00000123-1432.ats --start-ms 42")
+    parser.add_argument('input', help=".adp or .pcm")
+    parser.add_argument('output', help=".wav")
+    parser.add_argument('rate', nargs='?', type=int, default=16000, help="nominal sample rate")
+    parser.add_argument('silence', nargs='?', help=".sil listing skipped audio")
+    parser.add_argument('--sync', help=".ats sync points; resample to the recorder's timebase")
+    parser.add_argument('--start-ms', type=float, default=0.0,
+                        help="with --sync, start the WAV at this time (the first video frame's pts)")
+    args = parser.parse_args()
+
+    rate = args.rate
+    with open(args.input, 'rb') as f:
+        data = f.read()
+    pcm = args.input.endswith('.pcm')
+    if pcm:
+        samples = list(struct.unpack(f'<{len(data) // 2}h', data[:len(data) // 2 * 2]))
+        bad = 0
+    else:
+        samples, bad = decode(data)
+    if args.silence:
+        gaps = read_silence(args.silence)
+        if pcm:
+            samples = insert_silence(samples, gaps, lambda offset: offset // 2)
+        else:
+            samples = insert_silence(samples, gaps, lambda offset: offset // BLOCK_SIZE * SAMPLES_PER_BLOCK)
+        print(f"Restored {len(gaps)} silent gaps, {sum(n for _, n in gaps) / rate:.1f} s")
+    if args.sync:
+        clock = fit_clock(read_sync(args.sync))
+        if clock:
+            a, b = clock
+            actual = 1000000.0 / b
+            print(f"Audio clock: {actual:.3f} Hz ({(actual / rate - 1) * 1e6:+.0f} ppm), "
+                  f"first sample at {(a + b) / 1000:.1f} ms")
+            samples = retime(samples, a, b, rate, args.start_ms * 1000)
+        else:
+            print("Not enough sync points, keeping the nominal sample rate")
+    with wave.open(args.output, 'wb') as w:
+        w.setnchannels(1)
+        w.setsampwidth(2)
+        w.setframerate(rate)
+        w.writeframes(struct.pack(f'<{len(samples)}h', *samples))
+    if pcm:
+        print(f"Wrote {len(samples)} samples ({len(samples) / rate:.1f} s)")
+    else:
+        print(f"Decoded {len(data) // BLOCK_SIZE} blocks, {len(samples)} samples ({len(samples) / rate:.1f} s)")
+    if bad:
+        print(f"Replaced {bad} damaged blocks with silence")
+
+
+if __name__ == "__main__":
+    main()
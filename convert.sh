@@ -2,14 +2,17 @@
 
 # 检查参数
 if [ $# -ne 1 ]; then
-    echo "Usage: $0 <timestamp>"
-    echo "Example: $0 0000"
+    echo "Usage: $0 <recording name>"
+    echo "Example: $0 00000123-1432"
     exit 1
 fi
 
 TIMESTAMP=$1
 VIDEO_FILE="${TIMESTAMP}.vid"
 AUDIO_FILE="${TIMESTAMP}.pcm"
+ADPCM_FILE="${TIMESTAMP}.adp"
+SILENCE_FILE="${TIMESTAMP}.sil"
+SYNC_FILE="${TIMESTAMP}.ats"
 OUTPUT_VIDEO="${TIMESTAMP}.mp4"
 OUTPUT_AUDIO="${TIMESTAMP}.wav"
 
@@ -19,18 +22,55 @@ if [ ! -f "$VIDEO_FILE" ]; then
     exit 1
 fi
 
-if [ ! -f "$AUDIO_FILE" ]; then
-    echo "Error: Audio file $AUDIO_FILE not found"
+# 默认录制为IMA-ADPCM(.adp)，关闭编码时为原始PCM(.pcm)
+if [ ! -f "$AUDIO_FILE" ] && [ ! -f "$ADPCM_FILE" ]; then
+    echo "Error: Audio file $AUDIO_FILE or $ADPCM_FILE not found"
     exit 1
 fi
 
+# 共享表格式的帧没有DQT/DHT，先还原成标准MJPEG；标准MJPEG原样输出
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+MJPEG_FILE="${TIMESTAMP}.mjpeg"
+INDEX_FILE="${TIMESTAMP}.idx"
+# 有索引时补回静止画面中省掉的重复帧，并按索引中的时间戳得到实际帧率
+INDEX_ARG=""
+if [ -f "$INDEX_FILE" ]; then
+    INDEX_ARG="$INDEX_FILE"
+fi
+echo "Restoring JPEG tables..."
+RESTORE_OUTPUT=$(python3 "$SCRIPT_DIR/restore_jpeg_tables.py" "$VIDEO_FILE" "$MJPEG_FILE" $INDEX_ARG) || exit 1
+echo "$RESTORE_OUTPUT"
+FPS=$(echo "$RESTORE_OUTPUT" | sed -n 's/^Frame rate: \([0-9.]*\) fps$/\1/p')
+FRAMERATE_ARG=""
+if [ -n "$FPS" ]; then
+    FRAMERATE_ARG="-framerate $FPS"
+fi
+FIRST_FRAME_MS=$(echo "$RESTORE_OUTPUT" | sed -n 's/^First frame: \([0-9]*\) ms$/\1/p')
+
 # 转换视频
 echo "Converting video..."
-ffmpeg -f mjpeg -i "$VIDEO_FILE" "$OUTPUT_VIDEO"
+ffmpeg -f mjpeg $FRAMERATE_ARG -i "$MJPEG_FILE" "$OUTPUT_VIDEO"
+rm -f "$MJPEG_FILE"
 
 # 转换音频
 echo "Converting audio..."
-ffmpeg -f s16le -ar 16000 -ac 1 -i "$AUDIO_FILE" "$OUTPUT_AUDIO"
+# 录制时跳过的静音按 .sil 补回，音频与视频等长
+SILENCE_ARG=""
+if [ -s "$SILENCE_FILE" ]; then
+    SILENCE_ARG="$SILENCE_FILE"
+fi
+# 有 .ats 时按实际的采样时钟重采样，并从第一帧视频的时刻开始，与视频对齐
+SYNC_ARGS=""
+if [ -s "$SYNC_FILE" ]; then
+    SYNC_ARGS="--sync $SYNC_FILE --start-ms ${FIRST_FRAME_MS:-0}"
+fi
+if [ -f "$ADPCM_FILE" ]; then
+    python3 "$SCRIPT_DIR/adpcm_decode.py" "$ADPCM_FILE" "$OUTPUT_AUDIO" 16000 $SILENCE_ARG $SYNC_ARGS || exit 1
+elif [ -n "$SILENCE_ARG" ] || [ -n "$SYNC_ARGS" ]; then
+    python3 "$SCRIPT_DIR/adpcm_decode.py" "$AUDIO_FILE" "$OUTPUT_AUDIO" 16000 $SILENCE_ARG $SYNC_ARGS || exit 1
+else
+    ffmpeg -f s16le -ar 16000 -ac 1 -i "$AUDIO_FILE" "$OUTPUT_AUDIO"
+fi
 
 echo "Conversion complete!"
 echo "Video saved as: $OUTPUT_VIDEO"
@@ -0,0 +1,98 @@
+#include <string.h>
+#include "adpcm.h"
+
+static const int16_t s_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767,
+};
+
+static const int8_t s_index_table[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+void adpcm_encoder_reset(adpcm_encoder_t* enc) {
+    memset(enc, 0, sizeof(*enc));
+}
+
+// 每个样本依赖上一个样本的预测值和步长，只能逐个编码
+static inline uint8_t encode_sample(adpcm_encoder_t* enc, int32_t sample) {
+    int32_t step = s_step_table[enc->index];
+    int32_t diff = sample - enc->predictor;
+    uint8_t nibble = 0;
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+    // 与解码端相同的量化：delta = step/8 + 各位对应的 step、step/2、step/4
+    int32_t delta = step >> 3;
+    if (diff >= step) {
+        nibble |= 4;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        nibble |= 2;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        nibble |= 1;
+        delta += step;
+    }
+
+    int32_t predictor = (nibble & 8) ? enc->predictor - delta : enc->predictor + delta;
+    enc->predictor = predictor > 32767 ? 32767 : predictor < -32768 ? -32768 : predictor;
+    int32_t index = enc->index + s_index_table[nibble & 7];
+    enc->index = index < 0 ? 0 : index > 88 ? 88 : index;
+    return nibble;
+}
+
+static void start_block(adpcm_encoder_t* enc, int16_t sample) {
+    // 块的第一个样本原样存入块头，作为这一块的预测初值
+    enc->predictor = sample;
+    enc->block[0] = (uint8_t)(sample & 0xFF);
+    enc->block[1] = (uint8_t)((uint16_t)sample >> 8);
+    enc->block[2] = (uint8_t)enc->index;
+    enc->block[3] = 0;
+    enc->fill = 1;
+}
+
+size_t adpcm_encode(adpcm_encoder_t* enc, const int16_t* pcm, size_t samples, uint8_t* out) {
+    size_t written = 0;
+    for (size_t i = 0; i < samples; i++) {
+        if (enc->fill == 0) {
+            start_block(enc, pcm[i]);
+            continue;
+        }
+        uint8_t nibble = encode_sample(enc, pcm[i]);
+        uint32_t pos = ADPCM_HEADER_SIZE + (enc->fill - 1) / 2;
+        if (enc->fill & 1) {
+            enc->block[pos] = nibble;
+        } else {
+            enc->block[pos] |= nibble << 4;
+        }
+        if (++enc->fill == ADPCM_SAMPLES_PER_BLOCK) {
+            memcpy(out + written, enc->block, ADPCM_BLOCK_SIZE);
+            written += ADPCM_BLOCK_SIZE;
+            enc->fill = 0;
+        }
+    }
+    return written;
+}
+
+size_t adpcm_flush(adpcm_encoder_t* enc, uint8_t* out) {
+    if (enc->fill == 0) {
+        return 0;
+    }
+    int16_t last = (int16_t)enc->predictor;
+    size_t written = 0;
+    while (written == 0) {
+        written = adpcm_encode(enc, &last, 1, out);
+    }
+    return written;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// IMA-ADPCM编码，4位每样本，与WAV的IMA ADPCM(格式0x0011)单声道块格式相同：
+// 每块以4字节块头开始(第一个样本int16、步长索引uint8、保留uint8)，之后每字节两个样本，低4位在前。
+// 每块都能单独解码，按 块号 * ADPCM_SAMPLES_PER_BLOCK / 采样率 直接定位到任意时刻
+
+#define ADPCM_BLOCK_SIZE        256
+#define ADPCM_HEADER_SIZE       4
+#define ADPCM_SAMPLES_PER_BLOCK ((ADPCM_BLOCK_SIZE - ADPCM_HEADER_SIZE) * 2 + 1)
+
+// 编码 samples 个样本最多输出的字节数(只输出完整的块)
+#define ADPCM_MAX_OUTPUT(samples) ((((samples) + ADPCM_SAMPLES_PER_BLOCK - 1) / ADPCM_SAMPLES_PER_BLOCK + 1) * ADPCM_BLOCK_SIZE)
+
+typedef struct {
+    int32_t predictor;
+    int32_t index;                  // 步长表的索引，0-88
+    uint32_t fill;                  // 当前块已编码的样本数
+    uint8_t block[ADPCM_BLOCK_SIZE];
+} adpcm_encoder_t;
+
+/**
+ * @brief 清空编码状态，每个文件开始时调用
+ * @param enc 编码器
+ */
+void adpcm_encoder_reset(adpcm_encoder_t* enc);
+
+/**
+ * @brief 编码一段16位单声道样本，凑满的块写到 out，不足一块的样本留在编码器中
+ * @param enc 编码器
+ * @param pcm 样本
+ * @param samples 样本数
+ * @param out 输出缓冲，至少 ADPCM_MAX_OUTPUT(samples) 字节
+ * @return 写入 out 的字节数，为 ADPCM_BLOCK_SIZE 的整数倍
+ */
+size_t adpcm_encode(adpcm_encoder_t* enc, const int16_t* pcm, size_t samples, uint8_t* out);
+
+/**
+ * @brief 用最后一个样本补满当前块并输出，录制结束时调用
+ * @param enc 编码器
+ * @param out 输出缓冲，至少 ADPCM_BLOCK_SIZE 字节
+ * @return 写入的字节数，没有未输出的样本时为0
+ */
+size_t adpcm_flush(adpcm_encoder_t* enc, uint8_t* out);
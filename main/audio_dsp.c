@@ -0,0 +1,179 @@
+#include <string.h>
+#include <math.h>
+#include "sdkconfig.h"
+#include "audio_dsp.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "dsps_mul.h"
+#endif
+
+#define COEF_SHIFT  28
+#define DC_SHIFT    8
+#define HP_SHIFT    12
+// 向量乘法每次处理的样本数，增益向量放在栈上
+#define GAIN_CHUNK  64
+
+static inline int16_t saturate16(int32_t v) {
+    return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : (int16_t)v;
+}
+
+static inline int32_t to_q28(double v) {
+    return (int32_t)lround(v * (1 << COEF_SHIFT));
+}
+
+esp_err_t audio_dsp_init(audio_dsp_t* dsp, const audio_dsp_config_t* config) {
+    if (!dsp || !config || config->sample_rate == 0 ||
+        (config->highpass_hz && config->highpass_hz * 2 >= config->sample_rate)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(dsp, 0, sizeof(*dsp));
+    dsp->config = *config;
+    if (dsp->config.agc_max_gain > AUDIO_DSP_MAX_GAIN) {
+        dsp->config.agc_max_gain = AUDIO_DSP_MAX_GAIN;
+    }
+
+    // RBJ音频EQ手册的高通，Q = 1/sqrt(2)；系数只在这里用一次浮点
+    if (config->highpass_hz) {
+        double w0 = 2.0 * M_PI * config->highpass_hz / config->sample_rate;
+        double alpha = sin(w0) / (2.0 * M_SQRT1_2);
+        double cw = cos(w0);
+        double a0 = 1.0 + alpha;
+        dsp->b0 = to_q28((1.0 + cw) / 2.0 / a0);
+        dsp->b1 = to_q28(-(1.0 + cw) / a0);
+        dsp->b2 = dsp->b0;
+        dsp->a1 = to_q28(-2.0 * cw / a0);
+        dsp->a2 = to_q28((1.0 - alpha) / a0);
+    }
+    audio_dsp_reset(dsp);
+    return ESP_OK;
+}
+
+void audio_dsp_reset(audio_dsp_t* dsp) {
+    dsp->dc_x1 = 0;
+    dsp->dc_y = 0;
+    dsp->hp_x1 = dsp->hp_x2 = dsp->hp_y1 = dsp->hp_y2 = 0;
+    dsp->gain = AUDIO_DSP_UNITY_GAIN;
+}
+
+static inline int32_t dc_step(audio_dsp_t* dsp, int32_t x) {
+    int32_t diff = x - dsp->dc_x1;
+    dsp->dc_x1 = x;
+    dsp->dc_y = diff * (1 << DC_SHIFT) + (int32_t)(((int64_t)dsp->config.dc_pole * dsp->dc_y) >> 15);
+    return (dsp->dc_y + (1 << (DC_SHIFT - 1))) >> DC_SHIFT;
+}
+
+static inline int32_t highpass_step(audio_dsp_t* dsp, int32_t x) {
+    // 反馈部分在低截止频率下直流增益约1000倍，输出取整的误差会被放大成几十到上百LSB的低频噪声，
+    // 所以递归状态保留 HP_SHIFT 位小数
+    int64_t acc = ((int64_t)dsp->b0 * x + (int64_t)dsp->b1 * dsp->hp_x1 + (int64_t)dsp->b2 * dsp->hp_x2) * (1 << HP_SHIFT) -
+                  (int64_t)dsp->a1 * dsp->hp_y1 - (int64_t)dsp->a2 * dsp->hp_y2;
+    int32_t y = (int32_t)((acc + (1 << (COEF_SHIFT - 1))) >> COEF_SHIFT);
+    dsp->hp_x2 = dsp->hp_x1;
+    dsp->hp_x1 = x;
+    dsp->hp_y2 = dsp->hp_y1;
+    dsp->hp_y1 = y;
+    return (y + (1 << (HP_SHIFT - 1))) >> HP_SHIFT;
+}
+
+// 由这一块的峰值算出块末的增益：需要降低时立即降到目标，升高时每块最多升 agc_release
+static int32_t next_gain(const audio_dsp_t* dsp, int32_t peak) {
+    const audio_dsp_config_t* c = &dsp->config;
+    int32_t target = peak > 0 ? ((int32_t)c->agc_target << 8) / peak : c->agc_max_gain;
+    if (target > c->agc_max_gain) {
+        target = c->agc_max_gain;
+    } else if (target < 1) {
+        target = 1;
+    }
+    if (target <= dsp->gain) {
+        return target;
+    }
+    int32_t limit = dsp->gain + ((dsp->gain * c->agc_release) >> 8) + 1;
+    return target < limit ? target : limit;
+}
+
+// 增益从 from 线性过渡到 to，Q8增益放在高16位累加
+static inline int32_t ramp_step(int32_t from, int32_t to, size_t count) {
+    return (int32_t)((int64_t)(to - from) * 65536 / (int64_t)count);
+}
+
+// 与 dsps_mul_s16 一样算术右移(向下取整)，向量和标量两条路径的输出逐位相同
+static inline int16_t apply_gain(int16_t x, int32_t gain_q24) {
+    return saturate16(((int32_t)x * (gain_q24 >> 16)) >> 8);
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+// esp-dsp 的16位逐元素乘法，ESP32-S3 上用PIE向量指令：每段先写出每个样本的Q8增益，再与样本相乘右移8位。
+// 结果不饱和，只在整块都不会削波时使用；取整方式与 apply_gain 相同
+static void apply_gain_vector(int16_t* samples, size_t count, int32_t gain, int32_t step) {
+    int16_t gains[GAIN_CHUNK] __attribute__((aligned(16)));
+    for (size_t pos = 0; pos < count; pos += GAIN_CHUNK) {
+        size_t len = count - pos < GAIN_CHUNK ? count - pos : GAIN_CHUNK;
+        for (size_t i = 0; i < len; i++) {
+            gain += step;
+            gains[i] = (int16_t)(gain >> 16);
+        }
+        dsps_mul_s16(samples + pos, gains, samples + pos, (int)len, 1, 1, 1, 8);
+    }
+}
+#endif
+
+void audio_dsp_process(audio_dsp_t* dsp, int16_t* samples, size_t count) {
+    const audio_dsp_config_t* c = &dsp->config;
+    if (count == 0) {
+        return;
+    }
+
+    // 第一遍：两级递归滤波合并为一次遍历，顺带求峰值
+    int32_t peak = 0;
+    if (c->dc_block || c->highpass_hz) {
+        for (size_t i = 0; i < count; i++) {
+            int32_t v = samples[i];
+            if (c->dc_block) {
+                v = dc_step(dsp, v);
+            }
+            if (c->highpass_hz) {
+                v = highpass_step(dsp, v);
+            }
+            int16_t out = saturate16(v);
+            samples[i] = out;
+            int32_t mag = out < 0 ? -(int32_t)out : out;
+            peak = mag > peak ? mag : peak;
+        }
+    } else if (c->agc) {
+        for (size_t i = 0; i < count; i++) {
+            int32_t mag = samples[i] < 0 ? -(int32_t)samples[i] : samples[i];
+            peak = mag > peak ? mag : peak;
+        }
+    }
+    if (!c->agc) {
+        return;
+    }
+
+    // 第二遍：增益与样本无关，逐个元素相乘；增益不变时不做过渡
+    int32_t target = next_gain(dsp, peak);
+    if (target == dsp->gain && target == AUDIO_DSP_UNITY_GAIN) {
+        return;
+    }
+    int32_t step = ramp_step(dsp->gain, target, count);
+    int32_t gain = dsp->gain << 16;
+#if !CONFIG_IDF_TARGET_LINUX
+    // 过渡中的增益在两端之间，峰值乘较大的一端不溢出就整块都不会削波；
+    // 安静之后突然变响、增益还在从高处降下来的块走下面的饱和标量循环
+    int32_t max_gain = target > dsp->gain ? target : dsp->gain;
+    if ((int64_t)peak * max_gain < ((int64_t)INT16_MAX << 8)) {
+        apply_gain_vector(samples, count, gain, step);
+        dsp->gain = target;
+        return;
+    }
+#endif
+    if (step == 0) {
+        for (size_t i = 0; i < count; i++) {
+            samples[i] = apply_gain(samples[i], gain);
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            gain += step;
+            samples[i] = apply_gain(samples[i], gain);
+        }
+    }
+    dsp->gain = target;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// 麦克风音频的预处理，在音频任务中对每次读出的整块样本原地处理：
+// 隔直(一阶DC阻断) -> 二阶巴特沃斯高通(去掉低频隆隆声) -> 定点AGC。
+// 全部为整数运算。前两级是递归滤波器，逐个样本计算并顺带求出整块的峰值；
+// AGC按峰值算出这一块的目标增益，在块内从上一块的增益线性过渡过去，不会削波也没有增益跳变的咔哒声。
+// 设备上增益用 esp-dsp 的向量乘法(ESP32-S3 的PIE指令)，可能削波的块和主机上用标量循环
+
+typedef struct {
+    bool dc_block;
+    uint16_t dc_pole;               // DC阻断的极点，Q15，越接近32768截止频率越低
+    uint16_t highpass_hz;           // 高通截止频率，0表示关闭
+    uint32_t sample_rate;
+    bool agc;
+    int16_t agc_target;             // AGC的目标峰值
+    uint16_t agc_max_gain;          // 最大增益，Q8(256为1倍)，上限 AUDIO_DSP_MAX_GAIN
+    uint16_t agc_release;           // 每块增益最多上升的比例，Q8(4约为每块+1.6%)；下降不受限制
+} audio_dsp_config_t;
+
+#define AUDIO_DSP_UNITY_GAIN    256
+#define AUDIO_DSP_MAX_GAIN      (32 * AUDIO_DSP_UNITY_GAIN)
+
+#define AUDIO_DSP_CONFIG_DEFAULT() { \
+    .dc_block = true, \
+    .dc_pole = 32604, \
+    .highpass_hz = 80, \
+    .sample_rate = 16000, \
+    .agc = false, \
+    .agc_target = 8192, \
+    .agc_max_gain = 8 * AUDIO_DSP_UNITY_GAIN, \
+    .agc_release = 4, \
+}
+
+typedef struct {
+    audio_dsp_config_t config;
+    int32_t b0, b1, b2, a1, a2;     // 高通系数，Q28，y = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2
+    int32_t dc_x1;
+    int32_t dc_y;                   // DC阻断的输出，Q8，保留小数避免截断误差累积成直流
+    int32_t hp_x1, hp_x2;
+    int32_t hp_y1, hp_y2;           // 高通的输出，Q12，理由同上
+    int32_t gain;                   // 上一块结束时的增益，Q8
+} audio_dsp_t;
+
+/**
+ * @brief 按配置计算滤波器系数并清空状态
+ * @param dsp 处理状态
+ * @param config 配置
+ * @return ESP_OK 成功，ESP_ERR_INVALID_ARG 截止频率不低于采样率的一半
+ */
+esp_err_t audio_dsp_init(audio_dsp_t* dsp, const audio_dsp_config_t* config);
+
+/**
+ * @brief 清空滤波器状态，增益回到1倍，每个文件开始时调用
+ * @param dsp 处理状态
+ */
+void audio_dsp_reset(audio_dsp_t* dsp);
+
+/**
+ * @brief 原地处理一块16位单声道样本，滤波器状态跨块连续
+ * @param dsp 处理状态
+ * @param samples 样本
+ * @param count 样本数
+ */
+void audio_dsp_process(audio_dsp_t* dsp, int16_t* samples, size_t count);
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "audio_dsp.h"
+
+// 音频预处理的主机测试，单独构建: idf.py --preview set-target linux && idf.py -B build_dsp -DHOST_TEST=audio_dsp build
+// 运行 ./build_dsp/esp32s3_video_recorder.elf，失败时退出码非0
+// 每组配置用同一段合成信号分别跑定点实现和这里的双精度参考实现，按录制时的块大小以及奇数块大小分块，
+// 每个样本的差必须在容差内；另外粗略检查隔直、高通和AGC是否起作用。
+// 主机上AGC只走标量循环；设备上不削波的块走esp-dsp的向量乘法，两者取整相同，由 bench dsp 的 gain_vector 在设备上核对
+
+#define TEST_RATE       16000
+#define TEST_SECONDS    4
+#define TEST_SAMPLES    (TEST_RATE * TEST_SECONDS)
+// 定点实现的系数量化和逐级取整带来几个LSB的误差，开了AGC时再被增益放大；
+// 峰值差1时Q8增益可能差1，再加上相对误差
+#define TEST_TOL_LSB    4
+#define TEST_TOL_REL    (1.0 / 64)
+
+// 参考实现：按各级的定义用双精度逐级计算，不与 audio_dsp.c 共用代码。
+// 只有AGC的增益按定义每块取整到Q8，块内线性过渡
+typedef struct {
+    audio_dsp_config_t config;
+    double b0, b1, b2, a1, a2;
+    double dc_x1, dc_y1;
+    double x1, x2, y1, y2;
+    int gain;
+} ref_dsp_t;
+
+static void ref_init(ref_dsp_t* r, const audio_dsp_config_t* config) {
+    memset(r, 0, sizeof(*r));
+    r->config = *config;
+    if (r->config.agc_max_gain > AUDIO_DSP_MAX_GAIN) {
+        r->config.agc_max_gain = AUDIO_DSP_MAX_GAIN;
+    }
+    if (config->highpass_hz) {
+        // 二阶巴特沃斯高通的双线性变换
+        double k = tan(M_PI * config->highpass_hz / config->sample_rate);
+        double norm = 1.0 / (1.0 + M_SQRT2 * k + k * k);
+        r->b0 = norm;
+        r->b1 = -2.0 * norm;
+        r->b2 = norm;
+        r->a1 = 2.0 * (k * k - 1.0) * norm;
+        r->a2 = (1.0 - M_SQRT2 * k + k * k) * norm;
+    }
+}
+
+static void ref_reset(ref_dsp_t* r) {
+    r->dc_x1 = r->dc_y1 = 0;
+    r->x1 = r->x2 = r->y1 = r->y2 = 0;
+    r->gain = AUDIO_DSP_UNITY_GAIN;
+}
+
+static int16_t ref_clamp(double v) {
+    v = round(v);
+    return (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+}
+
+static void ref_process(ref_dsp_t* r, int16_t* samples, size_t count) {
+    const audio_dsp_config_t* c = &r->config;
+    double pole = c->dc_pole / 32768.0;
+    for (size_t i = 0; i < count; i++) {
+        double v = samples[i];
+        if (c->dc_block) {
+            double y = v - r->dc_x1 + pole * r->dc_y1;
+            r->dc_x1 = v;
+            r->dc_y1 = y;
+            v = y;
+        }
+        if (c->highpass_hz) {
+            double y = r->b0 * v + r->b1 * r->x1 + r->b2 * r->x2 - r->a1 * r->y1 - r->a2 * r->y2;
+            r->x2 = r->x1;
+            r->x1 = v;
+            r->y2 = r->y1;
+            r->y1 = y;
+            v = y;
+        }
+        samples[i] = ref_clamp(v);
+    }
+    if (!c->agc || count == 0) {
+        return;
+    }
+
+    int peak = 0;
+    for (size_t i = 0; i < count; i++) {
+        peak = abs(samples[i]) > peak ? abs(samples[i]) : peak;
+    }
+    // 降低时直接到目标，升高时每块最多升 agc_release/256 再加1
+    int target = peak > 0 ? c->agc_target * 256 / peak : c->agc_max_gain;
+    target = target > c->agc_max_gain ? c->agc_max_gain : target < 1 ? 1 : target;
+    if (target > r->gain) {
+        int limit = r->gain + r->gain * c->agc_release / 256 + 1;
+        target = target < limit ? target : limit;
+    }
+    for (size_t i = 0; i < count; i++) {
+        double gain = r->gain + (double)(target - r->gain) * (i + 1) / count;
+        samples[i] = ref_clamp(samples[i] * gain / 256.0);
+    }
+    r->gain = target;
+}
+
+static int s_failures = 0;
+
+static void check(int ok, const char* what) {
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) {
+        s_failures++;
+    }
+}
+
+// 1kHz语音频段的信号 + 直流偏置 + 20Hz隆隆声 + 噪声，中间一段音量降低20dB供AGC测试
+static void make_signal(int16_t* out, size_t n, int dc, double amp) {
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        double level = (i >= n / 4 && i < n / 2) ? amp / 10.0 : amp;
+        double v = dc + level * sin(2.0 * M_PI * 1000.0 * i / TEST_RATE) +
+                   3000.0 * sin(2.0 * M_PI * 20.0 * i / TEST_RATE) + (double)((seed >> 16) % 200) - 100.0;
+        out[i] = (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+    }
+}
+
+static void run(audio_dsp_t* dsp, int16_t* buf, size_t n, size_t block) {
+    audio_dsp_reset(dsp);
+    for (size_t pos = 0; pos < n; pos += block) {
+        size_t len = n - pos < block ? n - pos : block;
+        audio_dsp_process(dsp, buf + pos, len);
+    }
+}
+
+static void run_ref(ref_dsp_t* r, int16_t* buf, size_t n, size_t block) {
+    ref_reset(r);
+    for (size_t pos = 0; pos < n; pos += block) {
+        size_t len = n - pos < block ? n - pos : block;
+        ref_process(r, buf + pos, len);
+    }
+}
+
+// 单一频率分量的幅度(相关法)
+static double tone_level(const int16_t* x, size_t n, double hz) {
+    double re = 0, im = 0;
+    for (size_t i = 0; i < n; i++) {
+        re += x[i] * cos(2.0 * M_PI * hz * i / TEST_RATE);
+        im += x[i] * sin(2.0 * M_PI * hz * i / TEST_RATE);
+    }
+    return 2.0 * sqrt(re * re + im * im) / n;
+}
+
+static double mean(const int16_t* x, size_t n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += x[i];
+    }
+    return sum / n;
+}
+
+static int peak(const int16_t* x, size_t n) {
+    int p = 0;
+    for (size_t i = 0; i < n; i++) {
+        p = abs(x[i]) > p ? abs(x[i]) : p;
+    }
+    return p;
+}
+
+static int run_tests(void) {
+    int16_t* input = malloc(TEST_SAMPLES * sizeof(int16_t));
+    int16_t* fast = malloc(TEST_SAMPLES * sizeof(int16_t));
+    int16_t* ref = malloc(TEST_SAMPLES * sizeof(int16_t));
+    if (!input || !fast || !ref) {
+        free(input);
+        free(fast);
+        free(ref);
+        return 1;
+    }
+    s_failures = 0;
+
+    static const size_t blocks[] = { 1024, 1000, 37, 1 };
+    struct {
+        const char* name;
+        int dc_block;
+        uint16_t highpass_hz;
+        int agc;
+        int dc;
+        double amp;
+    } cases[] = {
+        { "all stages",          1, 80,  1, 2000,  6000 },
+        { "dc only",             1, 0,   0, 2000,  6000 },
+        { "highpass only",       0, 80,  0, 0,     6000 },
+        { "agc only",            0, 0,   1, 0,     3000 },
+        { "saturating input",    1, 150, 1, 12000, 30000 },
+        { "all off",             0, 0,   0, 500,   6000 },
+    };
+
+    char what[96];
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        audio_dsp_config_t config = AUDIO_DSP_CONFIG_DEFAULT();
+        config.sample_rate = TEST_RATE;
+        config.dc_block = cases[c].dc_block;
+        config.highpass_hz = cases[c].highpass_hz;
+        config.agc = cases[c].agc;
+        audio_dsp_t dsp;
+        if (audio_dsp_init(&dsp, &config) != ESP_OK) {
+            check(0, cases[c].name);
+            continue;
+        }
+        ref_dsp_t rdsp;
+        ref_init(&rdsp, &config);
+        make_signal(input, TEST_SAMPLES, cases[c].dc, cases[c].amp);
+        for (size_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++) {
+            memcpy(fast, input, TEST_SAMPLES * sizeof(int16_t));
+            memcpy(ref, input, TEST_SAMPLES * sizeof(int16_t));
+            run(&dsp, fast, TEST_SAMPLES, blocks[b]);
+            run_ref(&rdsp, ref, TEST_SAMPLES, blocks[b]);
+            size_t bad = TEST_SAMPLES;
+            int max_err = 0;
+            int tol = TEST_TOL_LSB * (config.agc ? config.agc_max_gain / AUDIO_DSP_UNITY_GAIN : 1);
+            for (size_t i = 0; i < TEST_SAMPLES; i++) {
+                int err = abs(fast[i] - ref[i]);
+                max_err = err > max_err ? err : max_err;
+                if (bad == TEST_SAMPLES && err > tol + abs(ref[i]) * TEST_TOL_REL) {
+                    bad = i;
+                }
+            }
+            snprintf(what, sizeof(what), "%s, block %u: matches reference (max error %d)", cases[c].name,
+                     (unsigned)blocks[b], max_err);
+            check(bad == TEST_SAMPLES, what);
+            if (bad != TEST_SAMPLES) {
+                printf("  first mismatch at %u: %d vs %d\n", (unsigned)bad, fast[bad], ref[bad]);
+            }
+        }
+    }
+
+    // 效果检查只用录制时的块大小，跳过第一秒让滤波器和AGC稳定
+    audio_dsp_config_t config = AUDIO_DSP_CONFIG_DEFAULT();
+    config.sample_rate = TEST_RATE;
+    audio_dsp_t dsp;
+    audio_dsp_init(&dsp, &config);
+    make_signal(input, TEST_SAMPLES, 2000, 6000);
+    memcpy(fast, input, TEST_SAMPLES * sizeof(int16_t));
+    run(&dsp, fast, TEST_SAMPLES, 1024);
+    const int16_t* tail = fast + TEST_SAMPLES / 2;
+    const int16_t* tail_in = input + TEST_SAMPLES / 2;
+    size_t tail_n = TEST_SAMPLES / 2;
+    double dc_out = mean(tail, tail_n);
+    double rumble = 20.0 * log10(tone_level(tail, tail_n, 20.0) / tone_level(tail_in, tail_n, 20.0));
+    double passband = 20.0 * log10(tone_level(tail, tail_n, 1000.0) / tone_level(tail_in, tail_n, 1000.0));
+    printf("dc offset %.2f, 20Hz %.1f dB, 1kHz %.2f dB\n", dc_out, rumble, passband);
+    check(fabs(dc_out) < 2.0, "dc offset removed");
+    check(rumble < -20.0, "20Hz rumble attenuated by more than 20dB");
+    check(fabs(passband) < 0.5, "1kHz passes within 0.5dB");
+
+    // 与只滤波不加AGC的输出比较：安静段(1/4到1/2处)末尾增益应已升高，整段不削波
+    memcpy(ref, fast, TEST_SAMPLES * sizeof(int16_t));
+    config.agc = true;
+    audio_dsp_init(&dsp, &config);
+    memcpy(fast, input, TEST_SAMPLES * sizeof(int16_t));
+    run(&dsp, fast, TEST_SAMPLES, 1024);
+    int quiet_in = peak(ref + TEST_SAMPLES / 2 - TEST_RATE / 4, TEST_RATE / 4);
+    int quiet_out = peak(fast + TEST_SAMPLES / 2 - TEST_RATE / 4, TEST_RATE / 4);
+    printf("agc: quiet peak %d -> %d, overall peak %d\n", quiet_in, quiet_out, peak(fast, TEST_SAMPLES));
+    check(quiet_out > quiet_in, "agc raises quiet passages");
+    check(peak(fast, TEST_SAMPLES) < 32767, "agc output does not clip");
+
+    free(input);
+    free(fast);
+    free(ref);
+    printf("%d failures\n", s_failures);
+    return s_failures;
+}
+
+void app_main(void)
+{
+    exit(run_tests() ? 1 : 0);
+}
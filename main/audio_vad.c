@@ -0,0 +1,97 @@
+#include <string.h>
+#include "audio_vad.h"
+
+// 噪声底的跟随速度(每块移动差值的 1/2^n)：无声时下降快、上升慢，有声时只缓慢上升
+#define FLOOR_FALL_SHIFT        2
+#define FLOOR_RISE_SHIFT        5
+#define FLOOR_RISE_ACTIVE_SHIFT 9
+#define ZCR_SHIFT               3
+
+esp_err_t audio_vad_init(audio_vad_t* vad, const audio_vad_config_t* config) {
+    if (!vad || !config || config->sample_rate == 0 || config->energy_ratio < 256) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(vad, 0, sizeof(*vad));
+    vad->config = *config;
+    vad->hangover_samples = (uint32_t)((uint64_t)config->hangover_ms * config->sample_rate / 1000);
+    audio_vad_reset(vad);
+    return ESP_OK;
+}
+
+void audio_vad_reset(audio_vad_t* vad) {
+    vad->floor = 0;
+    vad->noise_zcr = 0;
+    vad->primed = false;
+    vad->last = 0;
+    vad->hang_left = 0;
+    vad->run_samples = 0;
+}
+
+bool audio_vad_process(audio_vad_t* vad, const int16_t* samples, size_t count, audio_vad_result_t* out_result) {
+    const audio_vad_config_t* c = &vad->config;
+    if (count == 0) {
+        if (out_result) {
+            memset(out_result, 0, sizeof(*out_result));
+            out_result->active = vad->hang_left > 0;
+        }
+        return vad->hang_left > 0;
+    }
+
+    // 一次遍历求平方和与过零次数
+    uint64_t sum = 0;
+    uint32_t crossings = 0;
+    int32_t prev_neg = vad->last < 0;
+    for (size_t i = 0; i < count; i++) {
+        int32_t x = samples[i];
+        sum += (uint32_t)(x * x);
+        int32_t neg = x < 0;
+        crossings += neg ^ prev_neg;
+        prev_neg = neg;
+    }
+    vad->last = samples[count - 1];
+    uint32_t energy = (uint32_t)(sum / count);
+    uint16_t zcr = (uint16_t)((uint64_t)crossings * 1000 / count);
+
+    if (!vad->primed) {
+        vad->floor = (uint64_t)energy << 8;
+        vad->noise_zcr = (uint32_t)zcr << 8;
+        vad->primed = true;
+    }
+    uint64_t threshold = (vad->floor * c->energy_ratio) >> 16;
+    if (c->zcr_delta && zcr >= (vad->noise_zcr >> 8) + c->zcr_delta) {
+        threshold >>= 1;
+    }
+    bool speech = energy >= c->min_energy && energy > threshold;
+
+    uint64_t level = (uint64_t)energy << 8;
+    if (level < vad->floor) {
+        vad->floor -= (vad->floor - level) >> FLOOR_FALL_SHIFT;
+    } else {
+        vad->floor += (level - vad->floor) >> (speech ? FLOOR_RISE_ACTIVE_SHIFT : FLOOR_RISE_SHIFT);
+    }
+
+    if (!speech) {
+        int32_t diff = (int32_t)((uint32_t)zcr << 8) - (int32_t)vad->noise_zcr;
+        vad->noise_zcr = (uint32_t)((int32_t)vad->noise_zcr + diff / (1 << ZCR_SHIFT));
+    }
+
+    if (speech) {
+        vad->hang_left = vad->hangover_samples;
+        vad->run_samples = vad->run_samples + count < vad->run_samples ? UINT32_MAX : vad->run_samples + count;
+    } else {
+        vad->hang_left = vad->hang_left > count ? vad->hang_left - (uint32_t)count : 0;
+        vad->run_samples = 0;
+    }
+    // 有声的块本身总是保存，保持时间从块末开始算
+    bool active = speech || vad->hang_left > 0;
+
+    if (out_result) {
+        out_result->speech = speech;
+        out_result->active = active;
+        out_result->energy = energy;
+        out_result->noise_floor = (uint32_t)(vad->floor >> 8);
+        out_result->zcr = zcr;
+        out_result->run_ms = (uint32_t)((uint64_t)vad->run_samples * 1000 / c->sample_rate);
+    }
+    return active;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// 声音活动检测：按块计算均方能量和过零率，与自适应的噪声底比较。
+// 能量高出噪声底 energy_ratio 倍为有声；过零率明显高于背景噪声(清辅音、碰撞声等高频成分)时门限减半。
+// 判为有声后保持 hangover_ms，避免句间停顿把声音切碎。
+// 噪声底和背景的过零率只在无声时快速跟随，有声时噪声底缓慢上升，环境噪声变大(如风扇启动)后几秒内不再误判。
+// 输入应先去掉直流(见 audio_dsp.h)，否则直流偏置会算进能量
+
+typedef struct {
+    uint32_t sample_rate;
+    uint32_t min_energy;            // 均方能量的绝对门限，低于它总是无声(数字静音、极安静的环境)
+    uint16_t energy_ratio;          // 有声门限相对噪声底的倍数，Q8(2048为8倍，约9dB)
+    uint16_t zcr_delta;             // 过零率(每千个样本)比背景高出这么多时门限减半，0表示不使用过零率
+    uint16_t hangover_ms;           // 最后一次有声之后仍保持有声的时间
+} audio_vad_config_t;
+
+#define AUDIO_VAD_CONFIG_DEFAULT() { \
+    .sample_rate = 16000, \
+    .min_energy = 400, \
+    .energy_ratio = 8 * 256, \
+    .zcr_delta = 150, \
+    .hangover_ms = 800, \
+}
+
+typedef struct {
+    bool speech;                    // 这一块本身判为有声
+    bool active;                    // 计入保持时间后的结果，录制按它决定是否保存
+    uint32_t energy;                // 这一块的均方能量
+    uint32_t noise_floor;
+    uint16_t zcr;                   // 每千个样本的过零次数
+    uint32_t run_ms;                // 连续有声(不计保持时间)的时长，用于触发录制时过滤短促的噪声
+} audio_vad_result_t;
+
+typedef struct {
+    audio_vad_config_t config;
+    uint32_t hangover_samples;
+    uint64_t floor;                 // 噪声底，Q8
+    uint32_t noise_zcr;             // 背景的过零率，Q8
+    bool primed;                    // 已用第一块初始化噪声底
+    int16_t last;                   // 上一块最后一个样本，过零计数跨块连续
+    uint32_t hang_left;             // 剩余的保持样本数
+    uint32_t run_samples;
+} audio_vad_t;
+
+/**
+ * @brief 按配置初始化检测器
+ * @param vad 检测器
+ * @param config 配置
+ * @return ESP_OK 成功，ESP_ERR_INVALID_ARG 采样率为0或倍数小于1
+ */
+esp_err_t audio_vad_init(audio_vad_t* vad, const audio_vad_config_t* config);
+
+/**
+ * @brief 清空状态，噪声底由下一块重新初始化
+ * @param vad 检测器
+ */
+void audio_vad_reset(audio_vad_t* vad);
+
+/**
+ * @brief 检测一块16位单声道样本
+ * @param vad 检测器
+ * @param samples 样本
+ * @param count 样本数
+ * @param out_result 输出检测结果，可以为NULL
+ * @return 计入保持时间后是否有声
+ */
+bool audio_vad_process(audio_vad_t* vad, const int16_t* samples, size_t count, audio_vad_result_t* out_result);
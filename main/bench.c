@@ -0,0 +1,605 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_heap_caps.h"
+#include "esp_app_desc.h"
+#include "esp_idf_version.h"
+#include "esp_cpu.h"
+#include "driver/i2s_std.h"
+#include "fs_hal.h"
+#include "sdcard_hal.h"
+#include "sdcard_diskio.h"
+#include "adpcm.h"
+#include "audio_dsp.h"
+#include "audio_vad.h"
+#include "thumbnail.h"
+#include "bench.h"
+
+static const char* TAG = "bench";
+
+#define BENCH_FILE          "bench.tmp"
+#define BENCH_THUMBNAIL_FILE "bench.thm"
+#define BENCH_MAX_CHUNK     (64 * 1024)
+#define BENCH_MIN_CHUNK     (4 * 1024)
+// 每种块大小最多执行的命令数，避免单块测试耗时过长
+#define BENCH_MAX_OPS       2048
+#define BENCH_RANDOM_OPS    256
+// 切换摄像头设置后丢弃的帧数，等待曝光和码率稳定
+#define BENCH_CAMERA_WARMUP 5
+
+// 块数
+static const size_t s_raw_chunks[] = { 1, 8, 32, 128 };
+// 字节数
+static const size_t s_fs_chunks[] = { 4 * 1024, 16 * 1024, 32 * 1024, 64 * 1024 };
+static const int s_camera_qualities[] = { 10, 12, 20, 30 };
+
+typedef struct {
+    uint64_t bytes;
+    uint32_t ops;
+    uint64_t total_us;
+    uint32_t max_us;
+} bench_result_t;
+
+static void emit_u64(const char* test, const char* op, const char* param, const char* metric, uint64_t value) {
+    printf("%s,%s,%s,%s,%"PRIu64"\n", test, op, param, metric, value);
+}
+
+static void emit_float(const char* test, const char* op, const char* param, const char* metric, double value) {
+    printf("%s,%s,%s,%s,%.2f\n", test, op, param, metric, value);
+}
+
+static void emit_result(const char* test, const char* op, size_t chunk, const bench_result_t* r) {
+    char param[24];
+    snprintf(param, sizeof(param), "chunk=%u", (unsigned)chunk);
+    if (r->ops == 0 || r->total_us == 0) {
+        return;
+    }
+    emit_u64(test, op, param, "kbps", r->bytes * 1000000 / r->total_us / 1024);
+    emit_u64(test, op, param, "iops", (uint64_t)r->ops * 1000000 / r->total_us);
+    emit_u64(test, op, param, "avg_us", r->total_us / r->ops);
+    emit_u64(test, op, param, "max_us", r->max_us);
+}
+
+static void add_op(bench_result_t* r, size_t bytes, int64_t start_us) {
+    uint32_t us = (uint32_t)(esp_timer_get_time() - start_us);
+    r->bytes += bytes;
+    r->ops++;
+    r->total_us += us;
+    if (us > r->max_us) {
+        r->max_us = us;
+    }
+}
+
+// DMA缓冲分配不到时减半重试
+static uint8_t* alloc_buffer(size_t* size) {
+    while (*size >= BENCH_MIN_CHUNK) {
+        uint8_t* buf = heap_caps_malloc(*size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        if (buf) {
+            return buf;
+        }
+        *size /= 2;
+    }
+    return NULL;
+}
+
+void bench_print_header(void) {
+    const esp_app_desc_t* app = esp_app_get_description();
+    printf("# firmware %s, idf %s, built %s %s\n", app->version, esp_get_idf_version(), app->date, app->time);
+    printf("test,case,param,metric,value\n");
+}
+
+esp_err_t bench_raw(uint32_t mb) {
+    sdcard_t* card = fs_get_card();
+    sdcard_info_t info;
+    if (!card || sdcard_get_info(card, &info) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t buf_size = BENCH_MAX_CHUNK;
+    uint8_t* buf = alloc_buffer(&buf_size);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // 测试区放在卡的中部，对齐到4MB；写测试绕过 FatFs 和扇区缓存写回原数据，调用者要独占卡(recorder_acquire_exclusive)，
+    // 先把缓存的脏块写回，读到的就是卡上的最新数据；后台擦除暂停避免交叉访问，结束后恢复原来的状态
+    uint64_t sectors = info.capacity_bytes / SDCARD_BLOCK_SIZE;
+    size_t base = (size_t)(sectors / 2) & ~(size_t)8191;
+    size_t span = (size_t)(sectors - base);
+    bool trim_paused = sdcard_diskio_get_trim_paused();
+    sdcard_diskio_set_trim_paused(true);
+    for (uint8_t pdrv = 0; pdrv < FF_VOLUMES; pdrv++) {
+        sdcard_diskio_flush(pdrv);
+    }
+
+    esp_err_t ret = ESP_OK;
+    for (size_t c = 0; c < sizeof(s_raw_chunks) / sizeof(s_raw_chunks[0]) && ret == ESP_OK; c++) {
+        size_t chunk = s_raw_chunks[c];
+        size_t chunk_bytes = chunk * SDCARD_BLOCK_SIZE;
+        if (chunk_bytes > buf_size) {
+            continue;
+        }
+        uint64_t n_ops = (uint64_t)mb * 1024 * 1024 / chunk_bytes;
+        if (n_ops > BENCH_MAX_OPS) {
+            n_ops = BENCH_MAX_OPS;
+        }
+        if (n_ops * chunk > span) {
+            n_ops = span / chunk;
+        }
+
+        bench_result_t seq_read = { 0 };
+        for (uint64_t i = 0; i < n_ops && ret == ESP_OK; i++) {
+            int64_t t = esp_timer_get_time();
+            ret = sdcard_read_blocks(card, base + i * chunk, chunk, buf);
+            add_op(&seq_read, chunk_bytes, t);
+        }
+
+        bench_result_t seq_write = { 0 };
+        for (uint64_t i = 0; i < n_ops && ret == ESP_OK; i++) {
+            ret = sdcard_read_blocks(card, base + i * chunk, chunk, buf);
+            if (ret == ESP_OK) {
+                int64_t t = esp_timer_get_time();
+                ret = sdcard_write_blocks(card, base + i * chunk, chunk, buf);
+                add_op(&seq_write, chunk_bytes, t);
+            }
+        }
+
+        bench_result_t rand_read = { 0 };
+        for (uint32_t i = 0; i < BENCH_RANDOM_OPS && ret == ESP_OK; i++) {
+            size_t block = base + (esp_random() % (span / chunk)) * chunk;
+            int64_t t = esp_timer_get_time();
+            ret = sdcard_read_blocks(card, block, chunk, buf);
+            add_op(&rand_read, chunk_bytes, t);
+        }
+
+        if (ret == ESP_OK) {
+            emit_result("raw", "seq_read", chunk_bytes, &seq_read);
+            emit_result("raw", "seq_write", chunk_bytes, &seq_write);
+            emit_result("raw", "rand_read", chunk_bytes, &rand_read);
+        }
+    }
+
+    sdcard_diskio_set_trim_paused(trim_paused);
+    heap_caps_free(buf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Raw block benchmark failed (%s)", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t bench_fs(uint32_t mb) {
+    size_t buf_size = BENCH_MAX_CHUNK;
+    uint8_t* buf = alloc_buffer(&buf_size);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < buf_size; i++) {
+        buf[i] = (uint8_t)esp_random();
+    }
+
+    uint64_t file_size = (uint64_t)mb * 1024 * 1024;
+    esp_err_t ret = ESP_OK;
+    for (size_t c = 0; c < sizeof(s_fs_chunks) / sizeof(s_fs_chunks[0]) && ret == ESP_OK; c++) {
+        size_t chunk = s_fs_chunks[c];
+        if (chunk > buf_size) {
+            continue;
+        }
+        uint64_t n_ops = file_size / chunk;
+
+        // 顺序写：包含簇分配和FAT更新，关闭时的同步也计入
+        bench_result_t seq_write = { 0 };
+        fs_file_t file = fs_open(BENCH_FILE, FS_FILE_WRITE);
+        if (!file) {
+            ret = ESP_FAIL;
+            break;
+        }
+        int64_t start = esp_timer_get_time();
+        for (uint64_t i = 0; i < n_ops && ret == ESP_OK; i++) {
+            int64_t t = esp_timer_get_time();
+            if (fs_write(file, buf, chunk) != (int)chunk) {
+                ret = ESP_FAIL;
+            }
+            add_op(&seq_write, chunk, t);
+        }
+        fs_close(file);
+        seq_write.total_us = esp_timer_get_time() - start;
+
+        bench_result_t seq_read = { 0 };
+        bench_result_t rand_read = { 0 };
+        bench_result_t rand_write = { 0 };
+        file = ret == ESP_OK ? fs_open(BENCH_FILE, FS_FILE_READ) : NULL;
+        if (file) {
+            for (uint64_t i = 0; i < n_ops && ret == ESP_OK; i++) {
+                int64_t t = esp_timer_get_time();
+                if (fs_read(file, buf, chunk) != (int)chunk) {
+                    ret = ESP_FAIL;
+                }
+                add_op(&seq_read, chunk, t);
+            }
+            for (uint32_t i = 0; i < BENCH_RANDOM_OPS && ret == ESP_OK && n_ops > 0; i++) {
+                int64_t t = esp_timer_get_time();
+                if (fs_seek(file, (int64_t)(esp_random() % n_ops) * chunk, FS_SEEK_SET) != ESP_OK ||
+                    fs_read(file, buf, chunk) != (int)chunk) {
+                    ret = ESP_FAIL;
+                }
+                add_op(&rand_read, chunk, t);
+            }
+            fs_close(file);
+        } else if (ret == ESP_OK) {
+            ret = ESP_FAIL;
+        }
+
+        // 随机覆盖写：在已有文件内定位后写入，不分配新簇
+        file = ret == ESP_OK ? fs_open(BENCH_FILE, FS_FILE_APPEND) : NULL;
+        if (file) {
+            start = esp_timer_get_time();
+            for (uint32_t i = 0; i < BENCH_RANDOM_OPS && ret == ESP_OK && n_ops > 0; i++) {
+                int64_t t = esp_timer_get_time();
+                if (fs_seek(file, (int64_t)(esp_random() % n_ops) * chunk, FS_SEEK_SET) != ESP_OK ||
+                    fs_write(file, buf, chunk) != (int)chunk) {
+                    ret = ESP_FAIL;
+                }
+                add_op(&rand_write, chunk, t);
+            }
+            fs_close(file);
+            rand_write.total_us = esp_timer_get_time() - start;
+        } else if (ret == ESP_OK) {
+            ret = ESP_FAIL;
+        }
+
+        if (ret == ESP_OK) {
+            emit_result("fs", "seq_write", chunk, &seq_write);
+            emit_result("fs", "seq_read", chunk, &seq_read);
+            emit_result("fs", "rand_read", chunk, &rand_read);
+            emit_result("fs", "rand_write", chunk, &rand_write);
+        }
+    }
+
+    fs_remove(BENCH_FILE);
+    heap_caps_free(buf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Filesystem benchmark failed");
+    }
+    return ret;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+esp_err_t bench_camera(framesize_t max_size, uint32_t frames) {
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (!sensor || frames == 0) {
+        return sensor ? ESP_ERR_INVALID_ARG : ESP_ERR_INVALID_STATE;
+    }
+    uint32_t* sizes = malloc(frames * sizeof(uint32_t));
+    if (!sizes) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    framesize_t orig_size = sensor->status.framesize;
+    int orig_quality = sensor->status.quality;
+    static const framesize_t frame_sizes[] = {
+        FRAMESIZE_QQVGA, FRAMESIZE_QVGA, FRAMESIZE_CIF, FRAMESIZE_VGA,
+        FRAMESIZE_SVGA, FRAMESIZE_XGA, FRAMESIZE_HD, FRAMESIZE_SXGA, FRAMESIZE_UXGA,
+    };
+
+    for (size_t f = 0; f < sizeof(frame_sizes) / sizeof(frame_sizes[0]); f++) {
+        if (frame_sizes[f] > max_size) {
+            break;
+        }
+        if (sensor->set_framesize(sensor, frame_sizes[f]) != 0) {
+            continue;
+        }
+        for (size_t q = 0; q < sizeof(s_camera_qualities) / sizeof(s_camera_qualities[0]); q++) {
+            sensor->set_quality(sensor, s_camera_qualities[q]);
+            for (int i = 0; i < BENCH_CAMERA_WARMUP; i++) {
+                camera_fb_t* fb = esp_camera_fb_get();
+                if (fb) {
+                    esp_camera_fb_return(fb);
+                }
+            }
+
+            uint32_t captured = 0;
+            uint32_t failed = 0;
+            uint64_t total_bytes = 0;
+            int64_t start = esp_timer_get_time();
+            while (captured + failed < frames) {
+                camera_fb_t* fb = esp_camera_fb_get();
+                if (!fb) {
+                    failed++;
+                    continue;
+                }
+                sizes[captured++] = fb->len;
+                total_bytes += fb->len;
+                esp_camera_fb_return(fb);
+            }
+            int64_t elapsed = esp_timer_get_time() - start;
+
+            char param[32];
+            snprintf(param, sizeof(param), "%ux%u q=%d", resolution[frame_sizes[f]].width,
+                     resolution[frame_sizes[f]].height, s_camera_qualities[q]);
+            emit_u64("camera", "capture", param, "failed", failed);
+            if (captured == 0 || elapsed <= 0) {
+                continue;
+            }
+            qsort(sizes, captured, sizeof(uint32_t), compare_u32);
+            emit_float("camera", "capture", param, "fps", captured * 1000000.0 / elapsed);
+            emit_u64("camera", "jpeg", param, "avg_bytes", total_bytes / captured);
+            emit_u64("camera", "jpeg", param, "min_bytes", sizes[0]);
+            emit_u64("camera", "jpeg", param, "p50_bytes", sizes[captured / 2]);
+            emit_u64("camera", "jpeg", param, "p90_bytes", sizes[captured * 9 / 10]);
+            emit_u64("camera", "jpeg", param, "max_bytes", sizes[captured - 1]);
+        }
+    }
+
+    sensor->set_framesize(sensor, orig_size);
+    sensor->set_quality(sensor, orig_quality);
+    free(sizes);
+    return ESP_OK;
+}
+
+esp_err_t bench_thumbnail(uint32_t frames) {
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (!sensor || frames == 0) {
+        return sensor ? ESP_ERR_INVALID_ARG : ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = thumbnail_open(BENCH_THUMBNAIL_FILE, 0);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // handoff 是写卡任务实际付出的时间；decode 是后台任务的解码和写入，只占用空闲时间
+    bench_result_t handoff = { 0 };
+    bench_result_t decode = { 0 };
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (!fb) {
+            failed++;
+            continue;
+        }
+        int64_t start = esp_timer_get_time();
+        esp_err_t err = thumbnail_add(fb->buf, fb->len, i);
+        add_op(&handoff, fb->len, start);
+        esp_camera_fb_return(fb);
+        if (err != ESP_OK) {
+            failed++;
+            continue;
+        }
+        start = esp_timer_get_time();
+        thumbnail_wait(1000);
+        add_op(&decode, 0, start);
+    }
+    uint32_t written = 0;
+    thumbnail_close(&written);
+    fs_remove(BENCH_THUMBNAIL_FILE);
+
+    char param[32];
+    snprintf(param, sizeof(param), "%ux%u", resolution[sensor->status.framesize].width,
+             resolution[sensor->status.framesize].height);
+    // 采集失败、交不出去和后台解码失败的都算
+    emit_u64("thumbnail", "add", param, "failed", failed + (decode.ops - written));
+    if (handoff.ops) {
+        emit_u64("thumbnail", "handoff", param, "avg_us", handoff.total_us / handoff.ops);
+        emit_u64("thumbnail", "handoff", param, "max_us", handoff.max_us);
+    }
+    if (decode.ops) {
+        emit_u64("thumbnail", "decode", param, "avg_us", decode.total_us / decode.ops);
+        emit_u64("thumbnail", "decode", param, "max_us", decode.max_us);
+    }
+    return ESP_OK;
+}
+
+esp_err_t bench_i2s(i2s_chan_handle_t i2s, size_t chunk_size, uint32_t bytes_per_sec, uint32_t reads) {
+    if (!i2s || chunk_size == 0 || bytes_per_sec == 0 || reads < 2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t* buf = malloc(chunk_size);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // 先读空DMA中积压的数据，之后每次读取都要等新数据到达
+    size_t n = 0;
+    while (i2s_channel_read(i2s, buf, chunk_size, &n, 0) == ESP_OK && n > 0) {
+    }
+
+    double expected_us = (double)chunk_size * 1000000.0 / bytes_per_sec;
+    double sum = 0, sum_sq = 0;
+    uint32_t min_us = UINT32_MAX, max_us = 0, short_reads = 0, intervals = 0;
+    esp_err_t ret = ESP_OK;
+    int64_t last = 0;
+    for (uint32_t i = 0; i < reads; i++) {
+        ret = i2s_channel_read(i2s, buf, chunk_size, &n, pdMS_TO_TICKS(1000));
+        if (ret != ESP_OK) {
+            break;
+        }
+        int64_t now = esp_timer_get_time();
+        if (n != chunk_size) {
+            short_reads++;
+        }
+        if (i > 0) {
+            uint32_t us = (uint32_t)(now - last);
+            sum += us;
+            sum_sq += (double)us * us;
+            min_us = us < min_us ? us : min_us;
+            max_us = us > max_us ? us : max_us;
+            intervals++;
+        }
+        last = now;
+    }
+    free(buf);
+    if (ret != ESP_OK || intervals == 0) {
+        ESP_LOGE(TAG, "I2S benchmark failed (%s)", esp_err_to_name(ret));
+        return ret != ESP_OK ? ret : ESP_FAIL;
+    }
+
+    char param[24];
+    snprintf(param, sizeof(param), "chunk=%u", (unsigned)chunk_size);
+    double mean = sum / intervals;
+    double variance = sum_sq / intervals - mean * mean;
+    emit_float("i2s", "read", param, "expected_us", expected_us);
+    emit_float("i2s", "read", param, "mean_us", mean);
+    emit_float("i2s", "read", param, "stddev_us", variance > 0 ? sqrt(variance) : 0);
+    emit_u64("i2s", "read", param, "min_us", min_us);
+    emit_u64("i2s", "read", param, "max_us", max_us);
+    emit_float("i2s", "read", param, "max_jitter_us", fmax(max_us - expected_us, expected_us - min_us));
+    emit_u64("i2s", "read", param, "short_reads", short_reads);
+    return ESP_OK;
+}
+
+esp_err_t bench_adpcm(size_t chunk_size, uint32_t sample_rate, uint32_t seconds) {
+    size_t samples = chunk_size / sizeof(int16_t);
+    if (samples == 0 || sample_rate == 0 || seconds == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int16_t* pcm = malloc(samples * sizeof(int16_t));
+    uint8_t* out = malloc(ADPCM_MAX_OUTPUT(samples));
+    adpcm_encoder_t* enc = malloc(sizeof(adpcm_encoder_t));
+    if (!pcm || !out || !enc) {
+        free(pcm);
+        free(out);
+        free(enc);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // 440Hz正弦加噪声，步长会随噪声变化，接近真实录音的分支情况
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = (int16_t)(8000.0 * sin(2.0 * M_PI * 440.0 * i / sample_rate) + (int32_t)(esp_random() % 512) - 256);
+    }
+
+    adpcm_encoder_reset(enc);
+    uint64_t total = (uint64_t)sample_rate * seconds;
+    uint64_t encoded = 0;
+    uint64_t bytes = 0;
+    uint64_t cycles = 0;
+    int64_t start = esp_timer_get_time();
+    while (encoded < total) {
+        uint32_t c0 = esp_cpu_get_cycle_count();
+        bytes += adpcm_encode(enc, pcm, samples, out);
+        cycles += esp_cpu_get_cycle_count() - c0;
+        encoded += samples;
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    free(pcm);
+    free(out);
+    free(enc);
+
+    char param[24];
+    snprintf(param, sizeof(param), "chunk=%u", (unsigned)chunk_size);
+    emit_float("adpcm", "encode", param, "cycles_per_sample", (double)cycles / encoded);
+    emit_float("adpcm", "encode", param, "us_per_chunk", (double)elapsed * samples / encoded);
+    // 实时编码占用一个核的百分比
+    emit_float("adpcm", "encode", param, "cpu_percent", elapsed * 100.0 * sample_rate / encoded / 1000000.0);
+    emit_float("adpcm", "encode", param, "bytes_ratio", (double)bytes / (encoded * sizeof(int16_t)));
+    return ESP_OK;
+}
+
+esp_err_t bench_audio_dsp(size_t chunk_size, uint32_t sample_rate, uint32_t seconds) {
+    size_t samples = chunk_size / sizeof(int16_t);
+    if (samples == 0 || sample_rate == 0 || seconds == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    audio_dsp_config_t config = AUDIO_DSP_CONFIG_DEFAULT();
+    config.sample_rate = sample_rate;
+    config.agc = true;
+    int16_t* pcm = malloc(samples * sizeof(int16_t));
+    int16_t* work = malloc(samples * sizeof(int16_t));
+    audio_dsp_t* dsp = malloc(sizeof(audio_dsp_t));
+    if (!pcm || !work || !dsp || audio_dsp_init(dsp, &config) != ESP_OK) {
+        free(pcm);
+        free(work);
+        free(dsp);
+        return pcm && work && dsp ? ESP_ERR_INVALID_ARG : ESP_ERR_NO_MEM;
+    }
+
+    // 带直流偏置和低频成分的正弦加噪声，每块都要重新算AGC的过渡
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = (int16_t)(1500.0 + 4000.0 * sin(2.0 * M_PI * 440.0 * i / sample_rate) +
+                           2000.0 * sin(2.0 * M_PI * 30.0 * i / sample_rate) + (int32_t)(esp_random() % 512) - 256);
+    }
+
+    char param[24];
+    snprintf(param, sizeof(param), "chunk=%u", (unsigned)chunk_size);
+    uint64_t total = (uint64_t)sample_rate * seconds;
+
+    // 只滤波和加上AGC分别测，两者之差是增益那一遍(esp-dsp向量乘法)的开销
+    for (int agc = 0; agc < 2; agc++) {
+        config.agc = agc;
+        audio_dsp_init(dsp, &config);
+        uint64_t processed = 0;
+        uint64_t cycles = 0;
+        while (processed < total) {
+            memcpy(work, pcm, samples * sizeof(int16_t));
+            uint32_t c0 = esp_cpu_get_cycle_count();
+            audio_dsp_process(dsp, work, samples);
+            cycles += esp_cpu_get_cycle_count() - c0;
+            processed += samples;
+        }
+        const char* test = agc ? "filters_agc" : "filters";
+        emit_float("dsp", test, param, "cycles_per_sample", (double)cycles / processed);
+        // 实时处理占用一个核的百分比
+        emit_float("dsp", test, param, "cpu_percent",
+                   (double)cycles * sample_rate * 100.0 / processed / (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000.0));
+    }
+
+    // 设备上的AGC在不削波时走esp-dsp的向量乘法，主机测试只能覆盖标量循环。
+    // 只开AGC、输入够小时按增益过渡的定义逐样本重算，向量路径必须与标量的取整逐位相同
+    config.dc_block = false;
+    config.highpass_hz = 0;
+    config.agc = true;
+    audio_dsp_init(dsp, &config);
+    uint32_t mismatches = 0;
+    for (int block = 0; block < 8; block++) {
+        for (size_t i = 0; i < samples; i++) {
+            work[i] = pcm[i] / 16;
+        }
+        int32_t from = dsp->gain;
+        audio_dsp_process(dsp, work, samples);
+        int32_t to = dsp->gain;
+        int32_t step = (int32_t)((int64_t)(to - from) * 65536 / (int64_t)samples);
+        int32_t gain = from << 16;
+        for (size_t i = 0; i < samples; i++) {
+            gain += step;
+            int32_t expected = ((int32_t)(pcm[i] / 16) * (gain >> 16)) >> 8;
+            if (work[i] != expected) {
+                mismatches++;
+            }
+        }
+    }
+    emit_u64("dsp", "gain_vector", param, "mismatches", mismatches);
+    if (mismatches) {
+        ESP_LOGE(TAG, "Vector gain path differs from the scalar path in %"PRIu32" samples", mismatches);
+    }
+
+    // 静音门控/声音触发的检测在预处理之后对同一块运行
+    audio_vad_config_t vad_config = AUDIO_VAD_CONFIG_DEFAULT();
+    vad_config.sample_rate = sample_rate;
+    audio_vad_t vad;
+    audio_vad_init(&vad, &vad_config);
+    uint64_t processed = 0;
+    uint64_t cycles = 0;
+    while (processed < total) {
+        uint32_t c0 = esp_cpu_get_cycle_count();
+        audio_vad_process(&vad, pcm, samples, NULL);
+        cycles += esp_cpu_get_cycle_count() - c0;
+        processed += samples;
+    }
+    emit_float("dsp", "vad", param, "cycles_per_sample", (double)cycles / processed);
+    emit_float("dsp", "vad", param, "cpu_percent",
+               (double)cycles * sample_rate * 100.0 / processed / (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000.0));
+    free(pcm);
+    free(work);
+    free(dsp);
+    return mismatches ? ESP_FAIL : ESP_OK;
+}
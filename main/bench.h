@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+#include "esp_camera.h"
+#include "driver/i2s_types.h"
+
+// 设备上的基准测试，结果以CSV输出到控制台：
+//   test,case,param,metric,value
+// 以 # 开头的行是注释(固件版本等)，便于不同固件版本的结果直接 diff
+
+/**
+ * @brief 输出CSV表头和固件信息，每次运行前调用一次
+ */
+void bench_print_header(void);
+
+/**
+ * @brief 绕过文件系统测试块读写吞吐
+ *
+ * 写测试把刚读出的数据原样写回，不改变卡上的内容。
+ *
+ * @param mb 每种块大小读写的数据量(MB)
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 未挂载
+ */
+esp_err_t bench_raw(uint32_t mb);
+
+/**
+ * @brief 经由FatFs测试顺序和随机读写，使用临时文件，结束后删除
+ * @param mb 顺序读写的文件大小(MB)
+ * @return ESP_OK 成功
+ */
+esp_err_t bench_fs(uint32_t mb);
+
+/**
+ * @brief 测试不同分辨率和JPEG质量下的采集帧率和帧大小分布，结束后恢复原设置
+ * @param max_size 帧缓冲按此分辨率分配，只测试不超过它的分辨率
+ * @param frames 每组设置采集的帧数
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 摄像头未初始化
+ */
+esp_err_t bench_camera(framesize_t max_size, uint32_t frames);
+
+/**
+ * @brief 测试缩略图在写卡任务中的开销，用当前的摄像头设置采集，临时文件结束后删除
+ *
+ * 分别输出写卡任务交出一帧(复制)的时间和后台任务解码写入一张的时间。
+ *
+ * @param frames 采集的帧数
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 摄像头未初始化，其他 创建临时文件失败
+ */
+esp_err_t bench_thumbnail(uint32_t frames);
+
+/**
+ * @brief 测试I2S读取返回间隔的抖动
+ * @param i2s 已使能的接收通道
+ * @param chunk_size 每次读取的字节数
+ * @param bytes_per_sec 数据率，用于计算理论间隔
+ * @param reads 读取次数
+ * @return ESP_OK 成功
+ */
+esp_err_t bench_i2s(i2s_chan_handle_t i2s, size_t chunk_size, uint32_t bytes_per_sec, uint32_t reads);
+
+/**
+ * @brief 测试IMA-ADPCM编码的开销，输入为合成的正弦加噪声，按录制时的块大小分次编码
+ * @param chunk_size 每次编码的字节数(16位样本)
+ * @param sample_rate 采样率，用于换算CPU占用
+ * @param seconds 编码的音频时长(秒)
+ * @return ESP_OK 成功
+ */
+esp_err_t bench_adpcm(size_t chunk_size, uint32_t sample_rate, uint32_t seconds);
+
+/**
+ * @brief 测试音频预处理的开销：只滤波(隔直+高通)、滤波加AGC，以及声音活动检测，各输出每样本周期数和CPU占用
+ * @param chunk_size 每次处理的字节数(16位样本)
+ * @param sample_rate 采样率
+ * @param seconds 处理的音频时长(秒)
+ * @return ESP_OK 成功
+ */
+esp_err_t bench_audio_dsp(size_t chunk_size, uint32_t sample_rate, uint32_t seconds);
@@ -0,0 +1,173 @@
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "camera_profile.h"
+
+static const char* TAG = "camera_profile";
+
+// 切换后最多丢弃的帧数(在帧缓冲个数之外)，超过时认为传感器没有按新尺寸输出
+#define SETTLE_EXTRA_FRAMES 4
+
+static const camera_profile_t s_profiles[] = {
+    { "qvga", "320x240, highest frame rate", FRAMESIZE_QVGA, 12 },
+    { "vga",  "640x480",                     FRAMESIZE_VGA,  12 },
+    { "hd",   "1280x720",                    FRAMESIZE_HD,   12 },
+    { "uxga", "1600x1200, low frame rate",   FRAMESIZE_UXGA, 15 },
+};
+
+#define PROFILE_COUNT (sizeof(s_profiles) / sizeof(s_profiles[0]))
+
+static const camera_profile_t* s_current = NULL;
+static size_t s_fb_size = 0;
+static size_t s_fb_count = 0;
+
+static const camera_profile_t* find_profile(const char* name) {
+    for (size_t i = 0; name && i < PROFILE_COUNT; i++) {
+        if (strcmp(s_profiles[i].name, name) == 0) {
+            return &s_profiles[i];
+        }
+    }
+    return NULL;
+}
+
+// 驱动在取帧时按传感器当前的设置填写 fb->width/height，切换后缓冲中旧尺寸的帧也会带上新尺寸，
+// 所以从SOF段读出实际的尺寸
+static bool jpeg_dimensions(const uint8_t* p, size_t len, uint16_t* out_width, uint16_t* out_height) {
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (p[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = p[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        size_t seg_len = 2 + ((size_t)p[pos + 2] << 8 | p[pos + 3]);
+        if (marker == 0xC0 || marker == 0xC1) {
+            if (pos + 9 > len) {
+                return false;
+            }
+            *out_height = (uint16_t)(p[pos + 5] << 8 | p[pos + 6]);
+            *out_width = (uint16_t)(p[pos + 7] << 8 | p[pos + 8]);
+            return true;
+        }
+        if (marker == 0xDA) {
+            return false;
+        }
+        pos += seg_len;
+    }
+    return false;
+}
+
+const camera_profile_t* camera_profile_list(size_t* out_count) {
+    if (out_count) {
+        *out_count = PROFILE_COUNT;
+    }
+    return s_profiles;
+}
+
+size_t camera_profile_fb_size(framesize_t frame_size) {
+    // 与 esp32-camera 的 cam_hal 相同，JPEG模式下每个缓冲为 宽*高/5
+    return (size_t)resolution[frame_size].width * resolution[frame_size].height / 5;
+}
+
+framesize_t camera_profile_largest(size_t max_fb_size) {
+    framesize_t largest = s_profiles[0].frame_size;
+    for (size_t i = 0; i < PROFILE_COUNT; i++) {
+        size_t size = camera_profile_fb_size(s_profiles[i].frame_size);
+        if ((max_fb_size == 0 || size <= max_fb_size) && size > camera_profile_fb_size(largest)) {
+            largest = s_profiles[i].frame_size;
+        }
+    }
+    return largest;
+}
+
+esp_err_t camera_profile_init(const camera_config_t* config, const char* name) {
+    if (!config) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_fb_size = camera_profile_fb_size(config->frame_size);
+    s_fb_count = config->fb_count;
+    s_current = find_profile(name);
+    if (!s_current) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // 初始化用的是最大的分辨率，切到初始配置
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (!sensor) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (sensor->status.framesize != s_current->frame_size || sensor->status.quality != s_current->jpeg_quality) {
+        sensor->set_framesize(sensor, s_current->frame_size);
+        sensor->set_quality(sensor, s_current->jpeg_quality);
+    }
+    ESP_LOGI(TAG, "Profile '%s', buffers sized for %u bytes", s_current->name, (unsigned)s_fb_size);
+    return ESP_OK;
+}
+
+esp_err_t camera_profile_apply(const char* name, camera_profile_switch_t* out_switch) {
+    const camera_profile_t* profile = find_profile(name);
+    if (!profile) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    sensor_t* sensor = esp_camera_sensor_get();
+    if (!sensor || !s_current) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (camera_profile_fb_size(profile->frame_size) > s_fb_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    int64_t start = esp_timer_get_time();
+    if (sensor->set_framesize(sensor, profile->frame_size) != 0 ||
+        sensor->set_quality(sensor, profile->jpeg_quality) != 0) {
+        sensor->set_framesize(sensor, s_current->frame_size);
+        sensor->set_quality(sensor, s_current->jpeg_quality);
+        return ESP_FAIL;
+    }
+    int64_t programmed = esp_timer_get_time();
+    s_current = profile;
+
+    // 缓冲中可能还有按旧尺寸采集完的帧，丢掉它们直到出现新尺寸的帧
+    uint16_t want_width = resolution[profile->frame_size].width;
+    uint16_t want_height = resolution[profile->frame_size].height;
+    uint32_t stale = 0;
+    bool settled = false;
+    while (stale < s_fb_count + SETTLE_EXTRA_FRAMES) {
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (!fb) {
+            stale++;
+            continue;
+        }
+        uint16_t width = 0;
+        uint16_t height = 0;
+        settled = jpeg_dimensions(fb->buf, fb->len, &width, &height) &&
+                  width == want_width && height == want_height;
+        esp_camera_fb_return(fb);
+        if (settled) {
+            break;
+        }
+        stale++;
+    }
+    int64_t done = esp_timer_get_time();
+
+    if (out_switch) {
+        out_switch->reprogram_us = (uint32_t)(programmed - start);
+        out_switch->first_frame_us = (uint32_t)(done - start);
+        out_switch->stale_frames = stale;
+    }
+    if (!settled) {
+        ESP_LOGW(TAG, "No %ux%u frame after %"PRIu32" frames", want_width, want_height, stale);
+        return ESP_ERR_TIMEOUT;
+    }
+    ESP_LOGI(TAG, "Switched to '%s' in %"PRId64" us (%"PRIu32" stale frames)",
+             profile->name, done - start, stale);
+    return ESP_OK;
+}
+
+const camera_profile_t* camera_profile_current(void) {
+    return s_current;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "esp_camera.h"
+
+// 摄像头配置切换：帧缓冲在初始化时按最大的配置分配，之后切换配置只重新设置传感器的
+// 输出尺寸和JPEG质量，不需要 esp_camera_deinit/esp_camera_init，也不重新分配缓冲。
+// 像素格式固定为JPEG：驱动在初始化时按格式决定缓冲大小和DMA的接收方式，无法原地切换
+
+typedef struct {
+    const char* name;
+    const char* description;
+    framesize_t frame_size;
+    int jpeg_quality;               // 0-63，越小画质越好、帧越大
+} camera_profile_t;
+
+typedef struct {
+    uint32_t reprogram_us;          // 设置传感器寄存器的耗时
+    uint32_t first_frame_us;        // 从开始切换到拿到第一帧新尺寸的帧
+    uint32_t stale_frames;          // 期间丢弃的旧尺寸的帧
+} camera_profile_switch_t;
+
+/**
+ * @brief 获取预定义的配置列表
+ * @param out_count 输出配置个数
+ * @return 配置数组
+ */
+const camera_profile_t* camera_profile_list(size_t* out_count);
+
+/**
+ * @brief 找出不超过 max_fb_size 字节缓冲的最大分辨率，esp_camera_init 之前用它设置 frame_size
+ * @param max_fb_size 每个帧缓冲最多可用的字节数，0表示不限制
+ * @return 列表中能放下的最大分辨率
+ */
+framesize_t camera_profile_largest(size_t max_fb_size);
+
+/**
+ * @brief 驱动为某个分辨率的JPEG帧分配的缓冲大小
+ * @param frame_size 分辨率
+ * @return 字节数
+ */
+size_t camera_profile_fb_size(framesize_t frame_size);
+
+/**
+ * @brief esp_camera_init 之后调用，记录缓冲能容纳的分辨率并切换到初始配置
+ * @param config 初始化摄像头用的配置，frame_size 决定了缓冲大小
+ * @param name 初始配置的名字
+ * @return ESP_OK 成功，ESP_ERR_NOT_FOUND 没有这个配置
+ */
+esp_err_t camera_profile_init(const camera_config_t* config, const char* name);
+
+/**
+ * @brief 原地切换到另一个配置，等到新尺寸的第一帧才返回；不能与其他取帧的任务同时调用
+ * @param name 配置的名字
+ * @param out_switch 输出切换耗时，可以为NULL
+ * @return ESP_OK 成功，ESP_ERR_NOT_FOUND 没有这个配置，ESP_ERR_INVALID_SIZE 超出初始化时分配的缓冲，
+ *         ESP_ERR_TIMEOUT 没有等到新尺寸的帧
+ */
+esp_err_t camera_profile_apply(const char* name, camera_profile_switch_t* out_switch);
+
+/**
+ * @brief 当前使用的配置
+ * @return 配置，未初始化时为NULL
+ */
+const camera_profile_t* camera_profile_current(void);
@@ -0,0 +1,474 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "fs_hal.h"
+#include "catalog.h"
+
+static const char* TAG = "catalog";
+
+#define CATALOG_FILE        "catalog.bin"
+#define CATALOG_TMP_FILE    "catalog.tmp"
+#define CATALOG_MAGIC       0x54414352  // "RCAT"
+#define CATALOG_VERSION     1
+// 查询和压缩时每次读取的记录数
+#define CATALOG_BATCH       32
+// 已删除的记录至少有这么多、且占到一半时自动压缩
+#define CATALOG_COMPACT_MIN 64
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t deleted;
+    uint32_t unsorted_from;         // UINT32_MAX 表示全部有序
+    uint32_t reserved[3];
+    uint32_t crc;
+} catalog_header_t;
+
+_Static_assert(sizeof(catalog_header_t) == 32, "catalog header layout changed");
+_Static_assert(sizeof(catalog_entry_t) == 80, "catalog entry layout changed");
+
+static SemaphoreHandle_t s_mutex = NULL;
+static catalog_header_t s_header;
+static uint32_t s_count = 0;        // 有效记录数，之后的字节是写了一半的记录，下次追加时覆盖
+static uint32_t s_next_id = 1;
+static int64_t s_last_start = 0;
+
+static const char* const s_trigger_names[CATALOG_TRIGGER_COUNT] = { "manual", "boot", "loop", "event" };
+
+#define CATALOG_LOCK()   xSemaphoreTake(s_mutex, portMAX_DELAY)
+#define CATALOG_UNLOCK() xSemaphoreGive(s_mutex)
+
+static inline uint64_t entry_offset(uint32_t index) {
+    return sizeof(catalog_header_t) + (uint64_t)index * sizeof(catalog_entry_t);
+}
+
+// 删除标记在原位改写，不计入校验
+static uint32_t entry_crc(const catalog_entry_t* entry) {
+    catalog_entry_t tmp = *entry;
+    tmp.flags = 0;
+    return esp_rom_crc32_le(0, (const uint8_t*)&tmp, offsetof(catalog_entry_t, crc));
+}
+
+static uint32_t header_crc(const catalog_header_t* header) {
+    return esp_rom_crc32_le(0, (const uint8_t*)header, offsetof(catalog_header_t, crc));
+}
+
+static bool read_at(fs_file_t file, uint64_t offset, void* buf, size_t len) {
+    return fs_seek(file, (int64_t)offset, FS_SEEK_SET) == ESP_OK && fs_read(file, buf, len) == (int)len;
+}
+
+static bool write_at(fs_file_t file, uint64_t offset, const void* buf, size_t len) {
+    return fs_seek(file, (int64_t)offset, FS_SEEK_SET) == ESP_OK && fs_write(file, buf, len) == (int)len;
+}
+
+static bool write_header(fs_file_t file) {
+    s_header.crc = header_crc(&s_header);
+    return write_at(file, 0, &s_header, sizeof(s_header));
+}
+
+static void init_header(void) {
+    memset(&s_header, 0, sizeof(s_header));
+    s_header.magic = CATALOG_MAGIC;
+    s_header.version = CATALOG_VERSION;
+    s_header.entry_size = sizeof(catalog_entry_t);
+    s_header.unsorted_from = UINT32_MAX;
+}
+
+static esp_err_t create_catalog(void) {
+    fs_file_t file = fs_open(CATALOG_FILE, FS_FILE_WRITE);
+    if (!file) {
+        return ESP_FAIL;
+    }
+    init_header();
+    bool ok = write_header(file);
+    fs_close(file);
+    s_count = 0;
+    s_next_id = 1;
+    s_last_start = 0;
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+// 文件头损坏时扫描全部记录重建删除计数和有序区间，只在异常掉电后发生
+static void rebuild_header(fs_file_t file) {
+    ESP_LOGW(TAG, "Catalog header damaged, rebuilding from %"PRIu32" entries", s_count);
+    init_header();
+    int64_t last_start = INT64_MIN;
+    catalog_entry_t entry;
+    for (uint32_t i = 0; i < s_count && read_at(file, entry_offset(i), &entry, sizeof(entry)); i++) {
+        if (entry.flags & CATALOG_FLAG_DELETED) {
+            s_header.deleted++;
+        }
+        if (entry.start_time < last_start && s_header.unsorted_from == UINT32_MAX) {
+            s_header.unsorted_from = i;
+        }
+        last_start = entry.start_time;
+    }
+}
+
+esp_err_t catalog_init(void) {
+    if (!s_mutex) {
+        s_mutex = xSemaphoreCreateMutex();
+        if (!s_mutex) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    CATALOG_LOCK();
+    // 压缩在删除旧文件和改名之间掉电时，新文件是完整的
+    if (fs_exists(CATALOG_TMP_FILE)) {
+        if (!fs_exists(CATALOG_FILE)) {
+            fs_rename(CATALOG_TMP_FILE, CATALOG_FILE);
+        } else {
+            fs_remove(CATALOG_TMP_FILE);
+        }
+    }
+
+    if (!fs_exists(CATALOG_FILE)) {
+        esp_err_t ret = create_catalog();
+        CATALOG_UNLOCK();
+        ESP_LOGI(TAG, "Created empty catalog");
+        return ret;
+    }
+
+    fs_file_t file = fs_open(CATALOG_FILE, FS_FILE_READ);
+    if (!file) {
+        CATALOG_UNLOCK();
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = ESP_OK;
+    int64_t size = fs_size(file);
+    catalog_header_t header;
+    if (size < (int64_t)sizeof(header) || !read_at(file, 0, &header, sizeof(header)) ||
+        header.magic != CATALOG_MAGIC || header.version != CATALOG_VERSION ||
+        header.entry_size != sizeof(catalog_entry_t)) {
+        ESP_LOGE(TAG, "Unsupported catalog file, remove %s to start a new one", CATALOG_FILE);
+        ret = ESP_ERR_INVALID_VERSION;
+        goto out;
+    }
+
+    s_count = (uint32_t)((size - sizeof(header)) / sizeof(catalog_entry_t));
+    // 只有最后一条可能写了一半
+    catalog_entry_t last;
+    while (s_count > 0) {
+        if (read_at(file, entry_offset(s_count - 1), &last, sizeof(last)) && last.crc == entry_crc(&last)) {
+            break;
+        }
+        ESP_LOGW(TAG, "Dropping torn catalog entry %"PRIu32, s_count - 1);
+        s_count--;
+    }
+    s_next_id = s_count > 0 ? last.id + 1 : 1;
+    s_last_start = s_count > 0 ? last.start_time : 0;
+
+    if (header.crc == header_crc(&header)) {
+        s_header = header;
+    } else {
+        rebuild_header(file);
+    }
+    ESP_LOGI(TAG, "Catalog: %"PRIu32" entries, %"PRIu32" deleted", s_count, s_header.deleted);
+
+out:
+    fs_close(file);
+    CATALOG_UNLOCK();
+    return ret;
+}
+
+esp_err_t catalog_append(catalog_entry_t* entry) {
+    if (!entry) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    CATALOG_LOCK();
+    entry->id = s_next_id;
+    entry->flags = 0;
+    entry->crc = entry_crc(entry);
+
+    esp_err_t ret = ESP_FAIL;
+    fs_file_t file = fs_open(CATALOG_FILE, FS_FILE_APPEND);
+    if (file) {
+        bool ok = true;
+        // 文件被删除或卡被格式化过，没有文件头的目录下次启动时无法打开，从头开始
+        if (fs_size(file) < (int64_t)sizeof(catalog_header_t)) {
+            ESP_LOGW(TAG, "Catalog file lost its header, starting a new one");
+            init_header();
+            ok = write_header(file);
+            s_count = 0;
+            s_last_start = 0;
+        }
+        ok = ok && write_at(file, entry_offset(s_count), entry, sizeof(*entry));
+        if (ok && s_count > 0 && entry->start_time < s_last_start && s_header.unsorted_from == UINT32_MAX) {
+            // 系统时间被往回调过，这之后的记录按时间查询时顺序扫描
+            s_header.unsorted_from = s_count;
+            ok = write_header(file);
+        }
+        // 关闭时同步，掉电最多丢失正在写的这一条
+        if (fs_close(file) == ESP_OK && ok) {
+            ret = ESP_OK;
+        }
+    }
+
+    if (ret == ESP_OK) {
+        s_count++;
+        s_next_id++;
+        s_last_start = entry->start_time;
+    } else {
+        ESP_LOGE(TAG, "Failed to append catalog entry for %s", entry->name);
+    }
+    CATALOG_UNLOCK();
+    return ret;
+}
+
+esp_err_t catalog_reset(void) {
+    if (!s_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    CATALOG_LOCK();
+    if (fs_exists(CATALOG_TMP_FILE)) {
+        fs_remove(CATALOG_TMP_FILE);
+    }
+    esp_err_t ret = create_catalog();
+    CATALOG_UNLOCK();
+    return ret;
+}
+
+// 序号在文件内递增，二分查找
+static bool find_by_id(fs_file_t file, uint32_t id, uint32_t* out_index) {
+    uint32_t lo = 0, hi = s_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t mid_id;
+        if (!read_at(file, entry_offset(mid) + offsetof(catalog_entry_t, id), &mid_id, sizeof(mid_id))) {
+            return false;
+        }
+        if (mid_id == id) {
+            *out_index = mid;
+            return true;
+        }
+        if (mid_id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+static esp_err_t compact_locked(void) {
+    fs_file_t src = fs_open(CATALOG_FILE, FS_FILE_READ);
+    if (!src) {
+        return ESP_FAIL;
+    }
+    fs_file_t dst = fs_open(CATALOG_TMP_FILE, FS_FILE_WRITE);
+    catalog_entry_t* batch = malloc(CATALOG_BATCH * sizeof(catalog_entry_t));
+    if (!dst || !batch) {
+        free(batch);
+        if (dst) {
+            fs_close(dst);
+            fs_remove(CATALOG_TMP_FILE);
+        }
+        fs_close(src);
+        return dst ? ESP_ERR_NO_MEM : ESP_FAIL;
+    }
+
+    catalog_header_t old_header = s_header;
+    init_header();
+    bool ok = write_header(dst);
+    uint32_t kept = 0;
+    int64_t last_start = INT64_MIN;
+    for (uint32_t i = 0; i < s_count && ok; i += CATALOG_BATCH) {
+        uint32_t n = s_count - i < CATALOG_BATCH ? s_count - i : CATALOG_BATCH;
+        ok = read_at(src, entry_offset(i), batch, n * sizeof(catalog_entry_t));
+        for (uint32_t j = 0; j < n && ok; j++) {
+            if (batch[j].flags & CATALOG_FLAG_DELETED) {
+                continue;
+            }
+            if (batch[j].start_time < last_start && s_header.unsorted_from == UINT32_MAX) {
+                s_header.unsorted_from = kept;
+            }
+            last_start = batch[j].start_time;
+            ok = fs_write(dst, &batch[j], sizeof(catalog_entry_t)) == sizeof(catalog_entry_t);
+            kept++;
+        }
+    }
+    ok = write_header(dst) && ok;
+    free(batch);
+    fs_close(src);
+    if (fs_close(dst) != ESP_OK) {
+        ok = false;
+    }
+
+    if (!ok) {
+        fs_remove(CATALOG_TMP_FILE);
+        s_header = old_header;
+        ESP_LOGE(TAG, "Catalog compaction failed");
+        return ESP_FAIL;
+    }
+
+    // 删除旧文件之后掉电的情况由 catalog_init 处理
+    if (fs_remove(CATALOG_FILE) != ESP_OK || fs_rename(CATALOG_TMP_FILE, CATALOG_FILE) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to replace catalog with compacted copy");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Compacted catalog: %"PRIu32" -> %"PRIu32" entries", s_count, kept);
+    s_count = kept;
+    return ESP_OK;
+}
+
+esp_err_t catalog_delete(uint32_t id) {
+    if (!s_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    CATALOG_LOCK();
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    uint32_t index;
+    uint32_t flags = 0;
+    fs_file_t file = fs_open(CATALOG_FILE, FS_FILE_READ);
+    if (file) {
+        bool found = find_by_id(file, id, &index) &&
+                     read_at(file, entry_offset(index) + offsetof(catalog_entry_t, flags), &flags, sizeof(flags));
+        fs_close(file);
+        if (found) {
+            ret = ESP_OK;
+        }
+    }
+
+    if (ret == ESP_OK && !(flags & CATALOG_FLAG_DELETED)) {
+        flags |= CATALOG_FLAG_DELETED;
+        ret = ESP_FAIL;
+        file = fs_open(CATALOG_FILE, FS_FILE_APPEND);
+        if (file) {
+            bool ok = write_at(file, entry_offset(index) + offsetof(catalog_entry_t, flags), &flags, sizeof(flags));
+            if (ok) {
+                s_header.deleted++;
+                ok = write_header(file);
+            }
+            if (fs_close(file) == ESP_OK && ok) {
+                ret = ESP_OK;
+            }
+        }
+    }
+
+    if (ret == ESP_OK && s_header.deleted >= CATALOG_COMPACT_MIN && s_header.deleted * 2 >= s_count) {
+        compact_locked();
+    }
+    CATALOG_UNLOCK();
+    return ret;
+}
+
+// 在有序区间 [0, end) 内找第一条开始时间不早于 from 的记录
+static uint32_t lower_bound(fs_file_t file, uint32_t end, int64_t from) {
+    uint32_t lo = 0, hi = end;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int64_t start;
+        if (!read_at(file, entry_offset(mid) + offsetof(catalog_entry_t, start_time), &start, sizeof(start))) {
+            return end;
+        }
+        if (start < from) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// 顺序读取 [first, end)，sorted 时遇到超出 to 的记录即停止；返回 false 表示回调要求停止或读取失败
+static bool scan_range(fs_file_t file, catalog_entry_t* batch, uint32_t first, uint32_t end, bool sorted,
+                       int64_t from, int64_t to, catalog_visit_cb_t cb, void* ctx) {
+    for (uint32_t i = first; i < end; i += CATALOG_BATCH) {
+        uint32_t n = end - i < CATALOG_BATCH ? end - i : CATALOG_BATCH;
+        if (!read_at(file, entry_offset(i), batch, n * sizeof(catalog_entry_t))) {
+            return false;
+        }
+        for (uint32_t j = 0; j < n; j++) {
+            const catalog_entry_t* e = &batch[j];
+            if (sorted && e->start_time >= to) {
+                return true;
+            }
+            if ((e->flags & CATALOG_FLAG_DELETED) || e->start_time < from || e->start_time >= to) {
+                continue;
+            }
+            if (!cb(e, ctx)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+esp_err_t catalog_query(int64_t from, int64_t to, catalog_visit_cb_t cb, void* ctx) {
+    if (!cb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    CATALOG_LOCK();
+    if (s_count == 0) {
+        CATALOG_UNLOCK();
+        return ESP_OK;
+    }
+    catalog_entry_t* batch = malloc(CATALOG_BATCH * sizeof(catalog_entry_t));
+    fs_file_t file = fs_open(CATALOG_FILE, FS_FILE_READ);
+    if (!batch || !file) {
+        free(batch);
+        if (file) {
+            fs_close(file);
+        }
+        CATALOG_UNLOCK();
+        return batch ? ESP_FAIL : ESP_ERR_NO_MEM;
+    }
+
+    uint32_t sorted_end = s_header.unsorted_from < s_count ? s_header.unsorted_from : s_count;
+    uint32_t first = lower_bound(file, sorted_end, from);
+    if (scan_range(file, batch, first, sorted_end, true, from, to, cb, ctx)) {
+        scan_range(file, batch, sorted_end, s_count, false, from, to, cb, ctx);
+    }
+
+    fs_close(file);
+    free(batch);
+    CATALOG_UNLOCK();
+    return ESP_OK;
+}
+
+esp_err_t catalog_compact(void) {
+    if (!s_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    CATALOG_LOCK();
+    esp_err_t ret = compact_locked();
+    CATALOG_UNLOCK();
+    return ret;
+}
+
+esp_err_t catalog_get_stats(catalog_stats_t* out_stats) {
+    if (!out_stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    CATALOG_LOCK();
+    out_stats->entries = s_count;
+    out_stats->deleted = s_header.deleted;
+    out_stats->unsorted_from = s_header.unsorted_from;
+    out_stats->file_bytes = entry_offset(s_count);
+    CATALOG_UNLOCK();
+    return ESP_OK;
+}
+
+const char* catalog_trigger_name(uint8_t trigger) {
+    return trigger < CATALOG_TRIGGER_COUNT ? s_trigger_names[trigger] : "?";
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// 录像目录：每段录像一条定长记录，按录制顺序追加到 catalog.bin。
+// 列表、按时间查询和保留策略只读这个文件，不需要遍历目录表
+
+// 开始录制的原因
+typedef enum {
+    CATALOG_TRIGGER_MANUAL = 0,     // 控制台命令
+    CATALOG_TRIGGER_BOOT,           // 上电自动开始
+    CATALOG_TRIGGER_LOOP,           // 循环录制的下一段
+    CATALOG_TRIGGER_EVENT,          // 外部事件(运动检测、声音等)
+    CATALOG_TRIGGER_COUNT,
+} catalog_trigger_t;
+
+// 视频文件的格式
+typedef enum {
+    CATALOG_VIDEO_MJPEG = 0,        // 每帧都是完整的JPEG
+    CATALOG_VIDEO_MJPEG_SHARED,     // 重复的DQT/DHT表已去掉，见 jpeg_tables.h
+} catalog_video_format_t;
+
+// 音频文件的格式
+typedef enum {
+    CATALOG_AUDIO_PCM16 = 0,        // .pcm，16位有符号小端
+    CATALOG_AUDIO_IMA_ADPCM,        // .adp，见 adpcm.h
+} catalog_audio_format_t;
+
+#define CATALOG_FLAG_DELETED    0x01    // 文件已删除，压缩时丢弃
+#define CATALOG_NAME_LEN        32
+
+typedef struct {
+    uint32_t id;                    // 递增的序号，文件内按序号有序
+    uint32_t flags;                 // CATALOG_FLAG_*，不计入校验
+    int64_t start_time;             // 开始时间(Unix时间，秒)
+    uint32_t duration_ms;
+    uint32_t frames;
+    uint64_t video_bytes;
+    uint64_t audio_bytes;
+    uint8_t trigger;                // catalog_trigger_t
+    uint8_t video_format;           // catalog_video_format_t，旧记录为0
+    uint8_t audio_format;           // catalog_audio_format_t，旧记录为0
+    uint8_t reserved;
+    char name[CATALOG_NAME_LEN];    // 不带扩展名的文件路径，相对于挂载点
+    uint32_t crc;
+} catalog_entry_t;
+
+typedef struct {
+    uint32_t entries;               // 文件中的记录数(含已删除)
+    uint32_t deleted;               // 已删除但尚未压缩掉的记录数
+    uint32_t unsorted_from;         // 从这条记录起开始时间不再有序(系统时间被回调过)
+    uint64_t file_bytes;
+} catalog_stats_t;
+
+/**
+ * @brief 查询回调
+ * @param entry 记录
+ * @param ctx 调用者上下文
+ * @return true 继续，false 停止查询
+ */
+typedef bool (*catalog_visit_cb_t)(const catalog_entry_t* entry, void* ctx);
+
+/**
+ * @brief 打开或创建目录文件，截掉末尾写了一半的记录
+ *
+ * 只读取文件头和最后一条记录，不随目录大小变慢。必须在文件系统挂载之后调用。
+ *
+ * @return ESP_OK 成功，ESP_ERR_INVALID_VERSION 文件格式不兼容
+ */
+esp_err_t catalog_init(void);
+
+/**
+ * @brief 追加一条记录，id 由目录分配
+ * @param entry 记录，返回时填入分配的 id
+ * @return ESP_OK 成功
+ */
+esp_err_t catalog_append(catalog_entry_t* entry);
+
+/**
+ * @brief 清空目录，重新创建只有文件头的目录文件，序号从 1 开始。格式化SD卡之后调用
+ * @return ESP_OK 成功
+ */
+esp_err_t catalog_reset(void);
+
+/**
+ * @brief 把记录标记为已删除，已删除的记录足够多时自动压缩
+ * @param id 记录序号
+ * @return ESP_OK 成功，ESP_ERR_NOT_FOUND 没有这条记录
+ */
+esp_err_t catalog_delete(uint32_t id);
+
+/**
+ * @brief 按开始时间查询 [from, to) 内未删除的记录，按文件顺序回调
+ *
+ * 回调中不能再调用 catalog_* 函数。
+ *
+ * @param from 起始时间(含)
+ * @param to 结束时间(不含)
+ * @param cb 回调
+ * @param ctx 回调上下文
+ * @return ESP_OK 成功
+ */
+esp_err_t catalog_query(int64_t from, int64_t to, catalog_visit_cb_t cb, void* ctx);
+
+/**
+ * @brief 重写目录文件，丢弃已删除的记录
+ * @return ESP_OK 成功
+ */
+esp_err_t catalog_compact(void);
+
+/**
+ * @brief 获取目录统计
+ * @param out_stats 输出的统计信息
+ * @return ESP_OK 成功
+ */
+esp_err_t catalog_get_stats(catalog_stats_t* out_stats);
+
+/**
+ * @brief 触发原因的名称
+ * @param trigger 触发原因
+ * @return 名称字符串
+ */
+const char* catalog_trigger_name(uint8_t trigger);
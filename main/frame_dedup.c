@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "jpeg_crop.h"
+#include "frame_dedup.h"
+
+static int16_t* grow_map(int16_t* map, size_t count) {
+    int16_t* grown = heap_caps_realloc(map, count * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!grown) {
+        grown = realloc(map, count * sizeof(int16_t));
+    }
+    return grown;
+}
+
+void frame_dedup_init(frame_dedup_t* dedup, const frame_dedup_config_t* config) {
+    memset(dedup, 0, sizeof(*dedup));
+    dedup->config = *config;
+}
+
+void frame_dedup_reset(frame_dedup_t* dedup) {
+    dedup->have_ref = false;
+    dedup->repeats = 0;
+}
+
+// 任一MCU的差超过上限立即返回，静止画面时需要比较全部MCU
+static bool similar(const frame_dedup_config_t* config, const int16_t* a, const int16_t* b, size_t n) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        int d = a[i] - b[i];
+        d = d < 0 ? -d : d;
+        if (d > config->max_threshold) {
+            return false;
+        }
+        sum += d;
+    }
+    return sum <= config->mean_threshold * n;
+}
+
+bool frame_dedup_is_repeat(frame_dedup_t* dedup, jpeg_parser_t* parser, const uint8_t* jpeg, size_t len) {
+    uint16_t cols = 0;
+    uint16_t rows = 0;
+    esp_err_t ret = jpeg_luma_dc(parser, jpeg, len, dedup->cur, dedup->cap, &cols, &rows);
+    if (ret == ESP_ERR_INVALID_SIZE && cols && rows) {
+        // 第一帧或分辨率变大，按新的大小分配，原来的参考帧作废
+        size_t count = (size_t)cols * rows;
+        int16_t* ref = grow_map(dedup->ref, count);
+        if (ref) {
+            dedup->ref = ref;
+            int16_t* cur = grow_map(dedup->cur, count);
+            if (cur) {
+                dedup->cur = cur;
+                dedup->cap = count;
+            }
+        }
+        dedup->have_ref = false;
+        ret = jpeg_luma_dc(parser, jpeg, len, dedup->cur, dedup->cap, &cols, &rows);
+    }
+    if (ret != ESP_OK) {
+        // 算不出指纹的帧照常保存
+        dedup->have_ref = false;
+        return false;
+    }
+
+    size_t count = (size_t)cols * rows;
+    if (dedup->have_ref && cols == dedup->cols && rows == dedup->rows &&
+        dedup->repeats < dedup->config.max_repeat && similar(&dedup->config, dedup->ref, dedup->cur, count)) {
+        dedup->repeats++;
+        return true;
+    }
+
+    int16_t* tmp = dedup->ref;
+    dedup->ref = dedup->cur;
+    dedup->cur = tmp;
+    dedup->cols = cols;
+    dedup->rows = rows;
+    dedup->have_ref = true;
+    dedup->repeats = 0;
+    return false;
+}
+
+void frame_dedup_free(frame_dedup_t* dedup) {
+    free(dedup->ref);
+    free(dedup->cur);
+    dedup->ref = NULL;
+    dedup->cur = NULL;
+    dedup->cap = 0;
+    dedup->have_ref = false;
+}
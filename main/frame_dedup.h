@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "jpeg_crop.h"
+
+// 静止画面去重：用每个MCU的亮度DC作为帧的指纹(QVGA为20x30)，与上一个保存的帧比较，
+// 差别在传感器噪声范围内时不保存这一帧，只在索引中记一条重复记录
+
+typedef struct {
+    float mean_threshold;           // 所有MCU的DC平均差(量化步长)不超过此值才算重复
+    uint16_t max_threshold;         // 任一MCU的差超过此值即算变化，避免漏掉小范围的运动
+    uint32_t max_repeat;            // 最多连续重复的帧数，之后强制保存一帧
+} frame_dedup_config_t;
+
+#define FRAME_DEDUP_CONFIG_DEFAULT() { \
+    .mean_threshold = 0.5f, \
+    .max_threshold = 6, \
+    .max_repeat = 300, \
+}
+
+typedef struct {
+    frame_dedup_config_t config;
+    int16_t* ref;                   // 上一个保存的帧的指纹
+    int16_t* cur;
+    size_t cap;                     // ref 和 cur 的元素个数
+    uint16_t cols;
+    uint16_t rows;
+    bool have_ref;
+    uint32_t repeats;               // 当前连续重复的帧数
+} frame_dedup_t;
+
+/**
+ * @brief 初始化去重状态
+ * @param dedup 去重状态
+ * @param config 阈值配置
+ */
+void frame_dedup_init(frame_dedup_t* dedup, const frame_dedup_config_t* config);
+
+/**
+ * @brief 丢弃参考帧，每个文件开始时调用
+ * @param dedup 去重状态
+ */
+void frame_dedup_reset(frame_dedup_t* dedup);
+
+/**
+ * @brief 判断一帧是否与上一个保存的帧基本相同；不同时这一帧成为新的参考帧
+ * @param dedup 去重状态
+ * @param parser 解析帧头用的上下文，见 jpeg_parser_create
+ * @param jpeg 完整的JPEG帧
+ * @param len 帧长度
+ * @return true 可以不保存这一帧
+ */
+bool frame_dedup_is_repeat(frame_dedup_t* dedup, jpeg_parser_t* parser, const uint8_t* jpeg, size_t len);
+
+/**
+ * @brief 释放指纹缓冲
+ * @param dedup 去重状态
+ */
+void frame_dedup_free(frame_dedup_t* dedup);
@@ -1,25 +1,82 @@
 #include <string.h>
+#include <inttypes.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
 #include <dirent.h>
 #include <errno.h>
 #include "esp_vfs.h"
 #include "esp_vfs_fat.h"
+#include "diskio_impl.h"
 #include "sdmmc_cmd.h"
 #include "driver/sdmmc_host.h"
 #include "driver/sdspi_host.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "mbedtls/sha256.h"
 #include "sdcard_hal.h"
+#include "sdcard_diskio.h"
 #include "fs_hal.h"
 
 static const char* TAG = "fs_hal";
 static char s_mount_point[ESP_VFS_PATH_MAX] = { 0 };
 static bool s_is_mounted = false;
 static sdcard_t* s_card = NULL;
+static uint8_t s_pdrv = FF_DRV_NOT_USED;  // FatFs驱动器号
+static char s_drv[3] = { 0 };              // FatFs驱动器路径，例如 "0:"
+static FATFS* s_fs = NULL;                 // 在VFS中注册的FatFs对象
+static fs_format_t s_format = FS_FORMAT_AUTO;
+static size_t s_allocation_unit_size = 0;
 
 // 设置合适的路径长度，FAT文件系统支持更长的路径
 #define FS_MAX_PATH_LEN 256
 
+// FAT32格式化时默认的簇大小
+#define FS_ALLOCATION_UNIT_SIZE (16 * 1024)
+// exFAT格式化时默认的簇大小，簇越大，连续写入时访问分配位图的次数越少
+#define FS_EXFAT_ALLOCATION_UNIT_SIZE (128 * 1024)
+// FS_FORMAT_AUTO 时超过该容量的卡(SDXC)格式化为exFAT
+#define FS_EXFAT_MIN_CAPACITY (32ULL * 1024 * 1024 * 1024)
+// FAT32下单个文件的最大长度
+#define FS_FAT32_MAX_FILE_SIZE 0xFFFFFFFFULL
+
+// 快速定位(CLMT)：只对不小于该大小的只读文件建立
+#define FS_FASTSEEK_MIN_FILE_SIZE (1024 * 1024)
+// 单个文件CLMT的上限，每个连续片段占8字节
+#define FS_FASTSEEK_MAX_TABLE (16 * 1024)
+// 所有打开文件的CLMT总和上限
+#define FS_FASTSEEK_BUDGET (64 * 1024)
+
+// 写卡、暂存和目录任务都会打开文件，预算的检查和增减都在锁内完成
+static size_t s_clmt_bytes = 0;
+static portMUX_TYPE s_clmt_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// 用 fs_open 打开、还没关闭的文件数；格式化期间不能打开文件
+static uint32_t s_open_files = 0;
+static bool s_formatting = false;
+static portMUX_TYPE s_open_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// 校验时每次读取的块大小，读取位置按它对齐后 FatFs 直接多块读入缓冲区
+#define FS_CHECKSUM_CHUNK (32 * 1024)
+#define FS_CHECKSUM_MIN_CHUNK (4 * 1024)
+// 双缓冲：一块在读，一块在算
+#define FS_CHECKSUM_BUFFERS 2
+
+// 文件句柄结构体
+struct fs_file_s {
+    FIL fil;
+    DWORD* clmt;        // 快速定位用的簇链映射表，放在PSRAM
+    size_t clmt_bytes;
+    bool preallocated;  // 是否用 fs_preallocate 预分配过，此时 f_size 是预分配的长度
+    FSIZE_t data_end;   // 预分配文件中实际写入数据的末尾
+    uint8_t* tail;      // 预分配文件中还不够一个扇区、尚未交给 FatFs 的数据
+    UINT tail_len;
+};
+
 // 目录迭代器结构体
 struct fs_dir_iterator_s {
     DIR* dir;
@@ -72,6 +129,114 @@ static esp_err_t build_full_path(char* full_path, size_t max_len, const char* ba
     return ESP_OK;
 }
 
+// 按 s_format 格式化驱动器，调用前驱动器必须已卸载
+static esp_err_t format_volume(void) {
+    fs_format_t format = s_format;
+    if (format == FS_FORMAT_AUTO) {
+        uint64_t capacity = (uint64_t)s_card->sectors * SDCARD_BLOCK_SIZE;
+        format = (FF_FS_EXFAT && capacity > FS_EXFAT_MIN_CAPACITY) ? FS_FORMAT_EXFAT : FS_FORMAT_FAT32;
+    }
+
+    BYTE fmt;
+    size_t au_size = s_allocation_unit_size;
+#if !FF_FS_EXFAT
+    // 官方 ESP-IDF 的 ffconf.h 固定 FF_FS_EXFAT 为0，格式化成exFAT之后也无法挂载
+    if (format == FS_FORMAT_EXFAT) {
+        ESP_LOGW(TAG, "FatFs is built without exFAT support, formatting as FAT32");
+        format = FS_FORMAT_FAT32;
+        if (au_size > FS_ALLOCATION_UNIT_SIZE) {
+            au_size = 0;
+        }
+    }
+#endif
+    if (format == FS_FORMAT_EXFAT) {
+        fmt = FM_EXFAT;
+        au_size = au_size ? au_size : FS_EXFAT_ALLOCATION_UNIT_SIZE;
+    } else {
+        // 容量太小放不下FAT32时由 f_mkfs 退回FAT16
+        fmt = FM_FAT | FM_FAT32;
+        au_size = au_size ? au_size : FS_ALLOCATION_UNIT_SIZE;
+    }
+
+    ESP_LOGI(TAG, "Formatting card as %s, allocation unit size: %u",
+             format == FS_FORMAT_EXFAT ? "exFAT" : "FAT32", (unsigned)au_size);
+
+    const size_t workbuf_size = 4096;
+    void* workbuf = ff_memalloc(workbuf_size);
+    if (workbuf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    const MKFS_PARM opt = { fmt, 2, 0, 0, au_size };
+    FRESULT res = f_mkfs(s_drv, &opt, workbuf, workbuf_size);
+    free(workbuf);
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "f_mkfs failed (%d)", res);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// 把SD卡注册为FatFs驱动器并挂载到VFS，必要时格式化
+static esp_err_t mount_volume(const fs_config_t* config) {
+    esp_err_t ret = sdcard_diskio_register(s_card, &s_pdrv);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register disk driver (%s)", esp_err_to_name(ret));
+        return ret;
+    }
+    s_drv[0] = (char)('0' + s_pdrv);
+    s_drv[1] = ':';
+    s_drv[2] = '\0';
+
+    FATFS* fs = NULL;
+    esp_vfs_fat_conf_t vfs_conf = {
+        .base_path = config->mount_point,
+        .fat_drive = s_drv,
+        .max_files = config->max_files,
+    };
+    ret = esp_vfs_fat_register_cfg(&vfs_conf, &fs);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register FATFS in VFS (%s)", esp_err_to_name(ret));
+        sdcard_diskio_unregister(s_pdrv);
+        return ret;
+    }
+
+    FRESULT res = f_mount(fs, s_drv, 1);
+    if (res == FR_NO_FILESYSTEM && config->format_if_mount_failed) {
+        ESP_LOGW(TAG, "No filesystem found, formatting card");
+        res = format_volume() == ESP_OK ? f_mount(fs, s_drv, 1) : FR_MKFS_ABORTED;
+    }
+
+    if (res != FR_OK) {
+        if (res == FR_NO_FILESYSTEM) {
+            ESP_LOGE(TAG, "Failed to mount filesystem. If you want the card to be formatted, set format_if_mount_failed = true.");
+        } else {
+            ESP_LOGE(TAG, "Failed to mount filesystem (%d)", res);
+        }
+        f_mount(NULL, s_drv, 0);
+        esp_vfs_fat_unregister_path(config->mount_point);
+        sdcard_diskio_unregister(s_pdrv);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Mounted %s volume, cluster size: %u bytes",
+             fs->fs_type == FS_EXFAT ? "exFAT" : fs->fs_type == FS_FAT32 ? "FAT32" : "FAT12/16",
+             (unsigned)(fs->csize * SDCARD_BLOCK_SIZE));
+    // 扇区缓存中优先保留FAT、分配位图和根目录
+    sdcard_diskio_pin_metadata(s_pdrv, fs);
+    s_fs = fs;
+    return ESP_OK;
+}
+
+static esp_err_t unmount_volume(void) {
+    f_mount(NULL, s_drv, 0);
+    s_fs = NULL;
+    esp_err_t ret = esp_vfs_fat_unregister_path(s_mount_point);
+    sdcard_diskio_unregister(s_pdrv);
+    s_pdrv = FF_DRV_NOT_USED;
+    s_drv[0] = '\0';
+    return ret;
+}
+
 esp_err_t fs_init(const fs_config_t* config) {
     if (!config || !config->mount_point) {
         return ESP_ERR_INVALID_ARG;
@@ -82,8 +247,10 @@ esp_err_t fs_init(const fs_config_t* config) {
         return ESP_ERR_INVALID_STATE;
     }
 
-    // 保存挂载点
+    // 保存挂载点和格式化参数
     strlcpy(s_mount_point, config->mount_point, sizeof(s_mount_point));
+    s_format = config->format;
+    s_allocation_unit_size = config->allocation_unit_size;
 
     ESP_LOGI(TAG, "Initializing SD card");
     ESP_LOGI(TAG, "MOSI: %d, MISO: %d, SCK: %d, CS: %d", 
@@ -108,39 +275,18 @@ esp_err_t fs_init(const fs_config_t* config) {
 
     ESP_LOGI(TAG, "Initializing filesystem at %s", config->mount_point);
 
-    // 挂载配置
-    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-        .format_if_mount_failed = config->format_if_mount_failed,
-        .max_files = config->max_files,
-        .allocation_unit_size = 16 * 1024,  // 16KB clusters
-        .disk_status_check_enable = true    // 启用磁盘状态检查
-    };
-
     ESP_LOGI(TAG, "Mounting filesystem with following config:");
     ESP_LOGI(TAG, "- Mount point: %s", config->mount_point);
-    ESP_LOGI(TAG, "- Max files: %d", mount_config.max_files);
-    ESP_LOGI(TAG, "- Format if mount failed: %d", mount_config.format_if_mount_failed);
-    ESP_LOGI(TAG, "- Allocation unit size: %d", mount_config.allocation_unit_size);
-
-    // 准备SDMMC主机配置
-    sdmmc_host_t host = SDSPI_HOST_DEFAULT();
-    host.slot = s_card->spi;
-    host.max_freq_khz = s_card->sdcard->max_freq_khz;
-
-    // 准备SDSPI设备配置
-    sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
-    slot_config.gpio_cs = s_card->pin_cs;
-    slot_config.host_id = s_card->host;
-
-    // 挂载文件系统
-    ret = esp_vfs_fat_sdspi_mount(config->mount_point, &host, &slot_config, &mount_config, &s_card->sdcard);
+    ESP_LOGI(TAG, "- Max files: %d", config->max_files);
+    ESP_LOGI(TAG, "- Format if mount failed: %d", config->format_if_mount_failed);
+    ESP_LOGI(TAG, "- Format: %d, allocation unit size: %d (0: default)",
+             config->format, (int)config->allocation_unit_size);
+
+    // 挂载文件系统，FatFs的扇区读写经由 sdcard_hal
+    ret = mount_volume(config);
     if (ret != ESP_OK) {
-        if (ret == ESP_FAIL) {
-            ESP_LOGE(TAG, "Failed to mount filesystem. If you want the card to be formatted, set format_if_mount_failed = true.");
-        } else {
-            ESP_LOGE(TAG, "Failed to initialize the card (%s)", esp_err_to_name(ret));
-        }
         sdcard_deinit(s_card);
+        s_card = NULL;
         s_mount_point[0] = '\0';
         return ret;
     }
@@ -153,7 +299,7 @@ esp_err_t fs_init(const fs_config_t* config) {
         if (mkdir(config->mount_point, 0777) != 0) {
             ESP_LOGE(TAG, "Failed to create mount point directory: %s (errno: %d, %s)", 
                     config->mount_point, errno, strerror(errno));
-            esp_vfs_fat_sdcard_unmount(config->mount_point, s_card->sdcard);
+            unmount_volume();
             sdcard_deinit(s_card);
             s_mount_point[0] = '\0';
             return ESP_FAIL;
@@ -175,7 +321,7 @@ esp_err_t fs_init(const fs_config_t* config) {
         ESP_LOGI(TAG, "Test file already exists, attempting to delete");
         if (unlink(test_path) != 0) {
             ESP_LOGE(TAG, "Failed to delete existing test file (errno: %d, %s)", errno, strerror(errno));
-            esp_vfs_fat_sdcard_unmount(config->mount_point, s_card->sdcard);
+            unmount_volume();
             sdcard_deinit(s_card);
             s_mount_point[0] = '\0';
             return ESP_FAIL;
@@ -200,7 +346,7 @@ esp_err_t fs_init(const fs_config_t* config) {
         } else {
             ESP_LOGE(TAG, "Failed to open directory (errno: %d, %s)", errno, strerror(errno));
         }
-        esp_vfs_fat_sdcard_unmount(config->mount_point, s_card->sdcard);
+        unmount_volume();
         sdcard_deinit(s_card);
         s_mount_point[0] = '\0';
         return ESP_FAIL;
@@ -211,7 +357,7 @@ esp_err_t fs_init(const fs_config_t* config) {
         ESP_LOGE(TAG, "Failed to write to test file (errno: %d, %s)", errno, strerror(errno));
         fclose(fp);
         unlink(test_path);
-        esp_vfs_fat_sdcard_unmount(config->mount_point, s_card->sdcard);
+        unmount_volume();
         sdcard_deinit(s_card);
         s_mount_point[0] = '\0';
         return ESP_FAIL;
@@ -224,7 +370,7 @@ esp_err_t fs_init(const fs_config_t* config) {
     ESP_LOGI(TAG, "Verifying file creation...");
     if (stat(test_path, &st) != 0) {
         ESP_LOGE(TAG, "File does not exist after creation (errno: %d, %s)", errno, strerror(errno));
-        esp_vfs_fat_sdcard_unmount(config->mount_point, s_card->sdcard);
+        unmount_volume();
         sdcard_deinit(s_card);
         s_mount_point[0] = '\0';
         return ESP_FAIL;
@@ -245,7 +391,7 @@ esp_err_t fs_deinit(void) {
     }
 
     // 卸载文件系统
-    esp_err_t ret = esp_vfs_fat_sdcard_unmount(s_mount_point, s_card->sdcard);
+    esp_err_t ret = unmount_volume();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to unmount filesystem");
         return ret;
@@ -258,6 +404,55 @@ esp_err_t fs_deinit(void) {
     return ESP_OK;
 }
 
+esp_err_t fs_format(void) {
+    if (!s_is_mounted) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // 打开的文件在卸载后失效，关闭时会写坏新的文件系统
+    taskENTER_CRITICAL(&s_open_lock);
+    uint32_t open_files = s_open_files;
+    s_formatting = open_files == 0;
+    taskEXIT_CRITICAL(&s_open_lock);
+    if (open_files > 0) {
+        ESP_LOGE(TAG, "Not formatting, %"PRIu32" files still open", open_files);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // VFS的注册保持不变，只在FatFs层卸载、格式化后重新挂载
+    f_mount(NULL, s_drv, 0);
+    esp_err_t ret = format_volume();
+    FRESULT res = f_mount(s_fs, s_drv, 1);
+    taskENTER_CRITICAL(&s_open_lock);
+    s_formatting = false;
+    taskEXIT_CRITICAL(&s_open_lock);
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "Failed to remount after format (%d)", res);
+        return ret != ESP_OK ? ret : ESP_FAIL;
+    }
+    sdcard_diskio_pin_metadata(s_pdrv, s_fs);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Format done, cluster size: %u bytes", (unsigned)(s_fs->csize * SDCARD_BLOCK_SIZE));
+    }
+    return ret;
+}
+
+uint64_t fs_max_file_size(void) {
+    if (!s_is_mounted) {
+        return 0;
+    }
+#if FF_FS_EXFAT
+    if (s_fs->fs_type == FS_EXFAT) {
+        return UINT64_MAX;
+    }
+#endif
+    return FS_FAT32_MAX_FILE_SIZE;
+}
+
+sdcard_t* fs_get_card(void) {
+    return s_is_mounted ? s_card : NULL;
+}
+
 esp_err_t fs_get_info(fs_info_t* info) {
     if (!info || !s_is_mounted) {
         return ESP_ERR_INVALID_STATE;
@@ -265,15 +460,17 @@ esp_err_t fs_get_info(fs_info_t* info) {
 
     FATFS *fs;
     DWORD free_clusters;  // 修改为DWORD类型
-    int res = f_getfree("0:", &free_clusters, &fs);
+    int res = f_getfree(s_drv, &free_clusters, &fs);
     if (res != FR_OK) {
         ESP_LOGE(TAG, "Failed to get filesystem info (%d)", res);
         return ESP_FAIL;
     }
 
-    info->total_bytes = ((uint64_t)fs->n_fatent - 2) * fs->csize * 512;
-    info->free_bytes = free_clusters * fs->csize * 512;
+    info->cluster_size = fs->csize * SDCARD_BLOCK_SIZE;
+    info->total_bytes = ((uint64_t)fs->n_fatent - 2) * info->cluster_size;
+    info->free_bytes = (uint64_t)free_clusters * info->cluster_size;
     info->used_bytes = info->total_bytes - info->free_bytes;
+    info->is_exfat = fs->fs_type == FS_EXFAT;
 
     return ESP_OK;
 }
@@ -659,66 +856,538 @@ bool fs_has_space(uint64_t required_size) {
     return info.free_bytes >= required_size;
 }
 
+static void release_clmt_budget(size_t bytes) {
+    taskENTER_CRITICAL(&s_clmt_lock);
+    s_clmt_bytes -= bytes;
+    taskEXIT_CRITICAL(&s_clmt_lock);
+}
+
+// 只读打开的大文件建立簇链映射表(CLMT)，之后的 f_lseek 不再遍历FAT链
+static void enable_fast_seek(struct fs_file_s* file) {
+#if FF_USE_FASTSEEK
+    if (f_size(&file->fil) < FS_FASTSEEK_MIN_FILE_SIZE) {
+        return;
+    }
+
+    // 先用一个很小的表探测需要的长度，不够时 FatFs 会在 tbl[0] 中返回所需的项数
+    DWORD probe[4] = { 4 };
+    file->fil.cltbl = probe;
+    FRESULT res = f_lseek(&file->fil, CREATE_LINKMAP);
+    file->fil.cltbl = NULL;
+    if (res != FR_OK && res != FR_NOT_ENOUGH_CORE) {
+        ESP_LOGW(TAG, "Fast seek probe failed (%d)", res);
+        return;
+    }
+
+    size_t bytes = probe[0] * sizeof(DWORD);
+    size_t in_use;
+    bool fits = bytes <= FS_FASTSEEK_MAX_TABLE;
+    taskENTER_CRITICAL(&s_clmt_lock);
+    in_use = s_clmt_bytes;
+    fits = fits && in_use + bytes <= FS_FASTSEEK_BUDGET;
+    if (fits) {
+        // 先占用预算，失败时归还
+        s_clmt_bytes += bytes;
+    }
+    taskEXIT_CRITICAL(&s_clmt_lock);
+    if (!fits) {
+        ESP_LOGW(TAG, "File too fragmented for fast seek (%u bytes of CLMT, %u in use)",
+                 (unsigned)bytes, (unsigned)in_use);
+        return;
+    }
+
+    DWORD* clmt = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!clmt) {
+        clmt = malloc(bytes);
+    }
+    if (!clmt) {
+        release_clmt_budget(bytes);
+        return;
+    }
+
+    clmt[0] = probe[0];
+    file->fil.cltbl = clmt;
+    res = f_lseek(&file->fil, CREATE_LINKMAP);
+    if (res != FR_OK) {
+        ESP_LOGW(TAG, "Failed to build fast seek table (%d)", res);
+        file->fil.cltbl = NULL;
+        free(clmt);
+        release_clmt_budget(bytes);
+        return;
+    }
+
+    file->clmt = clmt;
+    file->clmt_bytes = bytes;
+    ESP_LOGD(TAG, "Fast seek enabled, %u fragments", (unsigned)(probe[0] / 2 - 1));
+#endif
+}
+
+// 预分配的文件长度大于写入位置，FatFs 写不满一个扇区时会先把该扇区读出来。
+// 写入位置在扇区边界上时，把不足一个扇区的尾部留到下次写入凑成整扇区，
+// 交给 FatFs 的总是整扇区，直接写卡，不需要先读
+static FRESULT write_whole_sectors(struct fs_file_s* file, const uint8_t* buf, size_t size, UINT* written) {
+    UINT bw;
+    *written = 0;
+    if (file->tail_len > 0) {
+        size_t n = SDCARD_BLOCK_SIZE - file->tail_len;
+        n = size < n ? size : n;
+        memcpy(file->tail + file->tail_len, buf, n);
+        file->tail_len += n;
+        *written += n;
+        if (file->tail_len < SDCARD_BLOCK_SIZE) {
+            return FR_OK;
+        }
+        FRESULT res = f_write(&file->fil, file->tail, SDCARD_BLOCK_SIZE, &bw);
+        if (res != FR_OK || bw != SDCARD_BLOCK_SIZE) {
+            // 尾部数据没有写出去，不计入已写入的字节
+            *written -= n;
+            file->tail_len -= n;
+            return res != FR_OK ? res : FR_DENIED;
+        }
+        file->tail_len = 0;
+    }
+
+    size_t whole = (size - *written) & ~(size_t)(SDCARD_BLOCK_SIZE - 1);
+    if (whole > 0) {
+        FRESULT res = f_write(&file->fil, buf + *written, whole, &bw);
+        *written += bw;
+        if (res != FR_OK || bw != whole) {
+            return res != FR_OK ? res : FR_DENIED;
+        }
+    }
+
+    file->tail_len = size - *written;
+    memcpy(file->tail, buf + *written, file->tail_len);
+    *written = size;
+    return FR_OK;
+}
+
+// 把攒下的尾部写入 FatFs，在定位和关闭前调用
+static FRESULT flush_tail(struct fs_file_s* file) {
+    if (file->tail_len == 0) {
+        return FR_OK;
+    }
+    UINT bw;
+    FRESULT res = f_write(&file->fil, file->tail, file->tail_len, &bw);
+    if (res == FR_OK && bw != file->tail_len) {
+        res = FR_DENIED;
+    }
+    file->tail_len = 0;
+    return res;
+}
+
 fs_file_t fs_open(const char* path, fs_mode_t mode) {
     if (!path || !s_is_mounted) {
         return NULL;
     }
 
-    // 构建完整路径
+    // 直接用 FatFs 打开，便于使用快速定位等 VFS 没有暴露的功能
     char full_path[FS_MAX_PATH_LEN];
-    esp_err_t ret = build_full_path(full_path, sizeof(full_path), s_mount_point, path);
+    esp_err_t ret = build_full_path(full_path, sizeof(full_path), s_drv, path);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to build full path for %s", path);
         return NULL;
     }
 
-    const char* mode_str;
+    BYTE fa_mode;
     switch (mode) {
         case FS_FILE_READ:
-            mode_str = "rb";
+            fa_mode = FA_READ | FA_OPEN_EXISTING;
             break;
         case FS_FILE_WRITE:
-            mode_str = "wb";
+            fa_mode = FA_WRITE | FA_CREATE_ALWAYS;
             break;
         case FS_FILE_APPEND:
-            mode_str = "ab";
+            fa_mode = FA_WRITE | FA_OPEN_APPEND;
             break;
         default:
             ESP_LOGE(TAG, "Invalid file mode: %d", mode);
             return NULL;
     }
 
-    ESP_LOGI(TAG, "Opening file: %s (mode: %s)", full_path, mode_str);
-    FILE* fp = fopen(full_path, mode_str);
-    if (!fp) {
-        ESP_LOGE(TAG, "Failed to open file %s (mode: %s, errno: %d, %s)", 
-                full_path, mode_str, errno, strerror(errno));
+    struct fs_file_s* file = calloc(1, sizeof(struct fs_file_s));
+    if (!file) {
+        return NULL;
+    }
+
+    taskENTER_CRITICAL(&s_open_lock);
+    bool formatting = s_formatting;
+    if (!formatting) {
+        s_open_files++;
+    }
+    taskEXIT_CRITICAL(&s_open_lock);
+    if (formatting) {
+        ESP_LOGE(TAG, "Cannot open %s while formatting", full_path);
+        free(file);
+        return NULL;
+    }
+
+    ESP_LOGI(TAG, "Opening file: %s (mode: 0x%02x)", full_path, fa_mode);
+    FRESULT res = f_open(&file->fil, full_path, fa_mode);
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "Failed to open file %s (mode: 0x%02x, FRESULT: %d)", full_path, fa_mode, res);
+        taskENTER_CRITICAL(&s_open_lock);
+        s_open_files--;
+        taskEXIT_CRITICAL(&s_open_lock);
+        free(file);
+        return NULL;
+    }
+
+    if (mode == FS_FILE_READ) {
+        enable_fast_seek(file);
     }
-    return (fs_file_t)fp;
+    return file;
 }
 
 esp_err_t fs_close(fs_file_t file) {
     if (!file) {
         return ESP_ERR_INVALID_ARG;
     }
-    FILE* fp = (FILE*)file;
-    if (fclose(fp) != 0) {
-        ESP_LOGE(TAG, "Failed to close file (errno: %d, %s)", errno, strerror(errno));
+    FRESULT res = flush_tail(file);
+    if (res == FR_OK && file->preallocated && file->data_end < f_size(&file->fil)) {
+        // 释放预分配但没有写入的部分，文件长度回到实际写入的数据末尾
+        res = f_lseek(&file->fil, file->data_end);
+        if (res == FR_OK) {
+            res = f_truncate(&file->fil);
+        }
+        if (res != FR_OK) {
+            ESP_LOGE(TAG, "Failed to release preallocated space (FRESULT: %d)", res);
+        }
+    }
+    FRESULT close_res = f_close(&file->fil);
+    res = res != FR_OK ? res : close_res;
+    if (file->clmt) {
+        free(file->clmt);
+        release_clmt_budget(file->clmt_bytes);
+    }
+    free(file->tail);
+    free(file);
+    taskENTER_CRITICAL(&s_open_lock);
+    s_open_files--;
+    taskEXIT_CRITICAL(&s_open_lock);
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "Failed to close file (FRESULT: %d)", res);
         return ESP_FAIL;
     }
     return ESP_OK;
 }
 
+int fs_read(fs_file_t file, void* buf, size_t size) {
+    if (!file || !buf) {
+        return -1;
+    }
+    UINT read = 0;
+    FRESULT res = f_read(&file->fil, buf, size, &read);
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "Failed to read data (FRESULT: %d)", res);
+        return -1;
+    }
+    return (int)read;
+}
+
 int fs_write(fs_file_t file, const void* buf, size_t size) {
     if (!file || !buf || size == 0) {
         return -1;
     }
-    FILE* fp = (FILE*)file;
-    size_t written = fwrite(buf, 1, size, fp);
-    if (written != size) {
-        ESP_LOGE(TAG, "Failed to write data: written %d of %d bytes (errno: %d, %s)", 
-                written, size, errno, strerror(errno));
+#if FF_FS_EXFAT
+    if (file->fil.obj.fs->fs_type != FS_EXFAT)
+#endif
+    {
+        // FAT32下 f_write 会把超出4GB的部分静默截断
+        if ((uint64_t)f_tell(&file->fil) + file->tail_len + size > FS_FAT32_MAX_FILE_SIZE) {
+            ESP_LOGE(TAG, "File would exceed the FAT32 4GB limit, format the card as exFAT");
+            return -1;
+        }
+    }
+
+    UINT written = 0;
+    FRESULT res;
+    if (file->tail && (file->tail_len > 0 || f_tell(&file->fil) % SDCARD_BLOCK_SIZE == 0)) {
+        res = write_whole_sectors(file, buf, size, &written);
+    } else {
+        res = f_write(&file->fil, buf, size, &written);
+    }
+    if (file->preallocated && f_tell(&file->fil) + file->tail_len > file->data_end) {
+        file->data_end = f_tell(&file->fil) + file->tail_len;
+    }
+    if (res != FR_OK || written != size) {
+        ESP_LOGE(TAG, "Failed to write data: written %u of %u bytes (FRESULT: %d)",
+                 (unsigned)written, (unsigned)size, res);
         return -1;
     }
     return (int)written;
 }
+
+esp_err_t fs_sync(fs_file_t file) {
+    if (!file) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // 尾部留到凑满一个扇区再写，这里写出去之后的写入又要先读扇区
+    FRESULT res = f_sync(&file->fil);
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "Failed to sync file (FRESULT: %d)", res);
+        return ESP_FAIL;
+    }
+    // 缓存中的元数据已经写回，固定范围移到当前的分配位置
+    sdcard_diskio_pin_metadata(s_pdrv, s_fs);
+    return ESP_OK;
+}
+
+esp_err_t fs_preallocate(fs_file_t file, uint64_t size) {
+    if (!file || size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!(file->fil.flag & FA_WRITE) || f_size(&file->fil) != 0) {
+        ESP_LOGE(TAG, "Only empty files opened for writing can be preallocated");
+        return ESP_ERR_INVALID_STATE;
+    }
+#if !FF_FS_EXFAT
+    if (size > FS_FAT32_MAX_FILE_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+#endif
+
+    // opt=1 立即分配。exFAT下连续的文件不使用FAT链，只更新分配位图
+    FRESULT res = f_expand(&file->fil, (FSIZE_t)size, 1);
+    if (res == FR_DENIED) {
+        ESP_LOGW(TAG, "No contiguous free space of %llu bytes", (unsigned long long)size);
+        return ESP_ERR_NO_MEM;
+    }
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "Failed to preallocate file (FRESULT: %d)", res);
+        return ESP_FAIL;
+    }
+
+    // 尾部缓冲只有一个扇区，分配失败时退回直接写入
+    if (!file->tail) {
+        file->tail = malloc(SDCARD_BLOCK_SIZE);
+    }
+    file->preallocated = true;
+    file->data_end = 0;
+    return ESP_OK;
+}
+
+// 文件的逻辑长度，预分配的文件只算到实际写入的位置
+static FSIZE_t data_size(const struct fs_file_s* file) {
+    return file->preallocated ? file->data_end : f_size(&file->fil);
+}
+
+esp_err_t fs_seek(fs_file_t file, int64_t offset, fs_seek_mode_t mode) {
+    if (!file) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (flush_tail(file) != FR_OK) {
+        ESP_LOGE(TAG, "Failed to write buffered data before seek");
+        return ESP_FAIL;
+    }
+
+    FSIZE_t base;
+    switch (mode) {
+        case FS_SEEK_SET:
+            base = 0;
+            break;
+        case FS_SEEK_CUR:
+            base = f_tell(&file->fil);
+            break;
+        case FS_SEEK_END:
+            base = data_size(file);
+            break;
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+    if (offset < 0 && (uint64_t)(-offset) > base) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset > 0 && (uint64_t)offset > (FSIZE_t)-1 - base) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // 有CLMT时定位只查表，不访问FAT
+    FRESULT res = f_lseek(&file->fil, base + offset);
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "Failed to seek (FRESULT: %d)", res);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int64_t fs_position(fs_file_t file) {
+    if (!file) {
+        return -1;
+    }
+    return (int64_t)(f_tell(&file->fil) + file->tail_len);
+}
+
+int64_t fs_size(fs_file_t file) {
+    if (!file) {
+        return -1;
+    }
+    return (int64_t)data_size(file);
+}
+
+typedef struct {
+    uint8_t* buf;
+    size_t len;         // 0 表示结束
+} checksum_chunk_t;
+
+typedef struct {
+    fs_checksum_type_t type;
+    uint32_t crc;
+    mbedtls_sha256_context sha;
+    QueueHandle_t full;     // 已读入、等待计算的块
+    QueueHandle_t empty;    // 计算完、可以继续读入的块
+    TaskHandle_t caller;
+} checksum_job_t;
+
+// 计算任务：和读取并行，SHA-256 由外设完成
+static void checksum_task(void* arg) {
+    checksum_job_t* job = arg;
+    checksum_chunk_t chunk;
+    while (xQueueReceive(job->full, &chunk, portMAX_DELAY) == pdTRUE && chunk.len > 0) {
+        if (job->type == FS_CHECKSUM_CRC32) {
+            job->crc = esp_rom_crc32_le(job->crc, chunk.buf, chunk.len);
+        } else {
+            mbedtls_sha256_update(&job->sha, chunk.buf, chunk.len);
+        }
+        xQueueSend(job->empty, &chunk, portMAX_DELAY);
+    }
+    xTaskNotifyGive(job->caller);
+    vTaskDelete(NULL);
+}
+
+esp_err_t fs_checksum(const char* path, uint64_t offset, uint64_t length,
+                      fs_checksum_type_t type, fs_checksum_result_t* out) {
+    if (!path || !out || (type != FS_CHECKSUM_CRC32 && type != FS_CHECKSUM_SHA256)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_is_mounted) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    fs_file_t file = fs_open(path, FS_FILE_READ);
+    if (!file) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    int64_t size = fs_size(file);
+    if (offset > (uint64_t)size || (length > 0 && length > (uint64_t)size - offset)) {
+        fs_close(file);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (length == 0) {
+        length = (uint64_t)size - offset;
+    }
+
+    memset(out, 0, sizeof(*out));
+    esp_err_t ret = ESP_OK;
+    int64_t start_us = esp_timer_get_time();
+    uint64_t remaining = length;
+    checksum_job_t job = {
+        .type = type,
+        .caller = xTaskGetCurrentTaskHandle(),
+    };
+    uint8_t* bufs[FS_CHECKSUM_BUFFERS] = { 0 };
+    bool task_started = false;
+
+    // 缓冲区放在可DMA的内部RAM，SD卡读和SHA外设都不需要再经过中转
+    size_t chunk_size = FS_CHECKSUM_CHUNK;
+    while (1) {
+        for (int i = 0; i < FS_CHECKSUM_BUFFERS; i++) {
+            bufs[i] = heap_caps_aligned_alloc(4, chunk_size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        }
+        if (bufs[FS_CHECKSUM_BUFFERS - 1] && bufs[0]) {
+            break;
+        }
+        for (int i = 0; i < FS_CHECKSUM_BUFFERS; i++) {
+            heap_caps_free(bufs[i]);
+            bufs[i] = NULL;
+        }
+        if (chunk_size <= FS_CHECKSUM_MIN_CHUNK) {
+            ret = ESP_ERR_NO_MEM;
+            goto cleanup;
+        }
+        chunk_size /= 2;
+    }
+
+    job.full = xQueueCreate(FS_CHECKSUM_BUFFERS + 1, sizeof(checksum_chunk_t));
+    job.empty = xQueueCreate(FS_CHECKSUM_BUFFERS, sizeof(checksum_chunk_t));
+    if (!job.full || !job.empty) {
+        ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+    for (int i = 0; i < FS_CHECKSUM_BUFFERS; i++) {
+        checksum_chunk_t chunk = { .buf = bufs[i], .len = 0 };
+        xQueueSend(job.empty, &chunk, 0);
+    }
+
+    if (type == FS_CHECKSUM_SHA256) {
+        mbedtls_sha256_init(&job.sha);
+        mbedtls_sha256_starts(&job.sha, 0);
+    }
+    if (xTaskCreate(checksum_task, "fs_checksum", 3072, &job, uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+        ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+    task_started = true;
+
+    if (fs_seek(file, (int64_t)offset, FS_SEEK_SET) != ESP_OK) {
+        ret = ESP_FAIL;
+        goto cleanup;
+    }
+
+    while (remaining > 0) {
+        checksum_chunk_t chunk;
+        xQueueReceive(job.empty, &chunk, portMAX_DELAY);
+
+        // 第一块只读到下一个块边界，之后每次读取都是对齐的整块
+        size_t want = chunk_size - (size_t)((offset + length - remaining) % chunk_size);
+        if (want > remaining) {
+            want = (size_t)remaining;
+        }
+        int n = fs_read(file, chunk.buf, want);
+        if (n != (int)want) {
+            ESP_LOGE(TAG, "Checksum read failed at offset %llu",
+                     (unsigned long long)(offset + length - remaining));
+            ret = ESP_FAIL;
+            break;
+        }
+        chunk.len = want;
+        xQueueSend(job.full, &chunk, portMAX_DELAY);
+        remaining -= want;
+    }
+
+cleanup:
+    if (task_started) {
+        // 发送结束标记，等计算任务处理完已排队的块
+        checksum_chunk_t end = { .buf = NULL, .len = 0 };
+        xQueueSend(job.full, &end, portMAX_DELAY);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    out->bytes = length - remaining;
+    out->elapsed_us = esp_timer_get_time() - start_us;
+    if (ret == ESP_OK) {
+        if (type == FS_CHECKSUM_CRC32) {
+            out->digest[0] = job.crc >> 24;
+            out->digest[1] = job.crc >> 16;
+            out->digest[2] = job.crc >> 8;
+            out->digest[3] = job.crc;
+            out->digest_len = 4;
+        } else {
+            mbedtls_sha256_finish(&job.sha, out->digest);
+            out->digest_len = 32;
+        }
+    }
+    if (type == FS_CHECKSUM_SHA256) {
+        mbedtls_sha256_free(&job.sha);
+    }
+    if (job.full) {
+        vQueueDelete(job.full);
+    }
+    if (job.empty) {
+        vQueueDelete(job.empty);
+    }
+    for (int i = 0; i < FS_CHECKSUM_BUFFERS; i++) {
+        heap_caps_free(bufs[i]);
+    }
+    fs_close(file);
+    return ret;
+}
@@ -5,11 +5,20 @@
 #include <stdio.h>
 #include "sdcard_hal.h"
 
+// 格式化时使用的文件系统类型
+typedef enum {
+    FS_FORMAT_AUTO = 0,     // 按容量选择：超过32GB且 FatFs 支持exFAT时用exFAT，否则FAT32
+    FS_FORMAT_FAT32,        // 单个文件最大4GB
+    FS_FORMAT_EXFAT,        // 单个文件不受4GB限制；FatFs 的 FF_FS_EXFAT 为0时退回FAT32
+} fs_format_t;
+
 // 文件系统配置
 typedef struct {
     const char* mount_point;     // 挂载点路径
     size_t max_files;           // 最大同时打开文件数
     bool format_if_mount_failed; // 挂载失败时是否格式化
+    fs_format_t format;         // 格式化时的文件系统类型
+    size_t allocation_unit_size; // 格式化时的簇大小，0表示按文件系统类型取默认值
     sdcard_config_t sdcard;     // SD卡配置
 } fs_config_t;
 
@@ -18,6 +27,8 @@ typedef struct {
     uint64_t total_bytes;      // 总容量
     uint64_t used_bytes;       // 已使用容量
     uint64_t free_bytes;       // 剩余容量
+    uint32_t cluster_size;     // 簇大小
+    bool is_exfat;             // 是否为exFAT
 } fs_info_t;
 
 // 文件信息
@@ -28,6 +39,22 @@ typedef struct {
     bool is_directory;       // 是否是目录
 } fs_file_info_t;
 
+// 校验算法
+typedef enum {
+    FS_CHECKSUM_CRC32 = 0,  // 与 zlib.crc32 一致
+    FS_CHECKSUM_SHA256,     // 由SHA外设计算，与 sha256sum 一致
+} fs_checksum_type_t;
+
+#define FS_CHECKSUM_MAX_LEN 32
+
+// 校验结果
+typedef struct {
+    uint8_t digest[FS_CHECKSUM_MAX_LEN]; // 摘要，CRC32按大端存放在前4字节
+    size_t digest_len;       // 摘要长度
+    uint64_t bytes;          // 实际校验的字节数
+    uint64_t elapsed_us;     // 耗时
+} fs_checksum_result_t;
+
 // 文件句柄
 typedef struct fs_file_s* fs_file_t;
 
@@ -64,6 +91,15 @@ esp_err_t fs_init(const fs_config_t* config);
  */
 esp_err_t fs_deinit(void);
 
+/**
+ * @brief 按 fs_init 时的 format 和 allocation_unit_size 重新格式化SD卡
+ *
+ * 卡上的所有数据都会丢失。还有用 fs_open 打开的文件时拒绝格式化，格式化期间 fs_open 失败。
+ *
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 未挂载或还有打开的文件
+ */
+esp_err_t fs_format(void);
+
 /**
  * @brief 获取文件系统信息
  * @param info 输出的文件系统信息
@@ -141,6 +177,29 @@ int fs_read(fs_file_t file, void* buf, size_t size);
  */
 int fs_write(fs_file_t file, const void* buf, size_t size);
 
+/**
+ * @brief 把文件的目录项、FAT和缓存中的元数据写到卡上
+ *
+ * 长时间写入的文件定期调用，掉电时只丢失上次同步之后的数据。
+ * 预分配文件中不足一个扇区的尾部仍留在内存中，目录项中的长度是预分配的长度。
+ *
+ * @param file 文件句柄
+ * @return ESP_OK 成功
+ */
+esp_err_t fs_sync(fs_file_t file);
+
+/**
+ * @brief 为以写模式打开的空文件预分配一段连续的簇
+ *
+ * 之后的写入落在预分配的范围内时不再分配簇：exFAT下只在预分配时更新一次
+ * 分配位图，FAT32下FAT链在预分配时一次写好。关闭文件时释放未写满的部分。
+ *
+ * @param file 文件句柄
+ * @param size 预分配的字节数
+ * @return ESP_OK 成功，ESP_ERR_NO_MEM 没有足够大的连续空间
+ */
+esp_err_t fs_preallocate(fs_file_t file, uint64_t size);
+
 /**
  * @brief 定位文件指针
  * @param file 文件句柄
@@ -148,21 +207,21 @@ int fs_write(fs_file_t file, const void* buf, size_t size);
  * @param mode 定位模式
  * @return ESP_OK 成功
  */
-esp_err_t fs_seek(fs_file_t file, long offset, fs_seek_mode_t mode);
+esp_err_t fs_seek(fs_file_t file, int64_t offset, fs_seek_mode_t mode);
 
 /**
  * @brief 获取文件指针位置
  * @param file 文件句柄
  * @return 当前位置，-1表示错误
  */
-long fs_position(fs_file_t file);
+int64_t fs_position(fs_file_t file);
 
 /**
  * @brief 获取文件大小
  * @param file 文件句柄
  * @return 文件大小，-1表示错误
  */
-long fs_size(fs_file_t file);
+int64_t fs_size(fs_file_t file);
 
 /**
  * @brief 打开目录
@@ -216,6 +275,18 @@ esp_err_t fs_closedir(fs_dir_iterator_t iterator);
  */
 esp_err_t fs_remove_recursive(const char* path);
 
+/**
+ * @brief 单个文件的最大长度，FAT32为4GB-1，exFAT不限制
+ * @return 字节数，exFAT时为 UINT64_MAX，未挂载时为0
+ */
+uint64_t fs_max_file_size(void);
+
+/**
+ * @brief 获取挂载的卡句柄，用于绕过文件系统的块级测试
+ * @return 卡句柄，未挂载时为NULL
+ */
+sdcard_t* fs_get_card(void);
+
 /**
  * @brief 检查剩余空间是否足够
  * @param required_size 需要的空间大小
@@ -230,3 +301,19 @@ bool fs_has_space(uint64_t required_size);
  * @return ESP_OK 成功
  */
 esp_err_t fs_get_file_size(const char* path, uint64_t* out_size);
+
+/**
+ * @brief 计算文件或其中一段的校验值
+ *
+ * 按扇区对齐的大块读取，读取下一块的同时由另一个任务计算上一块，
+ * 校验速度接近存储的读取速度。
+ *
+ * @param path 文件路径
+ * @param offset 起始偏移
+ * @param length 校验的字节数，0表示到文件末尾
+ * @param type 校验算法
+ * @param out 输出的校验结果
+ * @return ESP_OK 成功，ESP_ERR_INVALID_SIZE 范围超出文件
+ */
+esp_err_t fs_checksum(const char* path, uint64_t offset, uint64_t length,
+                      fs_checksum_type_t type, fs_checksum_result_t* out);
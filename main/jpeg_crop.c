@@ -0,0 +1,570 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "jpeg_crop.h"
+
+static const char* TAG = "jpeg_crop";
+
+#define JPEG_MARKER_SOF0    0xC0
+#define JPEG_MARKER_SOF1    0xC1
+#define JPEG_MARKER_DHT     0xC4
+#define JPEG_MARKER_SOI     0xD8
+#define JPEG_MARKER_EOI     0xD9
+#define JPEG_MARKER_SOS     0xDA
+#define JPEG_MARKER_DRI     0xDD
+
+#define MAX_COMPONENTS      3
+#define MAX_HUFF_TABLES     4
+#define LOOKAHEAD_BITS      8
+
+typedef struct {
+    int32_t maxcode[17];            // 按码长索引，-1表示没有这个长度的码
+    int32_t valoffset[17];
+    uint8_t huffval[256];
+    uint8_t lookup_len[1 << LOOKAHEAD_BITS];    // 码长不超过8位的码直接查表，0表示需要逐位比较
+    uint8_t lookup_sym[1 << LOOKAHEAD_BITS];
+    uint16_t ehufco[256];           // 输出时每个符号的码字
+    uint8_t ehufsi[256];            // 码长，0表示表中没有这个符号
+    bool defined;
+} huff_table_t;
+
+typedef struct {
+    uint8_t id;
+    uint8_t h;
+    uint8_t v;
+    uint8_t dc_table;
+    uint8_t ac_table;
+} component_t;
+
+struct jpeg_parser_s {
+    huff_table_t dc[MAX_HUFF_TABLES];
+    huff_table_t ac[MAX_HUFF_TABLES];
+    component_t comps[MAX_COMPONENTS];
+    int ncomps;
+    uint16_t width;
+    uint16_t height;
+    size_t sof;                     // SOF段的位置，输出时改写宽高
+    size_t dri;                     // DRI段的位置，0表示没有
+    size_t dri_len;
+    uint16_t restart_interval;
+    size_t sos;
+    size_t scan;                    // 熵编码数据的起始位置
+};
+typedef struct jpeg_parser_s jpeg_info_t;
+
+typedef struct {
+    const uint8_t* p;
+    const uint8_t* end;
+    uint32_t acc;
+    int bits;
+    bool marker;                    // 遇到了标记，之后补0
+} bit_reader_t;
+
+typedef struct {
+    uint8_t* p;
+    uint8_t* end;
+    uint32_t acc;
+    int bits;
+    bool overflow;
+} bit_writer_t;
+
+static bool build_huff_table(huff_table_t* t, const uint8_t* counts, const uint8_t* values, size_t nvalues) {
+    memset(t, 0, sizeof(*t));
+    uint32_t code = 0;
+    size_t k = 0;
+    for (int l = 1; l <= 16; l++) {
+        t->valoffset[l] = (int32_t)k - (int32_t)code;
+        for (int i = 0; i < counts[l - 1]; i++) {
+            if (k >= nvalues || code >= (1u << l)) {
+                return false;
+            }
+            uint8_t sym = values[k];
+            t->huffval[k] = sym;
+            t->ehufco[sym] = (uint16_t)code;
+            t->ehufsi[sym] = (uint8_t)l;
+            if (l <= LOOKAHEAD_BITS) {
+                uint32_t first = code << (LOOKAHEAD_BITS - l);
+                for (uint32_t j = 0; j < (1u << (LOOKAHEAD_BITS - l)); j++) {
+                    t->lookup_len[first + j] = (uint8_t)l;
+                    t->lookup_sym[first + j] = sym;
+                }
+            }
+            code++;
+            k++;
+        }
+        t->maxcode[l] = counts[l - 1] ? (int32_t)code - 1 : -1;
+        code <<= 1;
+    }
+    t->defined = true;
+    return true;
+}
+
+static esp_err_t parse_dht(jpeg_info_t* info, const uint8_t* p, size_t len) {
+    size_t pos = 0;
+    while (pos < len) {
+        if (pos + 17 > len) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        uint8_t tc = p[pos] >> 4;
+        uint8_t th = p[pos] & 0x0F;
+        const uint8_t* counts = p + pos + 1;
+        size_t total = 0;
+        for (int i = 0; i < 16; i++) {
+            total += counts[i];
+        }
+        if (tc > 1 || th >= MAX_HUFF_TABLES || total > 256 || pos + 17 + total > len) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        huff_table_t* t = tc == 0 ? &info->dc[th] : &info->ac[th];
+        if (!build_huff_table(t, counts, p + pos + 17, total)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        pos += 17 + total;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_sof(jpeg_info_t* info, const uint8_t* p, size_t len) {
+    if (len < 6 || p[0] != 8) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    info->height = (uint16_t)(p[1] << 8 | p[2]);
+    info->width = (uint16_t)(p[3] << 8 | p[4]);
+    info->ncomps = p[5];
+    if (info->ncomps < 1 || info->ncomps > MAX_COMPONENTS || len < 6 + 3 * (size_t)info->ncomps ||
+        info->width == 0 || info->height == 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    for (int i = 0; i < info->ncomps; i++) {
+        info->comps[i].id = p[6 + 3 * i];
+        info->comps[i].h = p[7 + 3 * i] >> 4;
+        info->comps[i].v = p[7 + 3 * i] & 0x0F;
+        if (info->comps[i].h < 1 || info->comps[i].h > 4 || info->comps[i].v < 1 || info->comps[i].v > 4) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+    }
+    if (info->ncomps == 1) {
+        // 单分量扫描的MCU总是一个块
+        info->comps[0].h = info->comps[0].v = 1;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t parse_sos(jpeg_info_t* info, const uint8_t* p, size_t len) {
+    // 只支持一次扫描包含全部分量的基线JPEG
+    if (len < 1 || p[0] != info->ncomps || len < 1 + 2 * (size_t)info->ncomps + 3) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    for (int i = 0; i < info->ncomps; i++) {
+        if (p[1 + 2 * i] != info->comps[i].id) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        uint8_t td = p[2 + 2 * i] >> 4;
+        uint8_t ta = p[2 + 2 * i] & 0x0F;
+        if (td >= MAX_HUFF_TABLES || ta >= MAX_HUFF_TABLES || !info->dc[td].defined || !info->ac[ta].defined) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        info->comps[i].dc_table = td;
+        info->comps[i].ac_table = ta;
+    }
+    return ESP_OK;
+}
+
+// 上下文逐帧复用，上一帧的表和段位置不能带到这一帧
+static void reset_info(jpeg_info_t* info) {
+    for (int i = 0; i < MAX_HUFF_TABLES; i++) {
+        info->dc[i].defined = false;
+        info->ac[i].defined = false;
+    }
+    info->ncomps = 0;
+    info->width = 0;
+    info->height = 0;
+    info->sof = 0;
+    info->dri = 0;
+    info->dri_len = 0;
+    info->restart_interval = 0;
+    info->sos = 0;
+    info->scan = 0;
+}
+
+static esp_err_t parse_header(const uint8_t* p, size_t len, jpeg_info_t* info) {
+    reset_info(info);
+    if (len < 4 || p[0] != 0xFF || p[1] != JPEG_MARKER_SOI) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t pos = 2;
+    bool have_sof = false;
+    while (pos + 4 <= len) {
+        if (p[pos] != 0xFF) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        uint8_t marker = p[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        size_t seg_len = 2 + ((size_t)p[pos + 2] << 8 | p[pos + 3]);
+        if (seg_len < 4 || pos + seg_len > len) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        const uint8_t* body = p + pos + 4;
+        size_t body_len = seg_len - 4;
+        esp_err_t ret = ESP_OK;
+        if (marker == JPEG_MARKER_SOF0 || marker == JPEG_MARKER_SOF1) {
+            info->sof = pos;
+            have_sof = true;
+            ret = parse_sof(info, body, body_len);
+        } else if (marker >= 0xC2 && marker <= 0xCF && marker != JPEG_MARKER_DHT && marker != 0xC8 && marker != 0xCC) {
+            // 渐进式、无损、算术编码
+            return ESP_ERR_NOT_SUPPORTED;
+        } else if (marker == JPEG_MARKER_DHT) {
+            ret = parse_dht(info, body, body_len);
+        } else if (marker == JPEG_MARKER_DRI) {
+            if (body_len < 2) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            info->dri = pos;
+            info->dri_len = seg_len;
+            info->restart_interval = (uint16_t)(body[0] << 8 | body[1]);
+        } else if (marker == JPEG_MARKER_SOS) {
+            if (!have_sof) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            ret = parse_sos(info, body, body_len);
+            info->sos = pos;
+            info->scan = pos + seg_len;
+            return ret;
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        pos += seg_len;
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+static void reader_fill(bit_reader_t* r) {
+    while (r->bits <= 24) {
+        uint32_t byte = 0;
+        if (!r->marker && r->p < r->end) {
+            byte = *r->p;
+            if (byte == 0xFF) {
+                uint8_t next = r->p + 1 < r->end ? r->p[1] : 0xD9;
+                if (next == 0x00) {
+                    r->p += 2;
+                } else {
+                    // 标记不消费，留给重启处理
+                    r->marker = true;
+                    byte = 0;
+                }
+            } else {
+                r->p++;
+            }
+        }
+        r->acc |= byte << (24 - r->bits);
+        r->bits += 8;
+    }
+}
+
+static inline uint32_t reader_peek(bit_reader_t* r, int n) {
+    if (r->bits < n) {
+        reader_fill(r);
+    }
+    return r->acc >> (32 - n);
+}
+
+static inline void reader_skip(bit_reader_t* r, int n) {
+    r->acc <<= n;
+    r->bits -= n;
+}
+
+static inline uint32_t reader_get(bit_reader_t* r, int n) {
+    if (n == 0) {
+        return 0;
+    }
+    uint32_t v = reader_peek(r, n);
+    reader_skip(r, n);
+    return v;
+}
+
+static int decode_symbol(bit_reader_t* r, const huff_table_t* t) {
+    uint32_t look = reader_peek(r, LOOKAHEAD_BITS);
+    if (t->lookup_len[look]) {
+        reader_skip(r, t->lookup_len[look]);
+        return t->lookup_sym[look];
+    }
+    for (int l = LOOKAHEAD_BITS + 1; l <= 16; l++) {
+        int32_t code = (int32_t)reader_peek(r, l);
+        if (code <= t->maxcode[l]) {
+            reader_skip(r, l);
+            return t->huffval[code + t->valoffset[l]];
+        }
+    }
+    return -1;
+}
+
+// 重启间隔结束：丢掉剩余的位，跳过RSTn标记
+static bool reader_restart(bit_reader_t* r) {
+    r->acc = 0;
+    r->bits = 0;
+    r->marker = false;
+    if (r->p + 1 < r->end && r->p[0] == 0xFF && r->p[1] >= 0xD0 && r->p[1] <= 0xD7) {
+        r->p += 2;
+        return true;
+    }
+    return false;
+}
+
+static inline void writer_put(bit_writer_t* w, uint32_t code, int n) {
+    if (n == 0) {
+        return;
+    }
+    w->acc = (w->acc << n) | (code & ((1u << n) - 1));
+    w->bits += n;
+    while (w->bits >= 8) {
+        uint8_t byte = (uint8_t)(w->acc >> (w->bits - 8));
+        w->bits -= 8;
+        if (w->p + 2 > w->end) {
+            w->overflow = true;
+            return;
+        }
+        *w->p++ = byte;
+        if (byte == 0xFF) {
+            *w->p++ = 0x00;
+        }
+    }
+}
+
+static void writer_flush(bit_writer_t* w) {
+    if (w->bits > 0) {
+        writer_put(w, 0x7F, 8 - w->bits);
+    }
+}
+
+// 解码一个块；keep 为 true 时把DC差分改为相对 out_pred 的值，AC码字原样输出
+static bool crop_block(bit_reader_t* r, bit_writer_t* w, const huff_table_t* dc, const huff_table_t* ac,
+                       int* pred, int* out_pred, bool keep) {
+    int s = decode_symbol(r, dc);
+    if (s < 0 || s > 11) {
+        return false;
+    }
+    int diff = 0;
+    if (s) {
+        uint32_t v = reader_get(r, s);
+        diff = v < (1u << (s - 1)) ? (int)v - (1 << s) + 1 : (int)v;
+    }
+    *pred += diff;
+
+    if (keep) {
+        int out_diff = *pred - *out_pred;
+        *out_pred = *pred;
+        int mag = out_diff < 0 ? -out_diff : out_diff;
+        int cat = 0;
+        while (mag) {
+            cat++;
+            mag >>= 1;
+        }
+        if (!dc->ehufsi[cat]) {
+            return false;
+        }
+        writer_put(w, dc->ehufco[cat], dc->ehufsi[cat]);
+        writer_put(w, out_diff < 0 ? (uint32_t)(out_diff - 1) : (uint32_t)out_diff, cat);
+    }
+
+    for (int k = 1; k < 64; k++) {
+        int rs = decode_symbol(r, ac);
+        if (rs < 0) {
+            return false;
+        }
+        int run = rs >> 4;
+        int size = rs & 0x0F;
+        uint32_t extra = reader_get(r, size);
+        if (keep) {
+            writer_put(w, ac->ehufco[rs], ac->ehufsi[rs]);
+            writer_put(w, extra, size);
+        }
+        if (size == 0) {
+            if (run != 15) {
+                break;      // EOB
+            }
+            k += 15;
+        } else {
+            k += run;
+        }
+    }
+    return true;
+}
+
+static void mcu_size(const jpeg_info_t* info, uint32_t* mcu_w, uint32_t* mcu_h) {
+    int hmax = 1;
+    int vmax = 1;
+    for (int i = 0; i < info->ncomps; i++) {
+        hmax = info->comps[i].h > hmax ? info->comps[i].h : hmax;
+        vmax = info->comps[i].v > vmax ? info->comps[i].v : vmax;
+    }
+    *mcu_w = 8 * hmax;
+    *mcu_h = 8 * vmax;
+}
+
+static uint16_t min_u16(uint32_t a, uint32_t b) {
+    return (uint16_t)(a < b ? a : b);
+}
+
+esp_err_t jpeg_parser_create(jpeg_parser_t** out_parser) {
+    if (!out_parser) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // 解码时逐个符号查表，放在内部RAM
+    *out_parser = calloc(1, sizeof(jpeg_parser_t));
+    return *out_parser ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void jpeg_parser_destroy(jpeg_parser_t* parser) {
+    free(parser);
+}
+
+esp_err_t jpeg_crop(jpeg_parser_t* parser, const uint8_t* jpeg, size_t len, const jpeg_crop_rect_t* rect,
+                    uint8_t* out, size_t out_cap, size_t* out_len, jpeg_crop_rect_t* out_rect) {
+    if (!parser || !jpeg || !rect || !out || !out_len || rect->width == 0 || rect->height == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    jpeg_info_t* info = parser;
+    esp_err_t ret = parse_header(jpeg, len, info);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    uint32_t mcu_w;
+    uint32_t mcu_h;
+    mcu_size(info, &mcu_w, &mcu_h);
+    uint32_t mcus_x = (info->width + mcu_w - 1) / mcu_w;
+    uint32_t mcus_y = (info->height + mcu_h - 1) / mcu_h;
+
+    uint32_t mx0 = rect->x / mcu_w;
+    uint32_t my0 = rect->y / mcu_h;
+    uint32_t mx1 = ((uint32_t)rect->x + rect->width + mcu_w - 1) / mcu_w;
+    uint32_t my1 = ((uint32_t)rect->y + rect->height + mcu_h - 1) / mcu_h;
+    mx1 = mx1 < mcus_x ? mx1 : mcus_x;
+    my1 = my1 < mcus_y ? my1 : mcus_y;
+    if (mx0 >= mx1 || my0 >= my1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    jpeg_crop_rect_t crop = {
+        .x = (uint16_t)(mx0 * mcu_w),
+        .y = (uint16_t)(my0 * mcu_h),
+        .width = min_u16(mx1 * mcu_w, info->width) - (uint16_t)(mx0 * mcu_w),
+        .height = min_u16(my1 * mcu_h, info->height) - (uint16_t)(my0 * mcu_h),
+    };
+
+    // 帧头原样复制，去掉DRI(输出不带重启标记)，SOF中的宽高改成裁剪后的
+    size_t head = 0;
+    if (info->scan + 2 > out_cap) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (info->dri) {
+        memcpy(out, jpeg, info->dri);
+        memcpy(out + info->dri, jpeg + info->dri + info->dri_len, info->scan - info->dri - info->dri_len);
+        head = info->scan - info->dri_len;
+    } else {
+        memcpy(out, jpeg, info->scan);
+        head = info->scan;
+    }
+    size_t sof = info->dri && info->dri < info->sof ? info->sof - info->dri_len : info->sof;
+    out[sof + 5] = (uint8_t)(crop.height >> 8);
+    out[sof + 6] = (uint8_t)crop.height;
+    out[sof + 7] = (uint8_t)(crop.width >> 8);
+    out[sof + 8] = (uint8_t)crop.width;
+
+    bit_reader_t r = { .p = jpeg + info->scan, .end = jpeg + len };
+    bit_writer_t w = { .p = out + head, .end = out + out_cap - 2 };
+    int pred[MAX_COMPONENTS] = { 0 };
+    int out_pred[MAX_COMPONENTS] = { 0 };
+    uint32_t mcu_count = 0;
+    bool ok = true;
+
+    // 裁剪区域下方的MCU不需要解码
+    for (uint32_t my = 0; my < my1 && ok; my++) {
+        for (uint32_t mx = 0; mx < mcus_x && ok; mx++) {
+            if (info->restart_interval && mcu_count > 0 && mcu_count % info->restart_interval == 0) {
+                reader_restart(&r);
+                memset(pred, 0, sizeof(pred));
+            }
+            bool keep = my >= my0 && mx >= mx0 && mx < mx1;
+            for (int c = 0; c < info->ncomps && ok; c++) {
+                const component_t* comp = &info->comps[c];
+                for (int b = 0; b < comp->h * comp->v && ok; b++) {
+                    ok = crop_block(&r, &w, &info->dc[comp->dc_table], &info->ac[comp->ac_table],
+                                    &pred[c], &out_pred[c], keep);
+                }
+            }
+            mcu_count++;
+        }
+    }
+
+    if (!ok) {
+        ESP_LOGD(TAG, "Corrupt entropy data");
+        return ESP_ERR_INVALID_ARG;
+    }
+    writer_flush(&w);
+    if (w.overflow) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *w.p++ = 0xFF;
+    *w.p++ = JPEG_MARKER_EOI;
+    *out_len = w.p - out;
+    if (out_rect) {
+        *out_rect = crop;
+    }
+    return ESP_OK;
+}
+
+esp_err_t jpeg_luma_dc(jpeg_parser_t* parser, const uint8_t* jpeg, size_t len, int16_t* out, size_t max,
+                       uint16_t* out_cols, uint16_t* out_rows) {
+    if (!parser || !jpeg || !out_cols || !out_rows) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    jpeg_info_t* info = parser;
+    esp_err_t ret = parse_header(jpeg, len, info);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    uint32_t mcu_w;
+    uint32_t mcu_h;
+    mcu_size(info, &mcu_w, &mcu_h);
+    uint32_t mcus_x = (info->width + mcu_w - 1) / mcu_w;
+    uint32_t mcus_y = (info->height + mcu_h - 1) / mcu_h;
+    *out_cols = (uint16_t)mcus_x;
+    *out_rows = (uint16_t)mcus_y;
+    if (!out || mcus_x * mcus_y > max) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    bit_reader_t r = { .p = jpeg + info->scan, .end = jpeg + len };
+    int pred[MAX_COMPONENTS] = { 0 };
+    uint32_t mcu_count = 0;
+    bool ok = true;
+    for (uint32_t i = 0; i < mcus_x * mcus_y && ok; i++) {
+        if (info->restart_interval && mcu_count > 0 && mcu_count % info->restart_interval == 0) {
+            reader_restart(&r);
+            memset(pred, 0, sizeof(pred));
+        }
+        int32_t luma = 0;
+        for (int c = 0; c < info->ncomps && ok; c++) {
+            const component_t* comp = &info->comps[c];
+            for (int b = 0; b < comp->h * comp->v && ok; b++) {
+                ok = crop_block(&r, NULL, &info->dc[comp->dc_table], &info->ac[comp->ac_table],
+                                &pred[c], NULL, false);
+                if (c == 0) {
+                    luma += pred[0];
+                }
+            }
+        }
+        out[i] = (int16_t)(luma / (info->comps[0].h * info->comps[0].v));
+        mcu_count++;
+    }
+    return ok ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
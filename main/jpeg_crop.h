@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// JPEG域的无损裁剪：只做哈夫曼解码，按MCU边界取出一块区域，
+// 重新计算区域内每行第一个块的DC差分，其余系数的码字原样输出，不做IDCT和重新编码。
+// 同一套哈夫曼解码也用来提取每个MCU的亮度DC，作为帧的低分辨率指纹
+
+// 帧头的解析结果(哈夫曼表等，约13KB)，逐帧复用，避免每帧分配
+typedef struct jpeg_parser_s jpeg_parser_t;
+
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+} jpeg_crop_rect_t;
+
+/**
+ * @brief 分配解析上下文
+ * @param out_parser 输出上下文
+ * @return ESP_OK 成功，ESP_ERR_NO_MEM 内存不足
+ */
+esp_err_t jpeg_parser_create(jpeg_parser_t** out_parser);
+
+/**
+ * @brief 释放解析上下文
+ * @param parser 上下文，可以为NULL
+ */
+void jpeg_parser_destroy(jpeg_parser_t* parser);
+
+/**
+ * @brief 裁剪一帧基线JPEG
+ * @param parser 解析上下文，同一时刻只能被一个调用使用
+ * @param jpeg 完整的JPEG帧(带DQT/DHT)
+ * @param len 帧长度
+ * @param rect 要保留的区域，起点向下、终点向上对齐到MCU(YUV422为16x8像素)，超出图像的部分截掉
+ * @param out 输出缓冲
+ * @param out_cap 输出缓冲的容量，取 len 即可
+ * @param out_len 输出的帧长度
+ * @param out_rect 实际输出的区域，可以为NULL
+ * @return ESP_OK 成功，ESP_ERR_NOT_SUPPORTED 渐进式或多次扫描的JPEG，ESP_ERR_INVALID_SIZE 输出缓冲不够
+ */
+esp_err_t jpeg_crop(jpeg_parser_t* parser, const uint8_t* jpeg, size_t len, const jpeg_crop_rect_t* rect,
+                    uint8_t* out, size_t out_cap, size_t* out_len, jpeg_crop_rect_t* out_rect);
+
+/**
+ * @brief 提取每个MCU的亮度DC(量化后的值，MCU内多个亮度块取平均)，按行存放
+ * @param parser 解析上下文，可以与 jpeg_crop 共用一个
+ * @param jpeg 完整的JPEG帧(带DQT/DHT)
+ * @param len 帧长度
+ * @param out 输出数组
+ * @param max out 的元素个数
+ * @param out_cols 输出每行的MCU数
+ * @param out_rows 输出MCU行数
+ * @return ESP_OK 成功，ESP_ERR_INVALID_SIZE out 不够大(已输出所需的行列数)
+ */
+esp_err_t jpeg_luma_dc(jpeg_parser_t* parser, const uint8_t* jpeg, size_t len, int16_t* out, size_t max,
+                       uint16_t* out_cols, uint16_t* out_rows);
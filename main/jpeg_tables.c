@@ -0,0 +1,333 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "fs_hal.h"
+#include "jpeg_tables.h"
+
+static const char* TAG = "jpeg_tables";
+
+#define JPEG_MARKER_SOI     0xD8
+#define JPEG_MARKER_EOI     0xD9
+#define JPEG_MARKER_SOS     0xDA
+#define JPEG_MARKER_DQT     0xDB
+#define JPEG_MARKER_DHT     0xC4
+
+#define JPEG_MAX_TABLE_SEGMENTS 16
+
+// 还原文件时每次读取的长度，以及单帧的长度上限
+#define RESTORE_READ_CHUNK      (32 * 1024)
+#define RESTORE_INITIAL_BUFFER  (64 * 1024)
+#define RESTORE_MAX_FRAME       (1024 * 1024)
+
+typedef struct {
+    size_t offset;
+    size_t len;
+} jpeg_segment_t;
+
+typedef struct {
+    size_t sos;                 // SOS标记的位置
+    size_t scan;                // 熵编码数据的起始位置
+    jpeg_segment_t tables[JPEG_MAX_TABLE_SEGMENTS];
+    size_t table_count;
+    size_t table_bytes;
+} jpeg_header_t;
+
+// 解析SOI到SOS之间的段；数据不完整时返回 ESP_ERR_INVALID_SIZE
+static esp_err_t parse_header(const uint8_t* p, size_t len, jpeg_header_t* h) {
+    if (len < 2) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (p[0] != 0xFF || p[1] != JPEG_MARKER_SOI) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    memset(h, 0, sizeof(*h));
+    size_t pos = 2;
+    while (1) {
+        if (pos + 2 > len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (p[pos] != 0xFF) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        uint8_t marker = p[pos + 1];
+        if (marker == 0xFF) {
+            // 标记前的填充字节
+            pos++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            // 没有长度字段的标记
+            pos += 2;
+            continue;
+        }
+        if (pos + 4 > len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        size_t seg_len = 2 + ((size_t)p[pos + 2] << 8 | p[pos + 3]);
+        if (seg_len < 4) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        if (pos + seg_len > len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (marker == JPEG_MARKER_SOS) {
+            h->sos = pos;
+            h->scan = pos + seg_len;
+            return ESP_OK;
+        }
+        if (marker == JPEG_MARKER_DQT || marker == JPEG_MARKER_DHT) {
+            if (h->table_count == JPEG_MAX_TABLE_SEGMENTS) {
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+            h->tables[h->table_count].offset = pos;
+            h->tables[h->table_count].len = seg_len;
+            h->table_count++;
+            h->table_bytes += seg_len;
+        }
+        pos += seg_len;
+    }
+}
+
+static bool tables_match(const jpeg_tables_t* tables, const uint8_t* frame, const jpeg_header_t* h) {
+    if (tables->len != h->table_bytes) {
+        return false;
+    }
+    size_t off = 0;
+    for (size_t i = 0; i < h->table_count; i++) {
+        if (memcmp(tables->data + off, frame + h->tables[i].offset, h->tables[i].len) != 0) {
+            return false;
+        }
+        off += h->tables[i].len;
+    }
+    return true;
+}
+
+static void remember_tables(jpeg_tables_t* tables, const uint8_t* frame, const jpeg_header_t* h) {
+    size_t off = 0;
+    for (size_t i = 0; i < h->table_count; i++) {
+        memcpy(tables->data + off, frame + h->tables[i].offset, h->tables[i].len);
+        off += h->tables[i].len;
+    }
+    tables->len = off;
+}
+
+void jpeg_tables_reset(jpeg_tables_t* tables) {
+    tables->len = 0;
+}
+
+size_t jpeg_tables_strip(jpeg_tables_t* tables, uint8_t* frame, size_t len, uint8_t** out_start) {
+    *out_start = frame;
+    jpeg_header_t h;
+    if (parse_header(frame, len, &h) != ESP_OK || h.table_count == 0 || h.table_bytes > JPEG_TABLES_MAX_LEN) {
+        return len;
+    }
+    if (!tables_match(tables, frame, &h)) {
+        // 第一帧或者表变了(例如改了画质)，这一帧保留完整的表
+        remember_tables(tables, frame, &h);
+        return len;
+    }
+
+    // 从后往前把表段之间的部分挪到紧挨SOS的位置，只移动帧头的几百字节
+    size_t dst = h.sos;
+    size_t piece_end = h.sos;
+    for (size_t i = h.table_count; i-- > 0;) {
+        size_t piece_start = h.tables[i].offset + h.tables[i].len;
+        dst -= piece_end - piece_start;
+        memmove(frame + dst, frame + piece_start, piece_end - piece_start);
+        piece_end = h.tables[i].offset;
+    }
+    dst -= piece_end - 2;
+    memmove(frame + dst, frame + 2, piece_end - 2);
+    dst -= 2;
+    frame[dst] = 0xFF;
+    frame[dst + 1] = JPEG_MARKER_SOI;
+
+    *out_start = frame + dst;
+    return len - dst;
+}
+
+esp_err_t jpeg_tables_restore(jpeg_tables_t* tables, const uint8_t* frame, size_t len,
+                              uint8_t* out, size_t out_cap, size_t* out_len) {
+    if (!tables || !frame || !out || !out_len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    jpeg_header_t h;
+    if (parse_header(frame, len, &h) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (h.table_count > 0) {
+        if (h.table_bytes <= JPEG_TABLES_MAX_LEN) {
+            remember_tables(tables, frame, &h);
+        }
+        if (len > out_cap) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(out, frame, len);
+        *out_len = len;
+        return ESP_OK;
+    }
+
+    if (tables->len == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len + tables->len > out_cap) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // 表放在SOI之后、SOF之前，JPEG语法允许表段出现在帧头之前
+    memcpy(out, frame, 2);
+    memcpy(out + 2, tables->data, tables->len);
+    memcpy(out + 2 + tables->len, frame + 2, len - 2);
+    *out_len = len + tables->len;
+    return ESP_OK;
+}
+
+// 在 p 中找出一个完整的帧；数据不够时返回 ESP_ERR_INVALID_SIZE，
+// *out_off 为可以丢弃的字节数(下一个SOI之前的内容)
+static esp_err_t find_frame(const uint8_t* p, size_t len, size_t* out_off, size_t* out_len) {
+    size_t soi = 0;
+    while (soi + 1 < len && !(p[soi] == 0xFF && p[soi + 1] == JPEG_MARKER_SOI)) {
+        soi++;
+    }
+    *out_off = soi;
+    if (soi + 1 >= len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    jpeg_header_t h;
+    esp_err_t ret = parse_header(p + soi, len - soi, &h);
+    if (ret == ESP_ERR_NOT_SUPPORTED) {
+        // 帧头损坏，跳过这个SOI继续找
+        *out_off = soi + 2;
+        return ret;
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // 熵编码数据中的0xFF后面只会是0x00或RST，遇到EOI即为帧尾
+    for (size_t i = soi + h.scan; i + 1 < len; i++) {
+        if (p[i] == 0xFF && p[i + 1] == JPEG_MARKER_EOI) {
+            *out_len = i + 2 - soi;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_SIZE;
+}
+
+static bool grow_buffer(uint8_t** buf, size_t size) {
+    uint8_t* grown = heap_caps_realloc(*buf, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!grown) {
+        grown = realloc(*buf, size);
+    }
+    if (!grown) {
+        return false;
+    }
+    *buf = grown;
+    return true;
+}
+
+esp_err_t jpeg_tables_restore_file(const char* src, const char* dst, uint32_t* out_frames) {
+    if (!src || !dst) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    fs_file_t in = fs_open(src, FS_FILE_READ);
+    if (!in) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    fs_file_t out = fs_open(dst, FS_FILE_WRITE);
+    if (!out) {
+        fs_close(in);
+        return ESP_FAIL;
+    }
+
+    size_t cap = RESTORE_INITIAL_BUFFER;
+    uint8_t* buf = NULL;
+    uint8_t* frame = NULL;
+    jpeg_tables_t* tables = calloc(1, sizeof(jpeg_tables_t));
+    esp_err_t ret = ESP_OK;
+    if (!tables || !grow_buffer(&buf, cap) || !grow_buffer(&frame, cap + JPEG_TABLES_MAX_LEN)) {
+        ret = ESP_ERR_NO_MEM;
+    }
+
+    size_t start = 0;
+    size_t fill = 0;
+    bool eof = false;
+    uint32_t frames = 0;
+    uint32_t skipped = 0;
+    while (ret == ESP_OK) {
+        size_t off = 0;
+        size_t len = 0;
+        esp_err_t found = find_frame(buf + start, fill - start, &off, &len);
+        start += off;
+        if (found == ESP_OK) {
+            size_t restored = 0;
+            esp_err_t r = jpeg_tables_restore(tables, buf + start, len, frame, cap + JPEG_TABLES_MAX_LEN, &restored);
+            if (r == ESP_OK) {
+                if (fs_write(out, frame, restored) != (int)restored) {
+                    ret = ESP_FAIL;
+                }
+                frames++;
+            } else {
+                // 文件开头就是去表的帧，没有可用的表
+                skipped++;
+            }
+            start += len;
+            continue;
+        }
+        if (found == ESP_ERR_NOT_SUPPORTED) {
+            continue;
+        }
+        if (eof) {
+            // 末尾不完整的帧(录制中断电)直接丢弃
+            break;
+        }
+
+        if (start > 0) {
+            memmove(buf, buf + start, fill - start);
+            fill -= start;
+            start = 0;
+        }
+        if (fill == cap) {
+            if (cap * 2 > RESTORE_MAX_FRAME) {
+                ESP_LOGE(TAG, "Frame larger than %d bytes in %s", RESTORE_MAX_FRAME, src);
+                ret = ESP_ERR_INVALID_SIZE;
+                break;
+            }
+            cap *= 2;
+            if (!grow_buffer(&buf, cap) || !grow_buffer(&frame, cap + JPEG_TABLES_MAX_LEN)) {
+                ret = ESP_ERR_NO_MEM;
+                break;
+            }
+        }
+        size_t want = cap - fill < RESTORE_READ_CHUNK ? cap - fill : RESTORE_READ_CHUNK;
+        int n = fs_read(in, buf + fill, want);
+        if (n < 0) {
+            ret = ESP_FAIL;
+        } else if (n == 0) {
+            eof = true;
+        } else {
+            fill += n;
+        }
+    }
+
+    fs_close(in);
+    if (fs_close(out) != ESP_OK && ret == ESP_OK) {
+        ret = ESP_FAIL;
+    }
+    free(buf);
+    free(frame);
+    free(tables);
+
+    if (skipped) {
+        ESP_LOGW(TAG, "%"PRIu32" frames without tables skipped in %s", skipped, src);
+    }
+    if (out_frames) {
+        *out_frames = frames;
+    }
+    return ret;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// 共享表MJPEG：OV2640每帧都带相同的量化表(DQT)和哈夫曼表(DHT)。
+// 录制时只有表发生变化的帧保留完整的表，其余帧去掉表段；
+// 还原时把最近一次出现的表插回SOI之后，解码结果与原始帧相同
+
+#define JPEG_TABLES_MAX_LEN 1024    // 表段总长度上限，超出时不去表
+
+typedef struct {
+    uint8_t data[JPEG_TABLES_MAX_LEN];  // 最近一次出现的DQT/DHT段，按出现顺序拼接(含标记和长度)
+    size_t len;                         // 0表示还没有遇到带表的帧
+} jpeg_tables_t;
+
+/**
+ * @brief 清空记住的表，每个文件开始时调用
+ * @param tables 表状态
+ */
+void jpeg_tables_reset(jpeg_tables_t* tables);
+
+/**
+ * @brief 原地去掉帧中与上一帧相同的表段
+ * @param tables 表状态，表变化时更新并保留整帧
+ * @param frame 完整的JPEG帧，去表时帧头部分会被移动
+ * @param len 帧长度
+ * @param out_start 输出去表后的帧起始位置(位于 frame 内)
+ * @return 去表后的长度，未去表时等于 len
+ */
+size_t jpeg_tables_strip(jpeg_tables_t* tables, uint8_t* frame, size_t len, uint8_t** out_start);
+
+/**
+ * @brief 还原一帧，带表的帧原样输出并更新记住的表
+ * @param tables 表状态
+ * @param frame 去表或完整的JPEG帧
+ * @param len 帧长度
+ * @param out 输出缓冲
+ * @param out_cap 输出缓冲的容量，至少为 len + JPEG_TABLES_MAX_LEN
+ * @param out_len 输出的帧长度
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 之前没有出现过带表的帧
+ */
+esp_err_t jpeg_tables_restore(jpeg_tables_t* tables, const uint8_t* frame, size_t len,
+                              uint8_t* out, size_t out_cap, size_t* out_len);
+
+/**
+ * @brief 把共享表格式的录像文件还原成标准MJPEG文件
+ * @param src 源文件(相对于挂载点)
+ * @param dst 目标文件，已存在时覆盖
+ * @param out_frames 输出还原的帧数，可以为NULL
+ * @return ESP_OK 成功
+ */
+esp_err_t jpeg_tables_restore_file(const char* src, const char* dst, uint32_t* out_frames);
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
@@ -7,6 +8,7 @@
 #include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "esp_camera.h"
 #include "esp_vfs.h"
 #include "esp_vfs_fat.h"
@@ -24,6 +26,17 @@
 #include "driver/uart.h"
 #include "esp_log.h"
 #include "camera_pins.h"
+#include "fs_hal.h"
+#include "sdcard_telemetry.h"
+#include "sdcard_diskio.h"
+#include "catalog.h"
+#include "recorder.h"
+#include "retention.h"
+#include "session.h"
+#include "camera_profile.h"
+#include "spill.h"
+#include "jpeg_tables.h"
+#include "bench.h"
 
 static const char *TAG = "video_recorder";
 
@@ -47,6 +60,21 @@ static const char *TAG = "video_recorder";
 #define DMA_BUFFER_COUNT    8
 #define DMA_BUFFER_LEN      1024
 
+// record start 不带时长时的默认录制时长
+#define RECORD_DEFAULT_DURATION_S 30
+// record trigger 不带时长时，连续有声多久才开始录制
+#define SOUND_TRIGGER_MIN_MS 300
+
+// 有PSRAM时相机的帧缓冲数；帧在写卡完成前一直占用一个缓冲，
+// 缓冲越多，SD卡写入越慢时传感器越不容易停下来
+#define CAMERA_PSRAM_FB_COUNT 8
+// PSRAM不够放下最大配置的 CAMERA_PSRAM_FB_COUNT 个缓冲时，缓冲数不少于此值
+#define CAMERA_PSRAM_FB_MIN   2
+// 帧缓冲最多占用空闲PSRAM的比例(分母)，其余留给裁剪、暂存等缓冲
+#define CAMERA_PSRAM_FB_SHARE 2
+// 启动时使用的摄像头配置，见 camera_profile.c
+#define CAMERA_DEFAULT_PROFILE "qvga"
+
 // Camera configuration
 static camera_config_t camera_config = {
     .pin_pwdn = PWDN_GPIO_NUM,
@@ -73,60 +101,69 @@ static camera_config_t camera_config = {
     .ledc_channel = LEDC_CHANNEL_0,
 
     .pixel_format = PIXFORMAT_JPEG,
-    .frame_size = FRAMESIZE_QVGA,    // 使用较小的分辨率
+    .frame_size = FRAMESIZE_QVGA,    // 有PSRAM时改为最大配置的分辨率，见 configure_camera_buffers
     .jpeg_quality = 12,              // 较低的质量设置
-    .fb_count = 1,                   // 减少帧缓冲区数量
-    .fb_location = CAMERA_FB_IN_DRAM,// 使用 DRAM 而不是 PSRAM
+    .fb_count = 1,                   // 没有PSRAM时只用一个DRAM帧缓冲，见 configure_camera_buffers
+    .fb_location = CAMERA_FB_IN_DRAM,
     .grab_mode = CAMERA_GRAB_WHEN_EMPTY
 };
 
+// 有PSRAM时改用多个PSRAM帧缓冲：写卡期间传感器继续向空闲缓冲采集，
+// 帧缓冲本身经队列交给写卡任务，写完才归还驱动，不做拷贝。
+// 缓冲按PSRAM能放下的最大配置分配，之后切换配置不再重新初始化摄像头
+static void configure_camera_buffers(void)
+{
+    if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) == 0) {
+        ESP_LOGW(TAG, "No PSRAM, capturing into a single DRAM frame buffer");
+        return;
+    }
+    size_t budget = heap_caps_get_free_size(MALLOC_CAP_SPIRAM) / CAMERA_PSRAM_FB_SHARE;
+    framesize_t frame_size = camera_profile_largest(budget / CAMERA_PSRAM_FB_MIN);
+    size_t fb_size = camera_profile_fb_size(frame_size);
+    size_t count = budget / fb_size;
+    if (count > CAMERA_PSRAM_FB_COUNT) {
+        count = CAMERA_PSRAM_FB_COUNT;
+    } else if (count == 0) {
+        count = 1;
+    }
+    camera_config.frame_size = frame_size;
+    camera_config.fb_count = count;
+    camera_config.fb_location = CAMERA_FB_IN_PSRAM;
+    camera_config.grab_mode = CAMERA_GRAB_LATEST;
+    ESP_LOGI(TAG, "Capturing into %u PSRAM frame buffers of %u bytes (up to %ux%u)", (unsigned)count,
+             (unsigned)fb_size, resolution[frame_size].width, resolution[frame_size].height);
+}
+
 // I2S PDM configuration
 static i2s_chan_handle_t i2s_handle = NULL;
 #define AUDIO_BUFFER_SIZE (DMA_BUFFER_LEN * 2)  // 每个采样16位
-static uint8_t audio_buffer[AUDIO_BUFFER_SIZE];
 
 static esp_err_t init_sdcard(void)
 {
-    esp_err_t ret;
-    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-        .format_if_mount_failed = false,
+    // 通过 fs_hal 挂载，块读写经过 sdcard_hal 以便统计延迟
+    fs_config_t fs_config = {
+        .mount_point = MOUNT_POINT,
         .max_files = 5,
-        .allocation_unit_size = 16 * 1024
+        .format_if_mount_failed = false,
+        // 只在 format 命令中使用：SDXC 卡且 FatFs 启用了 exFAT 时格式化为 exFAT(单个录像文件可以超过 4GB)，
+        // 否则为 FAT32；簇大小按文件系统类型取默认值
+        .format = FS_FORMAT_AUTO,
+        .allocation_unit_size = 0,
+        .sdcard = {
+            .host = SPI2_HOST,
+            .pin_mosi = PIN_NUM_MOSI,
+            .pin_miso = PIN_NUM_MISO,
+            .pin_sck = PIN_NUM_CLK,
+            .pin_cs = PIN_NUM_CS,
+            .freq_khz = SDMMC_FREQ_DEFAULT,
+        },
     };
 
     ESP_LOGI(TAG, "Initializing SD card");
-
-    sdmmc_host_t host = SDSPI_HOST_DEFAULT();
-    spi_bus_config_t bus_cfg = {
-        .mosi_io_num = PIN_NUM_MOSI,
-        .miso_io_num = PIN_NUM_MISO,
-        .sclk_io_num = PIN_NUM_CLK,
-        .quadwp_io_num = -1,
-        .quadhd_io_num = -1,
-        .max_transfer_sz = 4000,
-    };
-
-    ret = spi_bus_initialize(host.slot, &bus_cfg, SDSPI_DEFAULT_DMA);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize bus.");
-        return ret;
-    }
-
-    sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
-    slot_config.gpio_cs = PIN_NUM_CS;
-    slot_config.host_id = host.slot;
-
-    ESP_LOGI(TAG, "Mounting filesystem");
-    ret = esp_vfs_fat_sdspi_mount(MOUNT_POINT, &host, &slot_config, &mount_config, NULL);
-
+    esp_err_t ret = fs_init(&fs_config);
     if (ret != ESP_OK) {
-        if (ret == ESP_FAIL) {
-            ESP_LOGE(TAG, "Failed to mount filesystem. "
-                     "If you want the card to be formatted, set the CONFIG_EXAMPLE_FORMAT_IF_MOUNT_FAILED menuconfig option.");
-        } else {
-            ESP_LOGE(TAG, "Failed to initialize the card (%s). "
-                     "Make sure SD card lines have pull-up resistors in place.", esp_err_to_name(ret));
-        }
+        ESP_LOGE(TAG, "Failed to initialize the card (%s). "
+                 "Make sure SD card lines have pull-up resistors in place.", esp_err_to_name(ret));
         return ret;
     }
 
@@ -169,118 +206,6 @@ static void deinit_i2s(void)
     }
 }
 
-static esp_err_t record_audio_chunk(FIL* audio_file)
-{
-    size_t bytes_read = 0;
-    esp_err_t ret = i2s_channel_read(i2s_handle, audio_buffer, AUDIO_BUFFER_SIZE, &bytes_read, portMAX_DELAY);
-    if (ret != ESP_OK) {
-        return ret;
-    }
-
-    UINT bytes_written;
-    FRESULT res = f_write(audio_file, audio_buffer, bytes_read, &bytes_written);
-    if (res != FR_OK || bytes_written != bytes_read) {
-        return ESP_FAIL;
-    }
-
-    return ESP_OK;
-}
-
-void record_video(void)
-{
-    char video_path[32];
-    char audio_path[32];
-    time_t now;
-    struct tm timeinfo;
-    time(&now);
-    localtime_r(&now, &timeinfo);
-
-    // Generate filenames based on current time
-    snprintf(video_path, sizeof(video_path), MOUNT_POINT "/%02d%02d.vid",
-             timeinfo.tm_hour, timeinfo.tm_min);
-    snprintf(audio_path, sizeof(audio_path), MOUNT_POINT "/%02d%02d.pcm",
-             timeinfo.tm_hour, timeinfo.tm_min);
-
-    // Check if files already exist
-    FILINFO fno;
-    if (f_stat(video_path, &fno) == FR_OK) {
-        ESP_LOGE(TAG, "Video file already exists: %s", video_path);
-        return;
-    }
-    if (f_stat(audio_path, &fno) == FR_OK) {
-        ESP_LOGE(TAG, "Audio file already exists: %s", audio_path);
-        return;
-    }
-
-    // Open files for writing
-    FIL video_file, audio_file;
-    if (f_open(&video_file, video_path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
-        ESP_LOGE(TAG, "Failed to open video file: %s", video_path);
-        return;
-    }
-
-    if (f_open(&audio_file, audio_path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
-        ESP_LOGE(TAG, "Failed to open audio file: %s", audio_path);
-        f_close(&video_file);
-        return;
-    }
-
-    // Start recording
-    ESP_LOGI(TAG, "Starting recording...");
-    uint32_t frame_count = 0;
-    uint64_t start_time = esp_timer_get_time();
-    const uint64_t RECORD_LENGTH = 30 * 1000000; // 30 seconds
-
-    while ((esp_timer_get_time() - start_time) < RECORD_LENGTH) {
-        camera_fb_t *fb = esp_camera_fb_get();
-        if (!fb) {
-            ESP_LOGE(TAG, "Camera capture failed");
-            continue;
-        }
-
-        // Write video frame
-        UINT bytes_written;
-        FRESULT res = f_write(&video_file, fb->buf, fb->len, &bytes_written);
-        if (res != FR_OK || bytes_written != fb->len) {
-            ESP_LOGE(TAG, "Failed to write frame data: written %u of %u bytes",
-                     bytes_written, fb->len);
-        } else {
-            frame_count++;
-            if (frame_count % 30 == 0) {
-                ESP_LOGI(TAG, "Recorded %"PRIu32" frames", frame_count);
-            }
-        }
-
-        esp_camera_fb_return(fb);
-
-        // Record audio
-        if (record_audio_chunk(&audio_file) != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to record audio chunk");
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(10));
-    }
-
-    // Close files
-    f_close(&video_file);
-    f_close(&audio_file);
-
-    ESP_LOGI(TAG, "Recording finished. Recorded %"PRIu32" frames", frame_count);
-
-    // Get file information
-    if (f_stat(video_path, &fno) == FR_OK) {
-        ESP_LOGI(TAG, "Video file information:");
-        ESP_LOGI(TAG, "- Path: %s", video_path);
-        ESP_LOGI(TAG, "- Size: %"PRIu32" bytes", fno.fsize);
-    }
-
-    if (f_stat(audio_path, &fno) == FR_OK) {
-        ESP_LOGI(TAG, "Audio file information:");
-        ESP_LOGI(TAG, "- Path: %s", audio_path);
-        ESP_LOGI(TAG, "- Size: %"PRIu32" bytes", fno.fsize);
-    }
-}
-
 // File transfer command handler
 static void handle_transfer_command(const char* file_path)
 {
@@ -299,13 +224,13 @@ static void handle_transfer_command(const char* file_path)
         return;
     }
 
-    printf("File size: %"PRIu32" bytes\n", fno.fsize);
+    printf("File size: %"PRIu64" bytes\n", (uint64_t)fno.fsize);
     printf("Transfer starting...\n");
 
     // Transfer file in hex format
     uint8_t buffer[1024];
     UINT bytes_read;
-    uint32_t total_bytes = 0;
+    uint64_t total_bytes = 0;
 
     while (f_read(&file, buffer, sizeof(buffer), &bytes_read) == FR_OK && bytes_read > 0) {
         for (UINT i = 0; i < bytes_read; i++) {
@@ -315,15 +240,49 @@ static void handle_transfer_command(const char* file_path)
 
         // Print progress every 64KB
         if (total_bytes % (64 * 1024) == 0) {
-            printf("\nTransferred: %"PRIu32" bytes (%.1f%%)\n",
+            printf("\nTransferred: %"PRIu64" bytes (%.1f%%)\n",
                    total_bytes, (total_bytes * 100.0f) / fno.fsize);
         }
     }
 
-    printf("\nTransfer complete: %"PRIu32" bytes transferred\n", total_bytes);
+    printf("\nTransfer complete: %"PRIu64" bytes transferred\n", total_bytes);
     f_close(&file);
 }
 
+// 解析 YYYYMMDD、YYYYMMDDHHMM(本地时间)或Unix秒数
+static bool parse_time(const char* str, int64_t* out)
+{
+    size_t len = strlen(str);
+    int y, mo, d, h = 0, mi = 0;
+    if ((len == 8 && sscanf(str, "%4d%2d%2d", &y, &mo, &d) == 3) ||
+        (len == 12 && sscanf(str, "%4d%2d%2d%2d%2d", &y, &mo, &d, &h, &mi) == 5)) {
+        struct tm tm = {
+            .tm_year = y - 1900, .tm_mon = mo - 1, .tm_mday = d,
+            .tm_hour = h, .tm_min = mi, .tm_isdst = -1,
+        };
+        *out = mktime(&tm);
+        return true;
+    }
+    char* end;
+    *out = strtoll(str, &end, 10);
+    return *end == '\0' && end != str;
+}
+
+static bool print_catalog_entry(const catalog_entry_t* e, void* ctx)
+{
+    uint32_t* count = ctx;
+    time_t t = (time_t)e->start_time;
+    struct tm tm;
+    char when[24];
+    localtime_r(&t, &tm);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%6"PRIu32"  %s  %5"PRIu32".%01"PRIu32" s  %6"PRIu32"  %10"PRIu64"  %9"PRIu64"  %-6s  %s\n",
+           e->id, when, e->duration_ms / 1000, (e->duration_ms % 1000) / 100, e->frames,
+           e->video_bytes, e->audio_bytes, catalog_trigger_name(e->trigger), e->name);
+    (*count)++;
+    return true;
+}
+
 // Console command handler
 static int console_handler(int argc, char **argv)
 {
@@ -332,7 +291,129 @@ static int console_handler(int argc, char **argv)
     }
 
     if (strcmp(argv[0], "record") == 0) {
-        record_video();
+        if (argc >= 2 && strcmp(argv[1], "start") == 0 && argc <= 3) {
+            uint32_t duration_s = argc == 3 ? strtoul(argv[2], NULL, 10) : RECORD_DEFAULT_DURATION_S;
+            esp_err_t ret = recorder_start(duration_s, CATALOG_TRIGGER_MANUAL);
+            if (ret != ESP_OK) {
+                printf("Error: Could not start recording (%s)\n", esp_err_to_name(ret));
+            }
+        } else if (argc >= 2 && strcmp(argv[1], "crop") == 0 && (argc == 3 || argc == 6)) {
+            jpeg_crop_rect_t rect = { 0 };
+            if (argc == 6) {
+                rect.x = (uint16_t)strtoul(argv[2], NULL, 10);
+                rect.y = (uint16_t)strtoul(argv[3], NULL, 10);
+                rect.width = (uint16_t)strtoul(argv[4], NULL, 10);
+                rect.height = (uint16_t)strtoul(argv[5], NULL, 10);
+            } else if (strcmp(argv[2], "off") != 0) {
+                printf("Usage: record crop <x> <y> <width> <height> | record crop off\n");
+                return 0;
+            }
+            esp_err_t ret = recorder_set_crop(&rect);
+            if (ret != ESP_OK) {
+                printf("Error: Could not change crop while recording (%s)\n", esp_err_to_name(ret));
+            } else if (rect.width) {
+                printf("Next recording keeps %ux%u at (%u, %u), aligned to MCU boundaries\n",
+                       rect.width, rect.height, rect.x, rect.y);
+            } else {
+                printf("Next recording keeps the full frame\n");
+            }
+        } else if (argc == 3 && strcmp(argv[1], "audio") == 0 &&
+                   (strcmp(argv[2], "pcm") == 0 || strcmp(argv[2], "adpcm") == 0)) {
+            bool adpcm = strcmp(argv[2], "adpcm") == 0;
+            esp_err_t ret = recorder_set_audio_adpcm(adpcm);
+            if (ret != ESP_OK) {
+                printf("Error: Could not change audio format (%s)\n", esp_err_to_name(ret));
+            } else {
+                printf("Next recording saves audio as %s\n", adpcm ? "IMA-ADPCM (.adp)" : "raw PCM (.pcm)");
+            }
+        } else if (argc == 3 && strcmp(argv[1], "vad") == 0 &&
+                   (strcmp(argv[2], "on") == 0 || strcmp(argv[2], "off") == 0)) {
+            bool gate = strcmp(argv[2], "on") == 0;
+            esp_err_t ret = recorder_set_vad_gate(gate);
+            if (ret != ESP_OK) {
+                printf("Error: Could not change silence gating while recording (%s)\n", esp_err_to_name(ret));
+            } else {
+                printf("Next recording %s\n", gate ? "skips silent audio (gaps listed in .sil)" : "stores all audio");
+            }
+        } else if (argc >= 3 && argc <= 4 && strcmp(argv[1], "trigger") == 0) {
+            uint32_t duration_s = strcmp(argv[2], "off") == 0 ? 0 : strtoul(argv[2], NULL, 10);
+            uint32_t min_ms = argc == 4 ? strtoul(argv[3], NULL, 10) : SOUND_TRIGGER_MIN_MS;
+            if (duration_s == 0 && strcmp(argv[2], "off") != 0) {
+                printf("Usage: record trigger <seconds> [min sound ms] | record trigger off\n");
+                return 0;
+            }
+            esp_err_t ret = recorder_set_sound_trigger(duration_s, min_ms);
+            if (ret != ESP_OK) {
+                printf("Error: Could not change sound trigger (%s)\n", esp_err_to_name(ret));
+            } else if (duration_s) {
+                printf("Recording %"PRIu32" s after %"PRIu32" ms of sound\n", duration_s, min_ms);
+            } else {
+                printf("Sound trigger off\n");
+            }
+        } else if (argc == 2 && strcmp(argv[1], "stop") == 0) {
+            esp_err_t ret = recorder_stop();
+            if (ret != ESP_OK) {
+                printf("Error: Could not stop recording (%s)\n", esp_err_to_name(ret));
+            }
+        } else if (argc == 2 && strcmp(argv[1], "status") == 0) {
+            recorder_status_t st;
+            if (recorder_get_status(&st) != ESP_OK) {
+                printf("Error: Recorder not initialized\n");
+                return 0;
+            }
+            if (st.sound_trigger_s) {
+                printf("Sound trigger: armed for %"PRIu32" s recordings, %"PRIu32" triggered\n",
+                       st.sound_trigger_s, st.sound_triggers);
+            }
+            if (st.elapsed_ms == 0 && !st.running) {
+                printf("Idle, nothing recorded yet\n");
+                return 0;
+            }
+            printf("%s session %"PRIu32" (%s, %s): %"PRIu32".%01"PRIu32" s",
+                   st.running ? "Recording" : "Finished", st.session_id, st.video_path, st.audio_path, st.elapsed_ms / 1000, (st.elapsed_ms % 1000) / 100);
+            if (st.duration_s) {
+                printf(" of %"PRIu32" s", st.duration_s);
+            }
+            printf("\n%s %.1f fps, %"PRIu32" B/s\n", st.running ? "Rate" : "Average", st.fps, st.bytes_per_sec);
+            printf("Video: %"PRIu32" frames, %"PRIu64" bytes, %"PRIu32" dropped, queue %"PRIu32"/%"PRIu32"\n",
+                   st.frames, st.video_bytes, st.dropped_frames, st.video_queue_depth, st.video_queue_len);
+            if (st.crop.width) {
+                printf("Crop: %ux%u at (%u, %u)\n", st.crop.width, st.crop.height, st.crop.x, st.crop.y);
+            }
+            if (st.repeated_frames) {
+                printf("Repeated (static scene): %"PRIu32" frames stored as index entries\n", st.repeated_frames);
+            }
+            if (st.crop_failures) {
+                printf("Crop failures (saved full frame): %"PRIu32"\n", st.crop_failures);
+            }
+            if (st.thumbnails) {
+                printf("Thumbnails: %"PRIu32"\n", st.thumbnails);
+            }
+            if (st.table_bytes_saved) {
+                printf("Shared JPEG tables: %"PRIu64" bytes saved\n", st.table_bytes_saved);
+            }
+            printf("Audio (%s): %"PRIu32" chunks, %"PRIu64" bytes, %"PRIu32" dropped, queue %"PRIu32"/%"PRIu32"\n",
+                   st.audio_adpcm ? "IMA-ADPCM" : "PCM", st.audio_chunks, st.audio_bytes, st.dropped_audio_chunks, st.audio_queue_depth, st.audio_queue_len);
+            if (st.audio_rate_mhz) {
+                int32_t ppm = (int32_t)(((int64_t)st.audio_rate_mhz - I2S_SAMPLE_RATE * 1000LL) * 1000 / I2S_SAMPLE_RATE);
+                printf("Audio clock: %"PRIu32".%03"PRIu32" Hz (%+"PRId32" ppm, corrected by convert.sh)\n",
+                       st.audio_rate_mhz / 1000, st.audio_rate_mhz % 1000, ppm);
+            }
+            if (st.silence_gaps || st.silent_ms) {
+                printf("Silence: %"PRIu32".%01"PRIu32" s not stored, %"PRIu32" gaps\n",
+                       st.silent_ms / 1000, (st.silent_ms % 1000) / 100, st.silence_gaps);
+            }
+            if (st.spilled_records || st.spilling) {
+                printf("Flash spill: %s, %"PRIu32" records, %"PRIu32" bytes pending\n",
+                       st.spilling ? "active" : "idle", st.spilled_records, st.spill_pending_bytes);
+            }
+            if (st.write_errors) {
+                printf("Write errors: %"PRIu32"\n", st.write_errors);
+            }
+        } else {
+            printf("Usage: record start [seconds] | record stop | record status | record crop <x> <y> <w> <h>|off | "
+                   "record audio pcm|adpcm | record vad on|off | record trigger <seconds> [ms]|off\n");
+        }
     } else if (strcmp(argv[0], "transfer") == 0) {
         if (argc != 2) {
             printf("Usage: transfer <filename>\n");
@@ -340,22 +421,237 @@ static int console_handler(int argc, char **argv)
         }
         handle_transfer_command(argv[1]);
     } else if (strcmp(argv[0], "ls") == 0) {
-        // List all files in root directory
+        // 录像按日期分目录存放，ls <目录> 列出某一天的文件
+        const char* path = argc == 2 ? argv[1] : "/";
         FF_DIR dir;
         FILINFO fno;
-        FRESULT res = f_opendir(&dir, "/");
+        FRESULT res = f_opendir(&dir, path);
         if (res != FR_OK) {
-            printf("Error: Could not open root directory\n");
+            printf("Error: Could not open directory %s\n", path);
             return 0;
         }
 
-        printf("Files in root directory:\n");
+        printf("Files in %s:\n", path);
         while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0] != 0) {
-            if (!(fno.fattrib & AM_DIR)) {
-                printf("%s\t%"PRIu32" bytes\n", fno.fname, fno.fsize);
+            if (fno.fattrib & AM_DIR) {
+                printf("%s/\n", fno.fname);
+            } else {
+                printf("%s\t%"PRIu64" bytes\n", fno.fname, (uint64_t)fno.fsize);
             }
         }
         f_closedir(&dir);
+    } else if (strcmp(argv[0], "sdstat") == 0) {
+        if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+            sdcard_telemetry_reset();
+            printf("SD card telemetry cleared\n");
+        } else {
+            sdcard_telemetry_print();
+            for (uint8_t pdrv = 0; pdrv < FF_VOLUMES; pdrv++) {
+                sdcard_trim_stats_t trim;
+                if (sdcard_diskio_get_trim_stats(pdrv, &trim) == ESP_OK &&
+                    (trim.pending_blocks || trim.erased_blocks || trim.dropped_blocks)) {
+                    printf("Trim %u: %"PRIu64" blocks pending, %"PRIu64" erased in %"PRIu32" cmds, %"PRIu64" dropped\n",
+                           pdrv, trim.pending_blocks, trim.erased_blocks, trim.erase_cmds, trim.dropped_blocks);
+                }
+                sdcard_cache_stats_t cache;
+                if (sdcard_diskio_get_cache_stats(pdrv, &cache) == ESP_OK) {
+                    printf("Cache %u: read %"PRIu64"/%"PRIu64" hits, write %"PRIu64"/%"PRIu64" hits, "
+                           "%"PRIu64" written back, %"PRIu32" dirty, %"PRIu32" pinned\n",
+                           pdrv, cache.read_hits, cache.read_hits + cache.read_misses,
+                           cache.write_hits, cache.write_hits + cache.write_misses,
+                           cache.writebacks, cache.dirty_lines, cache.pinned_lines);
+                }
+            }
+        }
+    } else if (strcmp(argv[0], "format") == 0) {
+        if (argc != 2 || strcmp(argv[1], "yes") != 0) {
+            printf("Usage: format yes (erases all files on the card)\n");
+            return 0;
+        }
+        if (recorder_acquire_exclusive() != ESP_OK) {
+            printf("Error: Stop recording before formatting (or wait for the running bench/format)\n");
+            return 0;
+        }
+        // 溢出到flash的数据还要并回卡上的录像
+        if (spill_pending_bytes() > 0) {
+            recorder_release_exclusive();
+            printf("Error: %"PRIu32" bytes spilled to flash are not merged yet, try again later\n",
+                   spill_pending_bytes());
+            return 0;
+        }
+        retention_wait_idle();
+        esp_err_t ret = fs_format();
+        if (ret == ESP_OK && catalog_reset() != ESP_OK) {
+            printf("Warning: Failed to recreate the catalog\n");
+        }
+        if (ret == ESP_OK) {
+            session_forget_dirs();
+        }
+        recorder_release_exclusive();
+        if (ret == ESP_ERR_INVALID_STATE) {
+            printf("Error: Files are still open (catalog, checksum or transfer), try again later\n");
+            return 0;
+        }
+        fs_info_t info;
+        if (ret == ESP_OK && fs_get_info(&info) == ESP_OK) {
+            printf("Formatted as %s, cluster size %"PRIu32" bytes, %"PRIu64" bytes free\n",
+                   info.is_exfat ? "exFAT" : "FAT32", info.cluster_size, info.free_bytes);
+        } else {
+            printf("Error: Format failed (%s)\n", esp_err_to_name(ret));
+        }
+    } else if (strcmp(argv[0], "catalog") == 0) {
+        const char* sub = argc >= 2 ? argv[1] : "list";
+        if (strcmp(sub, "list") == 0 && argc <= 4) {
+            int64_t from = 0, to = INT64_MAX;
+            if ((argc >= 3 && !parse_time(argv[2], &from)) || (argc == 4 && !parse_time(argv[3], &to))) {
+                printf("Error: Times are YYYYMMDD, YYYYMMDDHHMM or Unix seconds\n");
+                return 0;
+            }
+            uint32_t count = 0;
+            printf("    id  start                duration  frames       video      audio  trigger name\n");
+            esp_err_t ret = catalog_query(from, to, print_catalog_entry, &count);
+            if (ret != ESP_OK) {
+                printf("Error: Catalog query failed (%s)\n", esp_err_to_name(ret));
+            }
+            printf("%"PRIu32" recordings\n", count);
+        } else if (strcmp(sub, "stats") == 0 && argc == 2) {
+            catalog_stats_t st;
+            if (catalog_get_stats(&st) == ESP_OK) {
+                printf("%"PRIu32" entries (%"PRIu32" deleted), %"PRIu64" bytes%s\n", st.entries, st.deleted,
+                       st.file_bytes, st.unsorted_from < st.entries ? ", clock went backwards" : "");
+            }
+        } else if (strcmp(sub, "compact") == 0 && argc == 2) {
+            esp_err_t ret = catalog_compact();
+            printf("%s\n", ret == ESP_OK ? "Catalog compacted" : esp_err_to_name(ret));
+        } else {
+            printf("Usage: catalog [list [from] [to] | stats | compact]\n");
+        }
+    } else if (strcmp(argv[0], "retention") == 0) {
+        retention_stats_t st;
+        if (retention_get_stats(&st) == ESP_OK) {
+            printf("Free (cached): %"PRIu64" MB, resynced %"PRIu32" s ago%s\n", st.free_bytes >> 20,
+                   st.resync_age_ms / 1000, st.reclaiming ? ", reclaiming" : "");
+            printf("Deleted %"PRIu32" recordings, %"PRIu64" MB freed, %"PRIu32" checks deferred while recording\n",
+                   st.deleted_recordings, st.freed_bytes >> 20, st.deferred_checks);
+        }
+    } else if (strcmp(argv[0], "bench") == 0) {
+        const char* suite = argc >= 2 ? argv[1] : "all";
+        bool all = strcmp(suite, "all") == 0;
+        if (argc > 3 || (!all && strcmp(suite, "raw") != 0 && strcmp(suite, "fs") != 0 &&
+                         strcmp(suite, "camera") != 0 && strcmp(suite, "i2s") != 0 && strcmp(suite, "adpcm") != 0 &&
+                         strcmp(suite, "dsp") != 0 && strcmp(suite, "thumb") != 0)) {
+            printf("Usage: bench [raw|fs|camera|thumb|i2s|adpcm|dsp|all] [MB|frames|reads|seconds]\n");
+            return 0;
+        }
+        // raw 写回卡中部、camera/i2s 和录制共用传感器与I2S，整个 bench 期间独占，声音触发也不会开始录制
+        if (recorder_acquire_exclusive() != ESP_OK) {
+            printf("Error: Stop recording before running benchmarks\n");
+            return 0;
+        }
+        retention_wait_idle();
+        uint32_t count = argc == 3 ? strtoul(argv[2], NULL, 10) : 0;
+
+        bench_print_header();
+        if (all || strcmp(suite, "raw") == 0) {
+            bench_raw(count ? count : 4);
+        }
+        if (all || strcmp(suite, "fs") == 0) {
+            bench_fs(count ? count : 4);
+        }
+        if (all || strcmp(suite, "camera") == 0) {
+            bench_camera(camera_config.frame_size, count ? count : 50);
+        }
+        if (all || strcmp(suite, "thumb") == 0) {
+            bench_thumbnail(count ? count : 20);
+        }
+        if (all || strcmp(suite, "i2s") == 0) {
+            bench_i2s(i2s_handle, AUDIO_BUFFER_SIZE, I2S_SAMPLE_RATE * I2S_CHANNEL_NUM * sizeof(int16_t),
+                      count ? count : 200);
+        }
+        if (all || strcmp(suite, "adpcm") == 0) {
+            bench_adpcm(AUDIO_BUFFER_SIZE, I2S_SAMPLE_RATE, count ? count : 10);
+        }
+        if (all || strcmp(suite, "dsp") == 0) {
+            bench_audio_dsp(AUDIO_BUFFER_SIZE, I2S_SAMPLE_RATE, count ? count : 10);
+        }
+        recorder_release_exclusive();
+    } else if (strcmp(argv[0], "checksum") == 0) {
+        if (argc < 2 || argc > 5) {
+            printf("Usage: checksum <filename> [crc32|sha256] [offset] [length]\n");
+            return 0;
+        }
+        fs_checksum_type_t type = FS_CHECKSUM_SHA256;
+        if (argc >= 3) {
+            if (strcmp(argv[2], "crc32") == 0) {
+                type = FS_CHECKSUM_CRC32;
+            } else if (strcmp(argv[2], "sha256") != 0) {
+                printf("Error: Unknown checksum type %s\n", argv[2]);
+                return 0;
+            }
+        }
+        uint64_t offset = argc >= 4 ? strtoull(argv[3], NULL, 0) : 0;
+        uint64_t length = argc >= 5 ? strtoull(argv[4], NULL, 0) : 0;
+
+        fs_checksum_result_t result;
+        esp_err_t ret = fs_checksum(argv[1], offset, length, type, &result);
+        if (ret != ESP_OK) {
+            printf("Error: Checksum failed (%s)\n", esp_err_to_name(ret));
+            return 0;
+        }
+        // 与主机上 sha256sum 的输出格式一致，便于直接比对
+        for (size_t i = 0; i < result.digest_len; i++) {
+            printf("%02x", result.digest[i]);
+        }
+        printf("  %s\n", argv[1]);
+        uint64_t ms = result.elapsed_us / 1000;
+        printf("%"PRIu64" bytes in %"PRIu64" ms (%.2f MB/s)\n", result.bytes, ms,
+               result.elapsed_us > 0 ? (double)result.bytes / result.elapsed_us : 0.0);
+    } else if (strcmp(argv[0], "restore") == 0) {
+        if (argc != 3) {
+            printf("Usage: restore <source.vid> <destination>\n");
+            return 0;
+        }
+        uint32_t frames = 0;
+        esp_err_t ret = jpeg_tables_restore_file(argv[1], argv[2], &frames);
+        if (ret != ESP_OK) {
+            printf("Error: Restore failed (%s)\n", esp_err_to_name(ret));
+            return 0;
+        }
+        printf("Restored %"PRIu32" frames to %s\n", frames, argv[2]);
+    } else if (strcmp(argv[0], "camera") == 0) {
+        const camera_profile_t* current = camera_profile_current();
+        if (argc == 1) {
+            size_t count = 0;
+            const camera_profile_t* profiles = camera_profile_list(&count);
+            for (size_t i = 0; i < count; i++) {
+                bool fits = camera_profile_fb_size(profiles[i].frame_size) <=
+                            camera_profile_fb_size(camera_config.frame_size);
+                printf("%c %-5s %4ux%-4u q=%-2d %s%s\n", &profiles[i] == current ? '*' : ' ',
+                       profiles[i].name, resolution[profiles[i].frame_size].width,
+                       resolution[profiles[i].frame_size].height, profiles[i].jpeg_quality,
+                       profiles[i].description, fits ? "" : " (buffers too small)");
+            }
+            return 0;
+        }
+        // 切换时要独占取帧，录制中采集任务也在取帧；独占期间声音触发不会开始录制
+        if (recorder_acquire_exclusive() != ESP_OK) {
+            printf("Error: Stop the recording before switching camera profiles\n");
+            return 0;
+        }
+        camera_profile_switch_t sw;
+        esp_err_t ret = camera_profile_apply(argv[1], &sw);
+        recorder_release_exclusive();
+        if (ret == ESP_ERR_NOT_FOUND) {
+            printf("Error: Unknown profile '%s', run 'camera' for the list\n", argv[1]);
+        } else if (ret == ESP_ERR_INVALID_SIZE) {
+            printf("Error: Frame buffers were allocated for a smaller resolution\n");
+        } else if (ret != ESP_OK && ret != ESP_ERR_TIMEOUT) {
+            printf("Error: Switch failed (%s)\n", esp_err_to_name(ret));
+        } else {
+            printf("%s '%s': sensor reprogrammed in %"PRIu32" us, first new frame after %"PRIu32" us "
+                   "(%"PRIu32" stale frames dropped)\n", ret == ESP_OK ? "Switched to" : "Timed out switching to",
+                   argv[1], sw.reprogram_us, sw.first_frame_us, sw.stale_frames);
+        }
     }
 
     return 0;
@@ -372,7 +668,9 @@ void app_main(void)
     ESP_ERROR_CHECK(ret);
 
     // Initialize camera
+    configure_camera_buffers();
     ESP_ERROR_CHECK(esp_camera_init(&camera_config));
+    ESP_ERROR_CHECK(camera_profile_init(&camera_config, CAMERA_DEFAULT_PROFILE));
     ESP_LOGI(TAG, "Camera initialized");
 
     // Initialize I2S for audio recording
@@ -383,6 +681,36 @@ void app_main(void)
     ESP_ERROR_CHECK(init_sdcard());
     ESP_LOGI(TAG, "SD card initialized");
 
+    // 会话号保存在NVS中，录像文件名依赖它
+    ESP_ERROR_CHECK(session_init());
+
+    // 目录不可用时仍可录制，只是不登记
+    bool catalog_ready = catalog_init() == ESP_OK;
+    if (!catalog_ready) {
+        ESP_LOGW(TAG, "Recording catalog unavailable");
+    }
+
+    // 保留策略依赖目录，目录不可用时不自动删除录像
+    retention_config_t retention_config = RETENTION_CONFIG_DEFAULT();
+    if (catalog_ready && retention_init(&retention_config) != ESP_OK) {
+        ESP_LOGW(TAG, "Retention service not started");
+    }
+
+    // 内部flash暂存层可选，没有 storage 分区时SD卡停顿照常丢帧
+    if (spill_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Flash spill tier unavailable");
+    }
+
+    recorder_config_t recorder_config = RECORDER_CONFIG_DEFAULT();
+    recorder_config.i2s = i2s_handle;
+    recorder_config.audio_chunk_size = AUDIO_BUFFER_SIZE;
+    recorder_config.audio_bytes_per_sec = I2S_SAMPLE_RATE * I2S_CHANNEL_NUM * sizeof(int16_t);
+    recorder_config.dsp.sample_rate = I2S_SAMPLE_RATE;
+    recorder_config.vad.sample_rate = I2S_SAMPLE_RATE;
+    // 排队的帧都占着帧缓冲，留一个给驱动继续采集，队列满时丢的是最新一帧而不是让传感器停下
+    recorder_config.video_queue_len = camera_config.fb_count > 1 ? camera_config.fb_count - 1 : 1;
+    ESP_ERROR_CHECK(recorder_init(&recorder_config));
+
     // Initialize console
     esp_console_repl_t *repl = NULL;
     esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
@@ -394,8 +722,9 @@ void app_main(void)
 
     esp_console_cmd_t cmd = {
         .command = "record",
-        .help = "Start recording video and audio",
-        .hint = NULL,
+        .help = "Record video and audio in the background (0 seconds = until stopped)",
+        .hint = "start [seconds] | stop | status | crop <x> <y> <w> <h>|off | audio pcm|adpcm | vad on|off | "
+                "trigger <seconds> [ms]|off",
         .func = &console_handler,
     };
     ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
@@ -406,10 +735,50 @@ void app_main(void)
     ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
 
     cmd.command = "ls";
-    cmd.help = "List files in root directory";
+    cmd.help = "List files and day directories in the root, or files in a directory";
+    cmd.hint = "[dir]";
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+
+    cmd.command = "sdstat";
+    cmd.help = "Show SD card latency histograms and stall events";
+    cmd.hint = "[reset]";
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+
+    cmd.command = "format";
+    cmd.help = "Format the SD card (FAT32 with 16KB clusters; exFAT with 128KB clusters if FatFs supports it)";
+    cmd.hint = "yes";
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+
+    cmd.command = "catalog";
+    cmd.help = "List recordings by start time (YYYYMMDD[HHMM] or Unix seconds), show stats or compact";
+    cmd.hint = "[list [from] [to] | stats | compact]";
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+
+    cmd.command = "retention";
+    cmd.help = "Show retention status (cached free space, deleted recordings)";
     cmd.hint = NULL;
     ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
 
+    cmd.command = "bench";
+    cmd.help = "Run SD card, filesystem, camera, I2S and ADPCM benchmarks, output as CSV";
+    cmd.hint = "[raw|fs|camera|i2s|adpcm|dsp|all] [MB|frames|reads|seconds]";
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+
+    cmd.command = "checksum";
+    cmd.help = "Compute CRC32 or SHA-256 of a file (or a byte range of it)";
+    cmd.hint = "<filename> [crc32|sha256] [offset] [length]";
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+
+    cmd.command = "restore";
+    cmd.help = "Rewrite a shared-table video file as plain MJPEG (JPEG tables in every frame)";
+    cmd.hint = "<source.vid> <destination>";
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+
+    cmd.command = "camera";
+    cmd.help = "List camera profiles or switch to one without reinitializing the camera";
+    cmd.hint = "[profile]";
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+
     ESP_ERROR_CHECK(esp_console_start_repl(repl));
 
     // 在程序退出时调用此函数
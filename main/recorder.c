@@ -0,0 +1,1394 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_camera.h"
+#include "driver/i2s_std.h"
+#include "fs_hal.h"
+#include "sdcard_telemetry.h"
+#include "sdcard_diskio.h"
+#include "catalog.h"
+#include "retention.h"
+#include "session.h"
+#include "spill.h"
+#include "jpeg_tables.h"
+#include "frame_dedup.h"
+#include "thumbnail.h"
+#include "adpcm.h"
+#include "audio_dsp.h"
+#include "audio_vad.h"
+#include "recorder.h"
+
+static const char* TAG = "recorder";
+
+#define CAPTURE_DONE_BIT    BIT0
+#define AUDIO_DONE_BIT      BIT1
+#define WRITER_DONE_BIT     BIT2
+#define SPILL_DONE_BIT      BIT3
+
+// 写卡任务等待新帧的超时，也决定了结束时检查退出条件的间隔
+#define WRITER_POLL_MS      20
+#define STOP_TIMEOUT_MS     10000
+// 暂存任务检查队列深度的间隔，远小于队列能缓冲的时长
+#define SPILL_POLL_MS       10
+// 裁剪只会让帧变小，留一点余量给重新编码的DC差分
+#define CROP_MARGIN         1024
+
+#define CAPTURE_TASK_PRIORITY   6
+#define AUDIO_TASK_PRIORITY     7   // I2S的DMA缓冲很小，音频任务优先级最高
+#define WRITER_TASK_PRIORITY    5
+#define SPILL_TASK_PRIORITY     5
+#define LISTEN_TASK_PRIORITY    4
+// 录制中监听任务让出I2S，每隔这么久看一次录制是否结束
+#define LISTEN_IDLE_MS          200
+// 音频同步点的间隔，以及开始估计实际采样率前等待的时间和最短的区间
+#define SYNC_INTERVAL_US        1000000
+#define SYNC_QUEUE_LEN          8
+#define RATE_WARMUP_US          2000000
+#define RATE_MIN_SPAN_US        10000000
+// 录制中定期同步文件(目录项、FAT和扇区缓存)，掉电时最多丢失这么久或这么多的数据
+#define FILE_SYNC_INTERVAL_US   5000000
+#define FILE_SYNC_BYTES         (4 * 1024 * 1024)
+// FAT32 下单个文件不能超过4GB，音视频文件写到这么大时换到新的一段
+#define SEGMENT_MAX_BYTES       ((4ULL << 30) - (16 << 20))
+
+typedef struct {
+    uint8_t* buf;
+    size_t len;
+    uint32_t silence_samples;       // 这一块之前跳过的静音样本数
+} audio_chunk_t;
+
+// 热路径上更新的计数，查询时在临界区内整体拷贝
+typedef struct {
+    uint32_t frames;
+    uint32_t repeated_frames;
+    uint32_t dropped_frames;
+    uint32_t audio_chunks;
+    uint32_t dropped_audio_chunks;
+    uint32_t write_errors;
+    uint32_t spilled_records;
+    uint64_t video_bytes;
+    uint64_t audio_bytes;
+    uint64_t table_bytes_saved;
+    uint32_t crop_failures;
+    uint32_t thumbnails;
+    uint32_t silence_gaps;
+    uint64_t silent_samples;
+    uint32_t audio_rate_mhz;
+    uint32_t segments;
+} recorder_counters_t;
+
+static recorder_config_t s_config;
+static bool s_initialized = false;
+static volatile bool s_running = false;
+static volatile bool s_stop_requested = false;
+// 开始、停止录制和独占设备互斥；独占期间(bench、format、切换摄像头配置)不能开始录制，监听任务也不读I2S
+static SemaphoreHandle_t s_control_lock = NULL;
+static volatile bool s_exclusive = false;
+// 监听任务每次读I2S和检测时持有，取得独占或开始录制时等它读完这一次
+static SemaphoreHandle_t s_listen_lock = NULL;
+
+static QueueHandle_t s_video_queue = NULL;  // camera_fb_t*
+static QueueHandle_t s_audio_free = NULL;   // 空闲的音频块
+static QueueHandle_t s_audio_full = NULL;   // 等待写卡的音频块
+static uint8_t* s_audio_pool = NULL;
+static uint8_t* s_audio_scratch = NULL;     // 没有空闲块时仍要读出I2S数据，避免DMA溢出；编码时先读到这里
+static adpcm_encoder_t s_adpcm;             // 归音频任务所有，录制结束后由写卡任务输出最后一块
+static bool s_adpcm_active = false;
+static audio_dsp_t s_dsp;                   // 归音频任务所有
+static audio_vad_t s_vad;                   // 归音频任务所有，监听任务用自己的一份
+static bool s_vad_gate_active = false;
+static bool s_gaps_active = false;          // .sil 已打开，跳过的音频可以记录下来
+static uint32_t s_silence_pending = 0;      // 还没随音频块送出的静音样本数
+static uint32_t s_silence_tail = 0;         // 录制结束时末尾的静音，音频任务结束后由写卡任务记录
+// 音频时间基准，归音频任务所有；同步点经 s_sync_queue 交给写卡任务写入 .ats
+static QueueHandle_t s_sync_queue = NULL;
+static uint64_t s_audio_captured = 0;
+static int64_t s_next_sync_us = 0;
+static recorder_sync_entry_t s_rate_ref;
+
+// 声音触发：监听任务只在没有录制时读I2S
+static TaskHandle_t s_listen_task = NULL;
+static volatile uint32_t s_trigger_duration_s = 0;
+static volatile uint32_t s_trigger_min_ms = 0;
+static volatile uint32_t s_sound_triggers = 0;
+// 声音触发的录制沿用监听时的检测状态，否则触发录制的声音会被当作噪声底，开头的声音被跳过
+static audio_vad_t s_vad_seed;
+static bool s_vad_seeded = false;
+static EventGroupHandle_t s_events = NULL;
+
+// 数据走向：s_spilling 为 true 时队列中的数据只由暂存任务取走写入flash，
+// 写卡任务只从flash读回，读空后才恢复直接出队，保证写入录像文件的顺序与采集顺序一致。
+// 切换和出队都在 s_route_lock 内进行
+static SemaphoreHandle_t s_route_lock = NULL;
+static volatile bool s_spilling = false;
+static bool s_spill_active = false;         // 本次录制是否启用暂存
+
+// 只在写卡任务中使用，帧按采集顺序经过这里
+static jpeg_tables_t s_jpeg_tables;
+static uint8_t* s_crop_buf = NULL;
+static jpeg_parser_t* s_jpeg_parser = NULL;    // 录制开始时分配，写卡任务结束时释放
+static size_t s_crop_cap = 0;
+static jpeg_crop_rect_t s_crop_actual;      // 最近一帧实际裁剪出的区域
+static frame_dedup_t s_dedup;
+static bool s_dedup_active = false;
+static uint64_t s_video_offset = 0;         // 下一帧在 .vid 中的偏移
+static uint64_t s_audio_offset = 0;         // 下一块在音频文件中的偏移
+static recorder_index_entry_t s_last_saved; // 重复帧指向的帧
+// 索引记录攒够一个扇区再写
+static recorder_index_entry_t s_index_buf[SDCARD_BLOCK_SIZE / sizeof(recorder_index_entry_t)];
+static size_t s_index_count = 0;
+static recorder_sync_entry_t s_sync_buf[SDCARD_BLOCK_SIZE / sizeof(recorder_sync_entry_t)];
+static size_t s_sync_count = 0;
+static int64_t s_next_file_sync_us = 0;
+static uint64_t s_synced_bytes = 0;         // 上次同步时音视频文件的总长度
+// 分段：每段是一组独立的文件和一条目录记录，.idx/.ats 以这一段开始的时刻为零点，
+// .ats 的样本数从这一段音频文件的第一个样本算起
+static uint64_t s_segment_limit = 0;        // 0表示不分段(exFAT)
+static int64_t s_segment_base_us = 0;       // 这一段的零点，相对录制开始
+static uint64_t s_segment_base_samples = 0;
+static uint64_t s_stream_samples = 0;       // 已写入音频文件和 .sil 的样本数，跨段累计
+static uint32_t s_last_pts_ms = 0;          // 最近写入的一帧，相对录制开始
+static time_t s_segment_start_time = 0;
+static int64_t s_segment_start_us = 0;
+static recorder_counters_t s_segment_base; // 这一段开始时的计数
+static bool s_segment_open = false;
+
+static fs_file_t s_video_file = NULL;
+static fs_file_t s_audio_file = NULL;
+static fs_file_t s_index_file = NULL;
+static fs_file_t s_silence_file = NULL;
+static fs_file_t s_sync_file = NULL;
+static bool s_thumbnails_active = false;
+static uint32_t s_next_thumbnail_ms = 0;
+static char s_video_path[RECORDER_PATH_LEN];
+static char s_audio_path[RECORDER_PATH_LEN];
+static char s_index_path[RECORDER_PATH_LEN];
+static char s_thumbnail_path[RECORDER_PATH_LEN];
+static char s_silence_path[RECORDER_PATH_LEN];
+static char s_sync_path[RECORDER_PATH_LEN];
+static uint32_t s_session_id = 0;
+static uint32_t s_duration_s = 0;
+static int64_t s_start_us = 0;
+static time_t s_start_time = 0;
+static catalog_trigger_t s_trigger = CATALOG_TRIGGER_MANUAL;
+static int64_t s_end_us = 0;
+static uint32_t s_stalls_before = 0;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static recorder_counters_t s_counters;
+
+// 上次查询状态时的快照，用于计算区间速率；只在查询方使用
+static int64_t s_last_query_us = 0;
+static recorder_counters_t s_last_query;
+
+esp_err_t recorder_init(const recorder_config_t* config) {
+    if (!config || !config->i2s || config->audio_chunk_size == 0 ||
+        config->video_queue_len == 0 || config->audio_buffers == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_config = *config;
+    frame_dedup_init(&s_dedup, &config->dedup);
+    if (audio_dsp_init(&s_dsp, &config->dsp) != ESP_OK) {
+        ESP_LOGW(TAG, "Invalid audio DSP config, recording unprocessed audio");
+        audio_dsp_config_t off = { .sample_rate = 16000 };
+        audio_dsp_init(&s_dsp, &off);
+    }
+    if (audio_vad_init(&s_vad, &config->vad) != ESP_OK) {
+        ESP_LOGW(TAG, "Invalid VAD config, silence gating and sound trigger disabled");
+        audio_vad_config_t def = AUDIO_VAD_CONFIG_DEFAULT();
+        audio_vad_init(&s_vad, &def);
+        s_config.vad_gate = false;
+    }
+    if (s_config.spill_queue_high == 0 || s_config.spill_queue_high > s_config.video_queue_len) {
+        s_config.spill_queue_high = s_config.video_queue_len > 1 ? s_config.video_queue_len - 1 : 1;
+    }
+    s_video_queue = xQueueCreate(config->video_queue_len, sizeof(camera_fb_t*));
+    s_audio_free = xQueueCreate(config->audio_buffers, sizeof(audio_chunk_t));
+    s_audio_full = xQueueCreate(config->audio_buffers, sizeof(audio_chunk_t));
+    s_sync_queue = xQueueCreate(SYNC_QUEUE_LEN, sizeof(recorder_sync_entry_t));
+    s_audio_pool = malloc(config->audio_chunk_size * (config->audio_buffers + 1));
+    s_events = xEventGroupCreate();
+    s_route_lock = xSemaphoreCreateMutex();
+    s_control_lock = xSemaphoreCreateMutex();
+    s_listen_lock = xSemaphoreCreateMutex();
+    if (!s_video_queue || !s_audio_free || !s_audio_full || !s_sync_queue || !s_audio_pool || !s_events ||
+        !s_route_lock || !s_control_lock || !s_listen_lock) {
+        ESP_LOGE(TAG, "Failed to allocate recorder buffers");
+        if (s_video_queue) vQueueDelete(s_video_queue);
+        if (s_audio_free) vQueueDelete(s_audio_free);
+        if (s_audio_full) vQueueDelete(s_audio_full);
+        if (s_sync_queue) vQueueDelete(s_sync_queue);
+        if (s_events) vEventGroupDelete(s_events);
+        if (s_route_lock) vSemaphoreDelete(s_route_lock);
+        if (s_control_lock) vSemaphoreDelete(s_control_lock);
+        if (s_listen_lock) vSemaphoreDelete(s_listen_lock);
+        free(s_audio_pool);
+        s_video_queue = s_audio_free = s_audio_full = s_sync_queue = NULL;
+        s_events = NULL;
+        s_route_lock = s_control_lock = s_listen_lock = NULL;
+        s_audio_pool = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t i = 0; i < config->audio_buffers; i++) {
+        audio_chunk_t chunk = {
+            .buf = s_audio_pool + i * config->audio_chunk_size,
+            .len = 0,
+        };
+        xQueueSend(s_audio_free, &chunk, 0);
+    }
+    s_audio_scratch = s_audio_pool + config->audio_buffers * config->audio_chunk_size;
+    // 编码结果写回音频块，块要能放下一次读取编码出的所有完整ADPCM块
+    if (s_config.audio_adpcm &&
+        ADPCM_MAX_OUTPUT(config->audio_chunk_size / sizeof(int16_t)) > config->audio_chunk_size) {
+        ESP_LOGW(TAG, "Audio chunks too small for ADPCM, recording raw PCM");
+        s_config.audio_adpcm = false;
+    }
+
+    s_initialized = true;
+    ESP_LOGI(TAG, "Recorder ready: %"PRIu32" frame queue, %"PRIu32" x %u byte audio buffers",
+             config->video_queue_len, config->audio_buffers, (unsigned)config->audio_chunk_size);
+    return ESP_OK;
+}
+
+static void capture_task(void* arg) {
+    uint64_t duration_us = (uint64_t)s_duration_s * 1000000;
+    while (!s_stop_requested) {
+        if (duration_us && (uint64_t)(esp_timer_get_time() - s_start_us) >= duration_us) {
+            // 到时后让音频任务也一起结束
+            s_stop_requested = true;
+            break;
+        }
+
+        // 帧缓冲的所有权随指针交给写卡(或暂存)任务，由它在写完后归还驱动
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (!fb) {
+            continue;
+        }
+        if (xQueueSend(s_video_queue, &fb, 0) != pdTRUE) {
+            esp_camera_fb_return(fb);
+            portENTER_CRITICAL(&s_lock);
+            s_counters.dropped_frames++;
+            portEXIT_CRITICAL(&s_lock);
+        }
+    }
+    xEventGroupSetBits(s_events, CAPTURE_DONE_BIT);
+    vTaskDelete(NULL);
+}
+
+static void count_dropped_audio(void) {
+    portENTER_CRITICAL(&s_lock);
+    s_counters.dropped_audio_chunks++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// 不保存的块(静音或没有空闲块)只累计样本数，随下一个保存的块交给写卡任务记入 .sil。
+// ADPCM编码器中不足一块的样本先补满输出，补的样本占掉跳过部分开头的时间；
+// 没有空闲块时丢掉这些样本，一起按跳过计入，时间轴仍然连续
+static void skip_audio(audio_chunk_t* chunk, bool have_buffer, size_t samples) {
+    if (s_adpcm_active && s_adpcm.fill) {
+        uint32_t pad = ADPCM_SAMPLES_PER_BLOCK - s_adpcm.fill;
+        if (have_buffer) {
+            chunk->len = adpcm_flush(&s_adpcm, chunk->buf);
+            chunk->silence_samples = s_silence_pending;
+            s_silence_pending = 0;
+            xQueueSend(s_audio_full, chunk, 0);
+            have_buffer = false;
+            samples = samples > pad ? samples - pad : 0;
+        } else {
+            s_silence_pending += s_adpcm.fill;
+            adpcm_encoder_reset(&s_adpcm);
+        }
+    }
+    if (have_buffer) {
+        xQueueSend(s_audio_free, chunk, 0);
+    }
+    s_silence_pending += samples;
+}
+
+// 每次读完I2S记下已采集的样本数(含跳过的)和 esp_timer 时间，约每秒交给写卡任务一个同步点。
+// 读取在DMA收满之后才返回，时间只会比最后一个样本的采集时间晚，播放端取下包络即可去掉调度抖动
+static void note_captured(size_t samples, int64_t now_us) {
+    s_audio_captured += samples;
+    if (now_us < s_next_sync_us) {
+        return;
+    }
+    s_next_sync_us = now_us + SYNC_INTERVAL_US;
+    recorder_sync_entry_t entry = { .samples = s_audio_captured, .time_us = now_us - s_start_us };
+    xQueueSend(s_sync_queue, &entry, 0);
+
+    // 开头几秒在读出启动前积压在DMA中的数据，从之后的第一个同步点起算实际采样率
+    if (s_rate_ref.time_us == 0) {
+        if (entry.time_us >= RATE_WARMUP_US) {
+            s_rate_ref = entry;
+        }
+        return;
+    }
+    int64_t span_us = entry.time_us - s_rate_ref.time_us;
+    if (span_us >= RATE_MIN_SPAN_US) {
+        uint32_t rate_mhz = (uint32_t)((entry.samples - s_rate_ref.samples) * 1000000000ULL / (uint64_t)span_us);
+        portENTER_CRITICAL(&s_lock);
+        s_counters.audio_rate_mhz = rate_mhz;
+        portEXIT_CRITICAL(&s_lock);
+    }
+}
+
+static void audio_task(void* arg) {
+    while (!s_stop_requested) {
+        audio_chunk_t chunk;
+        bool have_buffer = xQueueReceive(s_audio_free, &chunk, 0) == pdTRUE;
+        int16_t* pcm = (int16_t*)(have_buffer && !s_adpcm_active ? chunk.buf : s_audio_scratch);
+        size_t bytes_read = 0;
+        esp_err_t ret = i2s_channel_read(s_config.i2s, pcm, s_config.audio_chunk_size, &bytes_read, pdMS_TO_TICKS(100));
+        if (ret != ESP_OK || bytes_read == 0) {
+            if (have_buffer) {
+                xQueueSend(s_audio_free, &chunk, 0);
+            }
+            continue;
+        }
+        size_t samples = bytes_read / sizeof(int16_t);
+        note_captured(samples, esp_timer_get_time());
+
+        // 没有空闲块时也处理，滤波器和检测器的状态保持连续；静音的块不需要缓冲，不算丢弃
+        audio_dsp_process(&s_dsp, pcm, samples);
+        if (s_vad_gate_active && !audio_vad_process(&s_vad, pcm, samples, NULL)) {
+            portENTER_CRITICAL(&s_lock);
+            s_counters.silent_samples += samples;
+            portEXIT_CRITICAL(&s_lock);
+            skip_audio(&chunk, have_buffer, samples);
+            continue;
+        }
+        if (!have_buffer) {
+            count_dropped_audio();
+            if (s_gaps_active) {
+                skip_audio(&chunk, false, samples);
+            }
+            continue;
+        }
+        chunk.len = bytes_read;
+        if (s_adpcm_active) {
+            // 不足一个ADPCM块时这次没有输出
+            chunk.len = adpcm_encode(&s_adpcm, pcm, samples, chunk.buf);
+            if (chunk.len == 0) {
+                xQueueSend(s_audio_free, &chunk, 0);
+                continue;
+            }
+        }
+        chunk.silence_samples = s_silence_pending;
+        s_silence_pending = 0;
+        // 缓冲块总数等于队列长度，这里不会失败
+        xQueueSend(s_audio_full, &chunk, 0);
+    }
+    s_silence_tail = s_silence_pending;
+    xEventGroupSetBits(s_events, AUDIO_DONE_BIT);
+    vTaskDelete(NULL);
+}
+
+// 裁剪后的帧写到单独的缓冲里
+static bool crop_frame(uint8_t** buf, size_t* len) {
+    if (s_crop_cap < *len + CROP_MARGIN) {
+        uint8_t* grown = heap_caps_realloc(s_crop_buf, *len + CROP_MARGIN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!grown) {
+            grown = realloc(s_crop_buf, *len + CROP_MARGIN);
+        }
+        if (!grown) {
+            return false;
+        }
+        s_crop_buf = grown;
+        s_crop_cap = *len + CROP_MARGIN;
+    }
+    size_t cropped = 0;
+    if (jpeg_crop(s_jpeg_parser, *buf, *len, &s_config.crop, s_crop_buf, s_crop_cap, &cropped,
+                  &s_crop_actual) != ESP_OK) {
+        return false;
+    }
+    *buf = s_crop_buf;
+    *len = cropped;
+    return true;
+}
+
+static void flush_index(void) {
+    if (!s_index_file || s_index_count == 0) {
+        return;
+    }
+    size_t bytes = s_index_count * sizeof(recorder_index_entry_t);
+    int written = fs_write(s_index_file, s_index_buf, bytes);
+    s_index_count = 0;
+    if (written == (int)bytes) {
+        retention_note_write(bytes);
+        return;
+    }
+    portENTER_CRITICAL(&s_lock);
+    s_counters.write_errors++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static void append_index(uint64_t offset, uint32_t pts_ms, uint32_t len_flags) {
+    if (!s_index_file) {
+        return;
+    }
+    recorder_index_entry_t* e = &s_index_buf[s_index_count++];
+    e->offset = offset;
+    e->pts_ms = pts_ms;
+    e->len_flags = len_flags;
+    if (s_index_count == sizeof(s_index_buf) / sizeof(s_index_buf[0])) {
+        flush_index();
+    }
+}
+
+static void flush_sync(void) {
+    if (!s_sync_file || s_sync_count == 0) {
+        return;
+    }
+    size_t bytes = s_sync_count * sizeof(recorder_sync_entry_t);
+    int written = fs_write(s_sync_file, s_sync_buf, bytes);
+    s_sync_count = 0;
+    if (written == (int)bytes) {
+        retention_note_write(bytes);
+        return;
+    }
+    portENTER_CRITICAL(&s_lock);
+    s_counters.write_errors++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// 同步点只引用采集的样本数，与音频数据是否经过flash暂存无关，直接从队列取
+static void write_sync_points(void) {
+    recorder_sync_entry_t entry;
+    while (xQueueReceive(s_sync_queue, &entry, 0) == pdTRUE) {
+        if (!s_sync_file) {
+            continue;
+        }
+        entry.samples -= s_segment_base_samples;
+        entry.time_us -= s_segment_base_us;
+        s_sync_buf[s_sync_count++] = entry;
+        if (s_sync_count == sizeof(s_sync_buf) / sizeof(s_sync_buf[0])) {
+            flush_sync();
+        }
+    }
+}
+
+// 攒着的索引和同步点先写出去，再逐个同步打开的文件
+static void sync_files(void) {
+    flush_index();
+    write_sync_points();
+    flush_sync();
+    fs_file_t files[] = { s_video_file, s_audio_file, s_index_file, s_silence_file, s_sync_file };
+    uint32_t failed = 0;
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        if (files[i] && fs_sync(files[i]) != ESP_OK) {
+            failed++;
+        }
+    }
+    if (failed) {
+        portENTER_CRITICAL(&s_lock);
+        s_counters.write_errors += failed;
+        portEXIT_CRITICAL(&s_lock);
+    }
+}
+
+static void sync_files_if_due(void) {
+    int64_t now = esp_timer_get_time();
+    uint64_t written = s_video_offset + s_audio_offset;
+    if (now < s_next_file_sync_us && written - s_synced_bytes < FILE_SYNC_BYTES) {
+        return;
+    }
+    sync_files();
+    s_next_file_sync_us = now + FILE_SYNC_INTERVAL_US;
+    s_synced_bytes = written;
+}
+
+// 驱动用 esp_timer 的时间给帧打时间戳，与音频的同步点是同一个时间基准
+static uint32_t frame_pts_ms(const camera_fb_t* fb) {
+    int64_t us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec - s_start_us;
+    return us > 0 ? (uint32_t)(us / 1000) : 0;
+}
+
+static void roll_segment(uint32_t pts_ms);
+
+// 换段之后时间戳以这一段的零点为准
+static uint32_t segment_pts_ms(uint32_t pts_ms) {
+    uint32_t base_ms = (uint32_t)(s_segment_base_us / 1000);
+    return pts_ms > base_ms ? pts_ms - base_ms : 0;
+}
+
+// 帧缓冲归写卡任务所有，去表时原地修改；pts_ms 相对录制开始
+static void write_video_frame(uint8_t* buf, size_t len, uint32_t pts_ms) {
+    bool crop_failed = s_config.crop.width && !crop_frame(&buf, &len);
+
+    // 帧本身不会超过 24 位，检查放在去表前按完整长度算，留出余量
+    if (s_segment_limit && s_video_offset + len > s_segment_limit) {
+        roll_segment(pts_ms);
+    }
+    s_last_pts_ms = pts_ms;
+    pts_ms = segment_pts_ms(pts_ms);
+
+    // 缩略图取自裁剪后的画面；去表之前帧还是完整的JPEG
+    // 解码交给后台任务，这里只复制一帧；后台还在忙时下一帧再试
+    if (s_thumbnails_active && pts_ms >= s_next_thumbnail_ms &&
+        thumbnail_add(buf, len, pts_ms) != ESP_ERR_NOT_FINISHED) {
+        s_next_thumbnail_ms = pts_ms + s_config.thumbnail_interval_s * 1000;
+    }
+
+    // 去重在裁剪之后，只看保存的区域有没有变化
+    if (s_dedup_active && frame_dedup_is_repeat(&s_dedup, s_jpeg_parser, buf, len)) {
+        append_index(s_last_saved.offset, pts_ms, s_last_saved.len_flags | RECORDER_INDEX_REPEAT);
+        portENTER_CRITICAL(&s_lock);
+        s_counters.repeated_frames++;
+        if (crop_failed) {
+            s_counters.crop_failures++;
+        }
+        portEXIT_CRITICAL(&s_lock);
+        return;
+    }
+
+    size_t saved = 0;
+    if (s_config.share_jpeg_tables) {
+        size_t stripped = jpeg_tables_strip(&s_jpeg_tables, buf, len, &buf);
+        saved = len - stripped;
+        len = stripped;
+    }
+    int written = fs_write(s_video_file, buf, len);
+    if (written == (int)len) {
+        retention_note_write(len);
+        s_last_saved.offset = s_video_offset;
+        s_last_saved.len_flags = (uint32_t)len & RECORDER_INDEX_LEN_MASK;
+        append_index(s_video_offset, pts_ms, s_last_saved.len_flags);
+    }
+    if (written > 0) {
+        s_video_offset += written;
+    }
+    portENTER_CRITICAL(&s_lock);
+    if (written == (int)len) {
+        s_counters.frames++;
+        s_counters.video_bytes += len;
+        s_counters.table_bytes_saved += saved;
+    } else {
+        s_counters.write_errors++;
+    }
+    if (crop_failed) {
+        s_counters.crop_failures++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// 记录在音频文件当前位置跳过的静音
+static void append_silence(uint32_t samples) {
+    s_stream_samples += samples;
+    if (!s_silence_file || samples == 0) {
+        return;
+    }
+    recorder_silence_entry_t entry = { .offset = s_audio_offset, .samples = samples };
+    bool ok = fs_write(s_silence_file, &entry, sizeof(entry)) == (int)sizeof(entry);
+    portENTER_CRITICAL(&s_lock);
+    if (ok) {
+        s_counters.silence_gaps++;
+    } else {
+        s_counters.write_errors++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static void write_audio_chunk(const uint8_t* buf, size_t len, uint32_t silence_samples) {
+    // ADPCM 的块各自独立，新文件从块边界开始即可解码
+    if (s_segment_limit && s_audio_offset + len > s_segment_limit) {
+        roll_segment(s_last_pts_ms);
+    }
+    append_silence(silence_samples);
+    int written = fs_write(s_audio_file, buf, len);
+    if (written > 0) {
+        s_audio_offset += written;
+    }
+    if (written == (int)len) {
+        retention_note_write(len);
+        s_stream_samples += s_adpcm_active ? len / ADPCM_BLOCK_SIZE * ADPCM_SAMPLES_PER_BLOCK
+                                           : len / sizeof(int16_t);
+    }
+    portENTER_CRITICAL(&s_lock);
+    if (written == (int)len) {
+        s_counters.audio_chunks++;
+        s_counters.audio_bytes += len;
+    } else {
+        s_counters.write_errors++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// 没有在暂存时才出队，否则留给暂存任务
+static bool receive_direct(QueueHandle_t queue, void* item) {
+    xSemaphoreTake(s_route_lock, portMAX_DELAY);
+    bool received = !s_spilling && xQueueReceive(queue, item, 0) == pdTRUE;
+    xSemaphoreGive(s_route_lock);
+    return received;
+}
+
+static void write_audio_chunks(void) {
+    audio_chunk_t chunk;
+    while (receive_direct(s_audio_full, &chunk)) {
+        write_audio_chunk(chunk.buf, chunk.len, chunk.silence_samples);
+        xQueueSend(s_audio_free, &chunk, 0);
+    }
+}
+
+// 从flash读回一条暂存的记录写到SD卡；读空后切回直接写卡
+static void migrate_spilled(uint8_t** buf, size_t* cap) {
+    spill_record_type_t type;
+    uint32_t meta;
+    size_t len;
+    esp_err_t ret = spill_read(&type, &meta, buf, cap, &len);
+    if (ret == ESP_ERR_NOT_FOUND) {
+        xSemaphoreTake(s_route_lock, portMAX_DELAY);
+        // 暂存任务持锁追加，持锁后再确认一次确实读完了
+        if (spill_pending_bytes() == 0) {
+            spill_reset();
+            s_spilling = false;
+        }
+        xSemaphoreGive(s_route_lock);
+        if (!s_spilling) {
+            ESP_LOGI(TAG, "Spilled data migrated, writing to SD card directly");
+        }
+        return;
+    }
+    if (ret != ESP_OK) {
+        portENTER_CRITICAL(&s_lock);
+        s_counters.write_errors++;
+        portEXIT_CRITICAL(&s_lock);
+        return;
+    }
+    if (type == SPILL_RECORD_VIDEO) {
+        write_video_frame(*buf, len, meta);
+    } else {
+        // 音频记录的附加值是这一块之前跳过的静音样本数
+        write_audio_chunk(*buf, len, meta);
+    }
+}
+
+// 队列接近满，说明写卡任务卡在了一次慢写上
+static bool queues_backed_up(void) {
+    return uxQueueMessagesWaiting(s_video_queue) >= s_config.spill_queue_high ||
+           uxQueueMessagesWaiting(s_audio_free) == 0;
+}
+
+// 持有 s_route_lock 时调用，把队列中的数据搬到flash，flash写满时丢弃
+static bool spill_queued(void) {
+    bool moved = false;
+    camera_fb_t* fb;
+    if (xQueueReceive(s_video_queue, &fb, 0) == pdTRUE) {
+        esp_err_t ret = spill_append(SPILL_RECORD_VIDEO, frame_pts_ms(fb), fb->buf, fb->len);
+        esp_camera_fb_return(fb);
+        portENTER_CRITICAL(&s_lock);
+        if (ret == ESP_OK) {
+            s_counters.spilled_records++;
+        } else {
+            s_counters.dropped_frames++;
+        }
+        portEXIT_CRITICAL(&s_lock);
+        moved = true;
+    }
+    audio_chunk_t chunk;
+    while (xQueueReceive(s_audio_full, &chunk, 0) == pdTRUE) {
+        esp_err_t ret = spill_append(SPILL_RECORD_AUDIO, chunk.silence_samples, chunk.buf, chunk.len);
+        xQueueSend(s_audio_free, &chunk, 0);
+        portENTER_CRITICAL(&s_lock);
+        if (ret == ESP_OK) {
+            s_counters.spilled_records++;
+        } else {
+            s_counters.dropped_audio_chunks++;
+        }
+        portEXIT_CRITICAL(&s_lock);
+        moved = true;
+    }
+    return moved;
+}
+
+static void spill_task(void* arg) {
+    const EventBits_t producers_done = CAPTURE_DONE_BIT | AUDIO_DONE_BIT;
+    while (1) {
+        bool moved = false;
+        xSemaphoreTake(s_route_lock, portMAX_DELAY);
+        if (!s_spilling && queues_backed_up()) {
+            s_spilling = true;
+            ESP_LOGW(TAG, "SD card stalled, spilling to internal flash");
+        }
+        if (s_spilling) {
+            moved = spill_queued();
+        }
+        xSemaphoreGive(s_route_lock);
+
+        if (!moved) {
+            if ((xEventGroupGetBits(s_events) & producers_done) == producers_done &&
+                uxQueueMessagesWaiting(s_video_queue) == 0 && uxQueueMessagesWaiting(s_audio_full) == 0) {
+                break;
+            }
+            vTaskDelay(pdMS_TO_TICKS(SPILL_POLL_MS));
+        }
+    }
+    xEventGroupSetBits(s_events, SPILL_DONE_BIT);
+    vTaskDelete(NULL);
+}
+
+// 录制结束后报告SD卡写延迟，按最坏停顿估算需要缓冲的帧数
+static void log_sdcard_latency(uint32_t frame_count, uint64_t video_bytes, uint64_t elapsed_us) {
+    sdcard_latency_summary_t w;
+    if (sdcard_telemetry_get_summary(SDCARD_OP_WRITE, SDCARD_SIZE_CLASS_ALL, &w) != ESP_OK || w.count == 0) {
+        return;
+    }
+
+    uint32_t stalls_total = 0;
+    sdcard_telemetry_get_stalls(NULL, 0, &stalls_total);
+
+    ESP_LOGI(TAG, "SD write latency: p50 %"PRIu32" us, p99 %"PRIu32" us, p99.9 %"PRIu32" us, max %"PRIu32" us",
+             w.p50_us, w.p99_us, w.p999_us, w.max_us);
+    ESP_LOGI(TAG, "SD stalls during recording: %"PRIu32, stalls_total - s_stalls_before);
+
+    if (frame_count > 0 && elapsed_us > 0) {
+        uint64_t frame_interval_us = elapsed_us / frame_count;
+        uint32_t frames_needed = (uint32_t)((w.max_us + frame_interval_us - 1) / frame_interval_us);
+        ESP_LOGI(TAG, "Buffering to ride out worst stall: %"PRIu32" frames (~%"PRIu32" KB)",
+                 frames_needed, (uint32_t)(frames_needed * (video_bytes / frame_count) / 1024));
+    }
+}
+
+// 在目录中登记当前这一段录像，名称去掉扩展名；c 是到 end_us 为止的累计计数
+static void add_catalog_entry(const recorder_counters_t* c, int64_t end_us) {
+    const recorder_counters_t* b = &s_segment_base;
+    catalog_entry_t entry = {
+        .start_time = s_segment_start_time,
+        .duration_ms = (uint32_t)((end_us - s_segment_start_us) / 1000),
+        .frames = (c->frames + c->repeated_frames) - (b->frames + b->repeated_frames),
+        .video_bytes = c->video_bytes - b->video_bytes,
+        .audio_bytes = c->audio_bytes - b->audio_bytes,
+        .trigger = (uint8_t)s_trigger,
+        .video_format = s_config.share_jpeg_tables ? CATALOG_VIDEO_MJPEG_SHARED : CATALOG_VIDEO_MJPEG,
+        .audio_format = s_adpcm_active ? CATALOG_AUDIO_IMA_ADPCM : CATALOG_AUDIO_PCM16,
+    };
+    strlcpy(entry.name, s_video_path, sizeof(entry.name));
+    char* ext = strrchr(entry.name, '.');
+    if (ext) {
+        *ext = '\0';
+    }
+    if (catalog_append(&entry) != ESP_OK) {
+        ESP_LOGW(TAG, "Recording %s not added to catalog", entry.name);
+    }
+}
+
+// 音频文件每秒的字节数，ADPCM约为PCM的1/4(含块头)
+static uint32_t audio_file_bps(void) {
+    if (!s_config.audio_adpcm) {
+        return s_config.audio_bytes_per_sec;
+    }
+    return (uint32_t)((uint64_t)s_config.audio_bytes_per_sec * ADPCM_BLOCK_SIZE /
+                      (ADPCM_SAMPLES_PER_BLOCK * sizeof(int16_t)));
+}
+
+static void preallocate(fs_file_t file, const char* path, uint64_t size) {
+    if (size == 0) {
+        return;
+    }
+    esp_err_t ret = fs_preallocate(file, size);
+    if (ret != ESP_OK) {
+        // 没有足够的连续空间时照常按簇分配
+        ESP_LOGW(TAG, "Could not preallocate %"PRIu64" bytes for %s (%s)", size, path, esp_err_to_name(ret));
+    }
+}
+
+// 生成这一段的文件路径并打开。音视频文件打不开时失败，其余文件缺了只是少了对应的功能
+static esp_err_t open_segment(const char* base) {
+    char video_path[RECORDER_PATH_LEN];
+    char audio_path[RECORDER_PATH_LEN];
+    // fs_hal 的路径相对于挂载点
+    snprintf(video_path, sizeof(video_path), "%s.vid", base);
+    snprintf(audio_path, sizeof(audio_path), s_adpcm_active ? "%s.adp" : "%s.pcm", base);
+    snprintf(s_index_path, sizeof(s_index_path), "%s.idx", base);
+    snprintf(s_thumbnail_path, sizeof(s_thumbnail_path), "%s.thm", base);
+    snprintf(s_silence_path, sizeof(s_silence_path), "%s.sil", base);
+    snprintf(s_sync_path, sizeof(s_sync_path), "%s.ats", base);
+    if (fs_exists(video_path) || fs_exists(audio_path) || fs_exists(s_index_path) ||
+        fs_exists(s_thumbnail_path) || fs_exists(s_silence_path) || fs_exists(s_sync_path)) {
+        ESP_LOGE(TAG, "Recording files already exist: %s, %s", video_path, audio_path);
+        return ESP_ERR_INVALID_STATE;
+    }
+    // 状态查询会读这两个路径，换段时写卡任务改写它们
+    portENTER_CRITICAL(&s_lock);
+    strlcpy(s_video_path, video_path, sizeof(s_video_path));
+    strlcpy(s_audio_path, audio_path, sizeof(s_audio_path));
+    portEXIT_CRITICAL(&s_lock);
+
+    s_video_file = fs_open(s_video_path, FS_FILE_WRITE);
+    if (!s_video_file) {
+        return ESP_FAIL;
+    }
+    s_audio_file = fs_open(s_audio_path, FS_FILE_WRITE);
+    if (!s_audio_file) {
+        fs_close(s_video_file);
+        s_video_file = NULL;
+        return ESP_FAIL;
+    }
+
+    // 没有索引时仍可录制，但无法记录重复帧，去重随之关闭
+    s_index_file = fs_open(s_index_path, FS_FILE_WRITE);
+    if (!s_index_file) {
+        ESP_LOGW(TAG, "Could not create %s, recording without frame index", s_index_path);
+    }
+    // 没有 .sil 就无法还原时间轴，静音照常保存，丢弃的音频块会让音频变短
+    s_silence_file = fs_open(s_silence_path, FS_FILE_WRITE);
+    if (!s_silence_file) {
+        ESP_LOGW(TAG, "Could not create %s, storing silent audio", s_silence_path);
+    }
+    // 没有同步点时播放端按标称采样率处理
+    s_sync_file = fs_open(s_sync_path, FS_FILE_WRITE);
+    if (!s_sync_file) {
+        ESP_LOGW(TAG, "Could not create %s, recording without audio sync points", s_sync_path);
+    }
+    s_thumbnails_active = false;
+    if (s_config.thumbnail_interval_s) {
+        s_thumbnails_active = thumbnail_open(s_thumbnail_path, s_config.thumbnail_interval_s * 1000) == ESP_OK;
+        if (!s_thumbnails_active) {
+            ESP_LOGW(TAG, "Could not create %s, recording without thumbnails", s_thumbnail_path);
+        }
+    }
+    return ESP_OK;
+}
+
+static void close_segment(void) {
+    fs_file_t* files[] = { &s_video_file, &s_audio_file, &s_index_file, &s_silence_file, &s_sync_file };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        if (*files[i]) {
+            fs_close(*files[i]);
+            *files[i] = NULL;
+        }
+    }
+    // 已写入的张数在关闭时并入计数，写着的这一段由状态查询直接取
+    if (s_thumbnails_active) {
+        uint32_t written = 0;
+        thumbnail_close(&written);
+        portENTER_CRITICAL(&s_lock);
+        s_counters.thumbnails += written;
+        s_thumbnails_active = false;
+        portEXIT_CRITICAL(&s_lock);
+    }
+}
+
+// 时长已知时预先分配连续空间，录制中写入不再分配簇；分段时不超过一段的上限
+static void preallocate_segment(uint32_t elapsed_s) {
+    if (s_duration_s <= elapsed_s) {
+        return;
+    }
+    uint64_t left_s = s_duration_s - elapsed_s;
+    uint64_t video = left_s * s_config.video_prealloc_bps;
+    uint64_t audio = left_s * audio_file_bps();
+    if (s_segment_limit) {
+        video = video < s_segment_limit ? video : s_segment_limit;
+        audio = audio < s_segment_limit ? audio : s_segment_limit;
+    }
+    preallocate(s_video_file, s_video_path, video);
+    preallocate(s_audio_file, s_audio_path, audio);
+}
+
+// 视频或音频文件快到 SEGMENT_MAX_BYTES 时调用：上一段收尾并登记到目录，换一个会话号打开新的一段接着写。
+// 新一段以 pts_ms(相对录制开始)为零点；打不开新文件时结束录制
+static void roll_segment(uint32_t pts_ms) {
+    flush_index();
+    write_sync_points();
+    flush_sync();
+    close_segment();
+    s_segment_open = false;
+
+    int64_t now = esp_timer_get_time();
+    recorder_counters_t c;
+    portENTER_CRITICAL(&s_lock);
+    c = s_counters;
+    portEXIT_CRITICAL(&s_lock);
+    add_catalog_entry(&c, now);
+
+    time_t start = s_start_time + pts_ms / 1000;
+    char base[SESSION_BASE_LEN];
+    uint32_t session_id;
+    esp_err_t ret = session_begin(start, base, sizeof(base), &session_id);
+    if (ret == ESP_OK) {
+        ret = open_segment(base);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Could not open the next segment (%s), stopping the recording", esp_err_to_name(ret));
+        s_stop_requested = true;
+        return;
+    }
+    s_segment_open = true;
+    s_session_id = session_id;
+    s_segment_base = c;
+    s_segment_base_us = (int64_t)pts_ms * 1000;
+    s_segment_base_samples = s_stream_samples;
+    s_segment_start_time = start;
+    s_segment_start_us = now;
+    s_video_offset = 0;
+    s_audio_offset = 0;
+    s_synced_bytes = 0;
+    s_next_file_sync_us = now + FILE_SYNC_INTERVAL_US;
+    s_next_thumbnail_ms = 0;
+    jpeg_tables_reset(&s_jpeg_tables);
+    frame_dedup_reset(&s_dedup);
+    s_dedup_active = s_config.dedup_enabled && s_index_file;
+    preallocate_segment(pts_ms / 1000);
+    portENTER_CRITICAL(&s_lock);
+    s_counters.segments++;
+    portEXIT_CRITICAL(&s_lock);
+    ESP_LOGI(TAG, "File size limit reached, continuing in %s and %s", s_video_path, s_audio_path);
+}
+
+static void writer_task(void* arg) {
+    const EventBits_t all_done = CAPTURE_DONE_BIT | AUDIO_DONE_BIT | SPILL_DONE_BIT;
+    uint8_t* migrate_buf = NULL;
+    size_t migrate_cap = 0;
+    while (1) {
+        if (s_spilling) {
+            migrate_spilled(&migrate_buf, &migrate_cap);
+        } else {
+            camera_fb_t* fb;
+            if (xQueuePeek(s_video_queue, &fb, pdMS_TO_TICKS(WRITER_POLL_MS)) == pdTRUE &&
+                receive_direct(s_video_queue, &fb)) {
+                write_video_frame(fb->buf, fb->len, frame_pts_ms(fb));
+                esp_camera_fb_return(fb);
+            }
+            write_audio_chunks();
+        }
+        write_sync_points();
+        sync_files_if_due();
+
+        if ((xEventGroupGetBits(s_events) & all_done) == all_done && !s_spilling &&
+            uxQueueMessagesWaiting(s_video_queue) == 0 && uxQueueMessagesWaiting(s_audio_full) == 0) {
+            break;
+        }
+    }
+    free(migrate_buf);
+    free(s_crop_buf);
+    s_crop_buf = NULL;
+    s_crop_cap = 0;
+    frame_dedup_free(&s_dedup);
+    jpeg_parser_destroy(s_jpeg_parser);
+    s_jpeg_parser = NULL;
+    flush_index();
+    // 音频任务已经结束，补满并写出最后一个不完整的ADPCM块
+    if (s_adpcm_active) {
+        size_t tail = adpcm_flush(&s_adpcm, s_audio_scratch);
+        if (tail) {
+            write_audio_chunk(s_audio_scratch, tail, 0);
+        }
+    }
+    append_silence(s_silence_tail);
+    write_sync_points();
+    flush_sync();
+
+    close_segment();
+    sdcard_diskio_set_trim_paused(false);
+    s_end_us = esp_timer_get_time();
+
+    recorder_counters_t c;
+    portENTER_CRITICAL(&s_lock);
+    c = s_counters;
+    portEXIT_CRITICAL(&s_lock);
+
+    ESP_LOGI(TAG, "Recording finished: %"PRIu32" frames (%"PRIu32" repeated, %"PRIu32" dropped), "
+             "%"PRIu32" audio chunks (%"PRIu32" dropped), %"PRIu32" write errors, %"PRIu32" records via flash",
+             c.frames + c.repeated_frames, c.repeated_frames, c.dropped_frames, c.audio_chunks,
+             c.dropped_audio_chunks, c.write_errors, c.spilled_records);
+    ESP_LOGI(TAG, "- %s: %"PRIu64" bytes (%"PRIu64" bytes of repeated JPEG tables removed)",
+             s_video_path, c.video_bytes, c.table_bytes_saved);
+    ESP_LOGI(TAG, "- %s: %"PRIu64" bytes", s_audio_path, c.audio_bytes);
+    if (c.silence_gaps) {
+        ESP_LOGI(TAG, "- %s: %"PRIu32" gaps, %"PRIu64" ms of silence not stored", s_silence_path, c.silence_gaps,
+                 c.silent_samples * 1000 / s_vad.config.sample_rate);
+    }
+    if (c.audio_rate_mhz) {
+        ESP_LOGI(TAG, "- %s: audio clock %"PRIu32".%03"PRIu32" Hz", s_sync_path,
+                 c.audio_rate_mhz / 1000, c.audio_rate_mhz % 1000);
+    }
+    if (c.thumbnails) {
+        ESP_LOGI(TAG, "- %s: %"PRIu32" thumbnails", s_thumbnail_path, c.thumbnails);
+    }
+    if (c.segments) {
+        ESP_LOGI(TAG, "- split into %"PRIu32" segments at the FAT32 file size limit", c.segments + 1);
+    }
+    log_sdcard_latency(c.frames, c.video_bytes, s_end_us - s_start_us);
+    if (s_segment_open) {
+        add_catalog_entry(&c, s_end_us);
+    }
+    s_segment_open = false;
+
+    s_running = false;
+    xEventGroupSetBits(s_events, WRITER_DONE_BIT);
+    vTaskDelete(NULL);
+}
+
+// 持有 s_control_lock 时调用
+static esp_err_t start_recording(uint32_t duration_s, catalog_trigger_t trigger) {
+    // 裁剪和去重逐帧解析帧头，共用一个解析上下文，每次录制只分配一次；启动失败时留到下一次使用
+    if ((s_config.crop.width || s_config.dedup_enabled) && !s_jpeg_parser &&
+        jpeg_parser_create(&s_jpeg_parser) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate the JPEG parser");
+        return ESP_ERR_NO_MEM;
+    }
+    time_t now = time(NULL);
+    char base[SESSION_BASE_LEN];
+    uint32_t session_id;
+    esp_err_t ret = session_begin(now, base, sizeof(base), &session_id);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate a recording session (%s)", esp_err_to_name(ret));
+        return ret;
+    }
+
+    // 先腾出这段录像需要的空间；时长未知时只保证高水位
+    uint64_t estimate = (uint64_t)duration_s * (s_config.video_prealloc_bps + audio_file_bps());
+    if (retention_ensure_space(estimate) == ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "Card is nearly full and there are no old recordings to delete");
+    }
+
+    // 音频文件的格式在整段录制中不变，换段时沿用
+    s_adpcm_active = s_config.audio_adpcm;
+    ret = open_segment(base);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    // exFAT 不限制文件大小，一直写同一组文件
+    uint64_t max_file = fs_max_file_size();
+    s_segment_limit = max_file > SEGMENT_MAX_BYTES && max_file != UINT64_MAX ? SEGMENT_MAX_BYTES : 0;
+    s_duration_s = duration_s;
+    preallocate_segment(0);
+
+    portENTER_CRITICAL(&s_lock);
+    memset(&s_counters, 0, sizeof(s_counters));
+    portEXIT_CRITICAL(&s_lock);
+    memset(&s_last_query, 0, sizeof(s_last_query));
+    xQueueReset(s_video_queue);
+    xEventGroupClearBits(s_events, CAPTURE_DONE_BIT | AUDIO_DONE_BIT | WRITER_DONE_BIT | SPILL_DONE_BIT);
+    s_spilling = false;
+    jpeg_tables_reset(&s_jpeg_tables);
+    memset(&s_crop_actual, 0, sizeof(s_crop_actual));
+    frame_dedup_reset(&s_dedup);
+    s_dedup_active = s_config.dedup_enabled && s_index_file;
+    s_video_offset = 0;
+    s_audio_offset = 0;
+    s_index_count = 0;
+    s_next_thumbnail_ms = 0;
+    adpcm_encoder_reset(&s_adpcm);
+    audio_dsp_reset(&s_dsp);
+    if (s_vad_seeded) {
+        s_vad = s_vad_seed;
+        s_vad_seeded = false;
+    } else {
+        audio_vad_reset(&s_vad);
+    }
+    s_gaps_active = s_silence_file != NULL;
+    s_vad_gate_active = s_config.vad_gate && s_gaps_active;
+    xQueueReset(s_sync_queue);
+    s_sync_count = 0;
+    s_audio_captured = 0;
+    s_next_sync_us = 0;
+    memset(&s_rate_ref, 0, sizeof(s_rate_ref));
+    s_silence_pending = 0;
+    s_silence_tail = 0;
+    s_stream_samples = 0;
+    s_segment_base_samples = 0;
+    s_segment_base_us = 0;
+    s_last_pts_ms = 0;
+    memset(&s_segment_base, 0, sizeof(s_segment_base));
+    s_spill_active = s_config.spill_enabled && spill_available();
+    if (!s_spill_active) {
+        xEventGroupSetBits(s_events, SPILL_DONE_BIT);
+    }
+
+    sdcard_telemetry_get_stalls(NULL, 0, &s_stalls_before);
+    sdcard_diskio_set_trim_paused(true);
+    s_stop_requested = false;
+    s_start_us = esp_timer_get_time();
+    s_next_file_sync_us = s_start_us + FILE_SYNC_INTERVAL_US;
+    s_synced_bytes = 0;
+    s_start_time = now;
+    s_segment_start_time = now;
+    s_segment_start_us = s_start_us;
+    s_segment_open = true;
+    s_session_id = session_id;
+    s_trigger = trigger;
+    s_last_query_us = s_start_us;
+    s_running = true;
+    // 监听任务可能正在读I2S，等它读完这一次，之后它看到 s_running 就不再读
+    xSemaphoreTake(s_listen_lock, portMAX_DELAY);
+    xSemaphoreGive(s_listen_lock);
+
+    if (xTaskCreate(writer_task, "rec_writer", 4096, NULL, WRITER_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start writer task");
+        close_segment();
+        s_segment_open = false;
+        sdcard_diskio_set_trim_paused(false);
+        s_running = false;
+        return ESP_ERR_NO_MEM;
+    }
+    // 写卡任务已经在运行，其余任务创建失败时按已结束处理，写卡任务负责收尾
+    if (s_spill_active && xTaskCreate(spill_task, "rec_spill", 3072, NULL, SPILL_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGW(TAG, "Failed to start spill task, recording without flash buffering");
+        xEventGroupSetBits(s_events, SPILL_DONE_BIT);
+    }
+    if (xTaskCreate(audio_task, "rec_audio", 3072, NULL, AUDIO_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start audio task");
+        s_stop_requested = true;
+        xEventGroupSetBits(s_events, AUDIO_DONE_BIT);
+    }
+    if (xTaskCreate(capture_task, "rec_capture", 3072, NULL, CAPTURE_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start capture task");
+        s_stop_requested = true;
+        xEventGroupSetBits(s_events, CAPTURE_DONE_BIT);
+    }
+
+    ESP_LOGI(TAG, "Recording to %s and %s%s", s_video_path, s_audio_path,
+             duration_s ? "" : " until stopped");
+    return ESP_OK;
+}
+
+esp_err_t recorder_start(uint32_t duration_s, catalog_trigger_t trigger) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // 控制台和监听任务可能同时开始录制
+    xSemaphoreTake(s_control_lock, portMAX_DELAY);
+    esp_err_t ret = s_running || s_exclusive ? ESP_ERR_INVALID_STATE : start_recording(duration_s, trigger);
+    xSemaphoreGive(s_control_lock);
+    return ret;
+}
+
+esp_err_t recorder_acquire_exclusive(void) {
+    if (!s_initialized) {
+        return ESP_OK;
+    }
+    xSemaphoreTake(s_control_lock, portMAX_DELAY);
+    esp_err_t ret = ESP_OK;
+    if (s_running || s_exclusive) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        s_exclusive = true;
+    }
+    xSemaphoreGive(s_control_lock);
+    if (ret == ESP_OK) {
+        xSemaphoreTake(s_listen_lock, portMAX_DELAY);
+        xSemaphoreGive(s_listen_lock);
+    }
+    return ret;
+}
+
+bool recorder_is_exclusive(void) {
+    return s_exclusive;
+}
+
+void recorder_release_exclusive(void) {
+    if (!s_initialized) {
+        return;
+    }
+    xSemaphoreTake(s_control_lock, portMAX_DELAY);
+    s_exclusive = false;
+    xSemaphoreGive(s_control_lock);
+}
+
+esp_err_t recorder_set_audio_adpcm(bool enabled) {
+    if (!s_initialized || s_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (enabled && ADPCM_MAX_OUTPUT(s_config.audio_chunk_size / sizeof(int16_t)) > s_config.audio_chunk_size) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    s_config.audio_adpcm = enabled;
+    return ESP_OK;
+}
+
+esp_err_t recorder_set_vad_gate(bool enabled) {
+    if (!s_initialized || s_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_config.vad_gate = enabled;
+    return ESP_OK;
+}
+
+// 没有在录制时读I2S，连续有声够久就开始一段录制。录制中音频任务独占I2S，设备被独占时也不读，
+// 这里只等待；每次读取持有 s_listen_lock，开始录制和取得独占时等这一次读完
+static void listen_task(void* arg) {
+    uint8_t* buf = arg;
+    audio_dsp_t dsp;
+    audio_vad_t vad;
+    audio_dsp_init(&dsp, &s_dsp.config);
+    audio_vad_init(&vad, &s_vad.config);
+    bool paused = true;
+    while (1) {
+        xSemaphoreTake(s_listen_lock, portMAX_DELAY);
+        if (s_trigger_duration_s == 0 || s_running || s_exclusive) {
+            xSemaphoreGive(s_listen_lock);
+            paused = true;
+            vTaskDelay(pdMS_TO_TICKS(LISTEN_IDLE_MS));
+            continue;
+        }
+        // 录制期间环境可能变了，重新估计噪声底
+        if (paused) {
+            audio_dsp_reset(&dsp);
+            audio_vad_reset(&vad);
+            paused = false;
+        }
+        size_t bytes_read = 0;
+        audio_vad_result_t result = { 0 };
+        if (i2s_channel_read(s_config.i2s, buf, s_config.audio_chunk_size, &bytes_read, pdMS_TO_TICKS(100)) == ESP_OK &&
+            bytes_read > 0) {
+            size_t samples = bytes_read / sizeof(int16_t);
+            audio_dsp_process(&dsp, (int16_t*)buf, samples);
+            audio_vad_process(&vad, (const int16_t*)buf, samples, &result);
+        }
+        // 开始录制前放开，recorder_start 要等这把锁
+        xSemaphoreGive(s_listen_lock);
+        if (!result.speech || result.run_ms < s_trigger_min_ms) {
+            continue;
+        }
+        ESP_LOGI(TAG, "Sound for %"PRIu32" ms (energy %"PRIu32", noise floor %"PRIu32"), starting recording",
+                 result.run_ms, result.energy, result.noise_floor);
+        s_vad_seed = vad;
+        s_vad_seeded = true;
+        esp_err_t ret = recorder_start(s_trigger_duration_s, CATALOG_TRIGGER_EVENT);
+        if (ret == ESP_OK) {
+            s_sound_triggers++;
+        } else {
+            s_vad_seeded = false;
+            ESP_LOGW(TAG, "Sound-triggered recording failed to start (%s)", esp_err_to_name(ret));
+            vTaskDelay(pdMS_TO_TICKS(LISTEN_IDLE_MS));
+        }
+        paused = true;
+    }
+}
+
+esp_err_t recorder_set_sound_trigger(uint32_t duration_s, uint32_t min_sound_ms) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_trigger_min_ms = min_sound_ms;
+    // 第一次启用时创建监听任务，之后关闭时任务只是空转等待
+    if (duration_s && !s_listen_task) {
+        uint8_t* buf = malloc(s_config.audio_chunk_size);
+        if (!buf) {
+            return ESP_ERR_NO_MEM;
+        }
+        if (xTaskCreate(listen_task, "rec_listen", 3072, buf, LISTEN_TASK_PRIORITY, &s_listen_task) != pdPASS) {
+            free(buf);
+            s_listen_task = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    s_trigger_duration_s = duration_s;
+    return ESP_OK;
+}
+
+esp_err_t recorder_set_crop(const jpeg_crop_rect_t* rect) {
+    if (!s_initialized || s_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (rect && rect->width && rect->height) {
+        s_config.crop = *rect;
+    } else {
+        memset(&s_config.crop, 0, sizeof(s_config.crop));
+    }
+    return ESP_OK;
+}
+
+esp_err_t recorder_stop(void) {
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // 持锁等写卡任务结束，期间不会有新的录制开始
+    xSemaphoreTake(s_control_lock, portMAX_DELAY);
+    if (!s_running) {
+        xSemaphoreGive(s_control_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_stop_requested = true;
+    EventBits_t bits = xEventGroupWaitBits(s_events, WRITER_DONE_BIT, pdFALSE, pdFALSE,
+                                           pdMS_TO_TICKS(STOP_TIMEOUT_MS));
+    xSemaphoreGive(s_control_lock);
+    return (bits & WRITER_DONE_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+bool recorder_is_running(void) {
+    return s_running;
+}
+
+esp_err_t recorder_get_status(recorder_status_t* out_status) {
+    if (!out_status) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(out_status, 0, sizeof(*out_status));
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    recorder_counters_t c;
+    portENTER_CRITICAL(&s_lock);
+    c = s_counters;
+    bool thumbnails_open = s_thumbnails_active;
+    portEXIT_CRITICAL(&s_lock);
+
+    bool running = s_running;
+    int64_t now = running ? esp_timer_get_time() : s_end_us;
+    out_status->running = running;
+    portENTER_CRITICAL(&s_lock);
+    strlcpy(out_status->video_path, s_video_path, sizeof(out_status->video_path));
+    strlcpy(out_status->audio_path, s_audio_path, sizeof(out_status->audio_path));
+    portEXIT_CRITICAL(&s_lock);
+    out_status->session_id = s_session_id;
+    out_status->duration_s = s_duration_s;
+    out_status->elapsed_ms = s_start_us ? (uint32_t)((now - s_start_us) / 1000) : 0;
+    out_status->frames = c.frames;
+    out_status->repeated_frames = c.repeated_frames;
+    out_status->dropped_frames = c.dropped_frames;
+    out_status->audio_chunks = c.audio_chunks;
+    out_status->dropped_audio_chunks = c.dropped_audio_chunks;
+    out_status->write_errors = c.write_errors;
+    out_status->video_bytes = c.video_bytes;
+    out_status->audio_bytes = c.audio_bytes;
+    out_status->table_bytes_saved = c.table_bytes_saved;
+    out_status->crop = s_crop_actual;
+    out_status->crop_failures = c.crop_failures;
+    out_status->thumbnails = c.thumbnails + (thumbnails_open ? thumbnail_get_count() : 0);
+    out_status->audio_adpcm = running ? s_adpcm_active : s_config.audio_adpcm;
+    out_status->vad_gate = running ? s_vad_gate_active : s_config.vad_gate;
+    out_status->silence_gaps = c.silence_gaps;
+    out_status->silent_ms = (uint32_t)(c.silent_samples * 1000 / s_vad.config.sample_rate);
+    out_status->sound_trigger_s = s_trigger_duration_s;
+    out_status->sound_triggers = s_sound_triggers;
+    out_status->audio_rate_mhz = c.audio_rate_mhz;
+    out_status->video_queue_depth = uxQueueMessagesWaiting(s_video_queue);
+    out_status->video_queue_len = s_config.video_queue_len;
+    out_status->audio_queue_depth = uxQueueMessagesWaiting(s_audio_full);
+    out_status->audio_queue_len = s_config.audio_buffers;
+    out_status->spilling = s_spilling;
+    out_status->spilled_records = c.spilled_records;
+    out_status->spill_pending_bytes = spill_pending_bytes();
+
+    // 录制中按两次查询之间的增量计算，结束后给出整段录制的平均值
+    int64_t since_us = running ? s_last_query_us : s_start_us;
+    const recorder_counters_t* base = running ? &s_last_query : &(recorder_counters_t){ 0 };
+    int64_t span_us = now - since_us;
+    if (span_us > 0) {
+        uint32_t captured = (c.frames + c.repeated_frames) - (base->frames + base->repeated_frames);
+        out_status->fps = (float)captured * 1000000.0f / span_us;
+        uint64_t bytes = (c.video_bytes + c.audio_bytes) - (base->video_bytes + base->audio_bytes);
+        out_status->bytes_per_sec = (uint32_t)(bytes * 1000000 / span_us);
+    }
+    if (running) {
+        s_last_query = c;
+        s_last_query_us = now;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "driver/i2s_types.h"
+#include "catalog.h"
+#include "jpeg_crop.h"
+#include "frame_dedup.h"
+#include "audio_dsp.h"
+#include "audio_vad.h"
+
+// 日期目录/会话号-时分.扩展名，见 session.h
+#define RECORDER_PATH_LEN 40
+
+// .thm 的格式见 thumbnail.h
+// .idx：每个采集到的帧一条记录(小端)，播放时按采集时间还原节奏。
+// 去重跳过的帧标记为重复，偏移和长度指向被重复的那一帧
+typedef struct {
+    uint64_t offset;                // 帧在 .vid 中的偏移
+    uint32_t pts_ms;                // 相对这一段开始的采集时间(FAT32 上长录制按 4GB 分段)
+    uint32_t len_flags;             // 低24位为帧长度，高8位为 RECORDER_INDEX_*
+} recorder_index_entry_t;
+
+#define RECORDER_INDEX_LEN_MASK     0x00FFFFFF
+#define RECORDER_INDEX_REPEAT       0x80000000
+
+// .sil：跳过的每段音频(静音或没有空闲缓冲时丢弃的块)一条记录(小端)，
+// 播放时在音频文件的 offset 处插入 samples 个静音样本还原时间轴
+typedef struct {
+    uint64_t offset;                // 插入位置在音频文件中的偏移，ADPCM时在块边界上
+    uint32_t samples;               // 跳过的样本数
+    uint32_t reserved;
+} recorder_silence_entry_t;
+
+// .ats：音频的同步点(小端)，约每秒一条：采集到第 samples 个样本(含跳过的)时的 esp_timer 时间，
+// 与 .idx 的 pts_ms 零点相同。I2S的实际采样率与标称值有偏差，播放时按同步点拟合出实际采样率和
+// 第一个样本的时间，把音频重采样到视频的时间轴上
+typedef struct {
+    uint64_t samples;
+    int64_t time_us;                // 相对这一段开始
+} recorder_sync_entry_t;
+
+// 后台录制服务：采集任务只取帧/取音频并入队，写卡由单独的任务完成，
+// 控制台在录制期间仍可使用。SD卡停顿导致队列积压时，新数据按顺序暂存到内部flash，
+// 卡恢复后写卡任务先把暂存的数据追加到录像文件，再恢复直接写卡
+
+typedef struct {
+    i2s_chan_handle_t i2s;          // 已使能的PDM接收通道
+    size_t audio_chunk_size;        // 每次从I2S读取的字节数
+    uint32_t audio_bytes_per_sec;   // PCM数据率，用于按时长预分配音频文件
+    uint32_t video_queue_len;       // 等待写卡的帧数上限，超出时丢帧；不应超过相机帧缓冲数减一
+    uint32_t audio_buffers;         // 音频缓冲块数，用完时丢弃音频块
+    uint32_t video_prealloc_bps;    // 按时长预分配视频文件时估计的码率，0表示不预分配
+    bool spill_enabled;             // SD卡停顿时把数据暂存到内部flash，需要先调用 spill_init
+    uint32_t spill_queue_high;      // 帧队列达到这个深度时开始暂存，0表示队列长度减一
+    bool share_jpeg_tables;         // 去掉与上一帧相同的DQT/DHT表，见 jpeg_tables.h
+    jpeg_crop_rect_t crop;          // 只保存画面中的这块区域，宽度为0表示保存整帧，见 jpeg_crop.h
+    bool dedup_enabled;             // 画面静止时不保存重复的帧，只在 .idx 中记录
+    frame_dedup_config_t dedup;
+    uint32_t thumbnail_interval_s;  // 每隔多少秒往 .thm 中加一张1/8缩略图，0表示不生成，见 thumbnail.h
+    bool audio_adpcm;               // 音频在音频任务中编码为IMA-ADPCM写入 .adp，否则写原始PCM到 .pcm，见 adpcm.h
+    audio_dsp_config_t dsp;         // 写入(编码)前的隔直/高通/AGC，sample_rate 与I2S通道一致，见 audio_dsp.h
+    bool vad_gate;                  // 不保存没有声音的音频块，跳过的时长记在 .sil 中
+    audio_vad_config_t vad;         // 静音门控和声音触发共用的检测参数，见 audio_vad.h
+} recorder_config_t;
+
+#define RECORDER_CONFIG_DEFAULT() { \
+    .i2s = NULL, \
+    .audio_chunk_size = 2048, \
+    .audio_bytes_per_sec = 16000 * 2, \
+    .video_queue_len = 4, \
+    .audio_buffers = 8, \
+    .video_prealloc_bps = 512 * 1024, \
+    .spill_enabled = true, \
+    .spill_queue_high = 0, \
+    .share_jpeg_tables = true, \
+    .crop = { 0 }, \
+    .dedup_enabled = true, \
+    .dedup = FRAME_DEDUP_CONFIG_DEFAULT(), \
+    .thumbnail_interval_s = 10, \
+    .audio_adpcm = true, \
+    .dsp = AUDIO_DSP_CONFIG_DEFAULT(), \
+    .vad_gate = true, \
+    .vad = AUDIO_VAD_CONFIG_DEFAULT(), \
+}
+
+typedef struct {
+    bool running;
+    uint32_t session_id;
+    char video_path[RECORDER_PATH_LEN];
+    char audio_path[RECORDER_PATH_LEN];
+    uint32_t duration_s;            // 0表示一直录到 stop
+    uint32_t elapsed_ms;
+    uint32_t frames;                // 已写入的帧数
+    uint32_t repeated_frames;       // 画面静止、只记在索引中的帧数
+    uint32_t dropped_frames;        // 写卡跟不上(且flash也写满)时丢弃的帧数
+    uint32_t audio_chunks;          // 已写入的音频块数
+    uint32_t dropped_audio_chunks;  // 没有空闲缓冲时丢弃的音频块数
+    uint32_t write_errors;
+    uint64_t video_bytes;
+    uint64_t audio_bytes;
+    uint64_t table_bytes_saved;     // 去掉重复的JPEG表省下的字节数
+    jpeg_crop_rect_t crop;          // 实际保存的区域(对齐到MCU)，宽度为0表示整帧
+    uint32_t crop_failures;         // 无法裁剪、按整帧保存的帧数
+    uint32_t thumbnails;            // 已写入 .thm 的缩略图张数
+    bool audio_adpcm;               // 音频按IMA-ADPCM保存(录制中为本次录制，否则为下次录制)
+    bool vad_gate;                  // 静音门控(录制中为本次录制，否则为下次录制)
+    uint32_t silence_gaps;          // 记入 .sil 的跳过段数(静音或丢弃)
+    uint32_t silent_ms;             // 没有保存的静音时长
+    uint32_t sound_trigger_s;       // 声音触发的录制时长，0表示未启用
+    uint32_t sound_triggers;        // 启动以来由声音触发的录制次数
+    uint32_t audio_rate_mhz;        // 按同步点实测的音频采样率(毫赫兹)，录制不到十几秒时为0
+    uint32_t video_queue_depth;
+    uint32_t video_queue_len;
+    uint32_t audio_queue_depth;
+    uint32_t audio_queue_len;
+    bool spilling;                  // 正在经由内部flash写卡
+    uint32_t spilled_records;       // 暂存到flash的帧和音频块数
+    uint32_t spill_pending_bytes;   // flash中尚未写到SD卡的字节数
+    float fps;                      // 距上次查询(或开始录制)以来的帧率
+    uint32_t bytes_per_sec;         // 同一区间内写入的字节速率
+} recorder_status_t;
+
+/**
+ * @brief 初始化录制服务，分配队列和音频缓冲
+ * @param config 录制配置
+ * @return ESP_OK 成功，ESP_ERR_NO_MEM 内存不足
+ */
+esp_err_t recorder_init(const recorder_config_t* config);
+
+/**
+ * @brief 开始后台录制，立即返回
+ * @param duration_s 录制时长(秒)，0表示一直录到 recorder_stop
+ * @param trigger 开始录制的原因，结束时记入目录
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 正在录制、设备被独占或文件已存在
+ */
+esp_err_t recorder_start(uint32_t duration_s, catalog_trigger_t trigger);
+
+/**
+ * @brief 独占SD卡、摄像头和I2S：没有在录制时才能取得，之后 recorder_start 失败，声音触发的监听暂停。
+ *        bench、format 和切换摄像头配置在整个操作期间持有
+ * @return ESP_OK 成功(录制服务未初始化时也成功)，ESP_ERR_INVALID_STATE 正在录制或已被独占
+ */
+esp_err_t recorder_acquire_exclusive(void);
+
+/**
+ * @brief 释放 recorder_acquire_exclusive 取得的独占
+ */
+void recorder_release_exclusive(void);
+
+/**
+ * @brief 设备是否被独占，后台任务据此暂停访问卡
+ * @return true 已被独占
+ */
+bool recorder_is_exclusive(void);
+
+/**
+ * @brief 设置下次录制保存的画面区域
+ * @param rect 区域，NULL或宽度为0表示保存整帧
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 正在录制
+ */
+esp_err_t recorder_set_crop(const jpeg_crop_rect_t* rect);
+
+/**
+ * @brief 设置下次录制的音频格式
+ * @param enabled true 编码为IMA-ADPCM，false 保存原始PCM
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 正在录制，ESP_ERR_NOT_SUPPORTED 音频块太小
+ */
+esp_err_t recorder_set_audio_adpcm(bool enabled);
+
+/**
+ * @brief 设置下次录制是否跳过静音的音频
+ * @param enabled true 静音的音频块只在 .sil 中记录时长
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 正在录制
+ */
+esp_err_t recorder_set_vad_gate(bool enabled);
+
+/**
+ * @brief 启用或关闭声音触发：没有在录制时持续监听麦克风，连续有声达到 min_sound_ms 后开始一段录制，
+ *        目录中记为 CATALOG_TRIGGER_EVENT；录制结束后继续监听
+ * @param duration_s 每次触发录制的时长(秒)，0表示关闭
+ * @param min_sound_ms 连续有声多久才触发，过滤关门声之类短促的声音
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 未初始化，ESP_ERR_NO_MEM 无法创建监听任务
+ */
+esp_err_t recorder_set_sound_trigger(uint32_t duration_s, uint32_t min_sound_ms);
+
+/**
+ * @brief 停止录制，等待已入队的数据写完并关闭文件
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 没有在录制，ESP_ERR_TIMEOUT 写卡任务未按时结束
+ */
+esp_err_t recorder_stop(void);
+
+/**
+ * @brief 是否正在录制，不影响 recorder_get_status 的速率区间
+ * @return true 正在录制
+ */
+bool recorder_is_running(void);
+
+/**
+ * @brief 获取录制状态，录制结束后保留最后一次录制的统计
+ * @param out_status 输出的状态
+ * @return ESP_OK 成功
+ */
+esp_err_t recorder_get_status(recorder_status_t* out_status);
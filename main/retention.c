@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "fs_hal.h"
+#include "catalog.h"
+#include "recorder.h"
+#include "retention.h"
+#include "session.h"
+
+static const char* TAG = "retention";
+
+#define RETENTION_TASK_PRIORITY 2   // 低于录制的三个任务
+#define SECONDS_PER_DAY         86400
+
+// 每段录像的文件扩展名，删除时逐个删除
+static const char* const s_extensions[] = { ".vid", ".pcm", ".adp", ".idx", ".thm", ".sil", ".ats" };
+
+// 删除顺序：优先级低的先删，同优先级按时间先删旧的
+static const uint8_t s_priority[CATALOG_TRIGGER_COUNT] = {
+    [CATALOG_TRIGGER_LOOP] = 0,
+    [CATALOG_TRIGGER_BOOT] = 1,
+    [CATALOG_TRIGGER_MANUAL] = 2,
+    [CATALOG_TRIGGER_EVENT] = 3,
+};
+#define PRIORITY_LEVELS 4
+
+static retention_config_t s_config;
+static TaskHandle_t s_task = NULL;
+static SemaphoreHandle_t s_delete_mutex = NULL;
+
+// 剩余空间 = 上次校准的值 - 之后写入的字节 + 之后删除释放的字节
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t s_free_bytes = 0;
+static uint64_t s_written_bytes = 0;
+static uint32_t s_cluster_size = 0;
+static int64_t s_resync_us = 0;
+
+static bool s_reclaiming = false;
+static uint32_t s_deleted_recordings = 0;
+static uint64_t s_freed_bytes = 0;
+static uint32_t s_deferred_checks = 0;
+
+typedef struct {
+    catalog_entry_t entries[PRIORITY_LEVELS];
+    bool found[PRIORITY_LEVELS];
+} candidates_t;
+
+static void resync_free_space(void) {
+    fs_info_t info;
+    if (fs_get_info(&info) != ESP_OK) {
+        return;
+    }
+    portENTER_CRITICAL(&s_lock);
+    s_free_bytes = info.free_bytes;
+    s_written_bytes = 0;
+    s_cluster_size = info.cluster_size;
+    portEXIT_CRITICAL(&s_lock);
+    s_resync_us = esp_timer_get_time();
+}
+
+void retention_note_write(size_t bytes) {
+    portENTER_CRITICAL(&s_lock);
+    s_written_bytes += bytes;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+uint64_t retention_free_bytes(void) {
+    portENTER_CRITICAL(&s_lock);
+    uint64_t free_bytes = s_free_bytes > s_written_bytes ? s_free_bytes - s_written_bytes : 0;
+    portEXIT_CRITICAL(&s_lock);
+    return free_bytes;
+}
+
+static uint64_t round_to_cluster(uint64_t bytes) {
+    uint32_t cluster = s_cluster_size ? s_cluster_size : SDCARD_BLOCK_SIZE;
+    return (bytes + cluster - 1) / cluster * cluster;
+}
+
+// 每个优先级记下遇到的第一条(最旧的)，找到最低优先级后即可停止
+static bool collect_candidate(const catalog_entry_t* entry, void* ctx) {
+    candidates_t* c = ctx;
+    uint8_t p = entry->trigger < CATALOG_TRIGGER_COUNT ? s_priority[entry->trigger] : 0;
+    if (!c->found[p]) {
+        c->entries[p] = *entry;
+        c->found[p] = true;
+    }
+    return !c->found[0];
+}
+
+static bool take_first(const catalog_entry_t* entry, void* ctx) {
+    candidates_t* c = ctx;
+    c->entries[0] = *entry;
+    c->found[0] = true;
+    return false;
+}
+
+static bool find_oldest_expired(catalog_entry_t* out) {
+    time_t now = time(NULL);
+    if (s_config.max_age_days == 0 || now < (time_t)s_config.max_age_days * SECONDS_PER_DAY) {
+        return false;
+    }
+    candidates_t c = { 0 };
+    catalog_query(0, (int64_t)now - (int64_t)s_config.max_age_days * SECONDS_PER_DAY, take_first, &c);
+    if (c.found[0]) {
+        *out = c.entries[0];
+    }
+    return c.found[0];
+}
+
+static bool find_lowest_priority(catalog_entry_t* out) {
+    candidates_t c = { 0 };
+    catalog_query(0, INT64_MAX, collect_candidate, &c);
+    for (int p = 0; p < PRIORITY_LEVELS; p++) {
+        if (c.found[p]) {
+            *out = c.entries[p];
+            return true;
+        }
+    }
+    return false;
+}
+
+// 释放的空间按删掉的每个文件的实际大小计算：目录里只记了音视频的字节数，
+// 索引、缩略图、静音和同步点文件各占至少一个簇，漏算会让估计值偏小而多删录像
+static void delete_recording(const catalog_entry_t* entry, const char* reason) {
+    uint64_t freed = 0;
+    fs_file_info_t info;
+    for (size_t i = 0; i < sizeof(s_extensions) / sizeof(s_extensions[0]); i++) {
+        char path[CATALOG_NAME_LEN + 8];
+        snprintf(path, sizeof(path), "%s%s", entry->name, s_extensions[i]);
+        if (fs_stat(path, &info) != ESP_OK) {
+            continue;
+        }
+        if (fs_remove(path) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to delete %s", path);
+            continue;
+        }
+        freed += round_to_cluster(info.size);
+    }
+    session_remove_dir_if_empty(entry->name);
+    catalog_delete(entry->id);
+
+    portENTER_CRITICAL(&s_lock);
+    s_free_bytes += freed;
+    portEXIT_CRITICAL(&s_lock);
+    s_deleted_recordings++;
+    s_freed_bytes += freed;
+    ESP_LOGI(TAG, "Deleted %s (%s, %"PRIu64" bytes)", entry->name, reason, freed);
+}
+
+// 删除一段录像，没有需要删除的返回 false
+static bool reclaim_one(bool recording) {
+    catalog_entry_t entry;
+    // 录制期间只在空间告急时删除，过期的录像等录制结束再删
+    if (!recording && find_oldest_expired(&entry)) {
+        delete_recording(&entry, "expired");
+        return true;
+    }
+
+    uint64_t free_bytes = retention_free_bytes();
+    uint64_t threshold = recording ? s_config.critical_bytes :
+                         s_reclaiming ? s_config.target_free_bytes : s_config.high_water_bytes;
+    if (free_bytes >= threshold) {
+        if (!recording) {
+            s_reclaiming = false;
+        }
+        return false;
+    }
+
+    s_reclaiming = true;
+    if (!find_lowest_priority(&entry)) {
+        ESP_LOGW(TAG, "Free space %"PRIu64" bytes below threshold but no recordings left to delete", free_bytes);
+        s_reclaiming = false;
+        return false;
+    }
+    delete_recording(&entry, "space");
+    return true;
+}
+
+static void retention_task(void* arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(s_config.interval_ms));
+
+        // bench、format 独占卡期间不访问卡
+        if (recorder_is_exclusive()) {
+            continue;
+        }
+        bool recording = recorder_is_running();
+        if ((esp_timer_get_time() - s_resync_us) / 1000 >= s_config.resync_interval_ms) {
+            resync_free_space();
+        }
+
+        xSemaphoreTake(s_delete_mutex, portMAX_DELAY);
+        if (recorder_is_exclusive()) {
+            xSemaphoreGive(s_delete_mutex);
+            continue;
+        }
+        uint32_t deletes = 0;
+        while (deletes < s_config.max_deletes_per_interval && reclaim_one(recording)) {
+            deletes++;
+        }
+        if (recording && deletes == 0 && retention_free_bytes() < s_config.high_water_bytes) {
+            s_deferred_checks++;
+        }
+        xSemaphoreGive(s_delete_mutex);
+    }
+}
+
+esp_err_t retention_init(const retention_config_t* config) {
+    if (!config || config->interval_ms == 0 || config->target_free_bytes < config->high_water_bytes) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_config = *config;
+    s_delete_mutex = xSemaphoreCreateMutex();
+    if (!s_delete_mutex) {
+        return ESP_ERR_NO_MEM;
+    }
+    resync_free_space();
+    if (xTaskCreate(retention_task, "retention", 4096, NULL, RETENTION_TASK_PRIORITY, &s_task) != pdPASS) {
+        vSemaphoreDelete(s_delete_mutex);
+        s_delete_mutex = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Keeping %"PRIu64" MB free (high water %"PRIu64" MB), %"PRIu64" MB free now",
+             s_config.target_free_bytes >> 20, s_config.high_water_bytes >> 20, retention_free_bytes() >> 20);
+    return ESP_OK;
+}
+
+esp_err_t retention_ensure_space(uint64_t bytes) {
+    if (!s_task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_delete_mutex, portMAX_DELAY);
+    esp_err_t ret = ESP_OK;
+    while (retention_free_bytes() < s_config.high_water_bytes + bytes) {
+        catalog_entry_t entry;
+        if (!find_lowest_priority(&entry)) {
+            ret = ESP_ERR_NOT_FOUND;
+            break;
+        }
+        delete_recording(&entry, "space for new recording");
+    }
+    xSemaphoreGive(s_delete_mutex);
+    return ret;
+}
+
+void retention_wait_idle(void) {
+    if (s_delete_mutex) {
+        xSemaphoreTake(s_delete_mutex, portMAX_DELAY);
+        xSemaphoreGive(s_delete_mutex);
+    }
+}
+
+esp_err_t retention_get_stats(retention_stats_t* out_stats) {
+    if (!out_stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    out_stats->free_bytes = retention_free_bytes();
+    out_stats->deleted_recordings = s_deleted_recordings;
+    out_stats->freed_bytes = s_freed_bytes;
+    out_stats->deferred_checks = s_deferred_checks;
+    out_stats->resync_age_ms = (uint32_t)((esp_timer_get_time() - s_resync_us) / 1000);
+    out_stats->reclaiming = s_reclaiming;
+    return ESP_OK;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// 保留策略：后台任务按目录删除最旧、优先级最低的录像，让剩余空间保持在高水位之上。
+// 剩余空间按缓存值加减估算，检查本身不访问卡
+
+typedef struct {
+    uint64_t high_water_bytes;      // 剩余空间低于它时开始删除
+    uint64_t target_free_bytes;     // 一旦开始删除，删到剩余空间达到它为止
+    uint64_t critical_bytes;        // 录制期间只有剩余空间低于它才删除
+    uint32_t max_age_days;          // 超过这个天数的录像不论空间都删除，0表示不按时间删除
+    uint32_t interval_ms;           // 检查周期
+    uint32_t max_deletes_per_interval; // 每个周期最多删除的录像数
+    uint32_t resync_interval_ms;    // 按文件系统实际剩余空间校准缓存值的周期
+} retention_config_t;
+
+#define RETENTION_CONFIG_DEFAULT() { \
+    .high_water_bytes = 512ULL * 1024 * 1024, \
+    .target_free_bytes = 1024ULL * 1024 * 1024, \
+    .critical_bytes = 128ULL * 1024 * 1024, \
+    .max_age_days = 0, \
+    .interval_ms = 5000, \
+    .max_deletes_per_interval = 2, \
+    .resync_interval_ms = 60000, \
+}
+
+typedef struct {
+    uint64_t free_bytes;            // 缓存的剩余空间估计值
+    uint32_t deleted_recordings;
+    uint64_t freed_bytes;
+    uint32_t deferred_checks;       // 因正在录制而推迟删除的次数
+    uint32_t resync_age_ms;         // 距上次校准的时间
+    bool reclaiming;                // 低于高水位后还没删到目标值
+} retention_stats_t;
+
+/**
+ * @brief 启动保留策略任务，必须在目录初始化之后调用
+ * @param config 策略配置
+ * @return ESP_OK 成功
+ */
+esp_err_t retention_init(const retention_config_t* config);
+
+/**
+ * @brief 记录新写入的字节数，更新剩余空间估计值
+ *
+ * 只在临界区内做一次加法，可以在写卡路径上调用。
+ *
+ * @param bytes 写入的字节数
+ */
+void retention_note_write(size_t bytes);
+
+/**
+ * @brief 获取缓存的剩余空间估计值，不访问卡
+ * @return 剩余字节数
+ */
+uint64_t retention_free_bytes(void);
+
+/**
+ * @brief 立即删除录像，直到剩余空间比高水位多出 bytes，用于开始录制前
+ * @param bytes 即将写入的字节数
+ * @return ESP_OK 空间足够，ESP_ERR_NOT_FOUND 已没有可删除的录像
+ */
+esp_err_t retention_ensure_space(uint64_t bytes);
+
+/**
+ * @brief 等正在进行的删除结束，recorder_acquire_exclusive 之后调用；独占期间不再开始新的删除
+ */
+void retention_wait_idle(void);
+
+/**
+ * @brief 获取保留策略统计
+ * @param out_stats 输出的统计信息
+ * @return ESP_OK 成功
+ */
+esp_err_t retention_get_stats(retention_stats_t* out_stats);
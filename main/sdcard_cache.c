@@ -0,0 +1,357 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "sdcard_cache.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_heap_caps.h"
+#endif
+
+// FatFs 每个卷只有一个扇区窗口 win[]，同时写 .vid/.pcm 和索引文件时，
+// 窗口在FAT、目录和数据扇区之间来回切换，每次切换都要写回再读入。
+// 这里在块层缓存单块读写，固定范围(FAT、位图、根目录)的脏块在 CTRL_SYNC
+// 或被替换时才写卡。
+// 调用者(sdcard_diskio)负责加锁。
+
+static const char* TAG = "sdcard_cache";
+
+#define CACHE_MAX_PINS 4
+
+typedef struct {
+    uint32_t block;
+    uint32_t last_use;      // 最近一次访问的序号，用于LRU替换
+    bool valid;
+    bool dirty;
+    bool pinned;
+} cache_line_t;
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;           // 含
+} pin_range_t;
+
+struct sdcard_cache_s {
+    sdcard_t* card;
+    uint16_t sets;
+    uint8_t ways;
+    cache_line_t* lines;    // sets * ways
+    uint8_t* data;          // 每行一块，放在PSRAM
+    uint32_t tick;
+    pin_range_t pins[CACHE_MAX_PINS];
+    size_t pin_count;
+    sdcard_cache_stats_t stats;
+};
+
+static void* alloc_data(size_t size) {
+#if CONFIG_IDF_TARGET_LINUX
+    return malloc(size);
+#else
+    // 没有PSRAM时不占用内部RAM，调用者退回不带缓存的读写
+    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+}
+
+static uint8_t* line_data(sdcard_cache_t* cache, size_t idx) {
+    return cache->data + idx * SDCARD_BLOCK_SIZE;
+}
+
+static bool is_pinned(sdcard_cache_t* cache, uint32_t block) {
+    for (size_t i = 0; i < cache->pin_count; i++) {
+        if (block >= cache->pins[i].start && block <= cache->pins[i].end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int lookup(sdcard_cache_t* cache, uint32_t block) {
+    size_t base = (block & (cache->sets - 1)) * cache->ways;
+    for (size_t w = 0; w < cache->ways; w++) {
+        cache_line_t* line = &cache->lines[base + w];
+        if (line->valid && line->block == block) {
+            return (int)(base + w);
+        }
+    }
+    return -1;
+}
+
+static esp_err_t write_back(sdcard_cache_t* cache, size_t idx) {
+    cache_line_t* line = &cache->lines[idx];
+    esp_err_t err = sdcard_write_blocks(cache->card, line->block, 1, line_data(cache, idx));
+    if (err != ESP_OK) {
+        return err;
+    }
+    line->dirty = false;
+    cache->stats.dirty_lines--;
+    cache->stats.writebacks++;
+    return ESP_OK;
+}
+
+static void drop_line(sdcard_cache_t* cache, size_t idx) {
+    cache_line_t* line = &cache->lines[idx];
+    if (line->dirty) {
+        cache->stats.dirty_lines--;
+    }
+    if (line->pinned) {
+        cache->stats.pinned_lines--;
+    }
+    line->valid = false;
+    line->dirty = false;
+    line->pinned = false;
+}
+
+// 为 block 选出一行：优先空行，其次最久未用的非固定行，全部固定时取最久未用的行
+static esp_err_t allocate_line(sdcard_cache_t* cache, uint32_t block, size_t* out_idx) {
+    size_t base = (block & (cache->sets - 1)) * cache->ways;
+    int victim = -1;
+    int victim_pinned = -1;
+    for (size_t w = 0; w < cache->ways; w++) {
+        size_t idx = base + w;
+        cache_line_t* line = &cache->lines[idx];
+        if (!line->valid) {
+            victim = (int)idx;
+            break;
+        }
+        int* slot = line->pinned ? &victim_pinned : &victim;
+        if (*slot < 0 || line->last_use < cache->lines[*slot].last_use) {
+            *slot = (int)idx;
+        }
+    }
+    if (victim < 0) {
+        victim = victim_pinned;
+    }
+
+    if (cache->lines[victim].valid) {
+        if (cache->lines[victim].dirty) {
+            esp_err_t err = write_back(cache, victim);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        drop_line(cache, victim);
+    }
+
+    cache_line_t* line = &cache->lines[victim];
+    line->block = block;
+    line->valid = true;
+    line->pinned = is_pinned(cache, block);
+    if (line->pinned) {
+        cache->stats.pinned_lines++;
+    }
+    *out_idx = victim;
+    return ESP_OK;
+}
+
+esp_err_t sdcard_cache_create(sdcard_t* card, const sdcard_cache_config_t* config, sdcard_cache_t** out_cache) {
+    if (!card || !config || !out_cache || config->ways == 0 ||
+        config->sets == 0 || (config->sets & (config->sets - 1)) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    sdcard_cache_t* cache = calloc(1, sizeof(sdcard_cache_t));
+    if (!cache) {
+        return ESP_ERR_NO_MEM;
+    }
+    size_t n_lines = (size_t)config->sets * config->ways;
+    cache->lines = calloc(n_lines, sizeof(cache_line_t));
+    cache->data = alloc_data(n_lines * SDCARD_BLOCK_SIZE);
+    if (!cache->lines || !cache->data) {
+        free(cache->lines);
+        free(cache->data);
+        free(cache);
+        return ESP_ERR_NO_MEM;
+    }
+    cache->card = card;
+    cache->sets = config->sets;
+    cache->ways = config->ways;
+
+    ESP_LOGI(TAG, "%u sets x %u ways, %u KB", (unsigned)config->sets, (unsigned)config->ways,
+             (unsigned)(n_lines * SDCARD_BLOCK_SIZE / 1024));
+    *out_cache = cache;
+    return ESP_OK;
+}
+
+void sdcard_cache_destroy(sdcard_cache_t* cache) {
+    if (!cache) {
+        return;
+    }
+    if (sdcard_cache_flush(cache) != ESP_OK) {
+        ESP_LOGW(TAG, "%u dirty blocks lost", (unsigned)cache->stats.dirty_lines);
+    }
+    free(cache->lines);
+    free(cache->data);
+    free(cache);
+}
+
+esp_err_t sdcard_cache_read(sdcard_cache_t* cache, size_t start_block, size_t n_blocks, void* dst) {
+    uint8_t* out = dst;
+
+    if (n_blocks > 1) {
+        // 文件数据的多块读直接读卡，再用缓存中较新的块覆盖
+        esp_err_t err = sdcard_read_blocks(cache->card, start_block, n_blocks, dst);
+        if (err != ESP_OK) {
+            return err;
+        }
+        cache->stats.bypass_blocks += n_blocks;
+        for (size_t i = 0; i < n_blocks; i++) {
+            int idx = lookup(cache, start_block + i);
+            if (idx >= 0 && cache->lines[idx].dirty) {
+                memcpy(out + i * SDCARD_BLOCK_SIZE, line_data(cache, idx), SDCARD_BLOCK_SIZE);
+            }
+        }
+        return ESP_OK;
+    }
+
+    int idx = lookup(cache, start_block);
+    if (idx >= 0) {
+        cache->stats.read_hits++;
+    } else {
+        cache->stats.read_misses++;
+        // 直接读到调用者的缓冲区(内部RAM，可DMA)，再复制进缓存
+        esp_err_t err = sdcard_read_blocks(cache->card, start_block, 1, dst);
+        if (err != ESP_OK) {
+            return err;
+        }
+        size_t new_idx;
+        if (allocate_line(cache, start_block, &new_idx) == ESP_OK) {
+            memcpy(line_data(cache, new_idx), dst, SDCARD_BLOCK_SIZE);
+            cache->lines[new_idx].last_use = ++cache->tick;
+        }
+        return ESP_OK;
+    }
+
+    memcpy(out, line_data(cache, idx), SDCARD_BLOCK_SIZE);
+    cache->lines[idx].last_use = ++cache->tick;
+    return ESP_OK;
+}
+
+esp_err_t sdcard_cache_write(sdcard_cache_t* cache, size_t start_block, size_t n_blocks, const void* src) {
+    if (n_blocks > 1) {
+        // 多块写直接写卡，缓存中的旧副本作废
+        esp_err_t err = sdcard_write_blocks(cache->card, start_block, n_blocks, src);
+        if (err != ESP_OK) {
+            return err;
+        }
+        cache->stats.bypass_blocks += n_blocks;
+        sdcard_cache_discard(cache, start_block, start_block + n_blocks - 1);
+        return ESP_OK;
+    }
+
+    size_t idx;
+    int found = lookup(cache, start_block);
+    if (!is_pinned(cache, start_block)) {
+        // 固定范围之外的单块写多是文件数据的最后一个扇区，延迟写回只会占用缓存，
+        // 这里直接写卡，命中时顺带更新缓存中的副本
+        esp_err_t err = sdcard_write_blocks(cache->card, start_block, 1, src);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (found >= 0) {
+            cache->stats.write_hits++;
+            memcpy(line_data(cache, found), src, SDCARD_BLOCK_SIZE);
+            if (cache->lines[found].dirty) {
+                cache->lines[found].dirty = false;
+                cache->stats.dirty_lines--;
+            }
+        } else {
+            cache->stats.write_misses++;
+        }
+        return ESP_OK;
+    }
+
+    if (found >= 0) {
+        cache->stats.write_hits++;
+        idx = found;
+    } else {
+        cache->stats.write_misses++;
+        esp_err_t err = allocate_line(cache, start_block, &idx);
+        if (err != ESP_OK) {
+            // 替换时写回失败，这一块直接写卡
+            return sdcard_write_blocks(cache->card, start_block, 1, src);
+        }
+    }
+
+    memcpy(line_data(cache, idx), src, SDCARD_BLOCK_SIZE);
+    cache_line_t* line = &cache->lines[idx];
+    if (!line->dirty) {
+        line->dirty = true;
+        cache->stats.dirty_lines++;
+    }
+    line->last_use = ++cache->tick;
+    return ESP_OK;
+}
+
+esp_err_t sdcard_cache_flush(sdcard_cache_t* cache) {
+    // 每轮写回块号最小的脏块，让卡看到的写入尽量是顺序的
+    while (cache->stats.dirty_lines > 0) {
+        int next = -1;
+        size_t n_lines = (size_t)cache->sets * cache->ways;
+        for (size_t i = 0; i < n_lines; i++) {
+            if (cache->lines[i].dirty && (next < 0 || cache->lines[i].block < cache->lines[next].block)) {
+                next = (int)i;
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+        esp_err_t err = write_back(cache, next);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Write back of block %u failed (0x%x)", (unsigned)cache->lines[next].block, err);
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+void sdcard_cache_discard(sdcard_cache_t* cache, size_t start_block, size_t end_block) {
+    size_t n_lines = (size_t)cache->sets * cache->ways;
+    if (end_block - start_block + 1 < n_lines) {
+        for (size_t b = start_block; b <= end_block; b++) {
+            int idx = lookup(cache, b);
+            if (idx >= 0) {
+                drop_line(cache, idx);
+            }
+        }
+        return;
+    }
+    for (size_t i = 0; i < n_lines; i++) {
+        cache_line_t* line = &cache->lines[i];
+        if (line->valid && line->block >= start_block && line->block <= end_block) {
+            drop_line(cache, i);
+        }
+    }
+}
+
+esp_err_t sdcard_cache_pin(sdcard_cache_t* cache, size_t start_block, size_t n_blocks) {
+    if (n_blocks == 0) {
+        return ESP_OK;
+    }
+    if (cache->pin_count == CACHE_MAX_PINS) {
+        return ESP_ERR_NO_MEM;
+    }
+    cache->pins[cache->pin_count++] = (pin_range_t){ start_block, start_block + n_blocks - 1 };
+
+    // 已经在缓存中的块也标记为固定
+    size_t n_lines = (size_t)cache->sets * cache->ways;
+    for (size_t i = 0; i < n_lines; i++) {
+        cache_line_t* line = &cache->lines[i];
+        if (line->valid && !line->pinned && is_pinned(cache, line->block)) {
+            line->pinned = true;
+            cache->stats.pinned_lines++;
+        }
+    }
+    return ESP_OK;
+}
+
+void sdcard_cache_unpin_all(sdcard_cache_t* cache) {
+    cache->pin_count = 0;
+    size_t n_lines = (size_t)cache->sets * cache->ways;
+    for (size_t i = 0; i < n_lines; i++) {
+        cache->lines[i].pinned = false;
+    }
+    cache->stats.pinned_lines = 0;
+}
+
+void sdcard_cache_get_stats(sdcard_cache_t* cache, sdcard_cache_stats_t* out_stats) {
+    *out_stats = cache->stats;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "sdcard_hal.h"
+
+// 块层的组相联缓存，缓存单块读写(FatFs的FAT、目录和位图扇区)。
+// 固定范围内的单块写入写回，其余单块写入直写；多块传输(文件数据)直接读写卡
+typedef struct sdcard_cache_s sdcard_cache_t;
+
+typedef struct {
+    uint16_t sets;      // 组数，必须是2的幂，0表示不使用缓存
+    uint8_t ways;       // 每组的路数
+} sdcard_cache_config_t;
+
+// 64组 x 4路 = 256块，在PSRAM中占用128KB
+#define SDCARD_CACHE_CONFIG_DEFAULT() { \
+    .sets = 64, \
+    .ways = 4, \
+}
+
+typedef struct {
+    uint64_t read_hits;
+    uint64_t read_misses;
+    uint64_t write_hits;
+    uint64_t write_misses;
+    uint64_t bypass_blocks;     // 多块传输直接读写卡的块数
+    uint64_t writebacks;        // 写回卡的块数(替换和同步)
+    uint32_t dirty_lines;       // 当前未写回的块数
+    uint32_t pinned_lines;      // 当前缓存的固定块数
+} sdcard_cache_stats_t;
+
+/**
+ * @brief 创建缓存，数据区优先放在PSRAM
+ * @param card 卡句柄
+ * @param config 缓存配置
+ * @param out_cache 输出的缓存句柄
+ * @return ESP_OK 成功，ESP_ERR_NO_MEM 内存不足
+ */
+esp_err_t sdcard_cache_create(sdcard_t* card, const sdcard_cache_config_t* config, sdcard_cache_t** out_cache);
+
+/**
+ * @brief 写回所有脏块并释放缓存
+ * @param cache 缓存句柄
+ */
+void sdcard_cache_destroy(sdcard_cache_t* cache);
+
+/**
+ * @brief 经由缓存读取块
+ * @param cache 缓存句柄
+ * @param start_block 起始块
+ * @param n_blocks 块数
+ * @param dst 输出缓冲区
+ * @return ESP_OK 成功
+ */
+esp_err_t sdcard_cache_read(sdcard_cache_t* cache, size_t start_block, size_t n_blocks, void* dst);
+
+/**
+ * @brief 经由缓存写入块，单块写入只更新缓存，等同步或被替换时才写卡
+ * @param cache 缓存句柄
+ * @param start_block 起始块
+ * @param n_blocks 块数
+ * @param src 输入缓冲区
+ * @return ESP_OK 成功
+ */
+esp_err_t sdcard_cache_write(sdcard_cache_t* cache, size_t start_block, size_t n_blocks, const void* src);
+
+/**
+ * @brief 把所有脏块按块号顺序写回卡
+ * @param cache 缓存句柄
+ * @return ESP_OK 成功
+ */
+esp_err_t sdcard_cache_flush(sdcard_cache_t* cache);
+
+/**
+ * @brief 丢弃一段块的缓存(包括未写回的修改)，用于已释放的簇
+ * @param cache 缓存句柄
+ * @param start_block 起始块
+ * @param end_block 结束块(含)
+ */
+void sdcard_cache_discard(sdcard_cache_t* cache, size_t start_block, size_t end_block);
+
+/**
+ * @brief 把一段块标记为固定，替换时优先保留
+ *
+ * 用于FAT、分配位图和根目录，避免被文件数据的部分扇区挤出缓存。
+ *
+ * @param cache 缓存句柄
+ * @param start_block 起始块
+ * @param n_blocks 块数
+ * @return ESP_OK 成功，ESP_ERR_NO_MEM 固定范围已满
+ */
+esp_err_t sdcard_cache_pin(sdcard_cache_t* cache, size_t start_block, size_t n_blocks);
+
+/**
+ * @brief 清除所有固定范围
+ * @param cache 缓存句柄
+ */
+void sdcard_cache_unpin_all(sdcard_cache_t* cache);
+
+/**
+ * @brief 获取缓存统计
+ * @param cache 缓存句柄
+ * @param out_stats 输出的统计信息
+ */
+void sdcard_cache_get_stats(sdcard_cache_t* cache, sdcard_cache_stats_t* out_stats);
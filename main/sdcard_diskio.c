@@ -0,0 +1,438 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "diskio_impl.h"
+#include "ffconf.h"
+#include "ff.h"
+#include "esp_log.h"
+#include "sdcard_hal.h"
+#include "sdcard_cache.h"
+#include "sdcard_diskio.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#endif
+
+// FatFs 释放簇链时通过 CTRL_TRIM 报告空闲范围。这里不立即擦除，
+// 而是合并后放入队列，由后台任务在卡空闲时分批擦除，避免和录制写入抢总线。
+
+static const char* TAG = "sdcard_diskio";
+
+#define TRIM_QUEUE_LEN 128
+
+typedef struct {
+    uint32_t start;     // 起始块
+    uint32_t end;       // 结束块(含)
+} trim_range_t;
+
+typedef struct {
+    sdcard_t* card;
+    sdcard_cache_t* cache;  // 扇区缓存，内存不足时为NULL
+    trim_range_t trim[TRIM_QUEUE_LEN];
+    size_t trim_count;
+    int64_t last_io_us;     // 最后一次读写的时间
+    sdcard_trim_stats_t stats;
+} sdcard_drive_t;
+
+static sdcard_drive_t s_drives[FF_VOLUMES];
+static sdcard_trim_config_t s_trim_config = SDCARD_TRIM_CONFIG_DEFAULT();
+static sdcard_cache_config_t s_cache_config = SDCARD_CACHE_CONFIG_DEFAULT();
+static volatile bool s_trim_paused = false;
+
+#if CONFIG_IDF_TARGET_LINUX
+// 主机模拟是单线程的，擦除由调用者显式触发
+#define DRIVE_LOCK()
+#define DRIVE_UNLOCK()
+#define NOW_US() 0
+#else
+static SemaphoreHandle_t s_lock = NULL;
+static TaskHandle_t s_trim_task = NULL;
+#define DRIVE_LOCK()   xSemaphoreTake(s_lock, portMAX_DELAY)
+#define DRIVE_UNLOCK() xSemaphoreGive(s_lock)
+#define NOW_US() esp_timer_get_time()
+#endif
+
+static uint32_t range_blocks(const trim_range_t* r) {
+    return r->end - r->start + 1;
+}
+
+static void trim_remove_at(sdcard_drive_t* drv, size_t i) {
+    drv->trim[i] = drv->trim[--drv->trim_count];
+}
+
+// 加入队列，和已有范围相邻或重叠时合并
+static void trim_enqueue(sdcard_drive_t* drv, uint32_t start, uint32_t end) {
+    size_t i = 0;
+    while (i < drv->trim_count) {
+        trim_range_t* r = &drv->trim[i];
+        if (start <= r->end + 1 && r->start <= end + 1) {
+            // 合并后移出队列，继续和其它范围比较
+            start = r->start < start ? r->start : start;
+            end = r->end > end ? r->end : end;
+            trim_remove_at(drv, i);
+            continue;
+        }
+        i++;
+    }
+
+    uint32_t n = end - start + 1;
+    if (drv->trim_count == TRIM_QUEUE_LEN) {
+        // 队列满时丢弃，不擦除只影响卡的写入性能
+        drv->stats.dropped_blocks += n;
+        return;
+    }
+    drv->trim[drv->trim_count++] = (trim_range_t){ start, end };
+}
+
+// 已释放的簇可能在擦除前被重新分配，写入前必须把写入范围从队列中去掉
+static void trim_cancel(sdcard_drive_t* drv, uint32_t start, uint32_t end) {
+    size_t i = 0;
+    while (i < drv->trim_count) {
+        trim_range_t* r = &drv->trim[i];
+        if (end < r->start || start > r->end) {
+            i++;
+        } else if (start <= r->start && end >= r->end) {
+            trim_remove_at(drv, i);
+        } else if (start <= r->start) {
+            r->start = end + 1;
+            i++;
+        } else if (end >= r->end) {
+            r->end = start - 1;
+            i++;
+        } else {
+            // 写入落在范围中间，拆成两段；没有空位时丢弃后一段
+            trim_range_t tail = { end + 1, r->end };
+            r->end = start - 1;
+            if (drv->trim_count < TRIM_QUEUE_LEN) {
+                drv->trim[drv->trim_count++] = tail;
+            } else {
+                drv->stats.dropped_blocks += range_blocks(&tail);
+            }
+            i++;
+        }
+    }
+}
+
+static DSTATUS sdcard_disk_initialize(BYTE pdrv) {
+    return s_drives[pdrv].card ? 0 : STA_NOINIT;
+}
+
+static DSTATUS sdcard_disk_status(BYTE pdrv) {
+    return s_drives[pdrv].card ? 0 : STA_NOINIT;
+}
+
+static DRESULT sdcard_disk_read(BYTE pdrv, BYTE* buff, DWORD sector, UINT count) {
+    sdcard_drive_t* drv = &s_drives[pdrv];
+    assert(drv->card);
+    DRIVE_LOCK();
+    esp_err_t err = drv->cache ? sdcard_cache_read(drv->cache, sector, count, buff) :
+                                 sdcard_read_blocks(drv->card, sector, count, buff);
+    drv->last_io_us = NOW_US();
+    DRIVE_UNLOCK();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "sdcard_read_blocks failed (0x%x)", err);
+        return RES_ERROR;
+    }
+    return RES_OK;
+}
+
+static DRESULT sdcard_disk_write(BYTE pdrv, const BYTE* buff, DWORD sector, UINT count) {
+    sdcard_drive_t* drv = &s_drives[pdrv];
+    assert(drv->card);
+    DRIVE_LOCK();
+    trim_cancel(drv, sector, sector + count - 1);
+    esp_err_t err = drv->cache ? sdcard_cache_write(drv->cache, sector, count, buff) :
+                                 sdcard_write_blocks(drv->card, sector, count, buff);
+    drv->last_io_us = NOW_US();
+    DRIVE_UNLOCK();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "sdcard_write_blocks failed (0x%x)", err);
+        return RES_ERROR;
+    }
+    return RES_OK;
+}
+
+static DRESULT sdcard_disk_ioctl(BYTE pdrv, BYTE cmd, void* buff) {
+    sdcard_drive_t* drv = &s_drives[pdrv];
+    assert(drv->card);
+    switch (cmd) {
+        case CTRL_SYNC: {
+            // f_sync/f_close 时把缓存中的脏块写回；sdcard_write_blocks 返回时数据已经写入卡中
+            if (!drv->cache) {
+                return RES_OK;
+            }
+            DRIVE_LOCK();
+            esp_err_t err = sdcard_cache_flush(drv->cache);
+            DRIVE_UNLOCK();
+            return err == ESP_OK ? RES_OK : RES_ERROR;
+        }
+        case GET_SECTOR_COUNT:
+            *((DWORD*)buff) = drv->card->sectors;
+            return RES_OK;
+        case GET_SECTOR_SIZE:
+            *((WORD*)buff) = SDCARD_BLOCK_SIZE;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            return RES_ERROR;
+#if FF_USE_TRIM
+        case CTRL_TRIM: {
+            const DWORD* range = (const DWORD*)buff;
+            if (range[1] < range[0] || range[1] >= drv->card->sectors) {
+                return RES_PARERR;
+            }
+            DRIVE_LOCK();
+            // 已释放的块不必再写回
+            if (drv->cache) {
+                sdcard_cache_discard(drv->cache, range[0], range[1]);
+            }
+            trim_enqueue(drv, range[0], range[1]);
+            DRIVE_UNLOCK();
+            return RES_OK;
+        }
+#endif
+    }
+    return RES_ERROR;
+}
+
+size_t sdcard_diskio_trim_step(uint8_t pdrv, size_t max_blocks) {
+    if (pdrv >= FF_VOLUMES || !s_drives[pdrv].card || s_trim_paused) {
+        return 0;
+    }
+
+    sdcard_drive_t* drv = &s_drives[pdrv];
+    size_t erased = 0;
+    while (erased < max_blocks && !s_trim_paused) {
+        // 每次只擦一段，擦除期间持锁，保证擦除的块不会同时被写入
+        DRIVE_LOCK();
+        if (drv->trim_count == 0) {
+            DRIVE_UNLOCK();
+            break;
+        }
+        trim_range_t* r = &drv->trim[0];
+        uint32_t n = range_blocks(r);
+        if (n > max_blocks - erased) {
+            n = (uint32_t)(max_blocks - erased);
+        }
+        uint32_t start = r->start;
+        if (n == range_blocks(r)) {
+            trim_remove_at(drv, 0);
+        } else {
+            r->start += n;
+        }
+
+        esp_err_t err = sdcard_erase_blocks(drv->card, start, n);
+        if (err == ESP_OK) {
+            drv->stats.erased_blocks += n;
+            drv->stats.erase_cmds++;
+        } else {
+            drv->stats.dropped_blocks += n;
+        }
+        DRIVE_UNLOCK();
+
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Erase of %"PRIu32"+%"PRIu32" failed (0x%x)", start, n, err);
+            break;
+        }
+        erased += n;
+    }
+    return erased;
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static void trim_task(void* arg) {
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(s_trim_config.interval_ms));
+        int64_t now = esp_timer_get_time();
+        for (uint8_t pdrv = 0; pdrv < FF_VOLUMES; pdrv++) {
+            sdcard_drive_t* drv = &s_drives[pdrv];
+            if (!drv->card || drv->trim_count == 0) {
+                continue;
+            }
+            // 卡最近有读写时视为正在录制，推迟到空闲后再擦
+            if (now - drv->last_io_us < (int64_t)s_trim_config.min_idle_ms * 1000) {
+                continue;
+            }
+            sdcard_diskio_trim_step(pdrv, s_trim_config.max_blocks_per_step);
+        }
+    }
+}
+#endif
+
+esp_err_t sdcard_diskio_register(sdcard_t* card, uint8_t* out_pdrv) {
+    if (!card || !out_pdrv) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (!s_trim_task && s_trim_config.max_blocks_per_step > 0) {
+        if (xTaskCreate(trim_task, "sd_trim", 3072, NULL, tskIDLE_PRIORITY + 1, &s_trim_task) != pdPASS) {
+            ESP_LOGW(TAG, "Failed to start trim task, freed clusters will not be erased");
+        }
+    }
+#endif
+
+    BYTE pdrv = FF_DRV_NOT_USED;
+    if (ff_diskio_get_drive(&pdrv) != ESP_OK || pdrv == FF_DRV_NOT_USED) {
+        ESP_LOGE(TAG, "No free drive number");
+        return ESP_ERR_NO_MEM;
+    }
+
+    static const ff_diskio_impl_t sdcard_impl = {
+        .init = &sdcard_disk_initialize,
+        .status = &sdcard_disk_status,
+        .read = &sdcard_disk_read,
+        .write = &sdcard_disk_write,
+        .ioctl = &sdcard_disk_ioctl,
+    };
+    memset(&s_drives[pdrv], 0, sizeof(s_drives[pdrv]));
+    s_drives[pdrv].card = card;
+    if (s_cache_config.sets > 0) {
+        esp_err_t err = sdcard_cache_create(card, &s_cache_config, &s_drives[pdrv].cache);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Sector cache disabled (0x%x)", err);
+            s_drives[pdrv].cache = NULL;
+        }
+    }
+    ff_diskio_register(pdrv, &sdcard_impl);
+
+    *out_pdrv = pdrv;
+    return ESP_OK;
+}
+
+void sdcard_diskio_unregister(uint8_t pdrv) {
+    if (pdrv >= FF_VOLUMES) {
+        return;
+    }
+    ff_diskio_unregister(pdrv);
+    DRIVE_LOCK();
+    sdcard_cache_destroy(s_drives[pdrv].cache);
+    s_drives[pdrv].cache = NULL;
+    // 未擦除的范围随驱动器一起丢弃
+    s_drives[pdrv].card = NULL;
+    s_drives[pdrv].trim_count = 0;
+    DRIVE_UNLOCK();
+}
+
+void sdcard_diskio_set_trim_config(const sdcard_trim_config_t* config) {
+    if (config) {
+        s_trim_config = *config;
+    }
+}
+
+void sdcard_diskio_set_trim_paused(bool paused) {
+    s_trim_paused = paused;
+}
+
+bool sdcard_diskio_get_trim_paused(void) {
+    return s_trim_paused;
+}
+
+esp_err_t sdcard_diskio_get_trim_stats(uint8_t pdrv, sdcard_trim_stats_t* out_stats) {
+    if (pdrv >= FF_VOLUMES || !out_stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    DRIVE_LOCK();
+    sdcard_drive_t* drv = &s_drives[pdrv];
+    *out_stats = drv->stats;
+    out_stats->pending_blocks = 0;
+    for (size_t i = 0; i < drv->trim_count; i++) {
+        out_stats->pending_blocks += range_blocks(&drv->trim[i]);
+    }
+    DRIVE_UNLOCK();
+    return ESP_OK;
+}
+
+void sdcard_diskio_set_cache_config(const sdcard_cache_config_t* config) {
+    if (config) {
+        s_cache_config = *config;
+    }
+}
+
+// 固定的块是写回的，到 CTRL_SYNC 才写卡；每段最多固定这么多块，掉电时丢失的元数据有上限。
+// 32块FAT32的FAT覆盖4096个簇，录制时每次同步后按分配位置重新固定
+#define PIN_MAX_BLOCKS 32
+
+// 在 [base, base + total) 中取从 hint 所在块开始、不超过 PIN_MAX_BLOCKS 的一段
+static esp_err_t pin_window(sdcard_cache_t* cache, LBA_t base, size_t total, size_t hint) {
+    size_t n = total < PIN_MAX_BLOCKS ? total : PIN_MAX_BLOCKS;
+    size_t offset = hint < total - n ? hint : total - n;
+    return sdcard_cache_pin(cache, base + offset, n);
+}
+
+esp_err_t sdcard_diskio_pin_metadata(uint8_t pdrv, const FATFS* fs) {
+    if (pdrv >= FF_VOLUMES || !fs) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sdcard_drive_t* drv = &s_drives[pdrv];
+    if (!drv->cache) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // 从下一次分配簇的位置开始固定FAT和位图，写入文件时改动的就是这一段
+    DWORD next = fs->last_clst < 2 || fs->last_clst >= fs->n_fatent ? 2 : fs->last_clst;
+    size_t entry_bits = fs->fs_type == FS_FAT12 ? 12 : fs->fs_type == FS_FAT16 ? 16 : 32;
+    size_t fat_hint = (size_t)((uint64_t)next * entry_bits / 8 / SDCARD_BLOCK_SIZE);
+
+    DRIVE_LOCK();
+    sdcard_cache_unpin_all(drv->cache);
+    // 每个FAT副本的同一段
+    esp_err_t err = ESP_OK;
+    for (BYTE i = 0; i < fs->n_fats && err == ESP_OK; i++) {
+        err = pin_window(drv->cache, fs->fatbase + (LBA_t)i * fs->fsize, fs->fsize, fat_hint);
+    }
+#if FF_FS_EXFAT
+    if (err == ESP_OK && fs->fs_type == FS_EXFAT) {
+        // 分配位图，每簇1位
+        size_t bitmap_bytes = (fs->n_fatent - 2 + 7) / 8;
+        size_t bitmap_blocks = (bitmap_bytes + SDCARD_BLOCK_SIZE - 1) / SDCARD_BLOCK_SIZE;
+        err = pin_window(drv->cache, fs->bitbase, bitmap_blocks, (next - 2) / 8 / SDCARD_BLOCK_SIZE);
+    }
+#endif
+    if (err == ESP_OK) {
+        // 根目录：FAT12/16 是固定区域，FAT32/exFAT 是一个簇号，只固定它的第一个簇的开头
+        if (fs->fs_type == FS_FAT32 || fs->fs_type == FS_EXFAT) {
+            err = pin_window(drv->cache, fs->database + (LBA_t)(fs->dirbase - 2) * fs->csize, fs->csize, 0);
+        } else {
+            err = pin_window(drv->cache, fs->dirbase, fs->database - fs->dirbase, 0);
+        }
+    }
+    DRIVE_UNLOCK();
+    return err;
+}
+
+esp_err_t sdcard_diskio_flush(uint8_t pdrv) {
+    if (pdrv >= FF_VOLUMES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sdcard_drive_t* drv = &s_drives[pdrv];
+    if (!drv->cache) {
+        return ESP_OK;
+    }
+    DRIVE_LOCK();
+    esp_err_t err = sdcard_cache_flush(drv->cache);
+    DRIVE_UNLOCK();
+    return err;
+}
+
+esp_err_t sdcard_diskio_get_cache_stats(uint8_t pdrv, sdcard_cache_stats_t* out_stats) {
+    if (pdrv >= FF_VOLUMES || !out_stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sdcard_drive_t* drv = &s_drives[pdrv];
+    if (!drv->cache) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    DRIVE_LOCK();
+    sdcard_cache_get_stats(drv->cache, out_stats);
+    DRIVE_UNLOCK();
+    return ESP_OK;
+}
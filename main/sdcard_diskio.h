@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "ff.h"
+#include "sdcard_hal.h"
+#include "sdcard_cache.h"
+
+// 后台擦除已释放簇的策略
+typedef struct {
+    uint32_t interval_ms;           // 后台任务的检查周期
+    uint32_t min_idle_ms;           // 距最后一次读写至少空闲多久才开始擦除
+    uint32_t max_blocks_per_step;   // 每个周期最多擦除的块数，0表示关闭后台擦除
+} sdcard_trim_config_t;
+
+#define SDCARD_TRIM_CONFIG_DEFAULT() { \
+    .interval_ms = 1000, \
+    .min_idle_ms = 3000, \
+    .max_blocks_per_step = 8192, \
+}
+
+typedef struct {
+    uint64_t pending_blocks;        // 等待擦除的块数
+    uint64_t erased_blocks;         // 已擦除的块数
+    uint64_t dropped_blocks;        // 因队列满或擦除失败而放弃的块数
+    uint32_t erase_cmds;            // 已发出的擦除命令数
+} sdcard_trim_stats_t;
+
+/**
+ * @brief 把 sdcard_hal 的块设备注册为 FatFs 驱动器
+ *
+ * FatFs 的 disk_read/disk_write 会经由 sdcard_read_blocks/sdcard_write_blocks，
+ * 因此真实卡和主机模拟卡走的是同一条路径。
+ *
+ * @param card 已初始化的卡句柄
+ * @param out_pdrv 输出分配到的驱动器号
+ * @return ESP_OK 成功，ESP_ERR_NO_MEM 没有空闲驱动器号
+ */
+esp_err_t sdcard_diskio_register(sdcard_t* card, uint8_t* out_pdrv);
+
+/**
+ * @brief 注销驱动器
+ * @param pdrv 驱动器号
+ */
+void sdcard_diskio_unregister(uint8_t pdrv);
+
+/**
+ * @brief 擦除队列中等待的已释放范围
+ *
+ * 目标板上由后台任务在卡空闲时调用；主机模拟没有后台任务，由调用者显式触发。
+ *
+ * @param pdrv 驱动器号
+ * @param max_blocks 本次最多擦除的块数
+ * @return 实际擦除的块数
+ */
+size_t sdcard_diskio_trim_step(uint8_t pdrv, size_t max_blocks);
+
+/**
+ * @brief 设置后台擦除策略，需在 sdcard_diskio_register 之前调用才能关闭后台任务
+ * @param config 擦除策略
+ */
+void sdcard_diskio_set_trim_config(const sdcard_trim_config_t* config);
+
+/**
+ * @brief 暂停或恢复擦除，录制期间暂停以免擦除和写入争用总线
+ * @param paused true 暂停
+ */
+void sdcard_diskio_set_trim_paused(bool paused);
+
+/**
+ * @brief 擦除是否暂停
+ * @return true 已暂停
+ */
+bool sdcard_diskio_get_trim_paused(void);
+
+/**
+ * @brief 获取擦除统计
+ * @param pdrv 驱动器号
+ * @param out_stats 输出的统计信息
+ * @return ESP_OK 成功
+ */
+esp_err_t sdcard_diskio_get_trim_stats(uint8_t pdrv, sdcard_trim_stats_t* out_stats);
+
+/**
+ * @brief 设置扇区缓存的大小，对之后注册的驱动器生效
+ * @param config 缓存配置，sets 为0时不使用缓存
+ */
+void sdcard_diskio_set_cache_config(const sdcard_cache_config_t* config);
+
+/**
+ * @brief 按卷的布局固定FAT、分配位图和根目录所在的块，挂载后调用
+ *
+ * 固定的块写回缓存，每段最多固定32块：FAT和位图从下一次分配簇的位置开始，
+ * 长时间写入时在每次同步后重新调用，让固定范围跟上分配位置。
+ *
+ * @param pdrv 驱动器号
+ * @param fs 已挂载的卷
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 驱动器没有缓存
+ */
+esp_err_t sdcard_diskio_pin_metadata(uint8_t pdrv, const FATFS* fs);
+
+/**
+ * @brief 把缓存中的脏块写回卡，FatFs 在 f_sync/f_close 时会自动调用
+ * @param pdrv 驱动器号
+ * @return ESP_OK 成功
+ */
+esp_err_t sdcard_diskio_flush(uint8_t pdrv);
+
+/**
+ * @brief 获取扇区缓存的命中统计
+ * @param pdrv 驱动器号
+ * @param out_stats 输出的统计信息
+ * @return ESP_OK 成功，ESP_ERR_NOT_FOUND 驱动器没有缓存
+ */
+esp_err_t sdcard_diskio_get_cache_stats(uint8_t pdrv, sdcard_cache_stats_t* out_stats);
@@ -4,7 +4,9 @@
 #include "driver/spi_common.h"
 #include "sdmmc_cmd.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
 #include "sdcard_hal.h"
+#include "sdcard_telemetry.h"
 
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 
@@ -107,6 +109,7 @@ esp_err_t sdspi_card_init(const sdcard_config_t* config, sdcard_t** out_card) {
     card->type = (sdcard->ocr & (1ULL << 30)) ? CARD_SDHC : CARD_SD;
     card->sectors = sdcard->csd.capacity;
     card->spi = handle;
+    card->freq_khz = config->freq_khz;
     card->sdcard = sdcard;  // Keep the sdcard structure for read/write operations
 
     ESP_LOGI(TAG, "Card initialized at %d kHz", config->freq_khz);
@@ -135,7 +138,10 @@ esp_err_t sdcard_read_blocks(sdcard_t* card, size_t start_block, size_t n_blocks
         return ESP_ERR_INVALID_ARG;
     }
 
+    int64_t start = esp_timer_get_time();
     esp_err_t ret = sdmmc_read_sectors(card->sdcard, dst, start_block, n_blocks);
+    sdcard_telemetry_record(SDCARD_OP_READ, start_block, n_blocks, start,
+                            (uint32_t)(esp_timer_get_time() - start));
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to read sectors: %d", ret);
     }
@@ -147,13 +153,39 @@ esp_err_t sdcard_write_blocks(sdcard_t* card, size_t start_block, size_t n_block
         return ESP_ERR_INVALID_ARG;
     }
 
+    int64_t start = esp_timer_get_time();
     esp_err_t ret = sdmmc_write_sectors(card->sdcard, src, start_block, n_blocks);
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+    sdcard_telemetry_record(SDCARD_OP_WRITE, start_block, n_blocks, start, elapsed);
+
+    // 忙等发生在驱动内部，用总耗时减去按总线时钟估算的传输时间近似
+    uint32_t transfer_us = card->freq_khz > 0 ?
+        (uint32_t)((uint64_t)n_blocks * SDCARD_BLOCK_SIZE * 8 * 1000 / card->freq_khz) : 0;
+    sdcard_telemetry_record(SDCARD_OP_BUSY, start_block, n_blocks, start,
+                            elapsed > transfer_us ? elapsed - transfer_us : 0);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to write sectors: %d", ret);
     }
     return ret;
 }
 
+esp_err_t sdcard_erase_blocks(sdcard_t* card, size_t start_block, size_t n_blocks) {
+    if (!card) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // SPI模式下不支持 DISCARD，用普通擦除
+    sdmmc_erase_arg_t arg = sdmmc_can_discard(card->sdcard) == ESP_OK ? SDMMC_DISCARD_ARG : SDMMC_ERASE_ARG;
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = sdmmc_erase_sectors(card->sdcard, start_block, n_blocks, arg);
+    sdcard_telemetry_record(SDCARD_OP_ERASE, start_block, n_blocks, start,
+                            (uint32_t)(esp_timer_get_time() - start));
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase sectors: %d", ret);
+    }
+    return ret;
+}
+
 esp_err_t sdcard_get_info(sdcard_t* card, sdcard_info_t* out_info) {
     if (!card || !out_info) {
         return ESP_ERR_INVALID_ARG;
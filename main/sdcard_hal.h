@@ -1,9 +1,14 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <esp_err.h>
+#include "sdkconfig.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "driver/sdspi_host.h"
 #include "driver/spi_common.h"
 #include "sdmmc_cmd.h"
+#endif
 
 #define SDCARD_BLOCK_SIZE 512
 
@@ -14,6 +19,92 @@ typedef enum {
     CARD_SDHC = 3,
 } sdcard_type_t;
 
+typedef struct {
+    sdcard_type_t type;
+    uint64_t capacity_bytes;
+} sdcard_info_t;
+
+#if CONFIG_IDF_TARGET_LINUX
+
+// 主机模拟的延迟模型，所有时间单位为微秒
+typedef struct {
+    uint32_t cmd_overhead_us;      // 每条读/写命令的固定开销
+    uint32_t read_bytes_per_sec;   // 读带宽，0表示不限
+    uint32_t write_bytes_per_sec;  // 写带宽，0表示不限
+    uint32_t gc_interval_blocks;   // 每写入多少块触发一次垃圾回收停顿，0表示关闭
+    uint32_t gc_stall_min_us;      // 垃圾回收停顿的最短时间
+    uint32_t gc_stall_max_us;      // 垃圾回收停顿的最长时间
+    uint32_t dirty_gc_weight;      // 覆盖未擦除的块时，每块按多少块计入垃圾回收间隔
+    uint32_t erase_us_per_mb;      // 擦除耗时
+    bool realtime;                 // true: 真实睡眠；false: 只推进模拟时钟
+} sdcard_sim_latency_t;
+
+// 模拟卡的累计统计
+typedef struct {
+    uint64_t read_cmds;
+    uint64_t write_cmds;
+    uint64_t read_blocks;
+    uint64_t write_blocks;
+    uint64_t gc_stalls;
+    uint64_t erase_cmds;
+    uint64_t erase_blocks;
+    uint64_t dirty_writes;         // 写入时目标块尚未擦除的块数
+    uint64_t busy_us;              // 模拟的总忙碌时间
+    uint32_t max_cmd_us;           // 单条命令的最长模拟耗时
+} sdcard_sim_stats_t;
+
+typedef struct {
+    const char* image_path;        // 镜像文件路径
+    uint32_t sectors;              // 镜像不存在或过小时扩展到的扇区数
+    sdcard_sim_latency_t latency;  // 延迟模型
+} sdcard_config_t;
+
+typedef struct {
+    sdcard_type_t type;
+    uint32_t sectors;
+    int fd;                        // 镜像文件描述符
+    sdcard_sim_latency_t latency;
+    uint32_t blocks_since_gc;      // 距上次垃圾回收写入的块数
+    uint32_t rng;                  // 停顿时长的伪随机状态，保证结果可复现
+    uint8_t* dirty;                // 每块1位，写入后置位，擦除后清零
+    int64_t clock_us;              // 模拟时钟
+    sdcard_sim_stats_t stats;
+} sdcard_t;
+
+// 一张普通 Class 10 卡的默认延迟模型
+#define SDCARD_SIM_LATENCY_DEFAULT() { \
+    .cmd_overhead_us = 150, \
+    .read_bytes_per_sec = 10 * 1024 * 1024, \
+    .write_bytes_per_sec = 6 * 1024 * 1024, \
+    .gc_interval_blocks = 8192, \
+    .gc_stall_min_us = 100000, \
+    .gc_stall_max_us = 500000, \
+    .dirty_gc_weight = 4, \
+    .erase_us_per_mb = 2000, \
+    .realtime = false, \
+}
+
+// 主机模拟的SD卡操作函数
+esp_err_t sdsim_card_init(const sdcard_config_t* config, sdcard_t** out_card);
+esp_err_t sdsim_card_deinit(sdcard_t* card);
+
+/**
+ * @brief 获取模拟卡的累计统计
+ * @param card 卡句柄
+ * @param out_stats 输出的统计信息
+ * @return ESP_OK 成功
+ */
+esp_err_t sdcard_sim_get_stats(sdcard_t* card, sdcard_sim_stats_t* out_stats);
+
+/**
+ * @brief 获取模拟时钟（非实时模式下只随模拟延迟推进）
+ * @param card 卡句柄
+ * @return 模拟时钟，单位微秒
+ */
+int64_t sdcard_sim_clock_us(sdcard_t* card);
+
+#else
+
 typedef struct {
     spi_host_device_t host;
     int pin_mosi;
@@ -23,27 +114,43 @@ typedef struct {
     int freq_khz;
 } sdcard_config_t;
 
-typedef struct {
-    sdcard_type_t type;
-    uint64_t capacity_bytes;
-} sdcard_info_t;
-
 typedef struct {
     sdcard_type_t type;
     uint32_t sectors;
     sdspi_dev_handle_t spi;
     spi_host_device_t host;
     gpio_num_t pin_cs;  // CS引脚
+    int freq_khz;       // 总线时钟，用于从写耗时中估算卡的忙等时间
     sdmmc_card_t* sdcard;  // Keep the sdcard structure for read/write operations
 } sdcard_t;
 
 // SPI模式的SD卡操作函数
 esp_err_t sdspi_card_init(const sdcard_config_t* config, sdcard_t** out_card);
 esp_err_t sdspi_card_deinit(sdcard_t* card);
+
+#endif
+
 esp_err_t sdcard_read_blocks(sdcard_t* card, size_t start_block, size_t n_blocks, void* dst);
 esp_err_t sdcard_write_blocks(sdcard_t* card, size_t start_block, size_t n_blocks, const void* src);
 esp_err_t sdcard_get_info(sdcard_t* card, sdcard_info_t* out_info);
 
+/**
+ * @brief 擦除一段块(CMD32/33/38)，告知卡这些块已不再使用
+ *
+ * 擦除后块内容不确定，只能用于已释放的簇。
+ *
+ * @param card 卡句柄
+ * @param start_block 起始块
+ * @param n_blocks 块数
+ * @return ESP_OK 成功
+ */
+esp_err_t sdcard_erase_blocks(sdcard_t* card, size_t start_block, size_t n_blocks);
+
 // 为了向后兼容，保留旧的函数名作为别名
+#if CONFIG_IDF_TARGET_LINUX
+#define sdcard_init sdsim_card_init
+#define sdcard_deinit sdsim_card_deinit
+#else
 #define sdcard_init sdspi_card_init
 #define sdcard_deinit sdspi_card_deinit
+#endif
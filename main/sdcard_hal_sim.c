@@ -0,0 +1,280 @@
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <linux/falloc.h>
+#endif
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "sdcard_hal.h"
+#include "sdcard_telemetry.h"
+
+// 主机(linux target)上的SD卡模拟：块读写落到镜像文件，
+// 并按延迟模型(命令开销 + 带宽 + 周期性垃圾回收停顿)计时，
+// 用于在CI中对 fs_hal / 录制写入路径做可复现的吞吐测试。
+
+static const char* TAG = "sdcard_sim";
+
+static uint32_t sim_rand(sdcard_t* card) {
+    // xorshift32，固定种子保证每次运行的停顿序列一致
+    uint32_t x = card->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    card->rng = x;
+    return x;
+}
+
+static uint32_t transfer_us(size_t bytes, uint32_t bytes_per_sec) {
+    if (bytes_per_sec == 0) {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)bytes * 1000000ULL) / bytes_per_sec);
+}
+
+// 记账并按模式睡眠或推进模拟时钟
+static void sim_delay(sdcard_t* card, uint32_t us) {
+    card->clock_us += us;
+    card->stats.busy_us += us;
+    if (us > card->stats.max_cmd_us) {
+        card->stats.max_cmd_us = us;
+    }
+    if (card->latency.realtime && us > 0) {
+        struct timespec ts = {
+            .tv_sec = us / 1000000,
+            .tv_nsec = (long)(us % 1000000) * 1000,
+        };
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        }
+    }
+}
+
+// 统计并标记写入范围内的块：覆盖未擦除的块需要卡先整理，计入垃圾回收的权重更大
+static uint32_t mark_dirty(sdcard_t* card, size_t start_block, size_t n_blocks) {
+    uint32_t weight = card->latency.dirty_gc_weight ? card->latency.dirty_gc_weight : 1;
+    uint32_t cost = 0;
+    for (size_t b = start_block; b < start_block + n_blocks; b++) {
+        uint8_t mask = 1 << (b & 7);
+        if (card->dirty[b >> 3] & mask) {
+            card->stats.dirty_writes++;
+            cost += weight;
+        } else {
+            card->dirty[b >> 3] |= mask;
+            cost += 1;
+        }
+    }
+    return cost;
+}
+
+static uint32_t gc_stall_us(sdcard_t* card, uint32_t gc_blocks) {
+    const sdcard_sim_latency_t* lat = &card->latency;
+    if (lat->gc_interval_blocks == 0) {
+        return 0;
+    }
+
+    card->blocks_since_gc += gc_blocks;
+    if (card->blocks_since_gc < lat->gc_interval_blocks) {
+        return 0;
+    }
+    card->blocks_since_gc %= lat->gc_interval_blocks;
+    card->stats.gc_stalls++;
+
+    uint32_t span = lat->gc_stall_max_us > lat->gc_stall_min_us ?
+                    lat->gc_stall_max_us - lat->gc_stall_min_us : 0;
+    return lat->gc_stall_min_us + (span ? sim_rand(card) % (span + 1) : 0);
+}
+
+esp_err_t sdsim_card_init(const sdcard_config_t* config, sdcard_t** out_card) {
+    if (!config || !config->image_path || !out_card) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    sdcard_t* card = calloc(1, sizeof(sdcard_t));
+    if (!card) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    card->fd = open(config->image_path, O_RDWR | O_CREAT, 0644);
+    if (card->fd < 0) {
+        ESP_LOGE(TAG, "Failed to open image %s (errno: %d, %s)",
+                 config->image_path, errno, strerror(errno));
+        free(card);
+        return ESP_FAIL;
+    }
+
+    struct stat st;
+    if (fstat(card->fd, &st) != 0) {
+        ESP_LOGE(TAG, "Failed to stat image (errno: %d)", errno);
+        close(card->fd);
+        free(card);
+        return ESP_FAIL;
+    }
+
+    // 镜像过小时扩展为稀疏文件
+    off_t wanted = (off_t)config->sectors * SDCARD_BLOCK_SIZE;
+    if (st.st_size < wanted) {
+        if (ftruncate(card->fd, wanted) != 0) {
+            ESP_LOGE(TAG, "Failed to resize image to %u sectors (errno: %d)",
+                     (unsigned)config->sectors, errno);
+            close(card->fd);
+            free(card);
+            return ESP_FAIL;
+        }
+        st.st_size = wanted;
+    }
+
+    card->type = CARD_SDHC;
+    card->sectors = (uint32_t)(st.st_size / SDCARD_BLOCK_SIZE);
+
+    // 打开时视为全新的卡，所有块都已擦除
+    card->dirty = calloc((card->sectors + 7) / 8, 1);
+    if (!card->dirty) {
+        close(card->fd);
+        free(card);
+        return ESP_ERR_NO_MEM;
+    }
+    card->latency = config->latency;
+    card->rng = 0x2545F491;
+
+    ESP_LOGI(TAG, "Image %s: %lu sectors", config->image_path, (unsigned long)card->sectors);
+    ESP_LOGI(TAG, "Latency model - cmd: %uus, read: %u B/s, write: %u B/s, gc: %u-%uus every %u blocks, %s",
+             (unsigned)card->latency.cmd_overhead_us,
+             (unsigned)card->latency.read_bytes_per_sec,
+             (unsigned)card->latency.write_bytes_per_sec,
+             (unsigned)card->latency.gc_stall_min_us,
+             (unsigned)card->latency.gc_stall_max_us,
+             (unsigned)card->latency.gc_interval_blocks,
+             card->latency.realtime ? "realtime" : "simulated clock");
+
+    *out_card = card;
+    return ESP_OK;
+}
+
+esp_err_t sdcard_read_blocks(sdcard_t* card, size_t start_block, size_t n_blocks, void* dst) {
+    if (!card || !dst) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (start_block + n_blocks > card->sectors) {
+        ESP_LOGE(TAG, "Read out of range: %u+%u", (unsigned)start_block, (unsigned)n_blocks);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t len = n_blocks * SDCARD_BLOCK_SIZE;
+    ssize_t n = pread(card->fd, dst, len, (off_t)start_block * SDCARD_BLOCK_SIZE);
+    if (n != (ssize_t)len) {
+        ESP_LOGE(TAG, "Failed to read sectors (errno: %d)", errno);
+        return ESP_FAIL;
+    }
+
+    card->stats.read_cmds++;
+    card->stats.read_blocks += n_blocks;
+    int64_t start = card->clock_us;
+    sim_delay(card, card->latency.cmd_overhead_us +
+                    transfer_us(len, card->latency.read_bytes_per_sec));
+    sdcard_telemetry_record(SDCARD_OP_READ, start_block, n_blocks, start,
+                            (uint32_t)(card->clock_us - start));
+    return ESP_OK;
+}
+
+esp_err_t sdcard_write_blocks(sdcard_t* card, size_t start_block, size_t n_blocks, const void* src) {
+    if (!card || !src) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (start_block + n_blocks > card->sectors) {
+        ESP_LOGE(TAG, "Write out of range: %u+%u", (unsigned)start_block, (unsigned)n_blocks);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t len = n_blocks * SDCARD_BLOCK_SIZE;
+    ssize_t n = pwrite(card->fd, src, len, (off_t)start_block * SDCARD_BLOCK_SIZE);
+    if (n != (ssize_t)len) {
+        ESP_LOGE(TAG, "Failed to write sectors (errno: %d)", errno);
+        return ESP_FAIL;
+    }
+
+    card->stats.write_cmds++;
+    card->stats.write_blocks += n_blocks;
+    int64_t start = card->clock_us;
+    uint32_t busy_us = card->latency.cmd_overhead_us +
+                       gc_stall_us(card, mark_dirty(card, start_block, n_blocks));
+    sim_delay(card, busy_us + transfer_us(len, card->latency.write_bytes_per_sec));
+    sdcard_telemetry_record(SDCARD_OP_WRITE, start_block, n_blocks, start,
+                            (uint32_t)(card->clock_us - start));
+    sdcard_telemetry_record(SDCARD_OP_BUSY, start_block, n_blocks, start, busy_us);
+    return ESP_OK;
+}
+
+esp_err_t sdcard_erase_blocks(sdcard_t* card, size_t start_block, size_t n_blocks) {
+    if (!card) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (start_block + n_blocks > card->sectors) {
+        ESP_LOGE(TAG, "Erase out of range: %u+%u", (unsigned)start_block, (unsigned)n_blocks);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // 擦除后读出全0，这样误擦仍在使用的块会在校验时暴露出来
+    off_t offset = (off_t)start_block * SDCARD_BLOCK_SIZE;
+    int punched = -1;
+#ifdef FALLOC_FL_PUNCH_HOLE
+    punched = fallocate(card->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                       offset, (off_t)n_blocks * SDCARD_BLOCK_SIZE);
+#endif
+    if (punched != 0) {
+        static const uint8_t zeros[SDCARD_BLOCK_SIZE];
+        for (size_t i = 0; i < n_blocks; i++) {
+            if (pwrite(card->fd, zeros, sizeof(zeros), offset + (off_t)i * SDCARD_BLOCK_SIZE) != sizeof(zeros)) {
+                ESP_LOGE(TAG, "Failed to erase sectors (errno: %d)", errno);
+                return ESP_FAIL;
+            }
+        }
+    }
+
+    for (size_t b = start_block; b < start_block + n_blocks; b++) {
+        card->dirty[b >> 3] &= ~(1 << (b & 7));
+    }
+
+    card->stats.erase_cmds++;
+    card->stats.erase_blocks += n_blocks;
+    int64_t start = card->clock_us;
+    sim_delay(card, card->latency.cmd_overhead_us +
+                    (uint32_t)((uint64_t)n_blocks * card->latency.erase_us_per_mb / 2048));
+    sdcard_telemetry_record(SDCARD_OP_ERASE, start_block, n_blocks, start,
+                            (uint32_t)(card->clock_us - start));
+    return ESP_OK;
+}
+
+esp_err_t sdcard_get_info(sdcard_t* card, sdcard_info_t* out_info) {
+    if (!card || !out_info) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    out_info->type = card->type;
+    out_info->capacity_bytes = (uint64_t)card->sectors * SDCARD_BLOCK_SIZE;
+    return ESP_OK;
+}
+
+esp_err_t sdcard_sim_get_stats(sdcard_t* card, sdcard_sim_stats_t* out_stats) {
+    if (!card || !out_stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_stats = card->stats;
+    return ESP_OK;
+}
+
+int64_t sdcard_sim_clock_us(sdcard_t* card) {
+    return card ? card->clock_us : 0;
+}
+
+esp_err_t sdsim_card_deinit(sdcard_t* card) {
+    if (!card) return ESP_ERR_INVALID_ARG;
+
+    fsync(card->fd);
+    close(card->fd);
+    free(card->dirty);
+    free(card);
+    return ESP_OK;
+}
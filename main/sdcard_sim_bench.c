@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_log.h"
+#include "ff.h"
+#include "sdcard_hal.h"
+#include "sdcard_diskio.h"
+#include "sdcard_telemetry.h"
+
+// 主机基准测试：在模拟SD卡上格式化FAT，按录制路径的写入模式
+// (视频帧 + 音频块交替写入两个文件) 写入，报告模拟时钟下的吞吐和延迟。
+// 多段录制时按循环录制的方式删除最老的段，用于比较擦除已释放簇的效果。
+// 构建: idf.py --preview set-target linux && idf.py build
+// 参数通过环境变量覆盖，见 env_u32() 的调用处。
+
+static const char* TAG = "sdcard_sim_bench";
+
+#define AUDIO_CHUNK_SIZE 2048   // 与 main.c 中 AUDIO_BUFFER_SIZE 一致
+#define BENCH_WORKBUF_SIZE 4096
+
+static uint32_t env_u32(const char* name, uint32_t def) {
+    const char* v = getenv(name);
+    return v ? (uint32_t)strtoul(v, NULL, 0) : def;
+}
+
+static const char* env_str(const char* name, const char* def) {
+    const char* v = getenv(name);
+    return v ? v : def;
+}
+
+// 伪随机的JPEG帧大小，围绕平均值上下浮动25%
+static uint32_t next_frame_size(uint32_t* state, uint32_t mean) {
+    *state = *state * 1103515245u + 12345u;
+    uint32_t spread = mean / 2;
+    return mean - spread / 2 + ((*state >> 8) % (spread + 1));
+}
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t total_us;
+    uint32_t max_us;
+    uint32_t late_frames;
+} bench_result_t;
+
+// 预分配后文件长度大于写入位置，FatFs写不满一个扇区时要先把该扇区读出来。
+// 与 fs_hal 的做法一样，把不足一个扇区的尾部留到下次写入时凑成整扇区
+typedef struct {
+    uint8_t buf[SDCARD_BLOCK_SIZE];
+    UINT len;
+} sector_tail_t;
+
+static FRESULT write_whole_sectors(FIL* fp, sector_tail_t* tail, const uint8_t* data, UINT size) {
+    UINT written;
+    if (tail->len > 0) {
+        UINT n = size < SDCARD_BLOCK_SIZE - tail->len ? size : SDCARD_BLOCK_SIZE - tail->len;
+        memcpy(tail->buf + tail->len, data, n);
+        tail->len += n;
+        data += n;
+        size -= n;
+        if (tail->len < SDCARD_BLOCK_SIZE) {
+            return FR_OK;
+        }
+        FRESULT res = f_write(fp, tail->buf, SDCARD_BLOCK_SIZE, &written);
+        if (res != FR_OK || written != SDCARD_BLOCK_SIZE) {
+            return res != FR_OK ? res : FR_DENIED;
+        }
+        tail->len = 0;
+    }
+
+    UINT whole = size & ~(UINT)(SDCARD_BLOCK_SIZE - 1);
+    if (whole > 0) {
+        FRESULT res = f_write(fp, data, whole, &written);
+        if (res != FR_OK || written != whole) {
+            return res != FR_OK ? res : FR_DENIED;
+        }
+    }
+    memcpy(tail->buf, data + whole, size - whole);
+    tail->len = size - whole;
+    return FR_OK;
+}
+
+// 录制一段：视频帧和音频块交替写入一对文件
+// prealloc 非0时先为视频文件预分配连续空间，关闭前截掉没写满的部分
+static int record_segment(sdcard_t* card, const char* drv, uint32_t index, uint32_t frames,
+                          uint32_t frame_mean, uint32_t fps, uint64_t prealloc,
+                          uint32_t* rng, bench_result_t* out) {
+    uint8_t* frame_buf = malloc(frame_mean * 2);
+    uint8_t* audio_buf = malloc(AUDIO_CHUNK_SIZE);
+    if (!frame_buf || !audio_buf) {
+        free(frame_buf);
+        free(audio_buf);
+        return 1;
+    }
+    memset(frame_buf, 0xA5, frame_mean * 2);
+    memset(audio_buf, 0x5A, AUDIO_CHUNK_SIZE);
+
+    char video_path[16];
+    char audio_path[16];
+    snprintf(video_path, sizeof(video_path), "%s/%04" PRIu32 ".vid", drv, index % 10000);
+    snprintf(audio_path, sizeof(audio_path), "%s/%04" PRIu32 ".pcm", drv, index % 10000);
+
+    FIL video_file, audio_file;
+    if (f_open(&video_file, video_path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK ||
+        f_open(&audio_file, audio_path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        ESP_LOGE(TAG, "Failed to open output files");
+        free(frame_buf);
+        free(audio_buf);
+        return 1;
+    }
+    bool expanded = prealloc && f_expand(&video_file, (FSIZE_t)prealloc, 1) == FR_OK;
+    if (prealloc && !expanded) {
+        ESP_LOGW(TAG, "Failed to preallocate %" PRIu64 " bytes", prealloc);
+    }
+    sector_tail_t tail = { .len = 0 };
+
+    memset(out, 0, sizeof(*out));
+    const uint32_t frame_budget_us = 1000000 / (fps ? fps : 1);
+    int failed = 0;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        uint32_t len = next_frame_size(rng, frame_mean);
+        int64_t t0 = sdcard_sim_clock_us(card);
+
+        UINT written = len;
+        FRESULT res = expanded ? write_whole_sectors(&video_file, &tail, frame_buf, len) :
+                                 f_write(&video_file, frame_buf, len, &written);
+        if (res != FR_OK || written != len ||
+            f_write(&audio_file, audio_buf, AUDIO_CHUNK_SIZE, &written) != FR_OK ||
+            written != AUDIO_CHUNK_SIZE) {
+            ESP_LOGE(TAG, "Write failed at frame %" PRIu32, i);
+            failed = 1;
+            break;
+        }
+
+        uint32_t us = (uint32_t)(sdcard_sim_clock_us(card) - t0);
+        out->total_us += us;
+        out->bytes += len + AUDIO_CHUNK_SIZE;
+        if (us > out->max_us) {
+            out->max_us = us;
+        }
+        if (us > frame_budget_us) {
+            out->late_frames++;
+        }
+    }
+
+    if (expanded) {
+        UINT written;
+        f_write(&video_file, tail.buf, tail.len, &written);
+        f_truncate(&video_file);
+    }
+    f_close(&video_file);
+    f_close(&audio_file);
+    free(frame_buf);
+    free(audio_buf);
+    return failed;
+}
+
+// 循环录制：空间不足时删除最老的一段
+static int make_room(const char* drv, uint64_t needed, uint32_t* oldest, uint32_t newest) {
+    while (1) {
+        DWORD free_clusters;
+        FATFS* fs;
+        if (f_getfree(drv, &free_clusters, &fs) != FR_OK) {
+            return 1;
+        }
+        if ((uint64_t)free_clusters * fs->csize * SDCARD_BLOCK_SIZE >= needed) {
+            return 0;
+        }
+        if (*oldest >= newest) {
+            ESP_LOGE(TAG, "Card too small for one segment");
+            return 1;
+        }
+
+        char path[16];
+        snprintf(path, sizeof(path), "%s/%04" PRIu32 ".vid", drv, *oldest % 10000);
+        f_unlink(path);
+        snprintf(path, sizeof(path), "%s/%04" PRIu32 ".pcm", drv, *oldest % 10000);
+        f_unlink(path);
+        (*oldest)++;
+    }
+}
+
+static int run_bench(sdcard_t* card, uint8_t pdrv, const char* drv) {
+    uint32_t frames = env_u32("SDSIM_FRAMES", 900);
+    uint32_t frame_mean = env_u32("SDSIM_FRAME_BYTES", 9 * 1024);
+    uint32_t fps = env_u32("SDSIM_FPS", 15);
+    uint32_t segments = env_u32("SDSIM_SEGMENTS", 1);
+    bool trim = env_u32("SDSIM_TRIM", 1) != 0;
+    bool prealloc = env_u32("SDSIM_PREALLOC", 0) != 0;
+
+    // 段与段之间视为空闲，处理格式化和删除产生的擦除请求
+    if (trim) {
+        sdcard_diskio_trim_step(pdrv, SIZE_MAX);
+    }
+
+    printf("segment,frames,bytes,sim_seconds,kbytes_per_sec,avg_frame_us,max_frame_us,late_frames,"
+           "write_cmds,write_blocks,read_cmds,gc_stalls,dirty_writes,erased_total\n");
+
+    uint32_t rng = 1;
+    uint32_t oldest = 0;
+    uint64_t segment_bytes = (uint64_t)frames * (frame_mean * 5 / 4 + AUDIO_CHUNK_SIZE);
+    for (uint32_t seg = 0; seg < segments; seg++) {
+        // 多留一段余量，删除后的空间在下一次空闲时擦除，而不是删完立刻被写入
+        if (make_room(drv, segment_bytes * 2, &oldest, seg) != 0) {
+            return 1;
+        }
+
+        sdcard_sim_stats_t before;
+        sdcard_sim_get_stats(card, &before);
+
+        bench_result_t r;
+        uint64_t video_bytes = (uint64_t)frames * frame_mean * 5 / 4;
+        if (record_segment(card, drv, seg, frames, frame_mean, fps, prealloc ? video_bytes : 0,
+                           &rng, &r) != 0) {
+            return 1;
+        }
+
+        sdcard_sim_stats_t after;
+        sdcard_sim_get_stats(card, &after);
+
+        double secs = r.total_us / 1e6;
+        printf("%" PRIu32 ",%" PRIu32 ",%" PRIu64 ",%.3f,%.1f,%" PRIu64 ",%" PRIu32 ",%" PRIu32 ","
+               "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+               seg, frames, r.bytes, secs, secs > 0 ? r.bytes / 1024.0 / secs : 0.0,
+               frames ? r.total_us / frames : 0, r.max_us, r.late_frames,
+               after.write_cmds - before.write_cmds, after.write_blocks - before.write_blocks,
+               after.read_cmds - before.read_cmds, after.gc_stalls - before.gc_stalls,
+               after.dirty_writes - before.dirty_writes, before.erase_blocks);
+
+        if (trim) {
+            sdcard_diskio_trim_step(pdrv, SIZE_MAX);
+        }
+    }
+
+    sdcard_cache_stats_t cs;
+    if (sdcard_diskio_get_cache_stats(pdrv, &cs) == ESP_OK) {
+        printf("Cache: read %" PRIu64 "/%" PRIu64 " hits, write %" PRIu64 "/%" PRIu64 " hits, "
+               "%" PRIu64 " written back, %" PRIu64 " bypassed\n",
+               cs.read_hits, cs.read_hits + cs.read_misses, cs.write_hits, cs.write_hits + cs.write_misses,
+               cs.writebacks, cs.bypass_blocks);
+    }
+
+    // 块层延迟分布，SDSIM_TELEMETRY=1 时追加在结果之后
+    if (env_u32("SDSIM_TELEMETRY", 0)) {
+        sdcard_telemetry_print();
+    }
+    return 0;
+}
+
+void app_main(void)
+{
+    sdcard_config_t config = {
+        .image_path = env_str("SDSIM_IMAGE", "sdcard_sim.img"),
+        .sectors = env_u32("SDSIM_SECTORS", 256 * 1024 * 1024 / SDCARD_BLOCK_SIZE),
+        .latency = SDCARD_SIM_LATENCY_DEFAULT(),
+    };
+    config.latency.cmd_overhead_us = env_u32("SDSIM_CMD_US", config.latency.cmd_overhead_us);
+    config.latency.read_bytes_per_sec = env_u32("SDSIM_READ_BPS", config.latency.read_bytes_per_sec);
+    config.latency.write_bytes_per_sec = env_u32("SDSIM_WRITE_BPS", config.latency.write_bytes_per_sec);
+    config.latency.gc_interval_blocks = env_u32("SDSIM_GC_BLOCKS", config.latency.gc_interval_blocks);
+    config.latency.gc_stall_min_us = env_u32("SDSIM_GC_MIN_US", config.latency.gc_stall_min_us);
+    config.latency.gc_stall_max_us = env_u32("SDSIM_GC_MAX_US", config.latency.gc_stall_max_us);
+    config.latency.realtime = env_u32("SDSIM_REALTIME", 0) != 0;
+
+    sdcard_t* card = NULL;
+    if (sdcard_init(&config, &card) != ESP_OK) {
+        exit(1);
+    }
+
+    // SDSIM_CACHE_SETS=0 关闭扇区缓存
+    sdcard_cache_config_t cache_config = SDCARD_CACHE_CONFIG_DEFAULT();
+    cache_config.sets = (uint16_t)env_u32("SDSIM_CACHE_SETS", cache_config.sets);
+    cache_config.ways = (uint8_t)env_u32("SDSIM_CACHE_WAYS", cache_config.ways);
+    sdcard_diskio_set_cache_config(&cache_config);
+
+    uint8_t pdrv;
+    if (sdcard_diskio_register(card, &pdrv) != ESP_OK) {
+        sdcard_deinit(card);
+        exit(1);
+    }
+    const char drv[3] = { (char)('0' + pdrv), ':', '\0' };
+
+    // 每次都重新格式化，保证结果不受上次运行的碎片影响
+    int ret = 1;
+    FATFS fs;
+    void* workbuf = malloc(BENCH_WORKBUF_SIZE);
+    bool exfat = env_u32("SDSIM_EXFAT", 0) != 0;
+#if !FF_FS_EXFAT
+    if (exfat) {
+        ESP_LOGE(TAG, "SDSIM_EXFAT=1 needs FatFs built with FF_FS_EXFAT");
+        exit(1);
+    }
+#endif
+    const MKFS_PARM opt = {
+        exfat ? FM_EXFAT : (BYTE)(FM_FAT | FM_FAT32), 2, 0, 0,
+        env_u32("SDSIM_CLUSTER", exfat ? 128 * 1024 : 16 * 1024),
+    };
+    if (workbuf && f_mkfs(drv, &opt, workbuf, BENCH_WORKBUF_SIZE) == FR_OK &&
+        f_mount(&fs, drv, 1) == FR_OK) {
+        sdcard_diskio_pin_metadata(pdrv, &fs);
+        ret = run_bench(card, pdrv, drv);
+        f_mount(NULL, drv, 0);
+    } else {
+        ESP_LOGE(TAG, "Failed to format or mount the simulated card");
+    }
+    free(workbuf);
+
+    sdcard_diskio_unregister(pdrv);
+    sdcard_deinit(card);
+    exit(ret);
+}
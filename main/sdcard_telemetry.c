@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "sdcard_telemetry.h"
+
+// 每个数量级(2的幂)再细分 8 个子桶的对数直方图(HDR风格)，
+// 覆盖 1us ~ 2^32us，相对误差不超过 12.5%。
+
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS     (1 << SUB_BUCKET_BITS)
+#define BUCKET_COUNT    ((32 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+typedef struct {
+    uint32_t buckets[BUCKET_COUNT];
+    uint64_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+} histogram_t;
+
+static histogram_t s_hist[SDCARD_OP_COUNT][SDCARD_SIZE_CLASS_COUNT];
+static sdcard_stall_event_t s_stalls[SDCARD_STALL_HISTORY];
+static uint32_t s_stall_total = 0;
+static uint32_t s_stall_threshold_us = SDCARD_STALL_THRESHOLD_US_DEFAULT;
+
+#if CONFIG_IDF_TARGET_LINUX
+// 主机模拟是单线程的
+#define TELEMETRY_LOCK()
+#define TELEMETRY_UNLOCK()
+#else
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+#define TELEMETRY_LOCK()   portENTER_CRITICAL(&s_lock)
+#define TELEMETRY_UNLOCK() portEXIT_CRITICAL(&s_lock)
+#endif
+
+static const char* const s_op_names[SDCARD_OP_COUNT] = { "read", "write", "busy", "erase" };
+static const char* const s_class_names[SDCARD_SIZE_CLASS_COUNT] = { "1", "2-8", "9-64", "65+" };
+
+static int size_class_of(size_t n_blocks) {
+    if (n_blocks <= 1) return 0;
+    if (n_blocks <= 8) return 1;
+    if (n_blocks <= 64) return 2;
+    return 3;
+}
+
+static int bucket_of(uint32_t us) {
+    if (us < SUB_BUCKETS) {
+        return (int)us;
+    }
+    int msb = 31 - __builtin_clz(us);
+    int shift = msb - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKETS + (int)((us >> shift) & (SUB_BUCKETS - 1));
+}
+
+// 桶的代表值取区间中点
+static uint32_t bucket_value(int idx) {
+    if (idx < SUB_BUCKETS) {
+        return (uint32_t)idx;
+    }
+    int shift = idx / SUB_BUCKETS - 1;
+    uint32_t lower = (uint32_t)(SUB_BUCKETS + idx % SUB_BUCKETS) << shift;
+    return lower + ((1u << shift) >> 1);
+}
+
+void sdcard_telemetry_record(sdcard_op_t op, size_t start_block, size_t n_blocks,
+                             int64_t start_us, uint32_t duration_us) {
+    if (op >= SDCARD_OP_COUNT) {
+        return;
+    }
+
+    TELEMETRY_LOCK();
+    histogram_t* h = &s_hist[op][size_class_of(n_blocks)];
+    h->buckets[bucket_of(duration_us)]++;
+    h->count++;
+    h->total_us += duration_us;
+    if (duration_us > h->max_us) {
+        h->max_us = duration_us;
+    }
+
+    // 忙等时间已经包含在写耗时中，擦除在空闲时进行，停顿只按读写命令判定
+    if ((op == SDCARD_OP_READ || op == SDCARD_OP_WRITE) && duration_us >= s_stall_threshold_us) {
+        sdcard_stall_event_t* ev = &s_stalls[s_stall_total % SDCARD_STALL_HISTORY];
+        ev->timestamp_us = start_us;
+        ev->duration_us = duration_us;
+        ev->start_block = (uint32_t)start_block;
+        ev->n_blocks = n_blocks > UINT16_MAX ? UINT16_MAX : (uint16_t)n_blocks;
+        ev->op = (uint8_t)op;
+        s_stall_total++;
+    }
+    TELEMETRY_UNLOCK();
+}
+
+// 在 [first, last] 档位合并后的分布上求分位数
+static uint32_t percentile(const histogram_t* hs, int first, int last,
+                           uint64_t count, uint32_t max_us, uint32_t per_mille) {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t target = (count * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        for (int c = first; c <= last; c++) {
+            seen += hs[c].buckets[i];
+        }
+        if (seen >= target) {
+            uint32_t v = bucket_value(i);
+            return v > max_us ? max_us : v;
+        }
+    }
+    return max_us;
+}
+
+esp_err_t sdcard_telemetry_get_summary(sdcard_op_t op, int size_class, sdcard_latency_summary_t* out) {
+    if (op >= SDCARD_OP_COUNT || !out ||
+        size_class < SDCARD_SIZE_CLASS_ALL || size_class >= SDCARD_SIZE_CLASS_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // 不加锁读取，得到的是近似快照，避免长时间关中断
+    const histogram_t* hs = s_hist[op];
+    int first = size_class == SDCARD_SIZE_CLASS_ALL ? 0 : size_class;
+    int last = size_class == SDCARD_SIZE_CLASS_ALL ? SDCARD_SIZE_CLASS_COUNT - 1 : size_class;
+
+    memset(out, 0, sizeof(*out));
+    for (int c = first; c <= last; c++) {
+        out->count += hs[c].count;
+        out->total_us += hs[c].total_us;
+        if (hs[c].max_us > out->max_us) {
+            out->max_us = hs[c].max_us;
+        }
+    }
+    out->p50_us = percentile(hs, first, last, out->count, out->max_us, 500);
+    out->p90_us = percentile(hs, first, last, out->count, out->max_us, 900);
+    out->p99_us = percentile(hs, first, last, out->count, out->max_us, 990);
+    out->p999_us = percentile(hs, first, last, out->count, out->max_us, 999);
+    return ESP_OK;
+}
+
+size_t sdcard_telemetry_get_stalls(sdcard_stall_event_t* out, size_t max, uint32_t* out_total) {
+    TELEMETRY_LOCK();
+    uint32_t total = s_stall_total;
+    size_t n = total < SDCARD_STALL_HISTORY ? total : SDCARD_STALL_HISTORY;
+    if (n > max) {
+        n = max;
+    }
+    for (size_t i = 0; i < n; i++) {
+        out[i] = s_stalls[(total - n + i) % SDCARD_STALL_HISTORY];
+    }
+    TELEMETRY_UNLOCK();
+
+    if (out_total) {
+        *out_total = total;
+    }
+    return n;
+}
+
+void sdcard_telemetry_set_stall_threshold(uint32_t threshold_us) {
+    s_stall_threshold_us = threshold_us;
+}
+
+void sdcard_telemetry_reset(void) {
+    TELEMETRY_LOCK();
+    memset(s_hist, 0, sizeof(s_hist));
+    memset(s_stalls, 0, sizeof(s_stalls));
+    s_stall_total = 0;
+    TELEMETRY_UNLOCK();
+}
+
+const char* sdcard_telemetry_size_class_name(int size_class) {
+    if (size_class == SDCARD_SIZE_CLASS_ALL) {
+        return "all";
+    }
+    if (size_class < 0 || size_class >= SDCARD_SIZE_CLASS_COUNT) {
+        return "?";
+    }
+    return s_class_names[size_class];
+}
+
+void sdcard_telemetry_print(void) {
+    printf("op,blocks,count,avg_us,p50_us,p90_us,p99_us,p999_us,max_us\n");
+    for (int op = 0; op < SDCARD_OP_COUNT; op++) {
+        for (int c = SDCARD_SIZE_CLASS_ALL; c < SDCARD_SIZE_CLASS_COUNT; c++) {
+            sdcard_latency_summary_t s;
+            sdcard_telemetry_get_summary((sdcard_op_t)op, c, &s);
+            if (s.count == 0) {
+                continue;
+            }
+            printf("%s,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "\n",
+                   s_op_names[op], sdcard_telemetry_size_class_name(c), s.count, s.total_us / s.count,
+                   s.p50_us, s.p90_us, s.p99_us, s.p999_us, s.max_us);
+        }
+    }
+
+    sdcard_stall_event_t stalls[SDCARD_STALL_HISTORY];
+    uint32_t total;
+    size_t n = sdcard_telemetry_get_stalls(stalls, SDCARD_STALL_HISTORY, &total);
+    printf("Stalls >= %" PRIu32 " us: %" PRIu32 " total\n", s_stall_threshold_us, total);
+    for (size_t i = 0; i < n; i++) {
+        printf("  t=%" PRId64 " us %s block %" PRIu32 " x%u: %" PRIu32 " us\n",
+               stalls[i].timestamp_us, s_op_names[stalls[i].op], stalls[i].start_block,
+               stalls[i].n_blocks, stalls[i].duration_us);
+    }
+}
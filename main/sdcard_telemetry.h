@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// 块层操作类型
+typedef enum {
+    SDCARD_OP_READ = 0,   // 读命令的总耗时
+    SDCARD_OP_WRITE,      // 写命令的总耗时
+    SDCARD_OP_BUSY,       // 写命令中除去总线传输后卡处于忙状态的时间
+    SDCARD_OP_ERASE,      // 后台擦除命令的耗时
+    SDCARD_OP_COUNT,
+} sdcard_op_t;
+
+// 按单次操作块数划分的大小档位：1块, 2-8块, 9-64块, 65块以上
+#define SDCARD_SIZE_CLASS_COUNT 4
+#define SDCARD_SIZE_CLASS_ALL   (-1)
+
+// 默认的停顿判定阈值
+#define SDCARD_STALL_THRESHOLD_US_DEFAULT (100 * 1000)
+
+// 保留的最近停顿事件数
+#define SDCARD_STALL_HISTORY 16
+
+// 一次停顿事件
+typedef struct {
+    int64_t timestamp_us;   // 操作开始时间
+    uint32_t duration_us;   // 耗时
+    uint32_t start_block;   // 起始块
+    uint16_t n_blocks;      // 块数
+    uint8_t op;             // sdcard_op_t
+} sdcard_stall_event_t;
+
+// 延迟统计摘要，分位数精度约 12.5%
+typedef struct {
+    uint64_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t p999_us;
+} sdcard_latency_summary_t;
+
+/**
+ * @brief 记录一次块层操作，由 sdcard_hal 的读写实现调用
+ * @param op 操作类型
+ * @param start_block 起始块
+ * @param n_blocks 块数
+ * @param start_us 开始时间
+ * @param duration_us 耗时
+ */
+void sdcard_telemetry_record(sdcard_op_t op, size_t start_block, size_t n_blocks,
+                             int64_t start_us, uint32_t duration_us);
+
+/**
+ * @brief 获取延迟摘要
+ * @param op 操作类型
+ * @param size_class 大小档位，SDCARD_SIZE_CLASS_ALL 表示合并所有档位
+ * @param out 输出的摘要
+ * @return ESP_OK 成功
+ */
+esp_err_t sdcard_telemetry_get_summary(sdcard_op_t op, int size_class, sdcard_latency_summary_t* out);
+
+/**
+ * @brief 获取最近的停顿事件，按时间从旧到新
+ * @param out 输出缓冲区
+ * @param max 缓冲区容量
+ * @param out_total 输出自复位以来的停顿总数，可为NULL
+ * @return 写入的事件数
+ */
+size_t sdcard_telemetry_get_stalls(sdcard_stall_event_t* out, size_t max, uint32_t* out_total);
+
+/**
+ * @brief 设置停顿判定阈值
+ * @param threshold_us 超过该耗时的读写即记为停顿
+ */
+void sdcard_telemetry_set_stall_threshold(uint32_t threshold_us);
+
+/**
+ * @brief 清空所有直方图和停顿记录
+ */
+void sdcard_telemetry_reset(void);
+
+/**
+ * @brief 把各操作、各档位的延迟分布和最近的停顿打印到控制台
+ */
+void sdcard_telemetry_print(void);
+
+/**
+ * @brief 大小档位的名称
+ */
+const char* sdcard_telemetry_size_class_name(int size_class);
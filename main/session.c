@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "fs_hal.h"
+#include "session.h"
+
+static const char* TAG = "session";
+
+#define SESSION_NVS_NAMESPACE   "session"
+#define SESSION_NVS_KEY         "next_id"
+// 每次在NVS中预留一段会话号，减少写flash的次数；重启时未用完的号直接跳过
+#define SESSION_ID_RESERVE      16
+
+static uint32_t s_next_id = 0;
+static uint32_t s_reserved_until = 0;
+static char s_day_dir[9] = { 0 };       // 最近创建过的日期目录，同一天内不再检查
+// 录制开始/换段时创建日期目录，清理任务同时可能删除空目录：检查目录和改写 s_day_dir 都在锁内，
+// 不会出现刚确认目录存在就被删掉的情况
+static SemaphoreHandle_t s_lock = NULL;
+
+esp_err_t session_init(void) {
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(SESSION_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS (%s)", esp_err_to_name(ret));
+        return ret;
+    }
+
+    uint32_t next = 1;
+    ret = nvs_get_u32(nvs, SESSION_NVS_KEY, &next);
+    nvs_close(nvs);
+    if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "Failed to read session counter (%s)", esp_err_to_name(ret));
+        return ret;
+    }
+
+    s_next_id = next;
+    s_reserved_until = next;
+    ESP_LOGI(TAG, "Next session ID: %"PRIu32, s_next_id);
+    return ESP_OK;
+}
+
+static esp_err_t reserve_ids(void) {
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(SESSION_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    uint32_t until = s_next_id + SESSION_ID_RESERVE;
+    ret = nvs_set_u32(nvs, SESSION_NVS_KEY, until);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (ret == ESP_OK) {
+        s_reserved_until = until;
+    }
+    return ret;
+}
+
+esp_err_t session_begin(time_t start, char* out_base, size_t base_len, uint32_t* out_id) {
+    if (!out_base || base_len < SESSION_BASE_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_next_id == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    // 先持久化再使用，掉电后也不会分配到用过的号
+    if (s_next_id >= s_reserved_until) {
+        esp_err_t ret = reserve_ids();
+        if (ret != ESP_OK) {
+            xSemaphoreGive(s_lock);
+            ESP_LOGE(TAG, "Failed to persist session counter (%s)", esp_err_to_name(ret));
+            return ret;
+        }
+    }
+
+    struct tm tm;
+    localtime_r(&start, &tm);
+    char day[sizeof(s_day_dir)];
+    snprintf(day, sizeof(day), "%04d%02d%02d", (tm.tm_year + 1900) % 10000, tm.tm_mon + 1, tm.tm_mday);
+    if (strcmp(day, s_day_dir) != 0) {
+        if (!fs_exists(day) && fs_mkdir(day) != ESP_OK) {
+            xSemaphoreGive(s_lock);
+            return ESP_FAIL;
+        }
+        strlcpy(s_day_dir, day, sizeof(s_day_dir));
+    }
+
+    uint32_t id = s_next_id++;
+    xSemaphoreGive(s_lock);
+    snprintf(out_base, base_len, "%s/%08"PRIu32"-%02d%02d", day, id, tm.tm_hour, tm.tm_min);
+    if (out_id) {
+        *out_id = id;
+    }
+    return ESP_OK;
+}
+
+void session_forget_dirs(void) {
+    if (!s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_day_dir[0] = '\0';
+    xSemaphoreGive(s_lock);
+}
+
+void session_remove_dir_if_empty(const char* base) {
+    const char* slash = base ? strchr(base, '/') : NULL;
+    if (!slash || (size_t)(slash - base) >= sizeof(s_day_dir)) {
+        return;
+    }
+    if (!s_lock) {
+        return;
+    }
+    char day[sizeof(s_day_dir)];
+    memcpy(day, base, slash - base);
+    day[slash - base] = '\0';
+
+    // 当天的目录可能刚分配给一段还没创建文件的录像，留着不删
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    fs_dir_iterator_t it;
+    if (strcmp(day, s_day_dir) == 0 || fs_opendir(day, &it) != ESP_OK) {
+        xSemaphoreGive(s_lock);
+        return;
+    }
+    fs_file_info_t info;
+    bool empty = fs_readdir(it, &info) == ESP_ERR_NOT_FOUND;
+    fs_closedir(it);
+    bool removed = empty && fs_remove(day) == ESP_OK;
+    xSemaphoreGive(s_lock);
+    if (removed) {
+        ESP_LOGI(TAG, "Removed empty directory %s", day);
+    }
+}
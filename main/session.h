@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <esp_err.h>
+
+// 录像命名：每天一个目录，文件名带全局递增的会话号，
+// 例如 20261018/00000123-1432.vid。会话号保存在NVS中，重启和换卡后也不会重复
+
+#define SESSION_BASE_LEN 32     // 与 CATALOG_NAME_LEN 一致
+
+/**
+ * @brief 从NVS读取会话号，必须在 nvs_flash_init 之后调用
+ * @return ESP_OK 成功
+ */
+esp_err_t session_init(void);
+
+/**
+ * @brief 分配新的会话号并创建当天的目录
+ * @param start 开始时间，决定日期目录和文件名中的时分
+ * @param out_base 输出不带扩展名的路径(相对于挂载点)
+ * @param base_len out_base 的长度
+ * @param out_id 输出分配的会话号，可以为NULL
+ * @return ESP_OK 成功
+ */
+esp_err_t session_begin(time_t start, char* out_base, size_t base_len, uint32_t* out_id);
+
+/**
+ * @brief 录像文件删除后，日期目录为空时删除目录；最近一次 session_begin 用到的目录保留。可以在其他任务中调用
+ * @param base session_begin 生成的路径
+ */
+void session_remove_dir_if_empty(const char* base);
+
+/**
+ * @brief 忘记已经创建过的日期目录，下次开始录制时重新检查并创建。格式化SD卡之后调用
+ */
+void session_forget_dirs(void);
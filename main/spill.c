@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "esp_vfs_fat.h"
+#include "wear_levelling.h"
+#include "spill.h"
+
+static const char* TAG = "spill";
+
+#define SPILL_MOUNT_POINT   "/spill"
+#define SPILL_PARTITION     "storage"
+#define SPILL_FILE          SPILL_MOUNT_POINT "/spill.bin"
+// 磨损均衡和FAT本身占用的空间，剩余部分给溢出文件
+#define SPILL_RESERVED      (256 * 1024)
+
+typedef struct {
+    uint8_t type;
+    uint8_t reserved[3];
+    uint32_t meta;
+    uint32_t len;
+} spill_record_header_t;
+
+static wl_handle_t s_wl = WL_INVALID_HANDLE;
+static FILE* s_file = NULL;
+static SemaphoreHandle_t s_mutex = NULL;
+static uint32_t s_capacity = 0;
+static uint32_t s_write_off = 0;
+static uint32_t s_read_off = 0;
+static spill_stats_t s_stats;
+
+esp_err_t spill_init(void) {
+    if (s_file) {
+        return ESP_OK;
+    }
+
+    const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           ESP_PARTITION_SUBTYPE_DATA_FAT, SPILL_PARTITION);
+    if (!part) {
+        ESP_LOGW(TAG, "No '%s' partition, spilling to flash disabled", SPILL_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (part->size <= SPILL_RESERVED) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    s_mutex = xSemaphoreCreateMutex();
+    if (!s_mutex) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_vfs_fat_mount_config_t mount_config = {
+        .format_if_mount_failed = true,
+        .max_files = 1,
+        .allocation_unit_size = CONFIG_WL_SECTOR_SIZE,
+    };
+    esp_err_t ret = esp_vfs_fat_spiflash_mount_rw_wl(SPILL_MOUNT_POINT, SPILL_PARTITION, &mount_config, &s_wl);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount '%s' partition (%s)", SPILL_PARTITION, esp_err_to_name(ret));
+        vSemaphoreDelete(s_mutex);
+        s_mutex = NULL;
+        return ret;
+    }
+
+    // 上次掉电时没读回的数据已经无法并回原来的录像，直接丢弃
+    s_file = fopen(SPILL_FILE, "w+b");
+    if (!s_file) {
+        ESP_LOGE(TAG, "Failed to create %s", SPILL_FILE);
+        esp_vfs_fat_spiflash_unmount_rw_wl(SPILL_MOUNT_POINT, s_wl);
+        s_wl = WL_INVALID_HANDLE;
+        vSemaphoreDelete(s_mutex);
+        s_mutex = NULL;
+        return ESP_FAIL;
+    }
+    // 读写交替进行，不需要stdio的缓冲
+    setvbuf(s_file, NULL, _IONBF, 0);
+
+    s_capacity = part->size - SPILL_RESERVED;
+    s_stats.capacity_bytes = s_capacity;
+    ESP_LOGI(TAG, "Flash spill tier ready: %"PRIu32" KB", s_capacity / 1024);
+    return ESP_OK;
+}
+
+bool spill_available(void) {
+    return s_file != NULL;
+}
+
+esp_err_t spill_append(spill_record_type_t type, uint32_t meta, const void* data, size_t len) {
+    if (!s_file) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    spill_record_header_t header = { .type = (uint8_t)type, .meta = meta, .len = (uint32_t)len };
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if ((uint64_t)s_write_off + sizeof(header) + len > s_capacity) {
+        ret = ESP_ERR_NO_MEM;
+    } else if (fseek(s_file, s_write_off, SEEK_SET) != 0 ||
+               fwrite(&header, sizeof(header), 1, s_file) != 1 ||
+               fwrite(data, 1, len, s_file) != len) {
+        // 文件系统写满也按空间不足处理；已写入的部分不计入，下次从原位置覆盖
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        s_write_off += sizeof(header) + len;
+        s_stats.spilled_bytes += len;
+        s_stats.spilled_records++;
+        uint32_t pending = s_write_off - s_read_off;
+        if (pending > s_stats.peak_pending_bytes) {
+            s_stats.peak_pending_bytes = pending;
+        }
+    }
+    if (ret != ESP_OK) {
+        s_stats.full_drops++;
+    }
+    xSemaphoreGive(s_mutex);
+    return ret;
+}
+
+esp_err_t spill_read(spill_record_type_t* out_type, uint32_t* out_meta, uint8_t** buf, size_t* cap, size_t* out_len) {
+    if (!out_type || !out_meta || !buf || !cap || !out_len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_file) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_read_off >= s_write_off) {
+        xSemaphoreGive(s_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t ret = ESP_OK;
+    spill_record_header_t header;
+    bool header_ok = fseek(s_file, s_read_off, SEEK_SET) == 0 && fread(&header, sizeof(header), 1, s_file) == 1;
+    if (!header_ok || header.len > s_write_off - s_read_off - sizeof(header)) {
+        header_ok = false;
+        ret = ESP_FAIL;
+    } else if (header.len > *cap) {
+        uint8_t* grown = heap_caps_realloc(*buf, header.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!grown) {
+            grown = realloc(*buf, header.len);
+        }
+        if (grown) {
+            *buf = grown;
+            *cap = header.len;
+        } else {
+            ret = ESP_ERR_NO_MEM;
+        }
+    }
+    if (ret == ESP_OK && fread(*buf, 1, header.len, s_file) != header.len) {
+        ret = ESP_FAIL;
+    }
+
+    if (ret == ESP_OK) {
+        *out_type = (spill_record_type_t)header.type;
+        *out_meta = header.meta;
+        *out_len = header.len;
+        s_stats.migrated_bytes += header.len;
+    }
+    // 读不出来的记录直接跳过，否则写卡任务会一直卡在这里；记录头损坏时放弃剩下的积压
+    s_read_off = header_ok ? s_read_off + sizeof(header) + header.len : s_write_off;
+    xSemaphoreGive(s_mutex);
+    return ret;
+}
+
+uint32_t spill_pending_bytes(void) {
+    if (!s_file) {
+        return 0;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    uint32_t pending = s_write_off - s_read_off;
+    xSemaphoreGive(s_mutex);
+    return pending;
+}
+
+void spill_reset(void) {
+    if (!s_file) {
+        return;
+    }
+    // 文件长度不变，已分配的簇直接复用
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_read_off >= s_write_off) {
+        s_read_off = 0;
+        s_write_off = 0;
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+void spill_get_stats(spill_stats_t* out_stats) {
+    if (!out_stats) {
+        return;
+    }
+    if (!s_mutex) {
+        memset(out_stats, 0, sizeof(*out_stats));
+        return;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *out_stats = s_stats;
+    out_stats->pending_bytes = s_write_off - s_read_off;
+    xSemaphoreGive(s_mutex);
+}
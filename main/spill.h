@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// 溢出层：SD卡停顿时，录制数据先按顺序写入内部flash的 storage 分区(FAT + 磨损均衡)，
+// 卡恢复后由写卡任务按写入顺序读回并追加到SD卡上的录像文件
+
+typedef enum {
+    SPILL_RECORD_VIDEO = 1,
+    SPILL_RECORD_AUDIO = 2,
+} spill_record_type_t;
+
+typedef struct {
+    uint64_t spilled_bytes;         // 累计写入flash的字节数
+    uint64_t migrated_bytes;        // 累计读回的字节数
+    uint32_t spilled_records;
+    uint32_t full_drops;            // flash写满时丢弃的记录数
+    uint32_t pending_bytes;         // 尚未读回的字节数
+    uint32_t peak_pending_bytes;    // 最多积压的字节数
+    uint32_t capacity_bytes;
+} spill_stats_t;
+
+/**
+ * @brief 挂载 storage 分区，必要时格式化
+ * @return ESP_OK 成功，ESP_ERR_NOT_FOUND 分区表中没有 storage 分区
+ */
+esp_err_t spill_init(void);
+
+/**
+ * @brief 溢出层是否可用
+ * @return true 已挂载
+ */
+bool spill_available(void);
+
+/**
+ * @brief 在末尾追加一条记录
+ * @param type 记录类型
+ * @param meta 随记录保存的附加值(例如帧的采集时间)
+ * @param data 数据
+ * @param len 长度
+ * @return ESP_OK 成功，ESP_ERR_NO_MEM 空间已满
+ */
+esp_err_t spill_append(spill_record_type_t type, uint32_t meta, const void* data, size_t len);
+
+/**
+ * @brief 按写入顺序读出下一条记录
+ * @param out_type 输出的记录类型
+ * @param out_meta 输出追加时的附加值
+ * @param buf 读缓冲，长度不够时重新分配
+ * @param cap 读缓冲的容量，重新分配后更新
+ * @param out_len 输出的记录长度
+ * @return ESP_OK 成功，ESP_ERR_NOT_FOUND 没有积压的记录
+ */
+esp_err_t spill_read(spill_record_type_t* out_type, uint32_t* out_meta, uint8_t** buf, size_t* cap, size_t* out_len);
+
+/**
+ * @brief 积压的字节数
+ * @return 尚未读回的字节数
+ */
+uint32_t spill_pending_bytes(void);
+
+/**
+ * @brief 积压已全部读回后从头复用文件
+ */
+void spill_reset(void);
+
+/**
+ * @brief 获取溢出层统计
+ * @param out_stats 输出的统计信息
+ */
+void spill_get_stats(spill_stats_t* out_stats);
@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp32s3/rom/tjpgd.h"
+#include "fs_hal.h"
+#include "thumbnail.h"
+
+static const char* TAG = "thumbnail";
+
+// tjpgd的工作区，与 esp32-camera 的 esp_jpg_decode 相同
+#define THUMBNAIL_WORK_SIZE 3100
+// jd_decomp 的缩放参数：0为原尺寸，3为1/8，1/8时每个块只用DC，不做IDCT
+#define THUMBNAIL_SCALE     3
+// 解码在写卡任务之后的空闲时间里做，不能让写卡任务等它
+#define THUMBNAIL_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define THUMBNAIL_TASK_STACK    4096
+
+typedef struct {
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+    uint16_t* pixels;
+    uint16_t width;
+    uint16_t height;
+} decode_ctx_t;
+
+static fs_file_t s_file = NULL;
+static uint8_t* s_work = NULL;
+static uint16_t* s_pixels = NULL;
+static size_t s_pixel_cap = 0;
+static uint32_t s_count = 0;
+
+// 交给后台任务的一帧：thumbnail_add 复制进来，后台解码写完后清 s_busy
+static TaskHandle_t s_task = NULL;
+static SemaphoreHandle_t s_done = NULL;
+static uint8_t* s_jpeg = NULL;
+static size_t s_jpeg_cap = 0;
+static size_t s_jpeg_len = 0;
+static uint32_t s_jpeg_pts_ms = 0;
+static volatile bool s_busy = false;
+
+static UINT read_input(JDEC* jd, BYTE* buf, UINT len) {
+    decode_ctx_t* ctx = jd->device;
+    size_t left = ctx->len - ctx->pos;
+    if (len > left) {
+        len = left;
+    }
+    // buf为NULL时跳过这段数据
+    if (buf) {
+        memcpy(buf, ctx->data + ctx->pos, len);
+    }
+    ctx->pos += len;
+    return len;
+}
+
+// ROM中的tjpgd按MCU输出RGB888(JD_FORMAT为0)，1/8比例时每个MCU只有1-2个像素
+static UINT write_output(JDEC* jd, void* bitmap, JRECT* rect) {
+    decode_ctx_t* ctx = jd->device;
+    const uint8_t* rgb = bitmap;
+    for (uint16_t y = rect->top; y <= rect->bottom; y++) {
+        for (uint16_t x = rect->left; x <= rect->right; x++, rgb += 3) {
+            if (x < ctx->width && y < ctx->height) {
+                ctx->pixels[y * ctx->width + x] = ((rgb[0] & 0xF8) << 8) | ((rgb[1] & 0xFC) << 3) | (rgb[2] >> 3);
+            }
+        }
+    }
+    return 1;
+}
+
+static bool grow_pixels(size_t count) {
+    if (count <= s_pixel_cap) {
+        return true;
+    }
+    uint16_t* grown = heap_caps_realloc(s_pixels, count * sizeof(uint16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!grown) {
+        grown = realloc(s_pixels, count * sizeof(uint16_t));
+    }
+    if (!grown) {
+        return false;
+    }
+    s_pixels = grown;
+    s_pixel_cap = count;
+    return true;
+}
+
+static bool grow_jpeg(size_t len) {
+    if (len <= s_jpeg_cap) {
+        return true;
+    }
+    uint8_t* grown = heap_caps_realloc(s_jpeg, len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!grown) {
+        grown = realloc(s_jpeg, len);
+    }
+    if (!grown) {
+        return false;
+    }
+    s_jpeg = grown;
+    s_jpeg_cap = len;
+    return true;
+}
+
+static esp_err_t decode_and_append(const uint8_t* jpeg, size_t len, uint32_t pts_ms) {
+    decode_ctx_t ctx = { .data = jpeg, .len = len };
+    JDEC jd;
+    JRESULT res = jd_prepare(&jd, read_input, s_work, THUMBNAIL_WORK_SIZE, &ctx);
+    if (res != JDR_OK) {
+        ESP_LOGD(TAG, "jd_prepare failed: %d", res);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    ctx.width = jd.width >> THUMBNAIL_SCALE;
+    ctx.height = jd.height >> THUMBNAIL_SCALE;
+    if (ctx.width == 0 || ctx.height == 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    size_t count = (size_t)ctx.width * ctx.height;
+    if (!grow_pixels(count)) {
+        return ESP_ERR_NO_MEM;
+    }
+    ctx.pixels = s_pixels;
+    memset(s_pixels, 0, count * sizeof(uint16_t));
+
+    res = jd_decomp(&jd, write_output, THUMBNAIL_SCALE);
+    if (res != JDR_OK) {
+        ESP_LOGD(TAG, "jd_decomp failed: %d", res);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    thumbnail_record_t record = { .pts_ms = pts_ms, .width = ctx.width, .height = ctx.height };
+    if (fs_write(s_file, &record, sizeof(record)) != (int)sizeof(record) ||
+        fs_write(s_file, s_pixels, count * sizeof(uint16_t)) != (int)(count * sizeof(uint16_t))) {
+        return ESP_FAIL;
+    }
+    s_count++;
+    return ESP_OK;
+}
+
+static void thumbnail_task(void* arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!s_busy) {
+            continue;
+        }
+        esp_err_t ret = decode_and_append(s_jpeg, s_jpeg_len, s_jpeg_pts_ms);
+        if (ret != ESP_OK) {
+            ESP_LOGD(TAG, "Thumbnail at %"PRIu32" ms dropped (%s)", s_jpeg_pts_ms, esp_err_to_name(ret));
+        }
+        s_busy = false;
+        xSemaphoreGive(s_done);
+    }
+}
+
+esp_err_t thumbnail_open(const char* path, uint32_t interval_ms) {
+    if (!path) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_file) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // 后台任务和信号量第一次打开时创建，之后一直保留
+    if (!s_done) {
+        s_done = xSemaphoreCreateBinary();
+        if (!s_done) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (!s_task &&
+        xTaskCreate(thumbnail_task, "thumbnail", THUMBNAIL_TASK_STACK, NULL, THUMBNAIL_TASK_PRIORITY, &s_task) != pdPASS) {
+        s_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    s_work = malloc(THUMBNAIL_WORK_SIZE);
+    if (!s_work) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_file = fs_open(path, FS_FILE_WRITE);
+    if (!s_file) {
+        free(s_work);
+        s_work = NULL;
+        return ESP_FAIL;
+    }
+
+    s_count = 0;
+    thumbnail_file_header_t header = { .interval_ms = interval_ms };
+    memcpy(header.magic, THUMBNAIL_MAGIC, sizeof(header.magic));
+    if (fs_write(s_file, &header, sizeof(header)) != (int)sizeof(header)) {
+        thumbnail_close(NULL);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t thumbnail_add(const uint8_t* jpeg, size_t len, uint32_t pts_ms) {
+    if (!jpeg) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_file) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // 上一张还没解码完就跳过这一帧，调用方下一帧再试
+    if (s_busy) {
+        return ESP_ERR_NOT_FINISHED;
+    }
+    if (!grow_jpeg(len)) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(s_jpeg, jpeg, len);
+    s_jpeg_len = len;
+    s_jpeg_pts_ms = pts_ms;
+    // 清掉上一张留下的完成信号，thumbnail_wait 等到的一定是这一张
+    xSemaphoreTake(s_done, 0);
+    s_busy = true;
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+static esp_err_t wait_done(TickType_t ticks) {
+    if (s_busy && xSemaphoreTake(s_done, ticks) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t thumbnail_wait(uint32_t timeout_ms) {
+    return wait_done(pdMS_TO_TICKS(timeout_ms));
+}
+
+uint32_t thumbnail_get_count(void) {
+    return s_count;
+}
+
+esp_err_t thumbnail_close(uint32_t* out_count) {
+    if (!s_file) {
+        if (out_count) {
+            *out_count = s_count;
+        }
+        return ESP_ERR_INVALID_STATE;
+    }
+    // 后台任务还在用文件和缓冲，等它写完这一张
+    wait_done(portMAX_DELAY);
+    if (out_count) {
+        *out_count = s_count;
+    }
+    esp_err_t ret = fs_close(s_file);
+    s_file = NULL;
+    free(s_work);
+    free(s_pixels);
+    free(s_jpeg);
+    s_work = NULL;
+    s_pixels = NULL;
+    s_pixel_cap = 0;
+    s_jpeg = NULL;
+    s_jpeg_cap = 0;
+    if (ret == ESP_OK && s_count) {
+        ESP_LOGD(TAG, "%"PRIu32" thumbnails written", s_count);
+    }
+    return ret;
+}
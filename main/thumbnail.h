@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+// 缩略图条：录制时每隔一段时间用ROM中的tjpgd按1/8比例解码一帧(只用DC，不做IDCT)，
+// 以RGB565追加到与录像同名的 .thm 文件中，QVGA每张40x30只有2.4KB。
+// 解码在低优先级的后台任务中进行，调用方只付出复制一帧的时间。
+// 浏览录像时只需要拉取 .thm，用 thumbnails.py 拼成一张图
+
+#define THUMBNAIL_MAGIC "THM1"
+
+// 文件头，之后是若干张缩略图，每张为 thumbnail_record_t 加 width*height 个RGB565像素(小端)
+typedef struct {
+    char magic[4];
+    uint32_t interval_ms;           // 取帧间隔
+} thumbnail_file_header_t;
+
+typedef struct {
+    uint32_t pts_ms;                // 这一帧相对录制开始的时间
+    uint16_t width;
+    uint16_t height;
+} thumbnail_record_t;
+
+/**
+ * @brief 创建缩略图文件并写入文件头
+ * @param path 文件路径(相对于挂载点)
+ * @param interval_ms 取帧间隔，只记录在文件头中
+ * @return ESP_OK 成功
+ */
+esp_err_t thumbnail_open(const char* path, uint32_t interval_ms);
+
+/**
+ * @brief 复制一帧交给后台任务，按1/8比例解码后追加到缩略图文件
+ *
+ * 返回后调用方可以修改或释放 jpeg。解码失败的帧只在后台丢弃，不计入张数。
+ *
+ * @param jpeg 完整的JPEG帧(带DQT/DHT)
+ * @param len 帧长度
+ * @param pts_ms 这一帧相对录制开始的时间
+ * @return ESP_OK 已交给后台，ESP_ERR_INVALID_STATE 没有打开的文件，
+ *         ESP_ERR_NOT_FINISHED 上一张还没写完、这一帧被跳过，ESP_ERR_NO_MEM 复制缓冲分配失败
+ */
+esp_err_t thumbnail_add(const uint8_t* jpeg, size_t len, uint32_t pts_ms);
+
+/**
+ * @brief 等后台任务写完已交出的那一帧
+ * @param timeout_ms 超时(毫秒)
+ * @return ESP_OK 后台空闲，ESP_ERR_TIMEOUT 超时
+ */
+esp_err_t thumbnail_wait(uint32_t timeout_ms);
+
+/**
+ * @brief 当前文件中已写入的缩略图张数，关闭后保持到下一次打开
+ */
+uint32_t thumbnail_get_count(void);
+
+/**
+ * @brief 等后台写完正在解码的一帧后关闭缩略图文件，释放解码和复制缓冲
+ * @param out_count 输出写入的缩略图张数，可以为NULL
+ * @return ESP_OK 成功
+ */
+esp_err_t thumbnail_close(uint32_t* out_count);
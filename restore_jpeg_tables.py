@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+import struct
+import sys
+
+# 把共享表格式的 .vid 文件还原成标准 MJPEG：
+# 带 DQT/DHT 的帧原样输出并记住这些表，去掉表的帧在 SOI 之后插回最近一次的表。
+# 本来就是标准 MJPEG 的文件原样输出。
+# 给出 .idx 时按索引的顺序输出，静止画面中省掉的重复帧用它引用的帧补回
+
+SOI = 0xD8
+EOI = 0xD9
+SOS = 0xDA
+DQT = 0xDB
+DHT = 0xC4
+
+# .idx 每条记录：帧在 .vid 中的偏移(u64)、时间戳毫秒(u32)、长度和标志(u32)，小端
+INDEX_ENTRY = struct.Struct('<QII')
+INDEX_REPEAT = 0x80000000
+
+
+def parse_header(data, start):
+    """返回 (表段列表, 熵编码数据起始位置)，帧头损坏时返回 None"""
+    pos = start + 2
+    tables = []
+    while pos + 4 <= len(data):
+        if data[pos] != 0xFF:
+            return None
+        marker = data[pos + 1]
+        if marker == 0xFF:
+            pos += 1
+            continue
+        if marker == 0x01 or 0xD0 <= marker <= 0xD7:
+            pos += 2
+            continue
+        seg_len = 2 + ((data[pos + 2] << 8) | data[pos + 3])
+        if seg_len < 4 or pos + seg_len > len(data):
+            return None
+        if marker == SOS:
+            return tables, pos + seg_len
+        if marker in (DQT, DHT):
+            tables.append(data[pos:pos + seg_len])
+        pos += seg_len
+    return None
+
+
+def restore_frames(data):
+    """返回 ({帧在 .vid 中的偏移: 还原后的帧}, 跳过的帧数)"""
+    frames = {}
+    current = None
+    skipped = 0
+    pos = data.find(b'\xff\xd8')
+    while pos >= 0:
+        header = parse_header(data, pos)
+        if header is None:
+            pos = data.find(b'\xff\xd8', pos + 2)
+            continue
+        tables, scan = header
+        end = data.find(b'\xff\xd9', scan)
+        if end < 0:
+            # 末尾不完整的帧
+            break
+        end += 2
+        frame = data[pos:end]
+        if tables:
+            current = b''.join(tables)
+            frames[pos] = frame
+        elif current is not None:
+            frames[pos] = frame[:2] + current + frame[2:]
+        else:
+            skipped += 1
+        pos = data.find(b'\xff\xd8', end)
+    return frames, skipped
+
+
+def read_index(index):
+    return [INDEX_ENTRY.unpack_from(index, off)
+            for off in range(0, len(index) - INDEX_ENTRY.size + 1, INDEX_ENTRY.size)]
+
+
+def frame_rate(entries):
+    """由索引中的时间戳算出平均帧率，条目不足时返回 None"""
+    if len(entries) < 2 or entries[-1][1] <= entries[0][1]:
+        return None
+    return (len(entries) - 1) * 1000.0 / (entries[-1][1] - entries[0][1])
+
+
+def restore(data, entries=None):
+    frames, skipped = restore_frames(data)
+    if entries is None:
+        return b''.join(frames.values()), len(frames), skipped
+
+    out = bytearray()
+    count = 0
+    last = -1
+    indexed = set(e[0] for e in entries)
+    for offset, _pts, len_flags in entries:
+        frame = frames.get(offset)
+        if frame is None:
+            continue
+        out += frame
+        count += 1
+        if not len_flags & INDEX_REPEAT:
+            last = max(last, offset)
+    # 掉电时索引最后一批条目可能没有写入，后面的帧按文件顺序补上
+    for offset, frame in frames.items():
+        if offset > last and offset not in indexed:
+            out += frame
+            count += 1
+    return out, count, skipped
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        print("Usage: python3 restore_jpeg_tables.py <input.vid> <output.mjpeg> [input.idx]")
+        print("Example: python3 restore_jpeg_tables.py 00000123-1432.vid 00000123-1432.mjpeg 00000123-1432.idx")
+        sys.exit(1)
+
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    entries = None
+    if len(sys.argv) == 4:
+        with open(sys.argv[3], 'rb') as f:
+            entries = read_index(f.read())
+        repeats = sum(1 for e in entries if e[2] & INDEX_REPEAT)
+        print(f"Index: {len(entries)} frames, {repeats} repeated")
+        fps = frame_rate(entries)
+        if fps:
+            print(f"Frame rate: {fps:.2f} fps")
+        if entries:
+            # 与音频的同步点同一个零点，convert.sh 让音频从这一时刻开始
+            print(f"First frame: {entries[0][1]} ms")
+    out, frames, skipped = restore(data, entries)
+    with open(sys.argv[2], 'wb') as f:
+        f.write(out)
+    print(f"Restored {frames} frames ({len(data)} -> {len(out)} bytes)")
+    if skipped:
+        print(f"Skipped {skipped} frames without tables")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+import struct
+import sys
+import zlib
+
+# 把录制时生成的 .thm 缩略图条拼成一张 PNG，不需要额外的依赖。
+# 文件格式见 main/thumbnail.h：8 字节文件头，之后每张缩略图为
+# pts_ms(u32)、宽(u16)、高(u16) 加 宽*高 个 RGB565 像素，均为小端
+
+MAGIC = b'THM1'
+FILE_HEADER = struct.Struct('<4sI')
+RECORD = struct.Struct('<IHH')
+
+
+def read_thumbnails(data):
+    """返回 (取帧间隔毫秒, [(pts_ms, 宽, 高, RGB 字节)])，末尾不完整的一张丢弃"""
+    if len(data) < FILE_HEADER.size:
+        raise ValueError("file too short")
+    magic, interval_ms = FILE_HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError("not a thumbnail file")
+    thumbs = []
+    pos = FILE_HEADER.size
+    while pos + RECORD.size <= len(data):
+        pts_ms, width, height = RECORD.unpack_from(data, pos)
+        pos += RECORD.size
+        size = width * height * 2
+        if pos + size > len(data):
+            break
+        rgb = bytearray()
+        for (p,) in struct.iter_unpack('<H', data[pos:pos + size]):
+            r = (p >> 11) & 0x1F
+            g = (p >> 5) & 0x3F
+            b = p & 0x1F
+            rgb += bytes(((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)))
+        thumbs.append((pts_ms, width, height, bytes(rgb)))
+        pos += size
+    return interval_ms, thumbs
+
+
+def contact_sheet(thumbs, columns):
+    """按行排列，每格大小取最大的缩略图，返回 (宽, 高, RGB 字节)"""
+    cell_w = max(t[1] for t in thumbs)
+    cell_h = max(t[2] for t in thumbs)
+    rows = (len(thumbs) + columns - 1) // columns
+    width = cell_w * min(columns, len(thumbs))
+    height = cell_h * rows
+    sheet = bytearray(width * height * 3)
+    for i, (_pts, w, h, rgb) in enumerate(thumbs):
+        x0 = (i % columns) * cell_w
+        y0 = (i // columns) * cell_h
+        for y in range(h):
+            dst = ((y0 + y) * width + x0) * 3
+            sheet[dst:dst + w * 3] = rgb[y * w * 3:(y + 1) * w * 3]
+    return width, height, bytes(sheet)
+
+
+def write_png(path, width, height, rgb):
+    def chunk(kind, body):
+        return struct.pack('>I', len(body)) + kind + body + struct.pack('>I', zlib.crc32(kind + body))
+
+    raw = b''.join(b'\x00' + rgb[y * width * 3:(y + 1) * width * 3] for y in range(height))
+    with open(path, 'wb') as f:
+        f.write(b'\x89PNG\r\n\x1a\n')
+        f.write(chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 2, 0, 0, 0)))
+        f.write(chunk(b'IDAT', zlib.compress(raw, 9)))
+        f.write(chunk(b'IEND', b''))
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        print("Usage: python3 thumbnails.py <input.thm> <output.png> [columns]")
+        print("Example: python3 thumbnails.py 00000123-1432.thm 00000123-1432.png 10")
+        sys.exit(1)
+
+    columns = int(sys.argv[3]) if len(sys.argv) == 4 else 10
+    with open(sys.argv[1], 'rb') as f:
+        interval_ms, thumbs = read_thumbnails(f.read())
+    if not thumbs:
+        print("No thumbnails in file")
+        sys.exit(1)
+    width, height, rgb = contact_sheet(thumbs, max(1, columns))
+    write_png(sys.argv[2], width, height, rgb)
+    print(f"{len(thumbs)} thumbnails, one every {interval_ms / 1000:g} s, "
+          f"covering {thumbs[-1][0] / 1000:.0f} s -> {width}x{height}")
+    for i, (pts_ms, _w, _h, _rgb) in enumerate(thumbs):
+        m, s = divmod(pts_ms // 1000, 60)
+        print(f"  #{i}: {m:02d}:{s:02d}")
+
+
+if __name__ == "__main__":
+    main()